@@ -38,6 +38,7 @@ def main():
     buildOptions.addOption("gnuToolchain", "Build with gcc and libstdc++")
     buildOptions.addOption("llvmToolchain", "Build with clang and libc++")
     buildOptions.addOption("integrationTests", "Run Integration Tests")
+    buildOptions.addOption("benchmarks", "Run Benchmarks")
     buildOptions.addOption("addressSanitizer",
                            "Enable Address Sanitizer in generate project")
     # buildOptions.addOption("packageArtifacts", "Package the Artifacts")
@@ -109,6 +110,13 @@ def main():
         'integrationTests'
     ])
 
+    buildOptions.addWorkflow("benchmarks", "Run benchmarks", [
+        'lintCmake',
+        'makeBuildDirectory',
+        'generateProject',
+        'benchmarks'
+    ])
+
     buildOptions.addWorkflow("build", "Production Build", [
         'lintCmake',
         'makeBuildDirectory',
@@ -165,6 +173,9 @@ def main():
     if buildOptions.checkOption(options, 'integrationTests'):
         nfbuild.runIntegrationTests()
 
+    if buildOptions.checkOption(options, 'benchmarks'):
+        nfbuild.runBenchmarks()
+
     # if buildOptions.checkOption(options, 'packageArtifacts'):
     #     nfbuild.packageArtifacts()
 
@@ -70,7 +70,7 @@ sudo apt-get install -y -q --no-install-recommends apt-utils \
     libavcodec-dev \
     libavutil-dev \
     libswscale-dev \
-    libavresample-dev \
+    libswresample-dev \
     libavfilter-dev \
     libavdevice-dev \
     libavcodec-extra \
@@ -243,6 +243,49 @@ class NFBuild(object):
                 self.build_print(
                     "Integration Test Passed: " + integration_test['audio'])
 
+    def runBenchmarks(self):
+        benchmark_target_name = 'NFDecoderBenchmarks'
+        self.buildTarget(benchmark_target_name)
+        benchmark_binary = self.targetBinary(benchmark_target_name)
+        if not os.path.exists(self.output_directory):
+            os.makedirs(self.output_directory)
+        benchmark_output = os.path.join(self.output_directory,
+                                        'benchmarks.json')
+        # Fixtures are encoded on the first run and reused afterwards
+        fixture_directory = os.path.abspath(
+            os.path.join(self.build_directory, 'benchmark-fixtures'))
+        self.createCompressedBenchmarkFixtures(fixture_directory)
+        os.environ['NFDECODER_BENCHMARK_FIXTURES'] = fixture_directory
+        self.build_print('Running Benchmarks: ' + benchmark_output)
+        benchmark_result = subprocess.call([
+            benchmark_binary,
+            '--benchmark_out=' + benchmark_output,
+            '--benchmark_out_format=json'])
+        if benchmark_result:
+            sys.exit(benchmark_result)
+
+    def createCompressedBenchmarkFixtures(self, fixture_directory):
+        # There are no vendored MP3 or AAC encoders, so use ffmpeg where it
+        # is installed
+        if not os.path.exists(fixture_directory):
+            os.makedirs(fixture_directory)
+        fixtures = {
+            'benchmark.mp3': ['-c:a', 'libmp3lame', '-b:a', '192k'],
+            'benchmark.m4a': ['-c:a', 'aac', '-b:a', '192k']}
+        for fixture, codec_arguments in fixtures.items():
+            fixture_path = os.path.join(fixture_directory, fixture)
+            if os.path.exists(fixture_path):
+                continue
+            try:
+                subprocess.call([
+                    'ffmpeg', '-y', '-loglevel', 'error',
+                    '-f', 'lavfi', '-i', 'sine=frequency=440:duration=10',
+                    '-ac', '2', '-ar', '44100'] + codec_arguments +
+                    [fixture_path])
+            except OSError:
+                self.build_print('ffmpeg not found, skipping ' + fixture)
+                return
+
     def collectCodeCoverage(self):
         for root, dirnames, filenames in os.walk('build'):
             for filename in fnmatch.filter(filenames, '*.gcda'):
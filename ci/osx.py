@@ -37,6 +37,7 @@ def main():
                            "Lint CPP Files and fix them")
 
     buildOptions.addOption("integrationTests", "Run Integration Tests")
+    buildOptions.addOption("benchmarks", "Run Benchmarks")
 
     buildOptions.addOption("makeBuildDirectory",
                            "Wipe existing build directory")
@@ -115,6 +116,13 @@ def main():
         'integrationTests'
     ])
 
+    buildOptions.addWorkflow("benchmarks", "Run benchmarks", [
+        'lintCmake',
+        'makeBuildDirectory',
+        'generateProject',
+        'benchmarks'
+    ])
+
     options = buildOptions.parseArgs()
 
     buildOptions.verbosePrintBuildOptions(options)
@@ -164,6 +172,9 @@ def main():
     if buildOptions.checkOption(options, 'integrationTests'):
         nfbuild.runIntegrationTests()
 
+    if buildOptions.checkOption(options, 'benchmarks'):
+        nfbuild.runBenchmarks()
+
     if buildOptions.checkOption(options, 'codeCoverage'):
         nfbuild.collectCodeCoverage()
 
@@ -20,7 +20,9 @@
  */
 #pragma once
 
+#include <cstddef>
 #include <functional>
+#include <memory>
 #include <string>
 
 namespace nativeformat {
@@ -43,6 +45,25 @@ class DataProvider {
   virtual void load(const ERROR_DATA_PROVIDER_CALLBACK &data_provider_error_callback,
                     const LOAD_DATA_PROVIDER_CALLBACK &data_provider_load_callback) = 0;
   virtual const std::string &name() = 0;
+
+  /**
+   * Lends length bytes of the underlying storage starting at offset without copying them, and
+   * without moving the read position. Returns nullptr when the provider cannot lend its storage
+   * or the range is out of bounds. The pointer stays valid for the lifetime of the provider.
+   */
+  virtual const void *borrow(long offset, size_t length);
+
+  /**
+   * Returns a loaded provider over the same data with its own read position, sharing whatever
+   * this one has already mapped or fetched. Returns nullptr when the provider cannot be cloned.
+   */
+  virtual std::shared_ptr<DataProvider> clone();
+
+  /**
+   * Identifies the revision of the data, such as an HTTP entity tag or a file's modification
+   * time, so caches keyed on the path notice when it changes. Empty when unknown.
+   */
+  virtual std::string revision();
 };
 
 }  // namespace decoder
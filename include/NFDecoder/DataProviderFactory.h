@@ -48,9 +48,24 @@ class DataProviderFactory {
   virtual void removeDataProviderCreator(int creator_index) = 0;
 };
 
+extern const size_t DATA_PROVIDER_HTTP_DEFAULT_BLOCK_SIZE;
+extern const size_t DATA_PROVIDER_HTTP_DEFAULT_BLOCK_COUNT;
+extern const size_t DATA_PROVIDER_HTTP_DEFAULT_READ_AHEAD_BLOCKS;
+extern const long DATA_PROVIDER_MMAP_DEFAULT_SIZE_THRESHOLD;
+
+/**
+ * HTTP data providers fetch their resource in ranged requests of http_block_size bytes and keep
+ * the http_block_count most recently used blocks. While reading sequentially the next
+ * http_read_ahead_blocks blocks are requested in the background. Local files of at least
+ * mmap_size_threshold bytes are memory mapped, a negative threshold disables mapping.
+ */
 extern std::shared_ptr<DataProviderFactory> createDataProviderFactory(
     std::shared_ptr<http::Client> client = nullptr,
-    std::shared_ptr<ManifestFactory> manifest_factory = nullptr);
+    std::shared_ptr<ManifestFactory> manifest_factory = nullptr,
+    size_t http_block_size = DATA_PROVIDER_HTTP_DEFAULT_BLOCK_SIZE,
+    size_t http_block_count = DATA_PROVIDER_HTTP_DEFAULT_BLOCK_COUNT,
+    size_t http_read_ahead_blocks = DATA_PROVIDER_HTTP_DEFAULT_READ_AHEAD_BLOCKS,
+    long mmap_size_threshold = DATA_PROVIDER_MMAP_DEFAULT_SIZE_THRESHOLD);
 
 }  // namespace decoder
 }  // namespace nativeformat
@@ -21,12 +21,14 @@
 #pragma once
 
 #include <functional>
+#include <memory>
 #include <string>
 
 namespace nativeformat {
 namespace decoder {
 
 typedef std::function<void(long frame_index, long frame_count, float *samples)> DECODE_CALLBACK;
+typedef std::function<void(long frame_index, long frame_count)> DECODE_INTO_CALLBACK;
 typedef std::function<void(bool success)> LOAD_DECODER_CALLBACK;
 typedef std::function<void(const std::string &domain, int error_code)> ERROR_DECODER_CALLBACK;
 
@@ -45,12 +47,27 @@ class Decoder {
   virtual void decode(long frames,
                       const DECODE_CALLBACK &decode_callback,
                       bool synchronous = false) = 0;
+  /**
+   * Decodes into a caller owned buffer that holds at least frames * channels() samples. The buffer
+   * must stay valid until the callback fires.
+   */
+  virtual void decodeInto(float *samples,
+                          long frames,
+                          const DECODE_INTO_CALLBACK &decode_into_callback,
+                          bool synchronous = false);
   virtual bool eof() = 0;
   virtual const std::string &path() = 0;
   virtual const std::string &name() = 0;
   virtual void flush() = 0;
   virtual void load(const ERROR_DECODER_CALLBACK &decoder_error_callback,
                     const LOAD_DECODER_CALLBACK &decoder_load_callback) = 0;
+  /**
+   * Returns an independent, loaded decoder over the same stream at frame 0. It reuses the stream
+   * information this one has parsed and reads through the same provider cache, so no request or
+   * header parse goes back to the source. Returns nullptr when the decoder cannot be cloned, in
+   * which case create another through the Factory.
+   */
+  virtual std::shared_ptr<Decoder> clone();
 };
 
 }  // namespace decoder
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2017 Spotify AB.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+
+namespace nativeformat {
+namespace decoder {
+
+typedef std::function<void()> EXECUTOR_TASK;
+
+extern const size_t EXECUTOR_DEFAULT_QUEUE_SIZE;
+
+/**
+ * Runs the asynchronous work (loads and decodes) issued by decoders
+ */
+class Executor {
+ public:
+  virtual void execute(const EXECUTOR_TASK &task) = 0;
+};
+
+/**
+ * Creates a fixed size worker pool with a bounded queue. A thread_count of 0 uses the hardware
+ * concurrency. Tasks submitted while the queue is full run on their own thread.
+ */
+extern std::shared_ptr<Executor> createExecutor(size_t thread_count = 0,
+                                                size_t queue_size = EXECUTOR_DEFAULT_QUEUE_SIZE);
+
+/**
+ * Creates an executor that runs every task on a new detached thread
+ */
+extern std::shared_ptr<Executor> createThreadExecutor();
+
+}  // namespace decoder
+}  // namespace nativeformat
@@ -23,12 +23,16 @@
 #include <functional>
 #include <memory>
 #include <string>
+#include <vector>
 
+#include <NFDecoder/DataProvider.h>
 #include <NFDecoder/DataProviderFactory.h>
 #include <NFDecoder/Decoder.h>
 #include <NFDecoder/DecrypterFactory.h>
+#include <NFDecoder/Executor.h>
 #include <NFDecoder/ManifestFactory.h>
 #include <NFDecoder/NFDecoderMimeTypes.h>
+#include <NFDecoder/Resampler.h>
 
 namespace nativeformat {
 namespace decoder {
@@ -37,6 +41,27 @@ typedef std::function<void(std::shared_ptr<Decoder> decoder)> CREATE_DECODER_CAL
 
 extern const double STANDARD_SAMPLERATE;
 extern const int STANDARD_CHANNELS;
+extern const long PREFETCH_DECODER_DEFAULT_FRAMES;
+extern const int PARALLEL_DECODE_DEFAULT_SEGMENTS;
+extern const size_t STREAM_INFO_CACHE_DEFAULT_ENTRIES;
+extern const int PROBE_DEFAULT_CONCURRENCY;
+extern const size_t PROBE_DEFAULT_BYTE_BUDGET;
+
+/**
+ * What probe found out about a stream. mime_type and codec are empty when probe cannot tell, and
+ * values it cannot find within the byte budget stay 0, or UNKNOWN_FRAMES for frames.
+ */
+typedef struct ProbeResult {
+  std::string path;
+  std::string mime_type;
+  // Short codec name, such as pcm, flac, vorbis, opus, speex or mp3
+  std::string codec;
+  double samplerate;
+  int channels;
+  long frames;
+} ProbeResult;
+
+typedef std::function<void(size_t index, const ProbeResult &result)> PROBE_CALLBACK;
 
 class Factory {
  public:
@@ -46,12 +71,106 @@ class Factory {
                              const ERROR_DECODER_CALLBACK error_decoder_callback,
                              double samplerate = STANDARD_SAMPLERATE,
                              int channels = STANDARD_CHANNELS) = 0;
+
+  /**
+   * Creates a decoder reading from data_provider, which must already be loaded. Factories that
+   * wrap others hand the same provider down, rewinding it before each attempt, so the source is
+   * opened once however many decoders are tried. The default opens the provider's path again.
+   */
+  virtual void createDecoder(const std::shared_ptr<DataProvider> &data_provider,
+                             const std::string &mime_type,
+                             const CREATE_DECODER_CALLBACK create_decoder_callback,
+                             const ERROR_DECODER_CALLBACK error_decoder_callback,
+                             double samplerate = STANDARD_SAMPLERATE,
+                             int channels = STANDARD_CHANNELS);
 };
 
 extern std::shared_ptr<Factory> createFactory(
     std::shared_ptr<DataProviderFactory> data_provider_factory = nullptr,
     std::shared_ptr<DecrypterFactory> decrypter_factory = nullptr,
-    std::shared_ptr<ManifestFactory> manifest_factory = nullptr);
+    std::shared_ptr<ManifestFactory> manifest_factory = nullptr,
+    std::shared_ptr<Executor> executor = nullptr,
+    ResamplerType resampler_type = RESAMPLER_DEFAULT_TYPE,
+    ResamplerQuality resampler_quality = RESAMPLER_DEFAULT_QUALITY);
+
+/**
+ * Wraps a loaded decoder so tasks on executor keep up to prefetch_frames decoded ahead of the
+ * reader. Without an executor every prefetch decoder shares one pool. Decodes the prefetched PCM
+ * can satisfy never wait on the wrapped decoder, and seeks and flushes are handed to the next
+ * prefetch task, which makes it safe to decode synchronously from a render thread. Only use the
+ * wrapped decoder through the returned one, and call it from one thread at a time.
+ */
+extern std::shared_ptr<Decoder> createPrefetchDecoder(
+    std::shared_ptr<Decoder> decoder,
+    long prefetch_frames = PREFETCH_DECODER_DEFAULT_FRAMES,
+    std::shared_ptr<Executor> executor = nullptr);
+
+/**
+ * Decodes frames [frame_index, frame_index + frames) of path into samples, which must hold
+ * frames * channels samples, for offline jobs that want a whole range as fast as possible. The
+ * range is split into up to segments parts that decode concurrently on their own decoders from
+ * factory, and the parts are stitched sample exactly. Streams of unknown length decode as one
+ * part. Decoders from factory must produce samplerate and channels; a part whose decoder does
+ * not is reported as an error and left undecoded. The callback reports the frames decoded
+ * without a gap from frame_index.
+ */
+extern void decodeInParallel(std::shared_ptr<Factory> factory,
+                             const std::string &path,
+                             const std::string &mime_type,
+                             float *samples,
+                             long frame_index,
+                             long frames,
+                             const DECODE_INTO_CALLBACK decode_into_callback,
+                             const ERROR_DECODER_CALLBACK error_decoder_callback,
+                             int segments = PARALLEL_DECODE_DEFAULT_SEGMENTS,
+                             double samplerate = STANDARD_SAMPLERATE,
+                             int channels = STANDARD_CHANNELS,
+                             std::shared_ptr<Executor> executor = nullptr);
+
+/**
+ * Finds the format, sample rate, channel count and length of each of paths from its headers
+ * alone, without creating a decoder: STREAMINFO for FLAC, the fmt and data chunks for WAV, the
+ * identification header and last granule for Ogg, and the Xing or VBRI header for MP3 (constant
+ * bitrate MP3 is estimated from its size). Up to concurrency paths are probed at once, and each
+ * probe reads at most byte_budget bytes. Without a data_provider_factory, HTTP is fetched in
+ * blocks no larger than the budget with no read ahead; a caller supplied factory's block size and
+ * read ahead are what bound network traffic. probe_callback is called once per path, with its
+ * index in paths, from the probing threads.
+ */
+extern void probe(const std::vector<std::string> &paths,
+                  const PROBE_CALLBACK probe_callback,
+                  std::shared_ptr<DataProviderFactory> data_provider_factory = nullptr,
+                  int concurrency = PROBE_DEFAULT_CONCURRENCY,
+                  size_t byte_budget = PROBE_DEFAULT_BYTE_BUDGET,
+                  std::shared_ptr<Executor> executor = nullptr);
+
+/**
+ * Where seek indexes are cached between runs for streams that cannot seek cheaply on their own,
+ * such as FLAC without a SEEKTABLE. Empty, the default, keeps indexes in memory only.
+ */
+extern void setSeekIndexCacheDirectory(const std::string &directory);
+extern std::string seekIndexCacheDirectory();
+
+/**
+ * Decoders remember what they parsed from the headers of the most recently loaded streams, and
+ * what they found scanning to the end, so loading one of them again skips both. Entries are
+ * checked against the stream's size and revision. 0 entries disables the cache. With a
+ * directory set entries are also kept there across runs, empty, the default, keeps them in
+ * memory only.
+ */
+extern void setStreamInfoCacheEntries(size_t entries);
+extern size_t streamInfoCacheEntries();
+extern void setStreamInfoCacheDirectory(const std::string &directory);
+extern std::string streamInfoCacheDirectory();
+
+/**
+ * Vorbis and Opus streams normally scan to their end while loading to find their length, which
+ * over HTTP costs range requests before the first sample can be decoded. With lazy durations a
+ * stream whose length is not cached loads without the scan and reports UNKNOWN_FRAMES until a
+ * background probe finds its length. Off by default.
+ */
+extern void setLazyDuration(bool lazy_duration);
+extern bool lazyDuration();
 
 }  // namespace decoder
 }  // namespace nativeformat
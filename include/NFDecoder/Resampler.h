@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2017 Spotify AB.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#pragma once
+
+#include <memory>
+
+namespace nativeformat {
+namespace decoder {
+
+typedef enum : int { ResamplerTypeLibresample, ResamplerTypeSpeex } ResamplerType;
+
+typedef enum : int {
+  ResamplerQualityFastest,
+  ResamplerQualityLow,
+  ResamplerQualityMedium,
+  ResamplerQualityHigh,
+  ResamplerQualityBest
+} ResamplerQuality;
+
+extern const ResamplerType RESAMPLER_DEFAULT_TYPE;
+extern const ResamplerQuality RESAMPLER_DEFAULT_QUALITY;
+
+/**
+ * Converts interleaved PCM between two sample rates, all channels in one call
+ */
+class Resampler {
+ public:
+  virtual int channels() = 0;
+  virtual double inputSampleRate() = 0;
+  virtual double outputSampleRate() = 0;
+  /**
+   * Consumes up to input_frames frames, updating it with the number actually consumed, and
+   * returns the number of frames written to output. Pass last once the input has ended to drain
+   * the filter.
+   */
+  virtual long process(
+      const float *input, long &input_frames, float *output, long output_frames, bool last) = 0;
+  // Drops any buffered input, as after a seek
+  virtual void reset() = 0;
+};
+
+// Returns nullptr when the channel count or sample rates are unusable, or the library refuses them
+extern std::shared_ptr<Resampler> createResampler(
+    int channels,
+    double input_samplerate,
+    double output_samplerate,
+    ResamplerType type = RESAMPLER_DEFAULT_TYPE,
+    ResamplerQuality quality = RESAMPLER_DEFAULT_QUALITY);
+
+}  // namespace decoder
+}  // namespace nativeformat
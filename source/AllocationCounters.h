@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2017 Spotify AB.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#pragma once
+
+namespace nativeformat {
+namespace decoder {
+
+/*
+ * Counts PCM buffer growth on decode paths that should stop growing once they have warmed up.
+ * Heap traffic as a whole, inside the codec libraries too, is counted by the benchmarks' own
+ * allocation hook.
+ */
+typedef enum : int {
+  AllocationCounterPCMBuffer,
+  AllocationCounterCount
+} AllocationCounter;
+
+void countAllocation(AllocationCounter counter);
+long allocationCount(AllocationCounter counter);
+long totalAllocationCount();
+
+}  // namespace decoder
+}  // namespace nativeformat
@@ -0,0 +1,242 @@
+/*
+ * Copyright (c) 2017 Spotify AB.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include "ChannelMixer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "PCMKernels.h"
+
+namespace nativeformat {
+namespace decoder {
+
+namespace {
+
+typedef enum : int {
+  SpeakerFrontLeft,
+  SpeakerFrontRight,
+  SpeakerFrontCentre,
+  SpeakerLowFrequency,
+  SpeakerBackLeft,
+  SpeakerBackRight,
+  SpeakerBackCentre,
+  SpeakerSideLeft,
+  SpeakerSideRight,
+  SpeakerCount
+} Speaker;
+
+const float MINUS_3DB = 0.70710678f;
+const int MAX_LAYOUT_CHANNELS = 8;
+
+const std::vector<Speaker> &speakerLayout(int channels) {
+  static const std::vector<std::vector<Speaker>> layouts = {
+      {},
+      {SpeakerFrontCentre},
+      {SpeakerFrontLeft, SpeakerFrontRight},
+      {SpeakerFrontLeft, SpeakerFrontRight, SpeakerFrontCentre},
+      {SpeakerFrontLeft, SpeakerFrontRight, SpeakerBackLeft, SpeakerBackRight},
+      {SpeakerFrontLeft, SpeakerFrontRight, SpeakerFrontCentre, SpeakerBackLeft, SpeakerBackRight},
+      {SpeakerFrontLeft,
+       SpeakerFrontRight,
+       SpeakerFrontCentre,
+       SpeakerLowFrequency,
+       SpeakerBackLeft,
+       SpeakerBackRight},
+      {SpeakerFrontLeft,
+       SpeakerFrontRight,
+       SpeakerFrontCentre,
+       SpeakerLowFrequency,
+       SpeakerBackCentre,
+       SpeakerSideLeft,
+       SpeakerSideRight},
+      {SpeakerFrontLeft,
+       SpeakerFrontRight,
+       SpeakerFrontCentre,
+       SpeakerLowFrequency,
+       SpeakerBackLeft,
+       SpeakerBackRight,
+       SpeakerSideLeft,
+       SpeakerSideRight}};
+  return layouts[channels];
+}
+
+// Gains from each input speaker to the output speakers, indexed [output][input]
+void speakerMatrix(const std::vector<Speaker> &input_layout,
+                   const std::vector<Speaker> &output_layout,
+                   float matrix[SpeakerCount][SpeakerCount]) {
+  bool present[SpeakerCount] = {false};
+  for (const auto speaker : output_layout) {
+    present[speaker] = true;
+  }
+  const auto pair = [&](int input, Speaker left, Speaker right, float gain) {
+    matrix[left][input] += gain;
+    matrix[right][input] += gain;
+  };
+  // A lone mono source plays at full level on both front speakers, as it always has
+  const bool mono_input = input_layout.size() == 1;
+  for (const auto speaker : input_layout) {
+    if (present[speaker]) {
+      matrix[speaker][speaker] += 1.0f;
+      continue;
+    }
+    switch (speaker) {
+      case SpeakerFrontCentre:
+        pair(speaker, SpeakerFrontLeft, SpeakerFrontRight, mono_input ? 1.0f : MINUS_3DB);
+        break;
+      case SpeakerFrontLeft:
+      case SpeakerFrontRight:
+        matrix[SpeakerFrontCentre][speaker] += MINUS_3DB;
+        break;
+      case SpeakerLowFrequency:
+        break;
+      case SpeakerBackLeft:
+      case SpeakerBackRight:
+      case SpeakerSideLeft:
+      case SpeakerSideRight: {
+        const bool left = speaker == SpeakerBackLeft || speaker == SpeakerSideLeft;
+        const bool back = speaker == SpeakerBackLeft || speaker == SpeakerBackRight;
+        const Speaker counterpart = back ? (left ? SpeakerSideLeft : SpeakerSideRight)
+                                         : (left ? SpeakerBackLeft : SpeakerBackRight);
+        const Speaker front = left ? SpeakerFrontLeft : SpeakerFrontRight;
+        if (present[counterpart]) {
+          matrix[counterpart][speaker] += 1.0f;
+        } else if (present[front]) {
+          matrix[front][speaker] += MINUS_3DB;
+        } else {
+          matrix[SpeakerFrontCentre][speaker] += MINUS_3DB;
+        }
+        break;
+      }
+      case SpeakerBackCentre:
+        if (present[SpeakerBackLeft]) {
+          pair(speaker, SpeakerBackLeft, SpeakerBackRight, MINUS_3DB);
+        } else if (present[SpeakerSideLeft]) {
+          pair(speaker, SpeakerSideLeft, SpeakerSideRight, MINUS_3DB);
+        } else if (present[SpeakerFrontLeft]) {
+          pair(speaker, SpeakerFrontLeft, SpeakerFrontRight, MINUS_3DB * MINUS_3DB);
+        } else {
+          matrix[SpeakerFrontCentre][speaker] += MINUS_3DB;
+        }
+        break;
+      case SpeakerCount:
+        break;
+    }
+  }
+}
+
+}  // namespace
+
+ChannelMixer::ChannelMixer(int input_channels, int output_channels)
+    : _input_channels(std::max(input_channels, 1)),
+      _output_channels(std::max(output_channels, 1)),
+      _matrix(_input_channels * _output_channels, 0.0f),
+      _identity(_input_channels == _output_channels),
+      _input_planes(_input_channels, nullptr),
+      _output_planes(_output_channels, nullptr) {
+  if (_identity) {
+    for (int i = 0; i < _output_channels; ++i) {
+      _matrix[(i * _input_channels) + i] = 1.0f;
+    }
+    return;
+  }
+
+  if (_input_channels <= MAX_LAYOUT_CHANNELS && _output_channels <= MAX_LAYOUT_CHANNELS) {
+    const auto &input_layout = speakerLayout(_input_channels);
+    const auto &output_layout = speakerLayout(_output_channels);
+    float speaker_matrix[SpeakerCount][SpeakerCount] = {{0.0f}};
+    speakerMatrix(input_layout, output_layout, speaker_matrix);
+    for (int i = 0; i < _output_channels; ++i) {
+      for (int j = 0; j < _input_channels; ++j) {
+        _matrix[(i * _input_channels) + j] = speaker_matrix[output_layout[i]][input_layout[j]];
+      }
+    }
+  } else {
+    // No known layout, fold the input channels round the output channels
+    for (int j = 0; j < _input_channels; ++j) {
+      _matrix[((j % _output_channels) * _input_channels) + j] = 1.0f;
+    }
+  }
+
+  // Scale everything by the loudest row so a full scale input can't clip
+  float loudest_row = 0.0f;
+  for (int i = 0; i < _output_channels; ++i) {
+    float row = 0.0f;
+    for (int j = 0; j < _input_channels; ++j) {
+      row += std::fabs(_matrix[(i * _input_channels) + j]);
+    }
+    loudest_row = std::max(loudest_row, row);
+  }
+  if (loudest_row > 1.0f) {
+    for (auto &gain : _matrix) {
+      gain /= loudest_row;
+    }
+  }
+}
+
+ChannelMixer::~ChannelMixer() {}
+
+int ChannelMixer::inputChannels() const {
+  return _input_channels;
+}
+
+int ChannelMixer::outputChannels() const {
+  return _output_channels;
+}
+
+float ChannelMixer::gain(int output_channel, int input_channel) const {
+  return _matrix[(output_channel * _input_channels) + input_channel];
+}
+
+void ChannelMixer::process(const float *input, float *output, size_t frames) {
+  if (_identity) {
+    memcpy(output, input, frames * _output_channels * sizeof(float));
+    return;
+  }
+
+  if (_input_planar.size() < frames * _input_channels) {
+    _input_planar.resize(frames * _input_channels);
+  }
+  if (_output_planar.size() < frames * _output_channels) {
+    _output_planar.resize(frames * _output_channels);
+  }
+  for (int i = 0; i < _input_channels; ++i) {
+    _input_planes[i] = _input_planar.data() + (i * frames);
+  }
+  for (int i = 0; i < _output_channels; ++i) {
+    _output_planes[i] = _output_planar.data() + (i * frames);
+  }
+
+  pcmDeinterleave(input, _input_planes.data(), frames, _input_channels);
+  memset(_output_planar.data(), 0, frames * _output_channels * sizeof(float));
+  for (int i = 0; i < _output_channels; ++i) {
+    for (int j = 0; j < _input_channels; ++j) {
+      const float gain = _matrix[(i * _input_channels) + j];
+      if (gain != 0.0f) {
+        pcmMultiplyAdd(_input_planes[j], _output_planes[i], frames, gain);
+      }
+    }
+  }
+  pcmInterleave(_output_planes.data(), output, frames, _output_channels);
+}
+
+}  // namespace decoder
+}  // namespace nativeformat
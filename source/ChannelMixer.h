@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2017 Spotify AB.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace nativeformat {
+namespace decoder {
+
+/*
+ * Mixes interleaved PCM from one channel count to another through a gain matrix. Channels are
+ * expected in WAV order (FL FR FC LFE BL BR SL SR for 7.1), layouts up to 7.1 get the usual
+ * downmix and upmix coefficients and anything wider is folded. Rows are scaled down whenever a
+ * downmix could clip. Each output channel is computed as a vectorised sum of planar input
+ * channels, the scratch space is reused so processing only allocates when the block grows.
+ */
+class ChannelMixer {
+ public:
+  ChannelMixer(int input_channels, int output_channels);
+  virtual ~ChannelMixer();
+
+  int inputChannels() const;
+  int outputChannels() const;
+  float gain(int output_channel, int input_channel) const;
+
+  // The input and output must not overlap
+  void process(const float *input, float *output, size_t frames);
+
+ private:
+  const int _input_channels;
+  const int _output_channels;
+  std::vector<float> _matrix;
+  bool _identity;
+  std::vector<float> _input_planar;
+  std::vector<float> _output_planar;
+  std::vector<float *> _input_planes;
+  std::vector<float *> _output_planes;
+};
+
+}  // namespace decoder
+}  // namespace nativeformat
@@ -26,5 +26,17 @@ namespace decoder {
 const long UNKNOWN_SIZE = -1;
 const std::string DATA_PROVIDER_MEMORY_NAME("com.nativeformat.decoder.memory");
 
+const void *DataProvider::borrow(long offset, size_t length) {
+  return nullptr;
+}
+
+std::shared_ptr<DataProvider> DataProvider::clone() {
+  return nullptr;
+}
+
+std::string DataProvider::revision() {
+  return "";
+}
+
 }  // namespace decoder
 }  // namespace nativeformat
@@ -25,15 +25,30 @@
 namespace nativeformat {
 namespace decoder {
 
+const size_t DATA_PROVIDER_HTTP_DEFAULT_BLOCK_SIZE = 256 * 1024;
+const size_t DATA_PROVIDER_HTTP_DEFAULT_BLOCK_COUNT = 16;
+const size_t DATA_PROVIDER_HTTP_DEFAULT_READ_AHEAD_BLOCKS = 2;
+const long DATA_PROVIDER_MMAP_DEFAULT_SIZE_THRESHOLD = 1024 * 1024;
+
 std::shared_ptr<DataProviderFactory> createDataProviderFactory(
-    std::shared_ptr<http::Client> client, std::shared_ptr<ManifestFactory> manifest_factory) {
+    std::shared_ptr<http::Client> client,
+    std::shared_ptr<ManifestFactory> manifest_factory,
+    size_t http_block_size,
+    size_t http_block_count,
+    size_t http_read_ahead_blocks,
+    long mmap_size_threshold) {
   if (!client) {
     client = http::createClient(http::standardCacheLocation(), "NFDecoder");
   }
   if (!manifest_factory) {
     manifest_factory = createManifestFactory();
   }
-  return std::make_shared<DataProviderFactoryImplementation>(client, manifest_factory);
+  return std::make_shared<DataProviderFactoryImplementation>(client,
+                                                             manifest_factory,
+                                                             http_block_size,
+                                                             http_block_count,
+                                                             http_read_ahead_blocks,
+                                                             mmap_size_threshold);
 }
 
 }  // namespace decoder
@@ -20,20 +20,34 @@
  */
 #include "DataProviderFactoryImplementation.h"
 
+#include <sys/stat.h>
+
 #include <nlohmann/json.hpp>
 
 #include "DataProviderFileImplementation.h"
 #include "DataProviderHTTPImplementation.h"
+#include "DataProviderMmapImplementation.h"
 #include "Path.h"
 
 namespace nativeformat {
 namespace decoder {
 
 std::atomic<int> DataProviderFactoryImplementation::_creator_count{0};
+std::atomic<long> DataProviderFactoryImplementation::_open_count{0};
 
 DataProviderFactoryImplementation::DataProviderFactoryImplementation(
-    std::shared_ptr<http::Client> client, std::shared_ptr<ManifestFactory> manifest_factory)
-    : _http_client(client), _manifest_factory(manifest_factory) {}
+    std::shared_ptr<http::Client> client,
+    std::shared_ptr<ManifestFactory> manifest_factory,
+    size_t http_block_size,
+    size_t http_block_count,
+    size_t http_read_ahead_blocks,
+    long mmap_size_threshold)
+    : _http_client(client),
+      _manifest_factory(manifest_factory),
+      _http_block_size(http_block_size),
+      _http_block_count(http_block_count),
+      _http_read_ahead_blocks(http_read_ahead_blocks),
+      _mmap_size_threshold(mmap_size_threshold) {}
 
 DataProviderFactoryImplementation::~DataProviderFactoryImplementation() {}
 
@@ -42,6 +56,10 @@ std::string DataProviderFactoryImplementation::domain() {
   return domain;
 }
 
+long DataProviderFactoryImplementation::openCount() {
+  return _open_count.load(std::memory_order_relaxed);
+}
+
 void DataProviderFactoryImplementation::createDataProvider(
     const std::string &path,
     const CREATE_DATA_PROVIDER_CALLBACK &create_data_provider_callback,
@@ -88,10 +106,20 @@ void DataProviderFactoryImplementation::createDataProvider(
             });
         return;
       } else {
-        data_provider = std::make_shared<DataProviderHTTPImplementation>(path, _http_client);
+        data_provider = std::make_shared<DataProviderHTTPImplementation>(path,
+                                                                         _http_client,
+                                                                         _http_block_size,
+                                                                         _http_block_count,
+                                                                         _http_read_ahead_blocks);
       }
     } else {
-      data_provider = std::make_shared<DataProviderFileImplementation>(path);
+      struct stat file_stat;
+      if (_mmap_size_threshold >= 0 && stat(path.c_str(), &file_stat) == 0 &&
+          file_stat.st_size >= _mmap_size_threshold) {
+        data_provider = std::make_shared<DataProviderMmapImplementation>(path);
+      } else {
+        data_provider = std::make_shared<DataProviderFileImplementation>(path);
+      }
     }
   }
   // If we tried everything and there is still no data_provider, error...
@@ -99,6 +127,7 @@ void DataProviderFactoryImplementation::createDataProvider(
     create_data_provider_callback(nullptr);
     return;
   }
+  _open_count.fetch_add(1, std::memory_order_relaxed);
   data_provider->load(error_data_provider_callback,
                       [data_provider, create_data_provider_callback](bool success) {
                         create_data_provider_callback(success ? data_provider : nullptr);
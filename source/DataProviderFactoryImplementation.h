@@ -22,7 +22,10 @@
 
 #include <NFDecoder/DataProviderFactory.h>
 
+#include <atomic>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 
 namespace nativeformat {
@@ -33,10 +36,16 @@ class DataProviderFactoryImplementation
       public std::enable_shared_from_this<DataProviderFactoryImplementation> {
  public:
   DataProviderFactoryImplementation(std::shared_ptr<http::Client> client,
-                                    std::shared_ptr<ManifestFactory> manifest_factory);
+                                    std::shared_ptr<ManifestFactory> manifest_factory,
+                                    size_t http_block_size,
+                                    size_t http_block_count,
+                                    size_t http_read_ahead_blocks,
+                                    long mmap_size_threshold);
   virtual ~DataProviderFactoryImplementation();
 
   static std::string domain();
+  // Providers opened by every factory in the process, for checking how many opens a decoder costs
+  static long openCount();
 
   // DataProviderFactory
   virtual void createDataProvider(
@@ -50,10 +59,15 @@ class DataProviderFactoryImplementation
  private:
   const std::shared_ptr<http::Client> _http_client;
   const std::shared_ptr<ManifestFactory> _manifest_factory;
+  const size_t _http_block_size;
+  const size_t _http_block_count;
+  const size_t _http_read_ahead_blocks;
+  const long _mmap_size_threshold;
 
   std::mutex _creator_mutex;
   std::map<int, DATA_PROVIDER_CREATOR_FUNCTION> _creator_functions;
   static std::atomic<int> _creator_count;
+  static std::atomic<long> _open_count;
 };
 
 }  // namespace decoder
@@ -20,13 +20,19 @@
  */
 #include "DataProviderFileImplementation.h"
 
+#include "Path.h"
+
 namespace nativeformat {
 namespace decoder {
 
 DataProviderFileImplementation::DataProviderFileImplementation(const std::string &path)
-    : _path(path) {}
+    : _path(path), _handle(nullptr), _size(0) {}
 
-DataProviderFileImplementation::~DataProviderFileImplementation() {}
+DataProviderFileImplementation::~DataProviderFileImplementation() {
+  if (_handle) {
+    fclose(_handle);
+  }
+}
 
 const std::string &DataProviderFileImplementation::name() {
   static const std::string domain("com.nativeformat.decoder.file");
@@ -74,5 +80,21 @@ long DataProviderFileImplementation::size() {
   return _size;
 }
 
+std::shared_ptr<DataProvider> DataProviderFileImplementation::clone() {
+  // A second handle has its own position, and the size is already known
+  auto data_provider = std::make_shared<DataProviderFileImplementation>(_path);
+  data_provider->_handle = fopen(_path.c_str(), "r");
+  if (!data_provider->_handle) {
+    return nullptr;
+  }
+  data_provider->_size = size();
+  return data_provider;
+}
+
+std::string DataProviderFileImplementation::revision() {
+  int64_t modification_time = pathModificationTime(_path);
+  return modification_time ? std::to_string(modification_time) : "";
+}
+
 }  // namespace decoder
 }  // namespace nativeformat
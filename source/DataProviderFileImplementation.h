@@ -48,6 +48,8 @@ class DataProviderFileImplementation : public DataProvider {
   virtual void load(const ERROR_DATA_PROVIDER_CALLBACK &data_provider_error_callback,
                     const LOAD_DATA_PROVIDER_CALLBACK &data_provider_load_callback);
   virtual const std::string &name();
+  virtual std::shared_ptr<DataProvider> clone();
+  virtual std::string revision();
 
  private:
   const std::string _path;
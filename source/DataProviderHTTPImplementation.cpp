@@ -20,17 +20,27 @@
  */
 #include "DataProviderHTTPImplementation.h"
 
+#include <algorithm>
+#include <cstring>
 #include <sstream>
 
 namespace nativeformat {
 namespace decoder {
 
 DataProviderHTTPImplementation::DataProviderHTTPImplementation(const std::string &path,
-                                                               std::shared_ptr<http::Client> client)
+                                                               std::shared_ptr<http::Client> client,
+                                                               size_t block_size,
+                                                               size_t block_count,
+                                                               size_t read_ahead_blocks)
     : _path(path),
+      _block_size(std::max(block_size, static_cast<size_t>(1))),
+      _block_count(std::max(block_count, static_cast<size_t>(1))),
+      _read_ahead_blocks(std::min(read_ahead_blocks, _block_count - 1)),
       _client(client ?: http::createClient(http::standardCacheLocation(), "")),
       _content_length(0),
-      _offset(0) {}
+      _offset(0),
+      _next_block_index(0),
+      _cache(std::make_shared<BlockCache>()) {}
 
 DataProviderHTTPImplementation::~DataProviderHTTPImplementation() {}
 
@@ -52,6 +62,8 @@ void DataProviderHTTPImplementation::load(
       [strong_this, data_provider_load_callback, data_provider_error_callback](
           const std::shared_ptr<http::Response> &response) {
         static const std::string content_length_header = "Content-Length";
+        static const std::string etag_header = "ETag";
+        static const std::string last_modified_header = "Last-Modified";
         if (response->statusCode() != http::StatusCodeOK) {
           data_provider_error_callback(strong_this->name(), response->statusCode());
           data_provider_load_callback(false);
@@ -62,6 +74,11 @@ void DataProviderHTTPImplementation::load(
         size_t content_length_primitive = 0;
         content_length_stream >> content_length_primitive;
         strong_this->_content_length = content_length_primitive;
+        // Servers without entity tags usually still say when the entity last changed
+        strong_this->_revision = (*response)[etag_header];
+        if (strong_this->_revision.empty()) {
+          strong_this->_revision = (*response)[last_modified_header];
+        }
         strong_this->_load_future = std::async(std::launch::async, [data_provider_load_callback]() {
           data_provider_load_callback(true);
         });
@@ -70,22 +87,145 @@ void DataProviderHTTPImplementation::load(
 
 size_t DataProviderHTTPImplementation::read(void *ptr, size_t size, size_t nmemb) {
   std::lock_guard<std::mutex> read_lock(_read_mutex);
-  if (_offset >= _content_length) {
+  size_t content_length = _content_length;
+  size_t offset = _offset;
+  if (offset >= content_length) {
     return 0;
   }
-  size_t offset = _offset;
-  size_t new_offset = (offset + (size * nmemb)) - 1;
-  std::shared_ptr<http::Request> request = http::createRequest(
-      _path, {{"Range", "bytes=" + std::to_string(offset) + "-" + std::to_string(new_offset)}});
-  std::shared_ptr<http::Response> response = _client->performRequestSynchronously(request);
+  size_t bytes_to_read = std::min(size * nmemb, content_length - offset);
+  size_t bytes_read = 0;
+  std::vector<size_t> read_ahead_block_indexes;
+  {
+    std::unique_lock<std::mutex> cache_lock(_cache->mutex);
+    size_t first_block_index = offset / _block_size;
+    bool sequential =
+        first_block_index == _next_block_index || first_block_index == _next_block_index + 1;
+    while (bytes_read < bytes_to_read) {
+      size_t block_index = (offset + bytes_read) / _block_size;
+      size_t block_offset = (offset + bytes_read) % _block_size;
+      const std::vector<unsigned char> *block = fetchBlock(block_index, cache_lock);
+      if (block == nullptr || block_offset >= block->size()) {
+        break;
+      }
+      size_t block_bytes = std::min(block->size() - block_offset, bytes_to_read - bytes_read);
+      memcpy((unsigned char *)ptr + bytes_read, block->data() + block_offset, block_bytes);
+      bytes_read += block_bytes;
+    }
+    _next_block_index = (offset + bytes_read) / _block_size;
+    if (sequential) {
+      read_ahead_block_indexes = pendReadAhead(_next_block_index);
+    }
+  }
+  readAhead(read_ahead_block_indexes);
+  _offset = offset + bytes_read;
+  return bytes_read;
+}
+
+std::shared_ptr<http::Request> DataProviderHTTPImplementation::createBlockRequest(
+    size_t block_index) {
+  size_t block_start = block_index * _block_size;
+  size_t block_end = std::min(block_start + _block_size, static_cast<size_t>(_content_length)) - 1;
+  return http::createRequest(
+      _path, {{"Range", "bytes=" + std::to_string(block_start) + "-" + std::to_string(block_end)}});
+}
+
+const std::vector<unsigned char> *DataProviderHTTPImplementation::fetchBlock(
+    size_t block_index, std::unique_lock<std::mutex> &cache_lock) {
+  BlockCache &cache = *_cache;
+  // Wait for any read ahead of this block, ours or a clone's, to land
+  while (cache.pending_block_indexes.find(block_index) != cache.pending_block_indexes.end()) {
+    cache.condition.wait(cache_lock);
+  }
+  auto block_it = cache.blocks.find(block_index);
+  if (block_it == cache.blocks.end()) {
+    cache.pending_block_indexes.insert(block_index);
+    cache_lock.unlock();
+    std::shared_ptr<http::Response> response =
+        _client->performRequestSynchronously(createBlockRequest(block_index));
+    cache_lock.lock();
+    storeBlock(cache, block_index, response, _block_size, _block_count, _content_length);
+    block_it = cache.blocks.find(block_index);
+    if (block_it == cache.blocks.end()) {
+      return nullptr;
+    }
+  }
+  cache.lru_block_indexes.splice(
+      cache.lru_block_indexes.begin(), cache.lru_block_indexes, block_it->second.lru_iterator);
+  return &block_it->second.data;
+}
+
+void DataProviderHTTPImplementation::storeBlock(BlockCache &cache,
+                                                size_t block_index,
+                                                const std::shared_ptr<http::Response> &response,
+                                                size_t block_size,
+                                                size_t block_count,
+                                                size_t content_length) {
+  cache.pending_block_indexes.erase(block_index);
+  cache.condition.notify_all();
   size_t data_length = 0;
-  const unsigned char *data = response->data(data_length);
-  if (data == nullptr) {
-    return 0;
+  const unsigned char *data = response ? response->data(data_length) : nullptr;
+  if (data == nullptr || data_length == 0 || cache.blocks.find(block_index) != cache.blocks.end()) {
+    return;
+  }
+  size_t block_start = block_index * block_size;
+  size_t block_length = std::min(block_size, content_length - block_start);
+  const http::StatusCode status_code = response->statusCode();
+  if (status_code == http::StatusCodeOK) {
+    // Servers that ignore the Range header send back the whole entity
+    if (data_length < block_start + block_length) {
+      return;
+    }
+    data += block_start;
+  } else if (status_code != http::StatusCodePartialContent) {
+    // Error pages would be served as audio to every clone, leave the block for the next read
+    return;
+  }
+  data_length = std::min(data_length, block_length);
+  cache.lru_block_indexes.push_front(block_index);
+  Block &block = cache.blocks[block_index];
+  block.data.assign(data, data + data_length);
+  block.lru_iterator = cache.lru_block_indexes.begin();
+  while (cache.blocks.size() > block_count) {
+    cache.blocks.erase(cache.lru_block_indexes.back());
+    cache.lru_block_indexes.pop_back();
+  }
+}
+
+std::vector<size_t> DataProviderHTTPImplementation::pendReadAhead(size_t block_index) {
+  std::vector<size_t> block_indexes;
+  for (size_t i = 1; i <= _read_ahead_blocks; ++i) {
+    size_t read_ahead_block_index = block_index + i;
+    if (read_ahead_block_index * _block_size >= _content_length) {
+      break;
+    }
+    if (_cache->blocks.find(read_ahead_block_index) != _cache->blocks.end() ||
+        _cache->pending_block_indexes.find(read_ahead_block_index) !=
+            _cache->pending_block_indexes.end()) {
+      continue;
+    }
+    _cache->pending_block_indexes.insert(read_ahead_block_index);
+    block_indexes.push_back(read_ahead_block_index);
+  }
+  return block_indexes;
+}
+
+void DataProviderHTTPImplementation::readAhead(const std::vector<size_t> &block_indexes) {
+  // The cache outlives this provider while clones use it, and clones may be waiting on these
+  std::weak_ptr<BlockCache> weak_cache = _cache;
+  const size_t block_size = _block_size;
+  const size_t block_count = _block_count;
+  const size_t content_length = _content_length;
+  for (size_t block_index : block_indexes) {
+    _client->performRequest(
+        createBlockRequest(block_index),
+        [weak_cache, block_index, block_size, block_count, content_length](
+            const std::shared_ptr<http::Response> &response) {
+          if (auto cache = weak_cache.lock()) {
+            std::lock_guard<std::mutex> cache_lock(cache->mutex);
+            storeBlock(*cache, block_index, response, block_size, block_count, content_length);
+          }
+        });
   }
-  memcpy(ptr, data, data_length);
-  _offset = offset + data_length;
-  return data_length;
 }
 
 int DataProviderHTTPImplementation::seek(long offset, int whence) {
@@ -128,5 +268,19 @@ long DataProviderHTTPImplementation::size() {
   return _content_length;
 }
 
+std::shared_ptr<DataProvider> DataProviderHTTPImplementation::clone() {
+  // Skips the HEAD request, the content length is already known
+  auto data_provider = std::make_shared<DataProviderHTTPImplementation>(
+      _path, _client, _block_size, _block_count, _read_ahead_blocks);
+  data_provider->_content_length = static_cast<size_t>(_content_length);
+  data_provider->_cache = _cache;
+  data_provider->_revision = _revision;
+  return data_provider;
+}
+
+std::string DataProviderHTTPImplementation::revision() {
+  return _revision;
+}
+
 }  // namespace decoder
 }  // namespace nativeformat
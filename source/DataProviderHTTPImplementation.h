@@ -24,10 +24,15 @@
 #include <NFDecoder/DataProviderFactory.h>
 
 #include <atomic>
+#include <condition_variable>
 #include <future>
+#include <list>
 #include <memory>
 #include <mutex>
+#include <set>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <NFHTTP/Client.h>
 
@@ -42,7 +47,11 @@ class DataProviderHTTPImplementation
  public:
   typedef enum : int { ErrorCodeCouldNotReadFile } ErrorCode;
 
-  DataProviderHTTPImplementation(const std::string &path, std::shared_ptr<http::Client> client);
+  DataProviderHTTPImplementation(const std::string &path,
+                                 std::shared_ptr<http::Client> client,
+                                 size_t block_size,
+                                 size_t block_count,
+                                 size_t read_ahead_blocks);
   virtual ~DataProviderHTTPImplementation();
 
   // DataProvider
@@ -55,9 +64,42 @@ class DataProviderHTTPImplementation
   virtual void load(const ERROR_DATA_PROVIDER_CALLBACK &data_provider_error_callback,
                     const LOAD_DATA_PROVIDER_CALLBACK &data_provider_load_callback);
   virtual const std::string &name();
+  virtual std::shared_ptr<DataProvider> clone();
+  virtual std::string revision();
 
  private:
+  struct Block {
+    std::vector<unsigned char> data;
+    std::list<size_t>::iterator lru_iterator;
+  };
+
+  // Blocks fetched for the entity, shared by every clone of the provider
+  struct BlockCache {
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::unordered_map<size_t, Block> blocks;
+    std::list<size_t> lru_block_indexes;
+    std::set<size_t> pending_block_indexes;
+  };
+
+  std::shared_ptr<http::Request> createBlockRequest(size_t block_index);
+  // These require the cache lock to be held
+  const std::vector<unsigned char> *fetchBlock(size_t block_index,
+                                               std::unique_lock<std::mutex> &cache_lock);
+  static void storeBlock(BlockCache &cache,
+                         size_t block_index,
+                         const std::shared_ptr<http::Response> &response,
+                         size_t block_size,
+                         size_t block_count,
+                         size_t content_length);
+  std::vector<size_t> pendReadAhead(size_t block_index);
+
+  void readAhead(const std::vector<size_t> &block_indexes);
+
   const std::string _path;
+  const size_t _block_size;
+  const size_t _block_count;
+  const size_t _read_ahead_blocks;
 
   std::shared_ptr<http::Client> _client;
 
@@ -65,6 +107,10 @@ class DataProviderHTTPImplementation
   std::atomic<size_t> _offset;
   std::mutex _read_mutex;
   std::future<void> _load_future;
+  std::string _revision;
+  size_t _next_block_index;
+
+  std::shared_ptr<BlockCache> _cache;
 };
 
 }  // namespace decoder
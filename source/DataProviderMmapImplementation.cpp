@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2017 Spotify AB.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include "DataProviderMmapImplementation.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Path.h"
+
+namespace nativeformat {
+namespace decoder {
+
+DataProviderMmapImplementation::DataProviderMmapImplementation(const std::string &path)
+    : _path(path), _data(nullptr), _size(0), _offset(0) {}
+
+DataProviderMmapImplementation::~DataProviderMmapImplementation() {}
+
+const std::string &DataProviderMmapImplementation::name() {
+  static const std::string domain("com.nativeformat.decoder.mmap");
+  return domain;
+}
+
+void DataProviderMmapImplementation::load(
+    const ERROR_DATA_PROVIDER_CALLBACK &data_provider_error_callback,
+    const LOAD_DATA_PROVIDER_CALLBACK &data_provider_load_callback) {
+  int file_descriptor = open(path().c_str(), O_RDONLY);
+  struct stat file_stat;
+  if (file_descriptor < 0 || fstat(file_descriptor, &file_stat) != 0) {
+    printf("Failed to open file: %s\n", path().c_str());
+    if (file_descriptor >= 0) {
+      close(file_descriptor);
+    }
+    data_provider_error_callback(name(), ErrorCodeCouldNotReadFile);
+    data_provider_load_callback(false);
+    return;
+  }
+  _size = file_stat.st_size;
+  if (_size > 0) {
+    void *data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+    if (data == MAP_FAILED) {
+      printf("Failed to map file: %s\n", path().c_str());
+      close(file_descriptor);
+      data_provider_error_callback(name(), ErrorCodeCouldNotMapFile);
+      data_provider_load_callback(false);
+      return;
+    }
+    // Decoders mostly stream front to back
+    madvise(data, _size, MADV_SEQUENTIAL);
+    const long size = _size;
+    _mapping = std::shared_ptr<const unsigned char>(
+        (const unsigned char *)data,
+        [size](const unsigned char *data) { munmap((void *)data, size); });
+    _data = _mapping.get();
+  }
+  // The mapping keeps the file alive
+  close(file_descriptor);
+  data_provider_load_callback(true);
+}
+
+size_t DataProviderMmapImplementation::read(void *ptr, size_t size, size_t nmemb) {
+  long offset = _offset;
+  if (offset >= _size) {
+    return 0;
+  }
+  size_t bytes_to_read = std::min(size * nmemb, static_cast<size_t>(_size - offset));
+  // Only hand out whole items, like fread
+  bytes_to_read -= size > 0 ? bytes_to_read % size : 0;
+  memcpy(ptr, _data + offset, bytes_to_read);
+  _offset = offset + bytes_to_read;
+  return bytes_to_read;
+}
+
+int DataProviderMmapImplementation::seek(long offset, int whence) {
+  long new_offset = 0;
+  switch (whence) {
+    case SEEK_SET:
+      new_offset = offset;
+      break;
+    case SEEK_CUR:
+      new_offset = _offset + offset;
+      break;
+    case SEEK_END:
+      new_offset = _size + offset;
+      break;
+    default:
+      return -1;
+  }
+  if (new_offset < 0) {
+    return -1;
+  }
+  _offset = new_offset;
+  return 0;
+}
+
+long DataProviderMmapImplementation::tell() {
+  return _offset;
+}
+
+const std::string &DataProviderMmapImplementation::path() {
+  return _path;
+}
+
+bool DataProviderMmapImplementation::eof() {
+  return _offset >= _size;
+}
+
+long DataProviderMmapImplementation::size() {
+  return _size;
+}
+
+const void *DataProviderMmapImplementation::borrow(long offset, size_t length) {
+  if (_data == nullptr || offset < 0 || offset > _size ||
+      length > static_cast<size_t>(_size - offset)) {
+    return nullptr;
+  }
+  return _data + offset;
+}
+
+std::shared_ptr<DataProvider> DataProviderMmapImplementation::clone() {
+  auto data_provider = std::make_shared<DataProviderMmapImplementation>(_path);
+  data_provider->_mapping = _mapping;
+  data_provider->_data = _data;
+  data_provider->_size = _size;
+  return data_provider;
+}
+
+std::string DataProviderMmapImplementation::revision() {
+  int64_t modification_time = pathModificationTime(_path);
+  return modification_time ? std::to_string(modification_time) : "";
+}
+
+}  // namespace decoder
+}  // namespace nativeformat
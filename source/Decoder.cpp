@@ -20,6 +20,8 @@
  */
 #include <NFDecoder/Decoder.h>
 
+#include <cstring>
+
 #include <nfdecoder_generated_header.h>
 
 namespace nativeformat {
@@ -32,5 +34,25 @@ const std::string version() {
   return NFDECODER_VERSION;
 }
 
+void Decoder::decodeInto(float *samples,
+                         long frames,
+                         const DECODE_INTO_CALLBACK &decode_into_callback,
+                         bool synchronous) {
+  int channels = this->channels();
+  decode(frames,
+         [samples, channels, decode_into_callback](
+             long frame_index, long frame_count, float *decoded_samples) {
+           if (frame_count > 0) {
+             memcpy(samples, decoded_samples, frame_count * channels * sizeof(float));
+           }
+           decode_into_callback(frame_index, frame_count);
+         },
+         synchronous);
+}
+
+std::shared_ptr<Decoder> Decoder::clone() {
+  return nullptr;
+}
+
 }  // namespace decoder
 }  // namespace nativeformat
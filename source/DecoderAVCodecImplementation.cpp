@@ -22,8 +22,9 @@
 
 #if INCLUDE_LGPL
 
+#include <algorithm>
 #include <cstdlib>
-#include <future>
+#include <cstring>
 #include <iostream>
 
 namespace nativeformat {
@@ -52,15 +53,22 @@ static void swap_endians(uint8_t *memory, size_t memory_size) {
 const std::string DECODER_AVCODEC_NAME("com.nativeformat.decoder.avcodec");
 
 DecoderAVCodecImplementation::DecoderAVCodecImplementation(
-    const std::shared_ptr<DataProvider> &data_provider, const std::shared_ptr<Decrypter> &decrypter)
+    const std::shared_ptr<DataProvider> &data_provider,
+    const std::shared_ptr<Decrypter> &decrypter,
+    const std::shared_ptr<Executor> &executor)
     : _data_provider(data_provider),
       _decrypter(decrypter),
+      _executor(executor),
+      _samplerate(0.0),
+      _channels(0),
       _frame_index(0),
       _io_context_buffer(nullptr),
       _io_context(nullptr),
       _format_context(nullptr),
       _resample_context(nullptr),
       _codec_context(nullptr),
+      _packet(nullptr),
+      _decoded_frame(nullptr),
       _key_id(nullptr),
       _key_id_length(0),
       _stream(nullptr),
@@ -71,9 +79,10 @@ DecoderAVCodecImplementation::DecoderAVCodecImplementation(
 
 DecoderAVCodecImplementation::~DecoderAVCodecImplementation() {
   if (_resample_context != nullptr) {
-    avresample_close(_resample_context);
-    avresample_free(&_resample_context);
+    swr_free(&_resample_context);
   }
+  av_packet_free(&_packet);
+  av_frame_free(&_decoded_frame);
 
   if (_format_context != nullptr) {
     avformat_free_context(_format_context);
@@ -103,144 +112,148 @@ const std::string &DecoderAVCodecImplementation::name() {
 void DecoderAVCodecImplementation::load(const ERROR_DECODER_CALLBACK &decoder_error_callback,
                                         const LOAD_DECODER_CALLBACK &decoder_load_callback) {
   auto strong_this = shared_from_this();
-  _load_future = std::async(
-      std::launch::async, [strong_this, decoder_error_callback, decoder_load_callback]() {
-        static const size_t avio_context_buffer_size = 8192;
-        static std::once_flag avcodec_register_all_once;
-        static std::once_flag av_register_all_once;
-
-        std::call_once(avcodec_register_all_once, &avcodec_register_all);
-        std::call_once(av_register_all_once, &av_register_all);
+  _executor->execute([strong_this, decoder_error_callback, decoder_load_callback]() {
+    static const size_t avio_context_buffer_size = 8192;
+    static std::once_flag avcodec_register_all_once;
+    static std::once_flag av_register_all_once;
+
+    std::call_once(avcodec_register_all_once, &avcodec_register_all);
+    std::call_once(av_register_all_once, &av_register_all);
 #if NDEBUG
-        static std::once_flag av_log_once;
-        std::call_once(av_log_once, []() {
-          av_log_set_callback([](void *data, int log_level, const char *format, va_list args) {
-            /*
-            if (log_level <= AV_LOG_WARNING) {
-              char buffer[256];
-              vsprintf(buffer, format, args);
-              std::cout << "AVCodec Issue: " << buffer;
-            }
-             */
-          });
-        });
+    static std::once_flag av_log_once;
+    std::call_once(av_log_once, []() {
+      av_log_set_callback([](void *data, int log_level, const char *format, va_list args) {
+        /*
+        if (log_level <= AV_LOG_WARNING) {
+          char buffer[256];
+          vsprintf(buffer, format, args);
+          std::cout << "AVCodec Issue: " << buffer;
+        }
+         */
+      });
+    });
 #endif
-        {
-          std::lock_guard<std::mutex> av_lock(strong_this->_av_mutex);
-
-          strong_this->_io_context_buffer = (unsigned char *)av_malloc(avio_context_buffer_size);
-          strong_this->_io_context = avio_alloc_context(strong_this->_io_context_buffer,
-                                                        avio_context_buffer_size,
-                                                        0,
-                                                        strong_this.get(),
-                                                        &DecoderAVCodecImplementation::avio_read,
-                                                        nullptr,
-                                                        &DecoderAVCodecImplementation::avio_seek);
-          strong_this->_format_context = avformat_alloc_context();
-          strong_this->_resample_context = avresample_alloc_context();
-          strong_this->_format_context->pb = strong_this->_io_context;
-
-          int error_code = avformat_open_input(&strong_this->_format_context, "", nullptr, nullptr);
-          if (error_code != 0) {
-            decoder_error_callback(strong_this->name(), error_code);
-            decoder_load_callback(false);
-            return;
+    {
+      std::lock_guard<std::mutex> av_lock(strong_this->_av_mutex);
+
+      strong_this->_io_context_buffer = (unsigned char *)av_malloc(avio_context_buffer_size);
+      strong_this->_io_context = avio_alloc_context(strong_this->_io_context_buffer,
+                                                    avio_context_buffer_size,
+                                                    0,
+                                                    strong_this.get(),
+                                                    &DecoderAVCodecImplementation::avio_read,
+                                                    nullptr,
+                                                    &DecoderAVCodecImplementation::avio_seek);
+      strong_this->_format_context = avformat_alloc_context();
+      strong_this->_resample_context = swr_alloc();
+      // Reused for every packet and frame the decoder reads from here on
+      strong_this->_packet = av_packet_alloc();
+      strong_this->_decoded_frame = av_frame_alloc();
+      strong_this->_format_context->pb = strong_this->_io_context;
+
+      int error_code = avformat_open_input(&strong_this->_format_context, "", nullptr, nullptr);
+      if (error_code != 0) {
+        decoder_error_callback(strong_this->name(), error_code);
+        decoder_load_callback(false);
+        return;
+      }
+
+      error_code = avformat_find_stream_info(strong_this->_format_context, nullptr);
+      if (error_code != 0) {
+        decoder_error_callback(strong_this->name(), error_code);
+        decoder_load_callback(false);
+        return;
+      }
+      bool format_found = false;
+      for (int i = 0; i < strong_this->_format_context->nb_streams; ++i) {
+        strong_this->_stream = strong_this->_format_context->streams[i];
+        strong_this->_codec_context = strong_this->_stream->codec;
+        if (strong_this->_codec_context->codec_type == AVMEDIA_TYPE_AUDIO) {
+          auto frames = strong_this->_stream->nb_frames;
+          auto duration_seconds =
+              static_cast<double>(strong_this->_stream->duration) /
+              (strong_this->_stream->time_base.den / strong_this->_stream->time_base.num);
+          decltype(frames) duration_frames =
+              duration_seconds * strong_this->_codec_context->sample_rate;
+          if (frames > 0 || duration_frames > 0) {
+            strong_this->_frames = std::max(frames, duration_frames);
+          } else {
+            strong_this->_frames = UNKNOWN_FRAMES;
           }
 
-          error_code = avformat_find_stream_info(strong_this->_format_context, nullptr);
+          AVCodec *codec = avcodec_find_decoder(strong_this->_codec_context->codec_id);
+          if (codec->id == AV_CODEC_ID_AAC) {
+            strong_this->_start_junk_frames = 1024;
+          } else if (codec->id == AV_CODEC_ID_MP3) {
+            strong_this->_start_junk_frames = 275;
+          }
+          if (strong_this->_frames != UNKNOWN_FRAMES) {
+            strong_this->_frames -= strong_this->_start_junk_frames;
+          }
+          error_code = avcodec_open2(strong_this->_codec_context, codec, nullptr);
           if (error_code != 0) {
             decoder_error_callback(strong_this->name(), error_code);
             decoder_load_callback(false);
             return;
           }
-          bool format_found = false;
-          for (int i = 0; i < strong_this->_format_context->nb_streams; ++i) {
-            strong_this->_stream = strong_this->_format_context->streams[i];
-            strong_this->_codec_context = strong_this->_stream->codec;
-            if (strong_this->_codec_context->codec_type == AVMEDIA_TYPE_AUDIO) {
-              auto frames = strong_this->_stream->nb_frames;
-              auto duration_seconds =
-                  static_cast<double>(strong_this->_stream->duration) /
-                  (strong_this->_stream->time_base.den / strong_this->_stream->time_base.num);
-              decltype(frames) duration_frames =
-                  duration_seconds * strong_this->_codec_context->sample_rate;
-              if (frames > 0 || duration_frames > 0) {
-                strong_this->_frames = std::max(frames, duration_frames);
-              } else {
-                strong_this->_frames = UNKNOWN_FRAMES;
-              }
-
-              AVCodec *codec = avcodec_find_decoder(strong_this->_codec_context->codec_id);
-              if (codec->id == AV_CODEC_ID_AAC) {
-                strong_this->_start_junk_frames = 1024;
-              } else if (codec->id == AV_CODEC_ID_MP3) {
-                strong_this->_start_junk_frames = 275;
-              }
-              if (strong_this->_frames != UNKNOWN_FRAMES) {
-                strong_this->_frames -= strong_this->_start_junk_frames;
-              }
-              error_code = avcodec_open2(strong_this->_codec_context, codec, nullptr);
-              if (error_code != 0) {
-                decoder_error_callback(strong_this->name(), error_code);
-                decoder_load_callback(false);
-                return;
-              }
-
-              if (strong_this->_decrypter) {
-                // We need this to "guess" the IV's for decryption
-                if (strong_this->_stream->nb_index_entries >= 2) {
-                  AVIndexEntry &entry = strong_this->_stream->index_entries[0];
-                  AVIndexEntry &entry2 = strong_this->_stream->index_entries[1];
-                  strong_this->_frames_per_entry_index = entry2.timestamp - entry.timestamp;
-                  strong_this->_packets_per_moof = strong_this->_stream->nb_index_entries;
-                }
-              }
 
-              format_found = true;
-              break;
+          if (strong_this->_decrypter) {
+            // We need this to "guess" the IV's for decryption
+            if (strong_this->_stream->nb_index_entries >= 2) {
+              AVIndexEntry &entry = strong_this->_stream->index_entries[0];
+              AVIndexEntry &entry2 = strong_this->_stream->index_entries[1];
+              strong_this->_frames_per_entry_index = entry2.timestamp - entry.timestamp;
+              strong_this->_packets_per_moof = strong_this->_stream->nb_index_entries;
             }
           }
 
-          if (!format_found) {
-            decoder_error_callback(strong_this->name(), ErrorCodeCouldNotDecodeHeader);
-            decoder_load_callback(false);
-            return;
-          }
-
-          av_opt_set_int(strong_this->_resample_context,
-                         "in_channel_layout",
-                         strong_this->_codec_context->channel_layout,
-                         0);
-          av_opt_set_int(
-              strong_this->_resample_context, "out_channel_layout", AV_CH_LAYOUT_STEREO, 0);
-          av_opt_set_int(strong_this->_resample_context,
-                         "in_sample_rate",
-                         strong_this->_codec_context->sample_rate,
-                         0);
-          av_opt_set_int(
-              strong_this->_resample_context, "out_sample_rate", strong_this->sampleRate(), 0);
-          av_opt_set_int(strong_this->_resample_context,
-                         "in_sample_fmt",
-                         strong_this->_codec_context->sample_fmt,
-                         0);
-          av_opt_set_int(strong_this->_resample_context, "out_sample_fmt", AV_SAMPLE_FMT_FLTP, 0);
-          error_code = avresample_open(strong_this->_resample_context);
-          if (error_code != 0) {
-            decoder_error_callback(strong_this->name(), error_code);
-            decoder_load_callback(false);
-            return;
-          }
+          format_found = true;
+          break;
         }
-        decoder_load_callback(true);
-      });
+      }
+
+      if (!format_found) {
+        decoder_error_callback(strong_this->name(), ErrorCodeCouldNotDecodeHeader);
+        decoder_load_callback(false);
+        return;
+      }
+
+      // Decode at the stream's own rate and layout, only the sample format is converted so the
+      // normaliser is the one place anything gets resampled
+      auto codec_context = strong_this->_codec_context;
+      int64_t channel_layout = codec_context->channel_layout;
+      if (channel_layout == 0) {
+        channel_layout = av_get_default_channel_layout(codec_context->channels);
+      }
+      strong_this->_samplerate = codec_context->sample_rate;
+      strong_this->_channels = codec_context->channels;
+      av_opt_set_int(strong_this->_resample_context, "in_channel_layout", channel_layout, 0);
+      av_opt_set_int(strong_this->_resample_context, "out_channel_layout", channel_layout, 0);
+      av_opt_set_int(
+          strong_this->_resample_context, "in_sample_rate", codec_context->sample_rate, 0);
+      av_opt_set_int(
+          strong_this->_resample_context, "out_sample_rate", codec_context->sample_rate, 0);
+      av_opt_set_sample_fmt(
+          strong_this->_resample_context, "in_sample_fmt", codec_context->sample_fmt, 0);
+      av_opt_set_sample_fmt(
+          strong_this->_resample_context, "out_sample_fmt", AV_SAMPLE_FMT_FLT, 0);
+      error_code = swr_init(strong_this->_resample_context);
+      if (error_code != 0) {
+        decoder_error_callback(strong_this->name(), error_code);
+        decoder_load_callback(false);
+        return;
+      }
+    }
+    decoder_load_callback(true);
+  });
 }
 
 double DecoderAVCodecImplementation::sampleRate() {
-  return 44100.0;
+  return _samplerate;
 }
 
 int DecoderAVCodecImplementation::channels() {
-  return 2;
+  return _channels;
 }
 
 long DecoderAVCodecImplementation::currentFrameIndex() {
@@ -267,22 +280,35 @@ long DecoderAVCodecImplementation::frames() {
 void DecoderAVCodecImplementation::decode(long frames,
                                           const DECODE_CALLBACK &decode_callback,
                                           bool synchronous) {
+  float *samples = (float *)malloc(sizeof(float) * frames * channels());
+  decodeInto(samples,
+             frames,
+             [decode_callback, samples](long frame_index, long frame_count) {
+               decode_callback(frame_index, frame_count, samples);
+               free(samples);
+             },
+             synchronous);
+}
+
+void DecoderAVCodecImplementation::decodeInto(float *samples,
+                                              long frames,
+                                              const DECODE_INTO_CALLBACK &decode_into_callback,
+                                              bool synchronous) {
   auto strong_this = shared_from_this();
   if (synchronous) {
-    strong_this->runDecodeThread(frames, decode_callback);
+    strong_this->runDecodeThread(frames, samples, decode_into_callback);
   } else {
-    std::thread([strong_this, decode_callback, frames] {
-      strong_this->runDecodeThread(frames, decode_callback);
-    }).detach();
+    _executor->execute([strong_this, samples, decode_into_callback, frames] {
+      strong_this->runDecodeThread(frames, samples, decode_into_callback);
+    });
   }
 }
 
-void DecoderAVCodecImplementation::runDecodeThread(long frames,
-                                                   const DECODE_CALLBACK &decode_callback) {
+void DecoderAVCodecImplementation::runDecodeThread(
+    long frames, float *output_samples, const DECODE_INTO_CALLBACK &decode_into_callback) {
   long frame_index = currentFrameIndex();
   int c = channels();
   long read_frames = 0l;
-  float *output_samples = (float *)malloc(sizeof(float) * frames * c);
   {
     std::lock_guard<std::mutex> lock(_av_mutex);
     auto move_decoded = [&]() {
@@ -291,10 +317,7 @@ void DecoderAVCodecImplementation::runDecodeThread(long frames,
       if (samples_to_copy == 0) {
         return;
       }
-      for (long i = (read_frames * c), j = 0; i < (read_frames * c) + samples_to_copy; ++i, ++j) {
-        output_samples[i] = _pcm_buffer[j];
-      }
-      _pcm_buffer.erase(_pcm_buffer.begin(), _pcm_buffer.begin() + samples_to_copy);
+      _pcm_buffer.read(output_samples + (read_frames * c), samples_to_copy);
       read_frames += samples_to_copy / c;
     };
     move_decoded();
@@ -303,7 +326,7 @@ void DecoderAVCodecImplementation::runDecodeThread(long frames,
     long decoded_frames = 0l;
     while (read_frames < frames) {
       // Decode the packet
-      AVPacket *packet = av_packet_alloc();
+      AVPacket *packet = _packet;
       int error_code = av_read_frame(_format_context, packet);
       if (error_code == AVERROR_EOF) {
         // printf("HIT EOF calling av_read_frame, read_frames = %ld\n",
@@ -311,10 +334,10 @@ void DecoderAVCodecImplementation::runDecodeThread(long frames,
         drain = true;
       } else if (error_code == AVERROR(EAGAIN)) {
         // printf("NEED MORE INPUT (av_read_frame)\n");
-        av_packet_free(&packet);
+        av_packet_unref(packet);
         continue;
       } else if (error_code != 0) {
-        av_packet_free(&packet);
+        av_packet_unref(packet);
         continue;
       }
       AVPacket *p = drain ? nullptr : packet;
@@ -324,8 +347,8 @@ void DecoderAVCodecImplementation::runDecodeThread(long frames,
         static const int INVALID_ENTRY_INDEX = -1;
         int entry_index = packet->pts / _frames_per_entry_index;
         if (entry_index != INVALID_ENTRY_INDEX && _ivs.find(entry_index) != _ivs.end()) {
-          std::vector<unsigned char> input(p->buf->data, p->buf->data + p->buf->size);
-          std::vector<unsigned char> output(p->buf->size, 0);
+          _decrypt_input.assign(p->buf->data, p->buf->data + p->buf->size);
+          _decrypt_output.assign(p->buf->size, 0);
           unsigned char IV[16];
           memset(IV, 0, sizeof(IV));
           uint64_t new_iv;
@@ -336,9 +359,10 @@ void DecoderAVCodecImplementation::runDecodeThread(long frames,
             new_iv_bytes[i] = old_iv_bytes[sizeof(uint64_t) - i - 1];
           }
           memcpy(IV, new_iv_bytes, sizeof(new_iv));
-          auto status = _decrypter->decrypt(input, output, _key_id, _key_id_length, IV, sizeof(IV));
+          auto status = _decrypter->decrypt(
+              _decrypt_input, _decrypt_output, _key_id, _key_id_length, IV, sizeof(IV));
           if (status == 0) {
-            memcpy(p->buf->data, output.data(), p->buf->size);
+            memcpy(p->buf->data, _decrypt_output.data(), p->buf->size);
           }
         }
       }
@@ -346,119 +370,92 @@ void DecoderAVCodecImplementation::runDecodeThread(long frames,
 
       if (error_code == AVERROR_EOF) {
         drain = true;
-        av_packet_free(&packet);
+        av_packet_unref(packet);
         break;
       } else if (error_code != 0) {
         char err[1024];
         av_strerror(error_code, err, 1023);
         // printf("avcodec_send_packet failed: %s\n", err);
-        av_packet_free(&packet);
+        av_packet_unref(packet);
         continue;
       }
 
       while (!error_code) {
-        AVFrame *decoded_frame = av_frame_alloc();
+        AVFrame *decoded_frame = _decoded_frame;
         error_code = avcodec_receive_frame(_codec_context, decoded_frame);
         if (error_code == AVERROR_EOF) {
           // printf("EOF (avcodec_receive_frame)\n");
-          av_frame_free(&decoded_frame);
+          av_frame_unref(decoded_frame);
           break;
         } else if (error_code == AVERROR(EAGAIN)) {
           // printf("NEED MORE INPUT (avcodec_receive_frame)\n");
-          av_frame_free(&decoded_frame);
+          av_frame_unref(decoded_frame);
           break;
         } else if (error_code != 0) {
           // printf("avcodec_receive_frame failed\n");
-          av_frame_free(&decoded_frame);
+          av_frame_unref(decoded_frame);
           continue;
         }
 
         if (decoded_frame->nb_samples <= 0) {
-          av_frame_free(&decoded_frame);
+          av_frame_unref(decoded_frame);
           continue;
         }
 
-        // Resample the audio
-        auto samples_upper_bound =
-            avresample_get_out_samples(_resample_context, decoded_frame->nb_samples);
-        float **output_buffers = (float **)malloc(c * sizeof(float *));
-        for (int i = 0; i < c; ++i) {
-          output_buffers[i] = (float *)malloc(sizeof(float) * samples_upper_bound);
-        }
-
-        uint8_t *const *input_buffer = (uint8_t *const *)decoded_frame->extended_data;
-        long pcm_frames = avresample_convert(_resample_context,
-                                             (uint8_t **)output_buffers,
-                                             0,
-                                             samples_upper_bound,
-                                             input_buffer,
-                                             0,
-                                             decoded_frame->nb_samples);
-
+        // Convert straight into the PCM buffer, the format changes but the rate never does
+        const int pcm_capacity = swr_get_out_samples(_resample_context, decoded_frame->nb_samples);
+        float *pcm_samples = _pcm_buffer.prepareWrite(std::max(pcm_capacity, 0) * c);
+        uint8_t *output_buffer = (uint8_t *)pcm_samples;
+        long pcm_frames = swr_convert(_resample_context,
+                                      &output_buffer,
+                                      pcm_capacity,
+                                      (const uint8_t **)decoded_frame->extended_data,
+                                      decoded_frame->nb_samples);
         if (pcm_frames <= 0) {
-          for (int i = 0; i < c; ++i) {
-            free(output_buffers[i]);
-          }
-          free(output_buffers);
-          av_frame_free(&decoded_frame);
+          av_frame_unref(decoded_frame);
           continue;
         }
 
-        // Place it into our PCM buffer
-        int pcm_buffer_begin = _pcm_buffer.size();
         // FFMPEG seeks to the nearest packet, its up to us to clip that to the
         // nearest frame
-        auto packet_seconds =
-            static_cast<double>(p->pts) / (_stream->time_base.den / _stream->time_base.num);
-        auto packet_frames = static_cast<long>(packet_seconds * _codec_context->sample_rate);
         long clip_frames = 0l;
         if (first_run && decoded_frames < _start_junk_frames && frame_index == 0) {
           clip_frames = _start_junk_frames - decoded_frames;
         } else if (!first_run) {
-          clip_frames =
-              std::max((frame_index + _start_junk_frames + read_frames) - packet_frames, 0l);
+          if (p != nullptr) {
+            auto packet_seconds =
+                static_cast<double>(p->pts) / (_stream->time_base.den / _stream->time_base.num);
+            auto packet_frames = static_cast<long>(packet_seconds * _codec_context->sample_rate);
+            clip_frames =
+                std::max((frame_index + _start_junk_frames + read_frames) - packet_frames, 0l);
+          }
           first_run = true;
         }
         decoded_frames += pcm_frames;
 
-        int samples = (pcm_frames * c) - (clip_frames * c);
-        if (samples <= 0) {
-          for (int i = 0; i < c; ++i) {
-            free(output_buffers[i]);
-          }
-          free(output_buffers);
-          av_frame_free(&decoded_frame);
+        if (clip_frames >= pcm_frames) {
+          av_frame_unref(decoded_frame);
           continue;
         }
-
-        _pcm_buffer.insert(_pcm_buffer.end(), samples, 0.0f);
-        for (int i = 0; i < pcm_frames; ++i) {
-          if (i < clip_frames) {
-            continue;
-          }
-          for (int j = 0; j < c; ++j) {
-            auto adjusted_i = i - clip_frames;
-            _pcm_buffer[pcm_buffer_begin + (adjusted_i * c) + j] = output_buffers[j][adjusted_i];
-          }
-        }
-        for (int i = 0; i < c; ++i) {
-          free(output_buffers[i]);
+        if (clip_frames > 0) {
+          memmove(pcm_samples,
+                  pcm_samples + (clip_frames * c),
+                  (pcm_frames - clip_frames) * c * sizeof(float));
         }
-        free(output_buffers);
+        _pcm_buffer.commitWrite((pcm_frames - clip_frames) * c);
 
         // Move it into our decoded buffer
         move_decoded();
-        av_frame_free(&decoded_frame);
+        av_frame_unref(decoded_frame);
       }
-      av_packet_free(&packet);
+      av_packet_unref(packet);
     }
     if (drain) {
       avcodec_flush_buffers(_codec_context);
     }
   }
   _frame_index = frame_index + read_frames;
-  decode_callback(frame_index, std::min(read_frames, frames), output_samples);
-  free(output_samples);
+  decode_into_callback(frame_index, std::min(read_frames, frames));
 }
 
 bool DecoderAVCodecImplementation::eof() {
@@ -25,21 +25,24 @@
 #if INCLUDE_LGPL
 
 #include <atomic>
-#include <future>
+#include <map>
 #include <mutex>
 #include <vector>
 
 #include <NFDecoder/DataProvider.h>
 #include <NFDecoder/Decrypter.h>
+#include <NFDecoder/Executor.h>
 #include <NFDecoder/Factory.h>
 
 extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
-#include <libavresample/avresample.h>
 #include <libavutil/opt.h>
+#include <libswresample/swresample.h>
 }
 
+#include "PCMBuffer.h"
+
 namespace nativeformat {
 namespace decoder {
 
@@ -52,7 +55,8 @@ class DecoderAVCodecImplementation
   typedef enum : int { ErrorCodeCouldNotDecodeHeader } ErrorCode;
 
   DecoderAVCodecImplementation(const std::shared_ptr<DataProvider> &data_provider,
-                               const std::shared_ptr<Decrypter> &decrypter);
+                               const std::shared_ptr<Decrypter> &decrypter,
+                               const std::shared_ptr<Executor> &executor);
   virtual ~DecoderAVCodecImplementation();
 
   // Decoder
@@ -62,6 +66,10 @@ class DecoderAVCodecImplementation
   virtual void seek(long frame_index);
   virtual long frames();
   virtual void decode(long frames, const DECODE_CALLBACK &decode_callback, bool synchronous);
+  virtual void decodeInto(float *samples,
+                          long frames,
+                          const DECODE_INTO_CALLBACK &decode_into_callback,
+                          bool synchronous);
   virtual bool eof();
   virtual const std::string &path();
   virtual const std::string &name();
@@ -82,7 +90,9 @@ class DecoderAVCodecImplementation
     int offset;
     std::vector<SIDX_FRAME> _sidx_frames;
   };
-  virtual void runDecodeThread(long frames, const DECODE_CALLBACK &decode_callback);
+  virtual void runDecodeThread(long frames,
+                               float *output_samples,
+                               const DECODE_INTO_CALLBACK &decode_into_callback);
   static int avio_read(void *opaque, uint8_t *buf, int buf_size);
   static int64_t avio_seek(void *opaque, int64_t offset, int whence);
 
@@ -90,17 +100,21 @@ class DecoderAVCodecImplementation
 
   std::shared_ptr<DataProvider> _data_provider;
   const std::shared_ptr<Decrypter> _decrypter;
+  const std::shared_ptr<Executor> _executor;
 
-  std::future<void> _load_future;
+  std::atomic<double> _samplerate;
+  std::atomic_int _channels;
   std::atomic<long> _frame_index;
   std::atomic<long> _frames;
   unsigned char *_io_context_buffer;
   AVIOContext *_io_context;
   AVFormatContext *_format_context;
-  AVAudioResampleContext *_resample_context;
+  SwrContext *_resample_context;
   AVCodecContext *_codec_context;
+  AVPacket *_packet;
+  AVFrame *_decoded_frame;
   std::mutex _av_mutex;
-  std::vector<float> _pcm_buffer;
+  PCMBuffer _pcm_buffer;
   unsigned char *_key_id;
   size_t _key_id_length;
   AVStream *_stream;
@@ -108,6 +122,8 @@ class DecoderAVCodecImplementation
   long _frames_per_entry_index;
   bool _found_sidx;
   std::map<int, uint64_t> _ivs;
+  std::vector<unsigned char> _decrypt_input;
+  std::vector<unsigned char> _decrypt_output;
   MOOFS _moofs;
   long _packets_per_moof;
 };
@@ -23,14 +23,16 @@
 #if __APPLE__
 
 #include <cstdlib>
-#include <future>
 
 namespace nativeformat {
 namespace decoder {
 
 DecoderAudioConverterImplementation::DecoderAudioConverterImplementation(
-    std::shared_ptr<DataProvider> &data_provider)
-    : _data_provider(data_provider), _frame_offset(0), _start_junk_frames(0) {}
+    std::shared_ptr<DataProvider> &data_provider, const std::shared_ptr<Executor> &executor)
+    : _data_provider(data_provider),
+      _executor(executor),
+      _frame_offset(0),
+      _start_junk_frames(0) {}
 
 DecoderAudioConverterImplementation::~DecoderAudioConverterImplementation() {
   AudioFileStreamClose(_audio_file_stream);
@@ -46,164 +48,163 @@ const std::string &DecoderAudioConverterImplementation::name() {
 void DecoderAudioConverterImplementation::load(const ERROR_DECODER_CALLBACK &decoder_error_callback,
                                                const LOAD_DECODER_CALLBACK &decoder_load_callback) {
   auto strong_this = shared_from_this();
-  _load_future = std::async(
-      std::launch::async, [strong_this, decoder_error_callback, decoder_load_callback]() {
-        static const size_t maximum_header_size = 1024 * 1024;  // 1 MB
-
-        {
-          std::lock_guard<std::mutex> lock(strong_this->_audiotoolbox_mutex);
-          AudioFileStreamOpen(strong_this.get(),
-                              &DecoderAudioConverterImplementation::listenerProc,
-                              &DecoderAudioConverterImplementation::sampleProc,
-                              0,
-                              &strong_this->_audio_file_stream);
-          size_t read_bytes = 0;
-          while (read_bytes < maximum_header_size) {
-            // Read data from our provider
-            static const size_t chunk_size = 1024 * 500;  // 500 KB
-            unsigned char *buffer = (unsigned char *)malloc(chunk_size);
-            size_t chunk_read_bytes =
-                strong_this->_data_provider->read(buffer, sizeof(unsigned char), chunk_size);
-            if (chunk_read_bytes == 0) {
-              decoder_error_callback(strong_this->name(), ErrorCodeNotEnoughDataForHeader);
-              decoder_load_callback(false);
-              break;
-            }
+  _executor->execute([strong_this, decoder_error_callback, decoder_load_callback]() {
+    static const size_t maximum_header_size = 1024 * 1024;  // 1 MB
+
+    {
+      std::lock_guard<std::mutex> lock(strong_this->_audiotoolbox_mutex);
+      AudioFileStreamOpen(strong_this.get(),
+                          &DecoderAudioConverterImplementation::listenerProc,
+                          &DecoderAudioConverterImplementation::sampleProc,
+                          0,
+                          &strong_this->_audio_file_stream);
+      size_t read_bytes = 0;
+      while (read_bytes < maximum_header_size) {
+        // Read data from our provider
+        static const size_t chunk_size = 1024 * 500;  // 500 KB
+        unsigned char *buffer = (unsigned char *)malloc(chunk_size);
+        size_t chunk_read_bytes =
+            strong_this->_data_provider->read(buffer, sizeof(unsigned char), chunk_size);
+        if (chunk_read_bytes == 0) {
+          decoder_error_callback(strong_this->name(), ErrorCodeNotEnoughDataForHeader);
+          decoder_load_callback(false);
+          break;
+        }
 
-            // Parse the bytes we've got into the streamer
-            OSStatus status = AudioFileStreamParseBytes(strong_this->_audio_file_stream,
-                                                        chunk_read_bytes,
-                                                        buffer,
-                                                        (AudioFileStreamParseFlags)0);
-            if (status > 0) {
+        // Parse the bytes we've got into the streamer
+        OSStatus status = AudioFileStreamParseBytes(strong_this->_audio_file_stream,
+                                                    chunk_read_bytes,
+                                                    buffer,
+                                                    (AudioFileStreamParseFlags)0);
+        if (status > 0) {
+          decoder_error_callback(strong_this->name(), status);
+          decoder_load_callback(false);
+          return;
+        }
+        free(buffer);
+
+        // Check if we are ready to product packets
+        UInt32 readyToProducePackets = 0;
+        UInt32 readyToProducePacketsSize = sizeof(readyToProducePackets);
+        AudioFileStreamGetProperty(strong_this->_audio_file_stream,
+                                   kAudioFileStreamProperty_ReadyToProducePackets,
+                                   &readyToProducePacketsSize,
+                                   &readyToProducePackets);
+        if (readyToProducePackets != 0) {
+          // Setup the audio converter
+          AudioStreamBasicDescription input_format;
+          UInt32 descriptionSize = sizeof(input_format);
+          OSStatus status = AudioFileStreamGetProperty(strong_this->_audio_file_stream,
+                                                       kAudioFileStreamProperty_DataFormat,
+                                                       &descriptionSize,
+                                                       &input_format);
+          if (status > 0) {
+            decoder_error_callback(strong_this->name(), status);
+            decoder_load_callback(false);
+            return;
+          }
+
+          UInt32 audioPacketCount = 0;
+          UInt32 audioPacketCountSize = sizeof(audioPacketCount);
+          status = AudioFileStreamGetProperty(strong_this->_audio_file_stream,
+                                              kAudioFileStreamProperty_AudioDataPacketCount,
+                                              &audioPacketCountSize,
+                                              &audioPacketCount);
+          if (status > 0) {
+            if (status != kAudioFileStreamError_ValueUnknown) {
               decoder_error_callback(strong_this->name(), status);
               decoder_load_callback(false);
               return;
-            }
-            free(buffer);
-
-            // Check if we are ready to product packets
-            UInt32 readyToProducePackets = 0;
-            UInt32 readyToProducePacketsSize = sizeof(readyToProducePackets);
-            AudioFileStreamGetProperty(strong_this->_audio_file_stream,
-                                       kAudioFileStreamProperty_ReadyToProducePackets,
-                                       &readyToProducePacketsSize,
-                                       &readyToProducePackets);
-            if (readyToProducePackets != 0) {
-              // Setup the audio converter
-              AudioStreamBasicDescription input_format;
-              UInt32 descriptionSize = sizeof(input_format);
-              OSStatus status = AudioFileStreamGetProperty(strong_this->_audio_file_stream,
-                                                           kAudioFileStreamProperty_DataFormat,
-                                                           &descriptionSize,
-                                                           &input_format);
-              if (status > 0) {
-                decoder_error_callback(strong_this->name(), status);
-                decoder_load_callback(false);
-                return;
-              }
-
-              UInt32 audioPacketCount = 0;
-              UInt32 audioPacketCountSize = sizeof(audioPacketCount);
-              status = AudioFileStreamGetProperty(strong_this->_audio_file_stream,
-                                                  kAudioFileStreamProperty_AudioDataPacketCount,
-                                                  &audioPacketCountSize,
-                                                  &audioPacketCount);
-              if (status > 0) {
-                if (status != kAudioFileStreamError_ValueUnknown) {
-                  decoder_error_callback(strong_this->name(), status);
-                  decoder_load_callback(false);
-                  return;
-                } else {
-                  // Okej... let's estimate duration
-                  UInt32 average_bytes_per_packet = 0;
-                  UInt32 average_bytes_per_packet_size = sizeof(average_bytes_per_packet);
-                  status =
-                      AudioFileStreamGetProperty(strong_this->_audio_file_stream,
-                                                 kAudioFileStreamProperty_AverageBytesPerPacket,
-                                                 &average_bytes_per_packet_size,
-                                                 &average_bytes_per_packet);
-                  if (average_bytes_per_packet == 0) {
-                    // You know Apple you are fucking amazing, I'll do this myself
-                    // how 'bout that?
-                    SInt64 cumulated_offset = 0;
-                    SInt64 average_packet_count = 50;
-                    SInt64 last_byte_offset = 0;
-                    for (SInt64 i = 0; i < average_packet_count; ++i) {
-                      SInt64 byte_offset = 0;
-                      UInt32 io_flags = 0;
-                      status = AudioFileStreamSeek(
-                          strong_this->_audio_file_stream, i, &byte_offset, &io_flags);
-                      if (status != noErr) {
-                        decoder_error_callback(strong_this->name(), status);
-                        decoder_load_callback(false);
-                        return;
-                      }
-                      cumulated_offset += byte_offset - last_byte_offset;
-                      last_byte_offset = byte_offset;
-                    }
-                    average_bytes_per_packet = cumulated_offset / average_packet_count;
-                    SInt64 byte_offset = 0;
-                    UInt32 io_flags = 0;
-                    status = AudioFileStreamSeek(
-                        strong_this->_audio_file_stream, 0, &byte_offset, &io_flags);
+            } else {
+              // Okej... let's estimate duration
+              UInt32 average_bytes_per_packet = 0;
+              UInt32 average_bytes_per_packet_size = sizeof(average_bytes_per_packet);
+              status =
+                  AudioFileStreamGetProperty(strong_this->_audio_file_stream,
+                                             kAudioFileStreamProperty_AverageBytesPerPacket,
+                                             &average_bytes_per_packet_size,
+                                             &average_bytes_per_packet);
+              if (average_bytes_per_packet == 0) {
+                // You know Apple you are fucking amazing, I'll do this myself
+                // how 'bout that?
+                SInt64 cumulated_offset = 0;
+                SInt64 average_packet_count = 50;
+                SInt64 last_byte_offset = 0;
+                for (SInt64 i = 0; i < average_packet_count; ++i) {
+                  SInt64 byte_offset = 0;
+                  UInt32 io_flags = 0;
+                  status = AudioFileStreamSeek(
+                      strong_this->_audio_file_stream, i, &byte_offset, &io_flags);
+                  if (status != noErr) {
+                    decoder_error_callback(strong_this->name(), status);
+                    decoder_load_callback(false);
+                    return;
                   }
-                  strong_this->_frames =
-                      input_format.mFramesPerPacket *
-                      (strong_this->_data_provider->size() / average_bytes_per_packet);
+                  cumulated_offset += byte_offset - last_byte_offset;
+                  last_byte_offset = byte_offset;
                 }
-              } else {
-                strong_this->_frames = input_format.mFramesPerPacket * audioPacketCount;
-              }
-              strong_this->_data_provider->seek(0, SEEK_SET);
-
-              strong_this->_channels = input_format.mChannelsPerFrame;
-              strong_this->_samplerate = input_format.mSampleRate;
-
-              strong_this->_output_format.mSampleRate = input_format.mSampleRate;
-              strong_this->_output_format.mFormatID = kAudioFormatLinearPCM;
-              strong_this->_output_format.mFormatFlags =
-                  kAudioFormatFlagsNativeFloatPacked | kAudioFormatFlagIsPacked;
-              strong_this->_output_format.mChannelsPerFrame = input_format.mChannelsPerFrame;
-              strong_this->_output_format.mBytesPerFrame =
-                  sizeof(float) * strong_this->_output_format.mChannelsPerFrame;
-              strong_this->_output_format.mFramesPerPacket = 1;
-              strong_this->_output_format.mBytesPerPacket =
-                  strong_this->_output_format.mBytesPerFrame *
-                  strong_this->_output_format.mFramesPerPacket;
-              strong_this->_output_format.mBitsPerChannel = sizeof(float) * 8;
-
-              status = AudioConverterNew(
-                  &input_format, &strong_this->_output_format, &strong_this->_audio_converter);
-              if (status > 0) {
-                decoder_error_callback(strong_this->name(), status);
-                decoder_load_callback(false);
-                return;
+                average_bytes_per_packet = cumulated_offset / average_packet_count;
+                SInt64 byte_offset = 0;
+                UInt32 io_flags = 0;
+                status = AudioFileStreamSeek(
+                    strong_this->_audio_file_stream, 0, &byte_offset, &io_flags);
               }
-
-              // AAC encoders on Apple add 1024 junk frames to beginning of a decode
-              // Except if we are under the transmuxers influence (memory data
-              // provider)
-              if (input_format.mFormatID == kAudioFormatMPEG4AAC &&
-                  strong_this->_data_provider->name() != DATA_PROVIDER_MEMORY_NAME) {
-                strong_this->_start_junk_frames = 1024;
-              }
-              if (strong_this->_frames > 0) {
-                strong_this->_frames -= strong_this->_start_junk_frames;
-              }
-              strong_this->_audio_converter_setup_complete = true;
-
-              break;
+              strong_this->_frames =
+                  input_format.mFramesPerPacket *
+                  (strong_this->_data_provider->size() / average_bytes_per_packet);
             }
+          } else {
+            strong_this->_frames = input_format.mFramesPerPacket * audioPacketCount;
+          }
+          strong_this->_data_provider->seek(0, SEEK_SET);
+
+          strong_this->_channels = input_format.mChannelsPerFrame;
+          strong_this->_samplerate = input_format.mSampleRate;
+
+          strong_this->_output_format.mSampleRate = input_format.mSampleRate;
+          strong_this->_output_format.mFormatID = kAudioFormatLinearPCM;
+          strong_this->_output_format.mFormatFlags =
+              kAudioFormatFlagsNativeFloatPacked | kAudioFormatFlagIsPacked;
+          strong_this->_output_format.mChannelsPerFrame = input_format.mChannelsPerFrame;
+          strong_this->_output_format.mBytesPerFrame =
+              sizeof(float) * strong_this->_output_format.mChannelsPerFrame;
+          strong_this->_output_format.mFramesPerPacket = 1;
+          strong_this->_output_format.mBytesPerPacket =
+              strong_this->_output_format.mBytesPerFrame *
+              strong_this->_output_format.mFramesPerPacket;
+          strong_this->_output_format.mBitsPerChannel = sizeof(float) * 8;
+
+          status = AudioConverterNew(
+              &input_format, &strong_this->_output_format, &strong_this->_audio_converter);
+          if (status > 0) {
+            decoder_error_callback(strong_this->name(), status);
+            decoder_load_callback(false);
+            return;
+          }
 
-            read_bytes += chunk_read_bytes;
+          // AAC encoders on Apple add 1024 junk frames to beginning of a decode
+          // Except if we are under the transmuxers influence (memory data
+          // provider)
+          if (input_format.mFormatID == kAudioFormatMPEG4AAC &&
+              strong_this->_data_provider->name() != DATA_PROVIDER_MEMORY_NAME) {
+            strong_this->_start_junk_frames = 1024;
+          }
+          if (strong_this->_frames > 0) {
+            strong_this->_frames -= strong_this->_start_junk_frames;
           }
+          strong_this->_audio_converter_setup_complete = true;
+
+          break;
         }
 
-        strong_this->seek(0);
-        strong_this->_pcm_buffer.clear();
-        decoder_load_callback(true);
-      });
+        read_bytes += chunk_read_bytes;
+      }
+    }
+
+    strong_this->seek(0);
+    strong_this->_pcm_buffer.clear();
+    decoder_load_callback(true);
+  });
 }
 
 double DecoderAudioConverterImplementation::sampleRate() {
@@ -290,19 +291,13 @@ void DecoderAudioConverterImplementation::decode(long frames,
           auto delete_frames = std::min(
               strong_this->_start_junk_frames - current_frame_index,
               static_cast<long>(strong_this->_pcm_buffer.size() / strong_this->channels()));
-          strong_this->_pcm_buffer.erase(
-              strong_this->_pcm_buffer.begin(),
-              strong_this->_pcm_buffer.begin() + (delete_frames * strong_this->channels()));
+          strong_this->_pcm_buffer.consume(delete_frames * strong_this->channels());
           frames_to_read -= delete_frames;
         }
         long pcm_samples = strong_this->_pcm_buffer.size();
         if (frames_to_read > 0 && pcm_samples > 0) {
           long samples_to_read = std::min((long)pcm_samples, frames_to_read * channels);
-          memcpy(&samples[read_frames * channels],
-                 &strong_this->_pcm_buffer[0],
-                 samples_to_read * sizeof(float));
-          strong_this->_pcm_buffer.erase(strong_this->_pcm_buffer.begin(),
-                                         strong_this->_pcm_buffer.begin() + samples_to_read);
+          strong_this->_pcm_buffer.read(&samples[read_frames * channels], samples_to_read);
           read_frames += samples_to_read / channels;
         }
       };
@@ -311,9 +306,7 @@ void DecoderAudioConverterImplementation::decode(long frames,
           long maximum_erase =
               std::min(static_cast<long>(strong_this->_pcm_buffer.size() / channels),
                        strong_this->_frame_offset);
-          strong_this->_pcm_buffer.erase(
-              strong_this->_pcm_buffer.begin(),
-              strong_this->_pcm_buffer.begin() + (maximum_erase * channels));
+          strong_this->_pcm_buffer.consume(maximum_erase * channels);
           strong_this->_frame_offset -= maximum_erase;
           if (strong_this->_frame_offset > 0) {
             if (fill_data() != noErr) {
@@ -339,7 +332,7 @@ void DecoderAudioConverterImplementation::decode(long frames,
   if (synchronous) {
     run_thread();
   } else {
-    std::thread(run_thread).detach();
+    _executor->execute(run_thread);
   }
 }
 
@@ -411,8 +404,7 @@ void DecoderAudioConverterImplementation::sampleProc(
         number_frames_produced_in_buffer * decoder->_output_format.mBytesPerFrame;
     float *output_data = (float *)output_buffer_list.mBuffers[0].mData;
     UInt32 output_samples = output_data_bytes / sizeof(float);
-    decoder->_pcm_buffer.insert(
-        decoder->_pcm_buffer.end(), output_data, output_data + output_samples);
+    decoder->_pcm_buffer.write(output_data, output_samples);
   }
 
   free(output_buffer);
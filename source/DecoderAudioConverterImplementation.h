@@ -25,15 +25,17 @@
 #if __APPLE__
 
 #include <atomic>
-#include <future>
 #include <mutex>
 #include <vector>
 
 #include <NFDecoder/DataProvider.h>
+#include <NFDecoder/Executor.h>
 #include <NFDecoder/Factory.h>
 
 #import <AudioToolbox/AudioToolbox.h>
 
+#include "PCMBuffer.h"
+
 namespace nativeformat {
 namespace decoder {
 
@@ -43,7 +45,8 @@ class DecoderAudioConverterImplementation
  public:
   typedef enum : int { ErrorCodeNotEnoughDataForHeader, ErrorCodeCouldNotDecodeHeader } ErrorCode;
 
-  DecoderAudioConverterImplementation(std::shared_ptr<DataProvider> &data_provider);
+  DecoderAudioConverterImplementation(std::shared_ptr<DataProvider> &data_provider,
+                                      const std::shared_ptr<Executor> &executor);
   virtual ~DecoderAudioConverterImplementation();
 
   // Decoder
@@ -77,8 +80,8 @@ class DecoderAudioConverterImplementation
                                 void *inUserData);
 
   std::shared_ptr<DataProvider> _data_provider;
+  const std::shared_ptr<Executor> _executor;
 
-  std::future<void> _load_future;
   AudioFileStreamID _audio_file_stream;
   std::atomic<bool> _audio_converter_setup_complete;
   AudioConverterRef _audio_converter;
@@ -92,7 +95,7 @@ class DecoderAudioConverterImplementation
   std::mutex _audiotoolbox_mutex;
   std::atomic<long> _frames;
   long _frame_offset;
-  std::vector<float> _pcm_buffer;
+  PCMBuffer _pcm_buffer;
   long _start_junk_frames;
 };
 
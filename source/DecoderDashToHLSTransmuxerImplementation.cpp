@@ -22,8 +22,6 @@
 
 #if INCLUDE_UDT
 
-#include <thread>
-
 #include "DecoderAVCodecImplementation.h"
 
 namespace nativeformat {
@@ -37,13 +35,15 @@ DecoderDashToHLSTransmuxerImplementation::DecoderDashToHLSTransmuxerImplementati
     const std::string &path,
     const std::shared_ptr<Factory> &factory,
     const std::shared_ptr<Manifest> &manifest,
-    const std::shared_ptr<Decrypter> &decrypter)
+    const std::shared_ptr<Decrypter> &decrypter,
+    const std::shared_ptr<Executor> &executor)
     : _id(_next++),
       _data_provider(data_provider),
       _data_provider_factory(data_provider_factory),
       _factory(factory),
       _manifest(manifest),
       _decrypter(decrypter),
+      _executor(executor),
       _data_provider_memory(std::make_shared<DataProviderMemoryImplementation>(path)),
       _session(nullptr),
       _index(nullptr),
@@ -130,15 +130,15 @@ void DecoderDashToHLSTransmuxerImplementation::exhaustDecoder(
       static_cast<double>(segment.duration) * (1.0 / static_cast<double>(segment.timescale));
   long frames = time * sampleRate();
   auto strong_this = shared_from_this();
+  // Decode inline, this already runs on an executor task that waits for the result
   _decoder->decode(frames,
                    [strong_this, exhaust_callback, frames, segment_index](
                        long frame_index, long frame_count, float *samples) {
-                     strong_this->_samples.insert(
-                         strong_this->_samples.end(),
-                         samples,
-                         samples + (frame_count * strong_this->channels()));
+                     strong_this->_samples.write(samples,
+                                                 frame_count * strong_this->channels());
                      exhaust_callback();
-                   });
+                   },
+                   true);
 }
 
 double DecoderDashToHLSTransmuxerImplementation::sampleRate() {
@@ -165,7 +165,7 @@ void DecoderDashToHLSTransmuxerImplementation::seek(long frame_index) {
     // Do we have enough samples in our buffer to support this new frame index?
     long sample_diff = frame_diff * channels();
     if (sample_diff < _samples.size()) {
-      _samples.erase(_samples.begin(), _samples.begin() + sample_diff);
+      _samples.consume(sample_diff);
       return;
     }
   } else if (previous_frame_index == safe_frame_index) {
@@ -250,16 +250,14 @@ void DecoderDashToHLSTransmuxerImplementation::decode(long frames,
             std::min(strong_this->_start_junk_frames - current_frame_index,
                      static_cast<long>(strong_this->_samples.size() / strong_this->channels()));
         auto samples_to_remove = frames_to_remove * strong_this->channels();
-        strong_this->_samples.erase(strong_this->_samples.begin(),
-                                    strong_this->_samples.begin() + samples_to_remove);
+        strong_this->_samples.consume(samples_to_remove);
       }
 
       // Clip to the nearest segment
       if (current_frames == 0 && current_frame_index > start_time_frame_index) {
         auto frames_to_skip = static_cast<long>(current_frame_index - start_time_frame_index);
         auto samples_to_skip = frames_to_skip * strong_this->channels();
-        strong_this->_samples.erase(strong_this->_samples.begin(),
-                                    strong_this->_samples.begin() + samples_to_skip);
+        strong_this->_samples.consume(samples_to_skip);
       }
 
       if (error) {
@@ -273,15 +271,13 @@ void DecoderDashToHLSTransmuxerImplementation::decode(long frames,
     long output_frames = std::min(
         possible_frames, static_cast<long>(strong_this->_samples.size() / strong_this->channels()));
     strong_this->_frame_index = frame_index + output_frames;
-    decode_callback(frame_index, output_frames, &strong_this->_samples[0]);
-    strong_this->_samples.erase(
-        strong_this->_samples.begin(),
-        strong_this->_samples.begin() + (output_frames * strong_this->channels()));
+    decode_callback(frame_index, output_frames, strong_this->_samples.data());
+    strong_this->_samples.consume(output_frames * strong_this->channels());
   };
   if (synchronous) {
     run_thread();
   } else {
-    std::thread(run_thread).detach();
+    _executor->execute(run_thread);
   }
 }
 
@@ -297,7 +293,7 @@ void DecoderDashToHLSTransmuxerImplementation::load(
     const ERROR_DECODER_CALLBACK &decoder_error_callback,
     const LOAD_DECODER_CALLBACK &decoder_load_callback) {
   auto strong_this = shared_from_this();
-  std::thread([strong_this, decoder_error_callback, decoder_load_callback] {
+  _executor->execute([strong_this, decoder_error_callback, decoder_load_callback] {
     // Load the seek table
     std::vector<int> index_range = {0, 500 * 1024};
     if (strong_this->_manifest) {
@@ -358,7 +354,7 @@ void DecoderDashToHLSTransmuxerImplementation::load(
           }
         },
         decoder_error_callback);
-  }).detach();
+  });
 }
 
 void DecoderDashToHLSTransmuxerImplementation::flush() {
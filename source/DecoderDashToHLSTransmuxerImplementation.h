@@ -31,12 +31,14 @@
 #include <NFDecoder/DataProvider.h>
 #include <NFDecoder/DataProviderFactory.h>
 #include <NFDecoder/Decrypter.h>
+#include <NFDecoder/Executor.h>
 #include <NFDecoder/Factory.h>
 #include <NFDecoder/Manifest.h>
 
 #include <DashToHlsApi.h>
 
 #include "DataProviderMemoryImplementation.h"
+#include "PCMBuffer.h"
 
 namespace nativeformat {
 namespace decoder {
@@ -53,7 +55,8 @@ class DecoderDashToHLSTransmuxerImplementation
       const std::string &path,
       const std::shared_ptr<Factory> &factory,
       const std::shared_ptr<Manifest> &manifest,
-      const std::shared_ptr<Decrypter> &decrypter);
+      const std::shared_ptr<Decrypter> &decrypter,
+      const std::shared_ptr<Executor> &executor);
   virtual ~DecoderDashToHLSTransmuxerImplementation();
 
   // Decoder
@@ -86,6 +89,7 @@ class DecoderDashToHLSTransmuxerImplementation
   const std::shared_ptr<Factory> _factory;
   const std::shared_ptr<Manifest> _manifest;
   const std::shared_ptr<Decrypter> _decrypter;
+  const std::shared_ptr<Executor> _executor;
 
   const std::shared_ptr<DataProviderMemoryImplementation> _data_provider_memory;
 
@@ -93,7 +97,7 @@ class DecoderDashToHLSTransmuxerImplementation
   DashToHlsIndex *_index;
   std::shared_ptr<Decoder> _decoder;
   std::atomic<long> _frame_index;
-  std::vector<float> _samples;
+  PCMBuffer _samples;
   std::mutex _decoding_mutex;
   long _start_junk_frames;
 };
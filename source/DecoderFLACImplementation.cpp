@@ -20,19 +20,58 @@
  */
 #include "DecoderFLACImplementation.h"
 
+#include <algorithm>
+#include <cmath>
 #include <cstdlib>
-#include <future>
+#include <cstring>
+
+#include "PCMKernels.h"
 
 namespace nativeformat {
 namespace decoder {
 
-DecoderFLACImplementation::DecoderFLACImplementation(std::shared_ptr<DataProvider> &data_provider)
+// About a third of a second at 44.1kHz, a few FLAC frames to decode past after an indexed seek
+static const long FLAC_SEEK_INDEX_INTERVAL_FRAMES = 16384;
+// Targets further than this past the closest indexed frame are left to libFLAC's own search
+static const long FLAC_SEEK_INDEX_MAX_DECODE_FRAMES = FLAC_SEEK_INDEX_INTERVAL_FRAMES * 8;
+
+static const unsigned char FLAC_STREAM_MARKER[] = {'f', 'L', 'a', 'C'};
+static const long FLAC_METADATA_MAX_LENGTH = (1 << 24) - 1;
+static const unsigned char FLAC_METADATA_LAST_BLOCK = 0x80;
+
+static inline bool isSupportedBitDepth(int bits_per_sample) {
+  return bits_per_sample >= static_cast<int>(FLAC__MIN_BITS_PER_SAMPLE) &&
+         bits_per_sample <= static_cast<int>(FLAC__MAX_BITS_PER_SAMPLE);
+}
+
+static void appendBigEndian(std::vector<unsigned char> &bytes, uint64_t value, int byte_count) {
+  for (int i = byte_count - 1; i >= 0; --i) {
+    bytes.push_back(static_cast<unsigned char>(value >> (i * 8)));
+  }
+}
+
+static inline uint32_t metadataBlockHeader(FLAC__MetadataType type, long length, bool last) {
+  return (static_cast<uint32_t>((last ? FLAC_METADATA_LAST_BLOCK : 0) | type) << 24) |
+         static_cast<uint32_t>(length);
+}
+
+DecoderFLACImplementation::DecoderFLACImplementation(
+    std::shared_ptr<DataProvider> &data_provider, const std::shared_ptr<Executor> &executor)
     : _data_provider(data_provider),
+      _executor(executor),
       _flac_decoder(nullptr),
       _channels(0),
       _samplerate(0.0),
       _frame_index(0),
-      _frames(0) {}
+      _frames(0),
+      _bits_per_sample(0),
+      _seek_index(FLAC_SEEK_INDEX_INTERVAL_FRAMES),
+      _has_seek_table(false),
+      _indexing(false),
+      _next_frame_sample(0),
+      _discard_until_sample(0),
+      _stream_info(),
+      _metadata_prefix_bytes(0) {}
 
 DecoderFLACImplementation::~DecoderFLACImplementation() {
   if (_flac_decoder != nullptr) {
@@ -50,18 +89,7 @@ void DecoderFLACImplementation::load(const ERROR_DECODER_CALLBACK &decoder_error
   FLAC__StreamDecoderInitStatus init_status = FLAC__STREAM_DECODER_INIT_STATUS_OK;
   {
     std::lock_guard<std::mutex> flac_decoder_lock(_flac_decoder_mutex);
-    _flac_decoder = FLAC__stream_decoder_new();
-    FLAC__stream_decoder_set_md5_checking(_flac_decoder, true);
-    init_status = FLAC__stream_decoder_init_stream(_flac_decoder,
-                                                   &DecoderFLACImplementation::flac_read,
-                                                   &DecoderFLACImplementation::flac_seek,
-                                                   &DecoderFLACImplementation::flac_tell,
-                                                   &DecoderFLACImplementation::flac_length,
-                                                   &DecoderFLACImplementation::flac_eof,
-                                                   &DecoderFLACImplementation::flac_write,
-                                                   &DecoderFLACImplementation::flac_metadata,
-                                                   &DecoderFLACImplementation::flac_error,
-                                                   this);
+    init_status = initStream();
   }
 
   if (init_status != FLAC__STREAM_DECODER_INIT_STATUS_OK) {
@@ -71,25 +99,180 @@ void DecoderFLACImplementation::load(const ERROR_DECODER_CALLBACK &decoder_error
   }
 
   auto strong_this = shared_from_this();
-  _load_future = std::async(
-      std::launch::async, [strong_this, decoder_error_callback, decoder_load_callback]() {
-        FLAC__bool success = false;
-        {
-          std::lock_guard<std::mutex> flac_decoder_lock(strong_this->_flac_decoder_mutex);
-          success = FLAC__stream_decoder_process_until_end_of_metadata(strong_this->_flac_decoder);
-        }
-        if (!success) {
-          FLAC__StreamDecoderState error_code = FLAC__STREAM_DECODER_SEARCH_FOR_METADATA;
-          {
-            std::lock_guard<std::mutex> flac_decoder_lock(strong_this->_flac_decoder_mutex);
-            error_code = FLAC__stream_decoder_get_state(strong_this->_flac_decoder);
-          }
-          decoder_error_callback(strong_this->name(), error_code);
-          decoder_load_callback(false);
-          return;
+  _executor->execute([strong_this, decoder_error_callback, decoder_load_callback]() {
+    FLAC__bool success = false;
+    bool cached = false;
+    {
+      std::lock_guard<std::mutex> flac_decoder_lock(strong_this->_flac_decoder_mutex);
+      strong_this->_stream_info_key = streamInfoKey("flac", *strong_this->_data_provider);
+      StreamInfo stream_info;
+      cached = findStreamInfo(strong_this->_stream_info_key, stream_info) &&
+               strong_this->prepareMetadataPrefix(stream_info);
+      success = FLAC__stream_decoder_process_until_end_of_metadata(strong_this->_flac_decoder);
+    }
+    if (!success) {
+      FLAC__StreamDecoderState error_code = FLAC__STREAM_DECODER_SEARCH_FOR_METADATA;
+      {
+        std::lock_guard<std::mutex> flac_decoder_lock(strong_this->_flac_decoder_mutex);
+        error_code = FLAC__stream_decoder_get_state(strong_this->_flac_decoder);
+      }
+      decoder_error_callback(strong_this->name(), error_code);
+      decoder_load_callback(false);
+      return;
+    }
+    // No STREAMINFO, or a bit depth FLAC does not allow
+    if (!isSupportedBitDepth(strong_this->_bits_per_sample)) {
+      decoder_error_callback(strong_this->name(), ErrorCodeUnsupportedBitDepth);
+      decoder_load_callback(false);
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> flac_decoder_lock(strong_this->_flac_decoder_mutex);
+      StreamInfo &stream_info = strong_this->_stream_info;
+      FLAC__uint64 first_frame_offset = 0;
+      bool has_first_frame_offset = FLAC__stream_decoder_get_decode_position(
+          strong_this->_flac_decoder, &first_frame_offset);
+      if (!cached && has_first_frame_offset &&
+          stream_info.codec_private.size() <= first_frame_offset) {
+        stream_info.samplerate = strong_this->_samplerate;
+        stream_info.channels = strong_this->_channels;
+        stream_info.frames = strong_this->_frames;
+        stream_info.data_offset = first_frame_offset;
+        stream_info.data_bytes = strong_this->_data_provider->size() - first_frame_offset;
+        stream_info.seek_interval_frames = 0;
+        stream_info.seek_points.clear();
+        storeStreamInfo(strong_this->_stream_info_key, stream_info);
+      }
+      if (!strong_this->_has_seek_table) {
+        if (!stream_info.seek_points.empty()) {
+          strong_this->_seek_index.assign(stream_info.seek_points, strong_this->_frames);
+        } else if (!strong_this->_seek_index.loadSidecar(
+                       strong_this->path(),
+                       strong_this->_data_provider->size(),
+                       strong_this->_data_provider->revision()) &&
+                   has_first_frame_offset) {
+          strong_this->_seek_index.add(0, first_frame_offset);
+          strong_this->_indexing = true;
         }
-        decoder_load_callback(true);
-      });
+      }
+    }
+    decoder_load_callback(true);
+  });
+}
+
+FLAC__StreamDecoderInitStatus DecoderFLACImplementation::initStream() {
+  _flac_decoder = FLAC__stream_decoder_new();
+  // The MD5 is only checked once the whole stream has been decoded without seeking, which is
+  // rarely how we play, so skip hashing every sample
+  FLAC__stream_decoder_set_md5_checking(_flac_decoder, false);
+  FLAC__stream_decoder_set_metadata_respond(_flac_decoder, FLAC__METADATA_TYPE_SEEKTABLE);
+  return FLAC__stream_decoder_init_stream(_flac_decoder,
+                                          &DecoderFLACImplementation::flac_read,
+                                          &DecoderFLACImplementation::flac_seek,
+                                          &DecoderFLACImplementation::flac_tell,
+                                          &DecoderFLACImplementation::flac_length,
+                                          &DecoderFLACImplementation::flac_eof,
+                                          &DecoderFLACImplementation::flac_write,
+                                          &DecoderFLACImplementation::flac_metadata,
+                                          &DecoderFLACImplementation::flac_error,
+                                          this);
+}
+
+bool DecoderFLACImplementation::prepareMetadataPrefix(const StreamInfo &stream_info) {
+  const std::vector<unsigned char> &codec_private = stream_info.codec_private;
+  const long metadata_bytes = codec_private.size();
+  const long padding_bytes = stream_info.data_offset - metadata_bytes;
+  const long header_bytes = FLAC__STREAM_METADATA_HEADER_LENGTH;
+  // A gap smaller than a block header can't be padded, parse those streams as usual
+  if (metadata_bytes < static_cast<long>(sizeof(FLAC_STREAM_MARKER)) + header_bytes +
+                           static_cast<long>(FLAC__STREAM_METADATA_STREAMINFO_LENGTH) ||
+      memcmp(codec_private.data(), FLAC_STREAM_MARKER, sizeof(FLAC_STREAM_MARKER)) != 0 ||
+      padding_bytes < 0 || (padding_bytes > 0 && padding_bytes < header_bytes)) {
+    return false;
+  }
+  // Fill the gap the skipped blocks leave with PADDING blocks, which libFLAC skips over
+  _padding_headers.clear();
+  long offset = metadata_bytes;
+  while (offset < stream_info.data_offset) {
+    long remaining = stream_info.data_offset - offset - header_bytes;
+    long length = std::min(remaining, FLAC_METADATA_MAX_LENGTH);
+    if (remaining - length > 0 && remaining - length < header_bytes) {
+      // Leave room for the header of the block after this one
+      length -= header_bytes;
+    }
+    const bool last = length == remaining;
+    _padding_headers.emplace_back(
+        offset, metadataBlockHeader(FLAC__METADATA_TYPE_PADDING, length, last));
+    offset += header_bytes + length;
+  }
+  _metadata_prefix = codec_private;
+  if (_padding_headers.empty()) {
+    // Blocks are stored without the last block flag, find the final one and set it
+    long block_offset = sizeof(FLAC_STREAM_MARKER);
+    long last_block_offset = block_offset;
+    while (block_offset + header_bytes <= metadata_bytes) {
+      last_block_offset = block_offset;
+      block_offset += header_bytes + ((_metadata_prefix[block_offset + 1] << 16) |
+                                      (_metadata_prefix[block_offset + 2] << 8) |
+                                      _metadata_prefix[block_offset + 3]);
+    }
+    _metadata_prefix[last_block_offset] |= FLAC_METADATA_LAST_BLOCK;
+  }
+  _stream_info = stream_info;
+  _metadata_prefix_bytes = stream_info.data_offset;
+  return true;
+}
+
+void DecoderFLACImplementation::readMetadataPrefix(FLAC__byte *buffer,
+                                                   long offset,
+                                                   size_t bytes) const {
+  const long end = offset + bytes;
+  memset(buffer, 0, bytes);
+  if (offset < static_cast<long>(_metadata_prefix.size())) {
+    memcpy(buffer,
+           _metadata_prefix.data() + offset,
+           std::min(end, static_cast<long>(_metadata_prefix.size())) - offset);
+  }
+  for (const auto &padding_header : _padding_headers) {
+    for (long i = 0; i < static_cast<long>(FLAC__STREAM_METADATA_HEADER_LENGTH); ++i) {
+      long header_offset = padding_header.first + i;
+      if (header_offset >= offset && header_offset < end) {
+        buffer[header_offset - offset] =
+            static_cast<FLAC__byte>(padding_header.second >> ((3 - i) * 8));
+      }
+    }
+  }
+}
+
+std::shared_ptr<Decoder> DecoderFLACImplementation::clone() {
+  std::shared_ptr<DataProvider> data_provider = _data_provider->clone();
+  if (!data_provider) {
+    return nullptr;
+  }
+  auto decoder = std::make_shared<DecoderFLACImplementation>(data_provider, _executor);
+  {
+    // indexFrame() updates the stream info and seek index while another thread decodes
+    std::lock_guard<std::mutex> flac_decoder_lock(_flac_decoder_mutex);
+    decoder->_stream_info_key = _stream_info_key;
+    decoder->_stream_info = _stream_info;
+    decoder->_metadata_prefix = _metadata_prefix;
+    decoder->_padding_headers = _padding_headers;
+    decoder->_metadata_prefix_bytes = _metadata_prefix_bytes;
+    if (!_has_seek_table) {
+      // Start from everything indexed so far, and keep extending it from the first frame
+      decoder->_seek_index = _seek_index;
+      decoder->_indexing = !_seek_index.empty() && !_seek_index.complete();
+    }
+  }
+  std::lock_guard<std::mutex> clone_lock(decoder->_flac_decoder_mutex);
+  // libFLAC has to see the metadata before it decodes, it comes from the data the provider
+  // already holds
+  if (decoder->initStream() != FLAC__STREAM_DECODER_INIT_STATUS_OK ||
+      !FLAC__stream_decoder_process_until_end_of_metadata(decoder->_flac_decoder) ||
+      !isSupportedBitDepth(decoder->_bits_per_sample)) {
+    return nullptr;
+  }
+  return decoder;
 }
 
 double DecoderFLACImplementation::sampleRate() {
@@ -106,10 +289,26 @@ long DecoderFLACImplementation::currentFrameIndex() {
 
 void DecoderFLACImplementation::seek(long frame_index) {
   std::lock_guard<std::mutex> flac_decoder_lock(_flac_decoder_mutex);
-  std::lock_guard<std::mutex> samples_lock(_samples_mutex);
-  FLAC__stream_decoder_seek_absolute(_flac_decoder, frame_index);
-  _samples.clear();
+  {
+    // The seek writes the target frame, which takes this lock too
+    std::lock_guard<std::mutex> samples_lock(_samples_mutex);
+    _samples.clear();
+  }
   _frame_index = frame_index;
+  SeekIndex::Point point;
+  if (!_has_seek_table && _seek_index.find(frame_index, point) &&
+      frame_index - point.frame <= FLAC_SEEK_INDEX_MAX_DECODE_FRAMES) {
+    // One provider seek to the start of an indexed frame, flac_write drops what is before the
+    // target. Decoding on from an indexed frame keeps the index contiguous, so keep extending it
+    FLAC__stream_decoder_flush(_flac_decoder);
+    _data_provider->seek(point.offset, SEEK_SET);
+    _discard_until_sample = frame_index;
+    _indexing = !_seek_index.complete();
+    return;
+  }
+  _discard_until_sample = 0;
+  _indexing = false;
+  FLAC__stream_decoder_seek_absolute(_flac_decoder, frame_index);
 }
 
 long DecoderFLACImplementation::frames() {
@@ -124,34 +323,89 @@ void DecoderFLACImplementation::decode(long frames,
     std::lock_guard<std::mutex> flac_decoder_lock(strong_this->_flac_decoder_mutex);
     auto channels = strong_this->channels();
     auto frame_index = strong_this->currentFrameIndex();
-    long frame_count = 0;
+    auto read_frames = strong_this->bufferFrames(frames);
     {
       std::lock_guard<std::mutex> samples_lock(strong_this->_samples_mutex);
-      frame_count = strong_this->_samples.size() / channels;
-    }
-    while (frame_count < frames) {
-      if (!FLAC__stream_decoder_process_single(strong_this->_flac_decoder)) {
-        break;
-      }
-      {
-        std::lock_guard<std::mutex> samples_lock(strong_this->_samples_mutex);
-        frame_count = strong_this->_samples.size() / channels;
-      }
+      decode_callback(frame_index, read_frames, strong_this->_samples.data());
+      strong_this->_samples.consume(read_frames * channels);
+      strong_this->_frame_index = frame_index + read_frames;
     }
-    auto read_frames = std::min(frame_count, frames);
+  };
+  if (synchronous) {
+    run_thread();
+  } else {
+    _executor->execute(run_thread);
+  }
+}
+
+void DecoderFLACImplementation::decodeInto(float *samples,
+                                           long frames,
+                                           const DECODE_INTO_CALLBACK &decode_into_callback,
+                                           bool synchronous) {
+  auto strong_this = shared_from_this();
+  auto run_thread = [decode_into_callback, strong_this, samples, frames]() {
+    long frame_index = 0;
+    long read_frames = 0;
     {
+      std::lock_guard<std::mutex> flac_decoder_lock(strong_this->_flac_decoder_mutex);
+      auto channels = strong_this->channels();
+      frame_index = strong_this->currentFrameIndex();
+      read_frames = strong_this->bufferFrames(frames);
       std::lock_guard<std::mutex> samples_lock(strong_this->_samples_mutex);
-      decode_callback(frame_index, read_frames, &strong_this->_samples[0]);
-      auto read_samples = read_frames * channels;
-      strong_this->_samples.erase(strong_this->_samples.begin(),
-                                  strong_this->_samples.begin() + read_samples);
+      strong_this->_samples.read(samples, read_frames * channels);
       strong_this->_frame_index = frame_index + read_frames;
     }
+    decode_into_callback(frame_index, read_frames);
   };
   if (synchronous) {
     run_thread();
   } else {
-    std::thread(run_thread).detach();
+    _executor->execute(run_thread);
+  }
+}
+
+long DecoderFLACImplementation::bufferFrames(long frames) {
+  auto channels = this->channels();
+  long frame_count = 0;
+  {
+    std::lock_guard<std::mutex> samples_lock(_samples_mutex);
+    frame_count = _samples.size() / channels;
+  }
+  while (frame_count < frames) {
+    if (!FLAC__stream_decoder_process_single(_flac_decoder)) {
+      break;
+    }
+    if (_indexing) {
+      indexFrame();
+    }
+    if (FLAC__stream_decoder_get_state(_flac_decoder) == FLAC__STREAM_DECODER_END_OF_STREAM) {
+      break;
+    }
+    {
+      std::lock_guard<std::mutex> samples_lock(_samples_mutex);
+      frame_count = _samples.size() / channels;
+    }
+  }
+  return std::min(frame_count, frames);
+}
+
+void DecoderFLACImplementation::indexFrame() {
+  if (FLAC__stream_decoder_get_state(_flac_decoder) == FLAC__STREAM_DECODER_END_OF_STREAM) {
+    // Indexed from the first frame to the last, worth keeping for next time
+    _indexing = false;
+    _seek_index.finish(_next_frame_sample);
+    _seek_index.saveSidecar(path(), _data_provider->size(), _data_provider->revision());
+    if (_stream_info.data_offset > 0) {
+      _stream_info.seek_interval_frames = FLAC_SEEK_INDEX_INTERVAL_FRAMES;
+      _stream_info.seek_points = _seek_index.points();
+      storeStreamInfo(_stream_info_key, _stream_info);
+    }
+    return;
+  }
+  // After a frame is decoded the decode position is where the next one starts
+  FLAC__uint64 next_frame_offset = 0;
+  if (FLAC__stream_decoder_get_decode_position(_flac_decoder, &next_frame_offset)) {
+    _seek_index.add(_next_frame_sample, next_frame_offset);
   }
 }
 
@@ -172,6 +426,13 @@ void DecoderFLACImplementation::flush() {
 FLAC__StreamDecoderReadStatus DecoderFLACImplementation::flac_read(
     const FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes, void *client_data) {
   DecoderFLACImplementation *flac_decoder = (DecoderFLACImplementation *)client_data;
+  long offset = flac_decoder->_data_provider->tell();
+  if (offset < flac_decoder->_metadata_prefix_bytes) {
+    *bytes = std::min(*bytes, static_cast<size_t>(flac_decoder->_metadata_prefix_bytes - offset));
+    flac_decoder->readMetadataPrefix(buffer, offset, *bytes);
+    flac_decoder->_data_provider->seek(offset + *bytes, SEEK_SET);
+    return FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
+  }
   *bytes = flac_decoder->_data_provider->read(buffer, *bytes, 1);
   return flac_decoder->_data_provider->eof() ? FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM
                                              : FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
@@ -211,21 +472,40 @@ FLAC__StreamDecoderWriteStatus DecoderFLACImplementation::flac_write(
     void *client_data) {
   DecoderFLACImplementation *flac_decoder = (DecoderFLACImplementation *)client_data;
   int channels = flac_decoder->channels();
-  auto frames = frame->header.blocksize;
-  auto sample_count = frames * channels;
-  float *samples = (float *)malloc(sample_count * sizeof(float));
-  float sample_denominator = (float)std::numeric_limits<FLAC__int16>::max();
-  for (uint32_t i = 0; i < frame->header.blocksize; ++i) {
-    for (int channel = 0; channel < channels; ++channel) {
-      FLAC__int16 sample = (FLAC__int16)buffer[channel][i];
-      samples[(i * channels) + channel] = (float)sample / sample_denominator;
-    }
+  if (static_cast<int>(frame->header.channels) != channels) {
+    return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
   }
-  {
-    std::lock_guard<std::mutex> samples_lock(flac_decoder->_samples_mutex);
-    flac_decoder->_samples.insert(flac_decoder->_samples.end(), samples, samples + sample_count);
+  // libFLAC fills in the STREAMINFO bit depth for frames that defer to it
+  int bits_per_sample = frame->header.bits_per_sample;
+  if (bits_per_sample == 0) {
+    bits_per_sample = flac_decoder->_bits_per_sample;
+  }
+  if (!isSupportedBitDepth(bits_per_sample)) {
+    return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
   }
-  free(samples);
+  const long blocksize = frame->header.blocksize;
+  const long first_sample = frame->header.number_type == FLAC__FRAME_NUMBER_TYPE_SAMPLE_NUMBER
+                                ? static_cast<long>(frame->header.number.sample_number)
+                                : static_cast<long>(frame->header.number.frame_number) * blocksize;
+  flac_decoder->_next_frame_sample = first_sample + blocksize;
+  // Frames decoded after an indexed seek start before the target
+  const long skip_frames =
+      std::max(0L, std::min(blocksize, flac_decoder->_discard_until_sample - first_sample));
+  if (skip_frames == blocksize) {
+    return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+  }
+  const FLAC__int32 *channel_buffers[FLAC__MAX_CHANNELS];
+  for (int i = 0; i < channels; ++i) {
+    channel_buffers[i] = buffer[i] + skip_frames;
+  }
+  // Full scale is the largest positive sample, as it always has been for 16 bit streams
+  float scale = static_cast<float>(1.0 / (std::ldexp(1.0, bits_per_sample - 1) - 1.0));
+  auto frames = blocksize - skip_frames;
+  auto sample_count = frames * channels;
+  std::lock_guard<std::mutex> samples_lock(flac_decoder->_samples_mutex);
+  float *samples = flac_decoder->_samples.prepareWrite(sample_count);
+  pcmInterleaveInt32ToFloat(channel_buffers, samples, frames, channels, scale);
+  flac_decoder->_samples.commitWrite(sample_count);
   return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
 }
 
@@ -233,9 +513,50 @@ void DecoderFLACImplementation::flac_metadata(const FLAC__StreamDecoder *decoder
                                               const FLAC__StreamMetadata *metadata,
                                               void *client_data) {
   DecoderFLACImplementation *flac_decoder = (DecoderFLACImplementation *)client_data;
-  flac_decoder->_samplerate = metadata->data.stream_info.sample_rate;
-  flac_decoder->_channels = metadata->data.stream_info.channels;
-  flac_decoder->_frames = metadata->data.stream_info.total_samples;
+  // Keep the blocks we read as they were in the stream, a cached load replays them
+  std::vector<unsigned char> &codec_private = flac_decoder->_stream_info.codec_private;
+  if (metadata->type == FLAC__METADATA_TYPE_SEEKTABLE) {
+    const FLAC__StreamMetadata_SeekTable &seek_table = metadata->data.seek_table;
+    flac_decoder->_has_seek_table = seek_table.num_points > 0;
+    appendBigEndian(codec_private,
+                    metadataBlockHeader(FLAC__METADATA_TYPE_SEEKTABLE,
+                                        seek_table.num_points *
+                                            FLAC__STREAM_METADATA_SEEKPOINT_LENGTH,
+                                        false),
+                    FLAC__STREAM_METADATA_HEADER_LENGTH);
+    for (uint32_t i = 0; i < seek_table.num_points; ++i) {
+      appendBigEndian(codec_private, seek_table.points[i].sample_number, 8);
+      appendBigEndian(codec_private, seek_table.points[i].stream_offset, 8);
+      appendBigEndian(codec_private, seek_table.points[i].frame_samples, 2);
+    }
+    return;
+  }
+  if (metadata->type != FLAC__METADATA_TYPE_STREAMINFO) {
+    return;
+  }
+  const FLAC__StreamMetadata_StreamInfo &stream_info = metadata->data.stream_info;
+  flac_decoder->_samplerate = stream_info.sample_rate;
+  flac_decoder->_channels = stream_info.channels;
+  flac_decoder->_frames = stream_info.total_samples;
+  flac_decoder->_bits_per_sample = stream_info.bits_per_sample;
+  codec_private.assign(FLAC_STREAM_MARKER, FLAC_STREAM_MARKER + sizeof(FLAC_STREAM_MARKER));
+  appendBigEndian(codec_private,
+                  metadataBlockHeader(FLAC__METADATA_TYPE_STREAMINFO,
+                                      FLAC__STREAM_METADATA_STREAMINFO_LENGTH,
+                                      false),
+                  FLAC__STREAM_METADATA_HEADER_LENGTH);
+  appendBigEndian(codec_private, stream_info.min_blocksize, 2);
+  appendBigEndian(codec_private, stream_info.max_blocksize, 2);
+  appendBigEndian(codec_private, stream_info.min_framesize, 3);
+  appendBigEndian(codec_private, stream_info.max_framesize, 3);
+  appendBigEndian(codec_private,
+                  (static_cast<uint64_t>(stream_info.sample_rate) << 44) |
+                      (static_cast<uint64_t>(stream_info.channels - 1) << 41) |
+                      (static_cast<uint64_t>(stream_info.bits_per_sample - 1) << 36) |
+                      (stream_info.total_samples & 0xFFFFFFFFFULL),
+                  8);
+  codec_private.insert(
+      codec_private.end(), stream_info.md5sum, stream_info.md5sum + sizeof(stream_info.md5sum));
 }
 
 void DecoderFLACImplementation::flac_error(const FLAC__StreamDecoder *decoder,
@@ -23,15 +23,19 @@
 #include <NFDecoder/Decoder.h>
 
 #include <atomic>
-#include <future>
 #include <mutex>
 #include <vector>
 
 #include <NFDecoder/DataProvider.h>
+#include <NFDecoder/Executor.h>
 #include <NFDecoder/Factory.h>
 
 #include <FLAC/all.h>
 
+#include "PCMBuffer.h"
+#include "SeekIndex.h"
+#include "StreamInfoCache.h"
+
 namespace nativeformat {
 namespace decoder {
 
@@ -40,9 +44,14 @@ typedef std::function<void(bool success)> LOAD_DECODER_CALLBACK;
 class DecoderFLACImplementation : public Decoder,
                                   public std::enable_shared_from_this<DecoderFLACImplementation> {
  public:
-  typedef enum : int { ErrorCodeNotEnoughData, ErrorCodeCouldNotDecode } ErrorCode;
+  typedef enum : int {
+    ErrorCodeNotEnoughData,
+    ErrorCodeCouldNotDecode,
+    ErrorCodeUnsupportedBitDepth
+  } ErrorCode;
 
-  DecoderFLACImplementation(std::shared_ptr<DataProvider> &data_provider);
+  DecoderFLACImplementation(std::shared_ptr<DataProvider> &data_provider,
+                            const std::shared_ptr<Executor> &executor);
   virtual ~DecoderFLACImplementation();
 
   // Decoder
@@ -52,12 +61,17 @@ class DecoderFLACImplementation : public Decoder,
   virtual void seek(long frame_index);
   virtual long frames();
   virtual void decode(long frames, const DECODE_CALLBACK &decode_callback, bool synchronous);
+  virtual void decodeInto(float *samples,
+                          long frames,
+                          const DECODE_INTO_CALLBACK &decode_into_callback,
+                          bool synchronous);
   virtual bool eof();
   virtual const std::string &path();
   virtual const std::string &name();
   virtual void flush();
   virtual void load(const ERROR_DECODER_CALLBACK &decoder_error_callback,
                     const LOAD_DECODER_CALLBACK &decoder_load_callback);
+  virtual std::shared_ptr<Decoder> clone();
 
  private:
   static FLAC__StreamDecoderReadStatus flac_read(const FLAC__StreamDecoder *decoder,
@@ -85,17 +99,38 @@ class DecoderFLACImplementation : public Decoder,
                          FLAC__StreamDecoderErrorStatus status,
                          void *client_data);
 
+  // Requires _flac_decoder_mutex to be held
+  FLAC__StreamDecoderInitStatus initStream();
+  bool prepareMetadataPrefix(const StreamInfo &stream_info);
+  void readMetadataPrefix(FLAC__byte *buffer, long offset, size_t bytes) const;
+  long bufferFrames(long frames);
+  void indexFrame();
+
   std::shared_ptr<DataProvider> _data_provider;
+  const std::shared_ptr<Executor> _executor;
 
   FLAC__StreamDecoder *_flac_decoder;
   std::mutex _flac_decoder_mutex;
-  std::future<void> _load_future;
   std::atomic<int> _channels;
   std::atomic<double> _samplerate;
   std::atomic<long> _frame_index;
   std::atomic<long> _frames;
-  std::vector<float> _samples;
+  std::atomic<int> _bits_per_sample;
+  PCMBuffer _samples;
   std::mutex _samples_mutex;
+  // Without a SEEKTABLE libFLAC bisects over the provider, so index frame offsets as we decode
+  SeekIndex _seek_index;
+  bool _has_seek_table;
+  bool _indexing;
+  long _next_frame_sample;
+  long _discard_until_sample;
+  // A cached stream replays its STREAMINFO and SEEKTABLE to libFLAC and pads up to the first
+  // frame, so metadata that was skipped before (pictures, tags) is never read again
+  std::string _stream_info_key;
+  StreamInfo _stream_info;
+  std::vector<unsigned char> _metadata_prefix;
+  std::vector<std::pair<long, uint32_t>> _padding_headers;
+  long _metadata_prefix_bytes;
 };
 
 }  // namespace decoder
@@ -19,26 +19,105 @@
  * under the License.
  */
 #include "DecoderMidiImplementation.h"
-#include <iostream>
-#include <vector>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <map>
 
 namespace nativeformat {
 namespace decoder {
 
-DecoderMidiImplementation::DecoderMidiImplementation(const std::string &path)
+namespace {
+
+// A SoundFont parsed once for the process. Decoders render through their own tsf_copy, which
+// shares its presets and samples
+typedef struct SoundFontCacheEntry {
+  tsf *soundfont;
+  long decoders;
+} SoundFontCacheEntry;
+
+std::mutex &soundFontCacheMutex() {
+  static std::mutex cache_mutex;
+  return cache_mutex;
+}
+
+std::map<std::string, SoundFontCacheEntry> &soundFontCache() {
+  static std::map<std::string, SoundFontCacheEntry> cache;
+  return cache;
+}
+
+tsf *acquireSoundFont(const std::string &path) {
+  // tsf_copy and tsf_close count the instances sharing a SoundFont without any locking
+  std::lock_guard<std::mutex> cache_lock(soundFontCacheMutex());
+  auto &cache = soundFontCache();
+  auto entry = cache.find(path);
+  if (entry == cache.end()) {
+    tsf *soundfont = tsf_load_filename(path.c_str());
+    if (soundfont == nullptr) {
+      return nullptr;
+    }
+    entry = cache.insert(std::make_pair(path, SoundFontCacheEntry{soundfont, 0})).first;
+  }
+  tsf *instance = tsf_copy(entry->second.soundfont);
+  if (instance != nullptr) {
+    ++entry->second.decoders;
+  } else if (entry->second.decoders == 0) {
+    tsf_close(entry->second.soundfont);
+    cache.erase(entry);
+  }
+  return instance;
+}
+
+void releaseSoundFont(const std::string &path, tsf *instance) {
+  std::lock_guard<std::mutex> cache_lock(soundFontCacheMutex());
+  tsf_close(instance);
+  auto &cache = soundFontCache();
+  auto entry = cache.find(path);
+  if (entry != cache.end() && --entry->second.decoders == 0) {
+    // The last decoder using it is gone, free the samples
+    tsf_close(entry->second.soundfont);
+    cache.erase(entry);
+  }
+}
+
+}  // namespace
+
+static const int MIDI_CHANNELS = 16;
+static const int MIDI_DRUM_CHANNEL = 9;
+static const unsigned char MIDI_CONTROLLER_UNSET = 0xFF;
+static const unsigned short MIDI_PITCH_BEND_CENTRE = 8192;
+static const int MIDI_CONTROLLER_BANK_SELECT_MSB = 0;
+static const int MIDI_CONTROLLER_BANK_SELECT_LSB = 32;
+static const int MIDI_CONTROLLER_DATA_ENTRY_MSB = 6;
+static const int MIDI_CONTROLLER_DATA_ENTRY_LSB = 38;
+static const int MIDI_CONTROLLER_ALL_SOUND_OFF = 120;
+static const int MIDI_CONTROLLER_RESET_ALL = 121;
+static const int MIDI_CONTROLLER_ALL_NOTES_OFF = 123;
+// Recommended value from tsf.h. Lower means more accurate but more CPU required.
+static const long MIDI_RENDER_BLOCK_FRAMES = 64;
+// A seek replays controller changes from the last snapshot, at most this far back
+static const double MIDI_SNAPSHOT_INTERVAL_SECONDS = 5.0;
+
+DecoderMidiImplementation::DecoderMidiImplementation(const std::string &path,
+                                                     const std::shared_ptr<Executor> &executor)
     : _midi_path(path.begin() + path.find(midi_prefix) + midi_prefix.size(),
                  path.begin() + path.find(soundfont_prefix)),
       _soundfont_path(path.begin() + path.find(soundfont_prefix) + soundfont_prefix.size(),
                       path.end()),
+      _executor(executor),
+      _next_event(0),
+      _soundfont(nullptr),
       _channels(2),
       _samplerate(44100.0),
-      _frame_size(0),
       _frame_index(0),
       _frames(0) {}
 
 DecoderMidiImplementation::~DecoderMidiImplementation() {
-  tml_free(_midi_head);
-  tsf_close(_soundfont);
+  if (_soundfont != nullptr) {
+    releaseSoundFont(_soundfont_path, _soundfont);
+  }
 }
 
 const std::string &DecoderMidiImplementation::name() {
@@ -51,45 +130,110 @@ const std::string &DecoderMidiImplementation::path() {
 }
 
 void DecoderMidiImplementation::load_midi() {
-  _midi_head = tml_load_filename(_midi_path.c_str());
-  _midi_stream = _midi_head;
+  tml_message *midi_head = tml_load_filename(_midi_path.c_str());
+  if (midi_head == nullptr) {
+    return;
+  }
+  const double frames_per_ms = sampleRate() / 1.e3;
+  for (const tml_message *message = midi_head; message != nullptr; message = message->next) {
+    MidiEvent event;
+    event.frame = std::lround(message->time * frames_per_ms);
+    event.type = message->type;
+    event.channel = message->channel;
+    event.key = message->key;
+    event.value = message->velocity;
+    event.pitch_bend = message->type == TML_PITCH_BEND ? message->pitch_bend : 0;
+    _events.push_back(event);
+  }
+  tml_free(midi_head);
+  std::stable_sort(
+      _events.begin(), _events.end(), [](const MidiEvent &lhs, const MidiEvent &rhs) {
+        return lhs.frame < rhs.frame;
+      });
+  _frames = _events.empty() ? 0 : _events.back().frame;
+
+  // Fold the channel state forward, taking a snapshot at the first event of a frame once the
+  // interval has passed, so every event before a snapshot is earlier than its frame
+  const long interval_frames = std::lround(MIDI_SNAPSHOT_INTERVAL_SECONDS * sampleRate());
+  MidiSnapshot snapshot;
+  snapshot.frame = 0;
+  snapshot.event_index = 0;
+  for (int channel = 0; channel < MIDI_CHANNELS; ++channel) {
+    resetChannelState(snapshot.channels[channel]);
+  }
+  _snapshots.push_back(snapshot);
+  for (size_t i = 0; i < _events.size(); ++i) {
+    const MidiEvent &event = _events[i];
+    if (i > 0 && event.frame >= _snapshots.back().frame + interval_frames &&
+        _events[i - 1].frame < event.frame) {
+      snapshot.frame = event.frame;
+      snapshot.event_index = i;
+      _snapshots.push_back(snapshot);
+    }
+    if (event.channel < MIDI_CHANNELS) {
+      updateChannelState(snapshot.channels[event.channel], event);
+    }
+  }
 }
 
 void DecoderMidiImplementation::load_soundfont() {
-  _soundfont = tsf_load_filename(_soundfont_path.c_str());
-  tsf_set_output(_soundfont, TSF_STEREO_INTERLEAVED, sampleRate());
+  _soundfont = acquireSoundFont(_soundfont_path);
+  if (_soundfont != nullptr) {
+    tsf_set_output(_soundfont, TSF_STEREO_INTERLEAVED, sampleRate());
+  }
 }
 
 void DecoderMidiImplementation::load(const ERROR_DECODER_CALLBACK &decoder_error_callback,
                                      const LOAD_DECODER_CALLBACK &decoder_load_callback) {
   std::shared_ptr<DecoderMidiImplementation> strong_this = shared_from_this();
-  _load_future = std::async(
-      std::launch::async, [strong_this, decoder_error_callback, decoder_load_callback]() {
-        strong_this->load_midi();
-        if (strong_this->stream() == nullptr) {
-          decoder_error_callback(
-              strong_this->name(),
-              (int)DecoderMidiImplementation::ErrorCode::ErrorCodeLoadMIDIFailure);
-          decoder_load_callback(false);
-        }
+  _executor->execute([strong_this, decoder_error_callback, decoder_load_callback]() {
+    {
+      std::lock_guard<std::mutex> midi_lock(strong_this->_midi_mutex);
+      strong_this->load_midi();
+    }
+    if (strong_this->_events.empty()) {
+      decoder_error_callback(
+          strong_this->name(),
+          (int)DecoderMidiImplementation::ErrorCode::ErrorCodeLoadMIDIFailure);
+      decoder_load_callback(false);
+      return;
+    }
 
-        // figure out how many frames of data we have
-        const tml_message *tmp = strong_this->stream();
-        while (tmp->next != nullptr) {
-          tmp = tmp->next;
-        }
-        strong_this->_frames = (1. / 1.e3) * tmp->time * strong_this->sampleRate();
-
-        strong_this->load_soundfont();
-        if (strong_this->soundbank() == nullptr) {
-          decoder_error_callback(
-              strong_this->name(),
-              (int)DecoderMidiImplementation::ErrorCode::ErrorCodeLoadSoundFontFailure);
-          decoder_load_callback(false);
-        }
-        strong_this->seek(0);
-        decoder_load_callback(true);
-      });
+    {
+      std::lock_guard<std::mutex> midi_lock(strong_this->_midi_mutex);
+      strong_this->load_soundfont();
+    }
+    if (strong_this->soundbank() == nullptr) {
+      decoder_error_callback(
+          strong_this->name(),
+          (int)DecoderMidiImplementation::ErrorCode::ErrorCodeLoadSoundFontFailure);
+      decoder_load_callback(false);
+      return;
+    }
+    strong_this->seek(0);
+    decoder_load_callback(true);
+  });
+}
+
+std::shared_ptr<Decoder> DecoderMidiImplementation::clone() {
+  auto decoder = std::make_shared<DecoderMidiImplementation>(
+      midi_prefix + _midi_path + soundfont_prefix + _soundfont_path, _executor);
+  {
+    // The events and snapshots are copied, the SoundFont comes from the cache
+    std::lock_guard<std::mutex> midi_lock(_midi_mutex);
+    decoder->_events = _events;
+    decoder->_snapshots = _snapshots;
+    decoder->_frames = static_cast<long>(_frames);
+  }
+  {
+    std::lock_guard<std::mutex> clone_lock(decoder->_midi_mutex);
+    decoder->load_soundfont();
+  }
+  if (decoder->_events.empty() || decoder->soundbank() == nullptr) {
+    return nullptr;
+  }
+  decoder->seek(0);
+  return decoder;
 }
 
 double DecoderMidiImplementation::sampleRate() {
@@ -105,33 +249,35 @@ long DecoderMidiImplementation::currentFrameIndex() {
 }
 
 void DecoderMidiImplementation::seek(long frame_index) {
-  if (frame_index == _frame_index) return;
-
-  // For now we'll do a shlemiel the painter until caching all the
-  // messages into a vector seems reasonable
-  long desired_time = frame_index / sampleRate();
-  if (frame_index < _frame_index || frame_index < desired_time) {
-    _frame_index = 0;
-    _midi_stream = _midi_head;
-  }
-
-  // because the frame boundary may be in between two midi messages we
-  // search for when the next message cross the time boundary
-  tml_message *curr = _midi_stream;
-  tml_message *next = _midi_stream->next;
-
-  while (next && next->time < desired_time) {
-    ++_frame_index;
-    next = next->next;
-    curr = curr->next;
-  }
-  _midi_stream = curr;
-
+  std::lock_guard<std::mutex> midi_lock(_midi_mutex);
+  frame_index = std::max(frame_index, 0L);
   _frame_index = frame_index;
+  if (_snapshots.empty() || _soundfont == nullptr) {
+    return;
+  }
 
-  if (!next) {
-    _midi_stream = nullptr;
+  // The last snapshot at or before the target, then fold in the events between it and the
+  // target. Only channel state is replayed, so this is a search and a short walk
+  auto snapshot = std::upper_bound(
+      _snapshots.begin(),
+      _snapshots.end(),
+      frame_index,
+      [](long frame, const MidiSnapshot &snapshot) { return frame < snapshot.frame; });
+  --snapshot;
+  auto next_event = std::lower_bound(
+      _events.begin() + snapshot->event_index,
+      _events.end(),
+      frame_index,
+      [](const MidiEvent &event, long frame) { return event.frame < frame; });
+  MidiChannelState channels[MIDI_CHANNELS];
+  std::memcpy(channels, snapshot->channels, sizeof(channels));
+  for (auto event = _events.begin() + snapshot->event_index; event != next_event; ++event) {
+    if (event->channel < MIDI_CHANNELS) {
+      updateChannelState(channels[event->channel], *event);
+    }
   }
+  restoreChannels(channels);
+  _next_event = next_event - _events.begin();
 }
 
 long DecoderMidiImplementation::frames() {
@@ -141,90 +287,163 @@ long DecoderMidiImplementation::frames() {
 void DecoderMidiImplementation::decode(long frames,
                                        const DECODE_CALLBACK &decode_callback,
                                        bool synchronous) {
-  long frame_index = _frame_index;
-  if (_midi_stream == nullptr) {
-    decode_callback(frame_index, 0, nullptr);
-  }
+  float *samples = (float *)malloc(frames * channels() * sizeof(float));
+  decodeInto(samples,
+             frames,
+             [decode_callback, samples](long frame_index, long frame_count) {
+               decode_callback(frame_index, frame_count, frame_count > 0 ? samples : nullptr);
+               free(samples);
+             },
+             synchronous);
+}
 
+void DecoderMidiImplementation::decodeInto(float *samples,
+                                           long frames,
+                                           const DECODE_INTO_CALLBACK &decode_into_callback,
+                                           bool synchronous) {
   std::shared_ptr<DecoderMidiImplementation> strong_this = shared_from_this();
-  auto run_thread = [strong_this, decode_callback, frames, frame_index] {
-    if (frames == 0) {
-      decode_callback(frame_index, 0, nullptr);
-      return;
-    }
-    int channels = strong_this->channels();
-    if (channels == 0) {
-      decode_callback(frame_index, 0, nullptr);
-      return;
-    }
-
-    double samplerate = strong_this->sampleRate();
-    const tml_message *midi_pkt = strong_this->stream();
-    auto *sounds = const_cast<tsf *>(strong_this->soundbank());
-    const double time_incr = 1000.0 / samplerate;
-    double time_ms = frame_index * time_incr;
-    int frames_left = frames;
-
-    std::vector<float> output(frames * channels);
-
-    int frame_block = 64;  // Recommended value from tsf.h. Lower means more
-                           // accurate but more CPU required.
-    for (size_t output_index = 0; frames_left;
-         frames_left -= frame_block, output_index += frame_block * channels) {
-      // We progress the MIDI playback and then process
-      // TSF_RENDER_EFFECTSAMPLEBLOCK samples at once
-      if (frame_block > frames_left) frame_block = frames_left;
-
-      // Loop through all MIDI messages which need to be played up until the
-      // current playback time
-      // 1000 for milliseconds
-      for (time_ms += frame_block * time_incr; midi_pkt && time_ms >= midi_pkt->time;
-           midi_pkt = midi_pkt->next) {
-        switch (midi_pkt->type) {
-          case TML_NOTE_OFF:  // stop a note
-            tsf_channel_note_off(sounds, midi_pkt->channel, midi_pkt->key);
-            break;
-          case TML_NOTE_ON:  // play a note
-            tsf_channel_note_on(
-                sounds, midi_pkt->channel, midi_pkt->key, midi_pkt->velocity / 127.0f);
-            break;
-          case TML_KEY_PRESSURE:
-            // TODO: Implement
-            break;
-          case TML_CONTROL_CHANGE:  // MIDI controller messages
-            tsf_channel_midi_control(
-                sounds, midi_pkt->channel, midi_pkt->control, midi_pkt->control_value);
-            break;
-          case TML_PROGRAM_CHANGE:  // channel program (preset) change (special
-                                    // handling for 10th MIDI channel with drums)
-            tsf_channel_set_presetnumber(
-                sounds, midi_pkt->channel, midi_pkt->program, (midi_pkt->channel == 9));
-            break;
-          case TML_CHANNEL_PRESSURE:
-          // TODO: Implement
-          case TML_PITCH_BEND:  // pitch wheel modification
-            tsf_channel_set_pitchwheel(sounds, midi_pkt->channel, midi_pkt->pitch_bend);
-            break;
+  auto run_thread = [strong_this, samples, decode_into_callback, frames] {
+    long frame_index = 0;
+    long read_frames = 0;
+    {
+      std::lock_guard<std::mutex> midi_lock(strong_this->_midi_mutex);
+      frame_index = strong_this->_frame_index;
+      read_frames = std::max(0L, std::min(frames, strong_this->_frames - frame_index));
+      if (strong_this->_soundfont == nullptr) {
+        read_frames = 0;
+      }
+      const int channels = strong_this->channels();
+      const std::vector<MidiEvent> &events = strong_this->_events;
+      for (long rendered = 0; rendered < read_frames;) {
+        const long block_frames = std::min(MIDI_RENDER_BLOCK_FRAMES, read_frames - rendered);
+        // Events due before the end of the block start with it
+        const long block_end = frame_index + rendered + block_frames;
+        while (strong_this->_next_event < events.size() &&
+               events[strong_this->_next_event].frame < block_end) {
+          strong_this->playEvent(events[strong_this->_next_event++]);
         }
+        tsf_render_float(
+            strong_this->_soundfont, samples + rendered * channels, block_frames, 0);
+        rendered += block_frames;
       }
-
-      // Render the block of audio samples in float format
-      tsf_render_float(sounds, output.data() + output_index, frame_block, 0);
+      strong_this->_frame_index = frame_index + read_frames;
     }
-    decode_callback(frame_index, frames - frames_left, output.data());
+    decode_into_callback(frame_index, read_frames);
   };
   if (synchronous) {
     run_thread();
   } else {
-    std::thread(run_thread).detach();
+    _executor->execute(run_thread);
   }
 }
 
 bool DecoderMidiImplementation::eof() {
-  return _midi_stream == nullptr;
+  return _frame_index >= _frames;
 }
 
 void DecoderMidiImplementation::flush() {}
 
+void DecoderMidiImplementation::resetChannelState(MidiChannelState &state) {
+  state.program = -1;
+  state.program_bank_msb = 0;
+  state.program_bank_lsb = 0;
+  state.pitch_bend = MIDI_PITCH_BEND_CENTRE;
+  std::memset(state.controllers, MIDI_CONTROLLER_UNSET, sizeof(state.controllers));
+}
+
+void DecoderMidiImplementation::updateChannelState(MidiChannelState &state,
+                                                   const MidiEvent &event) {
+  switch (event.type) {
+    case TML_CONTROL_CHANGE:
+      if (event.key == MIDI_CONTROLLER_RESET_ALL) {
+        const short program = state.program;
+        const unsigned char program_bank_msb = state.program_bank_msb;
+        const unsigned char program_bank_lsb = state.program_bank_lsb;
+        resetChannelState(state);
+        state.program = program;
+        state.program_bank_msb = program_bank_msb;
+        state.program_bank_lsb = program_bank_lsb;
+      } else if (event.key != MIDI_CONTROLLER_ALL_SOUND_OFF &&
+                 event.key != MIDI_CONTROLLER_ALL_NOTES_OFF &&
+                 event.key < sizeof(state.controllers)) {
+        state.controllers[event.key] = event.value;
+      }
+      break;
+    case TML_PROGRAM_CHANGE: {
+      // The preset is picked from the bank selected when the program changes
+      const unsigned char msb = state.controllers[MIDI_CONTROLLER_BANK_SELECT_MSB];
+      const unsigned char lsb = state.controllers[MIDI_CONTROLLER_BANK_SELECT_LSB];
+      state.program = event.key;
+      state.program_bank_msb = msb == MIDI_CONTROLLER_UNSET ? 0 : msb;
+      state.program_bank_lsb = lsb == MIDI_CONTROLLER_UNSET ? 0 : lsb;
+      break;
+    }
+    case TML_PITCH_BEND:
+      state.pitch_bend = event.pitch_bend;
+      break;
+  }
+}
+
+void DecoderMidiImplementation::playEvent(const MidiEvent &event) {
+  switch (event.type) {
+    case TML_NOTE_OFF:  // stop a note
+      tsf_channel_note_off(_soundfont, event.channel, event.key);
+      break;
+    case TML_NOTE_ON:  // play a note
+      tsf_channel_note_on(_soundfont, event.channel, event.key, event.value / 127.0f);
+      break;
+    case TML_KEY_PRESSURE:
+      // TODO: Implement
+      break;
+    case TML_CONTROL_CHANGE:  // MIDI controller messages
+      tsf_channel_midi_control(_soundfont, event.channel, event.key, event.value);
+      break;
+    case TML_PROGRAM_CHANGE:  // channel program (preset) change (special
+                              // handling for 10th MIDI channel with drums)
+      tsf_channel_set_presetnumber(
+          _soundfont, event.channel, event.key, (event.channel == MIDI_DRUM_CHANNEL));
+      break;
+    case TML_CHANNEL_PRESSURE:
+      // TODO: Implement
+      break;
+    case TML_PITCH_BEND:  // pitch wheel modification
+      tsf_channel_set_pitchwheel(_soundfont, event.channel, event.pitch_bend);
+      break;
+  }
+}
+
+void DecoderMidiImplementation::restoreChannels(const MidiChannelState *channels) {
+  // Silences every voice and drops the channels back to their defaults
+  tsf_reset(_soundfont);
+  for (int channel = 0; channel < MIDI_CHANNELS; ++channel) {
+    const MidiChannelState &state = channels[channel];
+    if (state.program >= 0) {
+      tsf_channel_midi_control(
+          _soundfont, channel, MIDI_CONTROLLER_BANK_SELECT_MSB, state.program_bank_msb);
+      tsf_channel_midi_control(
+          _soundfont, channel, MIDI_CONTROLLER_BANK_SELECT_LSB, state.program_bank_lsb);
+      tsf_channel_set_presetnumber(
+          _soundfont, channel, state.program, (channel == MIDI_DRUM_CHANNEL));
+    }
+    // Data entry goes to the last selected parameter, so it follows the parameter numbers
+    for (int controller = 0; controller < static_cast<int>(sizeof(state.controllers));
+         ++controller) {
+      if (state.controllers[controller] != MIDI_CONTROLLER_UNSET &&
+          controller != MIDI_CONTROLLER_DATA_ENTRY_MSB &&
+          controller != MIDI_CONTROLLER_DATA_ENTRY_LSB) {
+        tsf_channel_midi_control(_soundfont, channel, controller, state.controllers[controller]);
+      }
+    }
+    for (const int controller : {MIDI_CONTROLLER_DATA_ENTRY_MSB, MIDI_CONTROLLER_DATA_ENTRY_LSB}) {
+      if (state.controllers[controller] != MIDI_CONTROLLER_UNSET) {
+        tsf_channel_midi_control(_soundfont, channel, controller, state.controllers[controller]);
+      }
+    }
+    if (state.pitch_bend != MIDI_PITCH_BEND_CENTRE) {
+      tsf_channel_set_pitchwheel(_soundfont, channel, state.pitch_bend);
+    }
+  }
+}
+
 }  // namespace decoder
 }  // namespace nativeformat
@@ -21,10 +21,13 @@
 #pragma once
 
 #include <NFDecoder/Decoder.h>
+#include <NFDecoder/Executor.h>
 #include <NFDecoder/Factory.h>
 
-#include <future>
+#include <atomic>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #define TSF_STATIC
 #define TSF_IMPLEMENTATION
@@ -46,7 +49,7 @@ class DecoderMidiImplementation : public Decoder,
  public:
   enum class ErrorCode : int { ErrorCodeLoadMIDIFailure, ErrorCodeLoadSoundFontFailure };
 
-  DecoderMidiImplementation(const std::string &path);
+  DecoderMidiImplementation(const std::string &path, const std::shared_ptr<Executor> &executor);
   ~DecoderMidiImplementation();
 
   virtual double sampleRate() final;
@@ -55,39 +58,75 @@ class DecoderMidiImplementation : public Decoder,
   virtual void seek(long frame_index) final;
   virtual long frames() final;
   virtual void decode(long frames, const DECODE_CALLBACK &decode_callback, bool synchronous) final;
+  virtual void decodeInto(float *samples,
+                          long frames,
+                          const DECODE_INTO_CALLBACK &decode_into_callback,
+                          bool synchronous) final;
   virtual bool eof() final;
   virtual const std::string &path() final;
   virtual const std::string &name() final;
   virtual void flush() final;
   virtual void load(const ERROR_DECODER_CALLBACK &decoder_error_callback,
                     const LOAD_DECODER_CALLBACK &decoder_load_callback) final;
+  virtual std::shared_ptr<Decoder> clone() final;
 
-  const tml_message *stream() { return _midi_stream; }
   const tsf *soundbank() { return _soundfont; }
 
   void load_midi();
   void load_soundfont();
 
  private:
+  typedef struct MidiEvent {
+    long frame;
+    unsigned char type;
+    unsigned char channel;
+    // Key, controller or program
+    unsigned char key;
+    // Velocity or controller value
+    unsigned char value;
+    unsigned short pitch_bend;
+  } MidiEvent;
+
+  // What a channel plays with, so a seek can put it back without replaying the stream
+  typedef struct MidiChannelState {
+    short program;
+    unsigned char program_bank_msb;
+    unsigned char program_bank_lsb;
+    unsigned short pitch_bend;
+    unsigned char controllers[128];
+  } MidiChannelState;
+
+  typedef struct MidiSnapshot {
+    long frame;
+    // The first event not folded into the channel states
+    size_t event_index;
+    MidiChannelState channels[16];
+  } MidiSnapshot;
+
+  static void resetChannelState(MidiChannelState &state);
+  static void updateChannelState(MidiChannelState &state, const MidiEvent &event);
+
+  // Require _midi_mutex to be held
+  void playEvent(const MidiEvent &event);
+  void restoreChannels(const MidiChannelState *channels);
+
   std::string midi_prefix = "midi:";
   std::string soundfont_prefix = ":soundfont:";
 
   std::string _midi_path;
   std::string _soundfont_path;
-  // TODO: Replace _midi_stream and _soundfont with custom allocators
-  // makes it easier on the destructor
-  // TODO: If the midi seeking becomes to slow consider copying the midi data
-  // into a vector and freeing the file
-  tml_message *_midi_head;
-  tml_message *_midi_stream;
+  const std::shared_ptr<Executor> _executor;
+  std::mutex _midi_mutex;
+  // The stream flattened at load, sorted by frame
+  std::vector<MidiEvent> _events;
+  std::vector<MidiSnapshot> _snapshots;
+  size_t _next_event;
   tsf *_soundfont;
 
   std::atomic<int> _channels;
   std::atomic<double> _samplerate;
-  std::atomic<long> _frame_size;
   std::atomic<long> _frame_index;
   std::atomic<long> _frames;
-  std::future<void> _load_future;
 };
 
 }  // namespace decoder
@@ -20,32 +20,41 @@
  */
 #include "DecoderNormalisationImplementation.h"
 
+#include <algorithm>
+#include <cmath>
 #include <cstdlib>
-#include <future>
+#include <cstring>
 
 namespace nativeformat {
 namespace decoder {
 
+static const long NORMALISATION_CHUNK_FRAMES = 4096;
+// Input decoded ahead of a seek target to fill the resampling filter, longer than any of its taps
+static const long NORMALISATION_PREROLL_FRAMES = 256;
+
 DecoderNormalisationImplementation::DecoderNormalisationImplementation(
-    const std::shared_ptr<Decoder> &wrapped_decoder, const double samplerate, const int channels)
+    const std::shared_ptr<Decoder> &wrapped_decoder,
+    const std::shared_ptr<Executor> &executor,
+    const double samplerate,
+    const int channels,
+    const ResamplerType resampler_type,
+    const ResamplerQuality resampler_quality)
     : _wrapped_decoder(wrapped_decoder),
+      _executor(executor),
+      _resampler_type(resampler_type),
+      _resampler_quality(resampler_quality),
       _factor(0.0),
       _frame_index(0),
+      _mixed_offset(0),
+      _mixed_frames(0),
+      _resampled_capacity(0),
+      _discard_frames(0),
+      _input_eof(false),
+      _drained(false),
       _samplerate(samplerate),
-      _channels(channels) {
-  for (int i = 0; i < this->channels(); ++i) {
-    _resampler_handlers[i] = nullptr;
-  }
-}
+      _channels(channels) {}
 
-DecoderNormalisationImplementation::~DecoderNormalisationImplementation() {
-  for (int i = 0; i < channels(); ++i) {
-    void *resample_handler = _resampler_handlers[i];
-    if (resample_handler != nullptr) {
-      resample_close(resample_handler);
-    }
-  }
-}
+DecoderNormalisationImplementation::~DecoderNormalisationImplementation() {}
 
 const std::string &DecoderNormalisationImplementation::name() {
   static const std::string domain("com.nativeformat.decoder.normalisation");
@@ -55,17 +64,50 @@ const std::string &DecoderNormalisationImplementation::name() {
 void DecoderNormalisationImplementation::load(const ERROR_DECODER_CALLBACK &decoder_error_callback,
                                               const LOAD_DECODER_CALLBACK &decoder_load_callback) {
   {
-    std::lock_guard<std::mutex> resampler_lock(_resampler_mutex);
+    std::lock_guard<std::mutex> normalisation_lock(_normalisation_mutex);
+    const int wrapped_channels = _wrapped_decoder->channels();
+    _channel_mixer = std::make_shared<ChannelMixer>(wrapped_channels, channels());
     _factor = sampleRate() / _wrapped_decoder->sampleRate();
+    _input_buffer.resize(NORMALISATION_CHUNK_FRAMES * wrapped_channels);
     if (_factor != 1.0) {
-      for (int i = 0; i < channels(); ++i) {
-        _resampler_handlers[i] = resample_open(1, _factor, _factor);
+      _resampler = createResampler(channels(),
+                                   _wrapped_decoder->sampleRate(),
+                                   sampleRate(),
+                                   _resampler_type,
+                                   _resampler_quality);
+      if (!_resampler) {
+        decoder_error_callback(name(), ErrorCodeCouldNotCreateResampler);
+        decoder_load_callback(false);
+        return;
       }
+      _mixed_buffer.resize(NORMALISATION_CHUNK_FRAMES * channels());
+      _resampled_capacity =
+          static_cast<long>(std::ceil(NORMALISATION_CHUNK_FRAMES * _factor)) + 1;
+      _pcm_buffer.reserve(_resampled_capacity * channels() * 2);
     }
+    _frame_index = std::lround(_wrapped_decoder->currentFrameIndex() * _factor);
   }
   decoder_load_callback(true);
 }
 
+std::shared_ptr<Decoder> DecoderNormalisationImplementation::clone() {
+  std::shared_ptr<Decoder> wrapped_decoder = _wrapped_decoder->clone();
+  if (!wrapped_decoder) {
+    return nullptr;
+  }
+  auto decoder = std::make_shared<DecoderNormalisationImplementation>(wrapped_decoder,
+                                                                      _executor,
+                                                                      sampleRate(),
+                                                                      channels(),
+                                                                      _resampler_type,
+                                                                      _resampler_quality);
+  // Loading only sets up the mixer and resampler, it finishes before returning
+  bool loaded = false;
+  decoder->load([](const std::string &domain, int error_code) {},
+                [&loaded](bool success) { loaded = success; });
+  return loaded ? decoder : nullptr;
+}
+
 double DecoderNormalisationImplementation::sampleRate() {
   return _samplerate;
 }
@@ -79,29 +121,9 @@ long DecoderNormalisationImplementation::currentFrameIndex() {
 }
 
 void DecoderNormalisationImplementation::seek(long frame_index) {
+  std::lock_guard<std::mutex> normalisation_lock(_normalisation_mutex);
   _frame_index = frame_index;
-
-  std::lock_guard<std::mutex> resampler_lock(_resampler_mutex);
-  _wrapped_decoder->seek(frame_index / _factor);
-
-  // Flush the resamplers
-  for (int i = 0; i < channels(); ++i) {
-    if (_resampler_handlers[i] != nullptr) {
-      int out_buffer_size = sampleRate() * channels() * sizeof(float);
-      float *out_buffer = (float *)malloc(out_buffer_size);
-      int in_buffer_size = 0;
-      resample_process(_resampler_handlers[i],
-                       _factor,
-                       nullptr,
-                       0,
-                       1,
-                       &in_buffer_size,
-                       out_buffer,
-                       out_buffer_size);
-      free(out_buffer);
-    }
-  }
-  _pcm_buffer.clear();
+  resetPipeline(frame_index);
 }
 
 long DecoderNormalisationImplementation::frames() {
@@ -115,176 +137,47 @@ long DecoderNormalisationImplementation::frames() {
 void DecoderNormalisationImplementation::decode(long frames,
                                                 const DECODE_CALLBACK &decode_callback,
                                                 bool synchronous) {
-  {
-    auto samples = frames * channels();
-    if (_pcm_buffer.size() >= samples) {
-      long frame_index = _frame_index;
-      _frame_index = frame_index + frames;
-      decode_callback(frame_index, frames, _pcm_buffer.data());
-      _pcm_buffer.erase(_pcm_buffer.begin(), _pcm_buffer.begin() + samples);
-      return;
+  // Each call gets its own buffer, concurrent decodes would otherwise overwrite each other's output
+  float *samples = (float *)malloc(frames * channels() * sizeof(float));
+  decodeInto(samples,
+             frames,
+             [decode_callback, samples](long frame_index, long frame_count) {
+               decode_callback(frame_index, frame_count, samples);
+               free(samples);
+             },
+             synchronous);
+}
+
+void DecoderNormalisationImplementation::decodeInto(
+    float *samples,
+    long frames,
+    const DECODE_INTO_CALLBACK &decode_into_callback,
+    bool synchronous) {
+  auto strong_this = shared_from_this();
+  auto run_thread = [strong_this, samples, frames, decode_into_callback]() {
+    long frame_index = 0;
+    long read_frames = 0;
+    {
+      std::lock_guard<std::mutex> normalisation_lock(strong_this->_normalisation_mutex);
+      frame_index = strong_this->_frame_index;
+      read_frames = strong_this->readFrames(samples, frames);
+      strong_this->_frame_index = frame_index + read_frames;
     }
+    decode_into_callback(frame_index, read_frames);
+  };
+  if (synchronous) {
+    run_thread();
+  } else {
+    _executor->execute(run_thread);
   }
-  auto strong_this = shared_from_this();
-  // Sometimes the normaliser cuts a bit off
-  const auto normalised_frames = _factor != 1.0 ? (frames / _factor) * 1.01 : frames;
-  _wrapped_decoder->decode(
-      normalised_frames,
-      [decode_callback, strong_this, frames](long frame_index, long input_frames, float *samples) {
-        long sent_frames = 0;
-        float *buffered_output = nullptr;
-        long current_frame_index = strong_this->currentFrameIndex();
-        {
-          std::lock_guard<std::mutex> resampler_lock(strong_this->_resampler_mutex);
-          const auto channels = strong_this->channels();
-          size_t channel_samples_count = input_frames * channels;
-          float *channel_samples = (float *)malloc(sizeof(float) * channel_samples_count);
-          for (int i = 0; i < channel_samples_count; ++i) {
-            channel_samples[i] = 0.0f;
-          }
-
-          // Normalise the channels
-          const auto decoder_channels = strong_this->_wrapped_decoder->channels();
-          if (decoder_channels > channels) {
-            // Copy the channels into stereo
-            int even_decoder_channels = decoder_channels - (decoder_channels % channels);
-            for (long i = 0; i < input_frames; ++i) {
-              for (int j = 0; j < even_decoder_channels; ++j) {
-                int normalised_channel = j % channels;
-                channel_samples[(i * channels) + normalised_channel] +=
-                    samples[(i * decoder_channels) + j];
-              }
-            }
-            // Mix the uneven channel into both channels
-            if (even_decoder_channels != decoder_channels) {
-              for (long i = 0; i < input_frames; ++i) {
-                for (int j = 0; j < channels; ++j) {
-                  channel_samples[(i * channels) + j] +=
-                      samples[(i * decoder_channels) + (decoder_channels - 1)];
-                }
-              }
-            }
-            // Lower the volume properly
-            float volume_factor = decoder_channels / channels;
-            for (long i = 0; i < input_frames; ++i) {
-              for (int j = 0; j < channels; ++j) {
-                channel_samples[(i * channels) + j] /= volume_factor;
-              }
-            }
-          } else if (decoder_channels < channels) {
-            // Copy all the other channels into the redundant channels
-            for (int i = 0; i < channels; ++i) {
-              for (long j = 0; j < input_frames; ++j) {
-                if (i < decoder_channels) {
-                  channel_samples[(j * channels) + i] = samples[(j * decoder_channels) + i];
-                } else {
-                  float sample = 0.0f;
-                  for (int k = 0; k < decoder_channels; ++k) {
-                    sample += samples[(j * decoder_channels) + k];
-                  }
-                  sample /= static_cast<float>(decoder_channels);
-                  channel_samples[(j * channels) + i] = sample;
-                }
-              }
-            }
-          } else {
-            memcpy(channel_samples, samples, channel_samples_count * sizeof(float));
-          }
-
-          // Resample the channels
-          const auto factor = strong_this->_factor;
-          if (factor == 1.0) {
-            // Short circuit here
-            decode_callback(current_frame_index, input_frames, channel_samples);
-            free(channel_samples);
-            return;
-          }
-
-          long new_frames = input_frames * factor + 1;
-          auto resampled_output_samples = new_frames * channels;
-          size_t resampled_output_size = resampled_output_samples * sizeof(float);
-          float *resampled_output = (float *)malloc(resampled_output_size);
-          if (new_frames - 1 == input_frames) {
-            memcpy(resampled_output, channel_samples, resampled_output_size);
-            new_frames = input_frames;
-          } else {
-            bool eof = strong_this->_wrapped_decoder->eof();
-            size_t old_channel_samples_size = input_frames * sizeof(float);
-            size_t resampled_samples_size = new_frames * sizeof(float);
-            float *old_channel_samples = (float *)malloc(old_channel_samples_size);
-            float *resampled_samples = (float *)malloc(resampled_samples_size);
-            for (int i = 0; i < channels; ++i) {
-              void *resample_handler = strong_this->_resampler_handlers[i];
-              if (resample_handler != nullptr) {
-                for (long j = 0; j < input_frames; ++j) {
-                  old_channel_samples[j] = channel_samples[(j * channels) + i];
-                }
-                int buffer_used = 0;
-                int sample_count = resample_process(resample_handler,
-                                                    factor,
-                                                    old_channel_samples,
-                                                    input_frames,
-                                                    eof,
-                                                    &buffer_used,
-                                                    resampled_samples,
-                                                    new_frames);
-                new_frames = std::min(static_cast<long>(sample_count), new_frames);
-                for (long j = 0; j < new_frames; ++j) {
-                  float sample = resampled_samples[j];
-                  resampled_output[(j * channels) + i] = sample;
-                }
-              } else {
-                // This shouldn't happen... but if it does do a regular copy
-                long max_frames = std::min(new_frames, input_frames);
-                for (long j = 0; j < max_frames; ++j) {
-                  resampled_output[(j * channels) + i] = channel_samples[(j * channels) + i];
-                }
-              }
-            }
-            free(old_channel_samples);
-            free(resampled_samples);
-          }
-
-          auto buffered_output_samples = frames * channels;
-          buffered_output = (float *)malloc(buffered_output_samples * sizeof(float));
-          auto cached_buffer_samples = std::min((long)strong_this->_pcm_buffer.size(), new_frames);
-          memcpy(buffered_output,
-                 strong_this->_pcm_buffer.data(),
-                 cached_buffer_samples * sizeof(float));
-          strong_this->_pcm_buffer.erase(strong_this->_pcm_buffer.begin(),
-                                         strong_this->_pcm_buffer.begin() + cached_buffer_samples);
-          auto resampled_output_used_samples =
-              std::min(buffered_output_samples - cached_buffer_samples, resampled_output_samples);
-          memcpy(&buffered_output[cached_buffer_samples],
-                 resampled_output,
-                 resampled_output_used_samples * sizeof(float));
-          auto resampled_output_left_samples =
-              resampled_output_samples - resampled_output_used_samples;
-          float *leftover_output = resampled_output + resampled_output_used_samples;
-          strong_this->_pcm_buffer.insert(strong_this->_pcm_buffer.end(),
-                                          leftover_output,
-                                          leftover_output + resampled_output_left_samples);
-          free(resampled_output);
-          free(channel_samples);
-
-          sent_frames = (resampled_output_used_samples + cached_buffer_samples) / channels;
-          if (sent_frames == 1 && frames != 1) {
-            sent_frames = 0;
-            strong_this->_pcm_buffer.clear();
-          } else {
-            strong_this->_frame_index = current_frame_index + sent_frames;
-          }
-        }
-
-        decode_callback(current_frame_index, sent_frames, buffered_output);
-        free(buffered_output);
-      },
-      synchronous);
 }
 
 bool DecoderNormalisationImplementation::eof() {
-  std::lock_guard<std::mutex> resampler_lock(_resampler_mutex);
-  return _wrapped_decoder->eof() && _pcm_buffer.empty();
+  std::lock_guard<std::mutex> normalisation_lock(_normalisation_mutex);
+  if (!_resampler) {
+    return _wrapped_decoder->eof();
+  }
+  return _drained && _pcm_buffer.empty();
 }
 
 const std::string &DecoderNormalisationImplementation::path() {
@@ -292,25 +185,106 @@ const std::string &DecoderNormalisationImplementation::path() {
 }
 
 void DecoderNormalisationImplementation::flush() {
-  std::lock_guard<std::mutex> resampler_lock(_resampler_mutex);
-  _pcm_buffer.clear();
+  std::lock_guard<std::mutex> normalisation_lock(_normalisation_mutex);
   _wrapped_decoder->flush();
-  for (int i = 0; i < channels(); ++i) {
-    if (_resampler_handlers[i] != nullptr) {
-      int out_buffer_size = sampleRate() * channels() * sizeof(float);
-      float *out_buffer = (float *)malloc(out_buffer_size);
-      int in_buffer_size = 0;
-      resample_process(_resampler_handlers[i],
-                       _factor,
-                       nullptr,
-                       0,
-                       1,
-                       &in_buffer_size,
-                       out_buffer,
-                       out_buffer_size);
-      free(out_buffer);
+  resetPipeline(_frame_index);
+}
+
+long DecoderNormalisationImplementation::readFrames(float *samples, long frames) {
+  const int channels = this->channels();
+  long read_frames = 0;
+  if (!_resampler) {
+    while (read_frames < frames) {
+      const long input_frames = decodeInput(frames - read_frames);
+      if (input_frames <= 0) {
+        break;
+      }
+      _channel_mixer->process(
+          _input_buffer.data(), samples + (read_frames * channels), input_frames);
+      read_frames += input_frames;
+    }
+    return read_frames;
+  }
+
+  // Output the resampler produced beyond the last request goes first
+  read_frames = _pcm_buffer.read(samples, frames * channels) / channels;
+  while (read_frames < frames && resampleInput(frames - read_frames)) {
+    read_frames += _pcm_buffer.read(samples + (read_frames * channels),
+                                    (frames - read_frames) * channels) /
+                   channels;
+  }
+  return read_frames;
+}
+
+bool DecoderNormalisationImplementation::resampleInput(long missing_frames) {
+  const int channels = this->channels();
+  if (_mixed_frames == 0 && !_input_eof) {
+    // Decode just enough input to cover the output still missing, the resampler keeps the rest
+    const long wanted_frames =
+        static_cast<long>(std::ceil((missing_frames + _discard_frames) / _factor));
+    const long input_frames = decodeInput(std::max(1L, wanted_frames));
+    if (input_frames > 0) {
+      _channel_mixer->process(_input_buffer.data(), _mixed_buffer.data(), input_frames);
+      _mixed_offset = 0;
+      _mixed_frames = input_frames;
+    } else if (_wrapped_decoder->eof()) {
+      _input_eof = true;
+    } else {
+      return false;
     }
   }
+
+  long consumed_frames = _mixed_frames;
+  float *output = _pcm_buffer.prepareWrite(_resampled_capacity * channels);
+  long resampled_frames = _resampler->process(_mixed_buffer.data() + (_mixed_offset * channels),
+                                              consumed_frames,
+                                              output,
+                                              _resampled_capacity,
+                                              _input_eof);
+  _pcm_buffer.commitWrite(resampled_frames * channels);
+  _mixed_offset += consumed_frames;
+  _mixed_frames -= consumed_frames;
+  if (resampled_frames == 0 && consumed_frames == 0) {
+    _drained = _input_eof;
+    return !_input_eof && _mixed_frames == 0;
+  }
+
+  // Drop what the resampler produced for the pre-roll, the buffer only holds this call's output
+  const long discarded_frames = std::min(resampled_frames, _discard_frames);
+  _pcm_buffer.consume(discarded_frames * channels);
+  _discard_frames -= discarded_frames;
+  return true;
+}
+
+long DecoderNormalisationImplementation::decodeInput(long frames) {
+  long input_frames = 0;
+  _wrapped_decoder->decodeInto(_input_buffer.data(),
+                               std::min(frames, NORMALISATION_CHUNK_FRAMES),
+                               [&input_frames](long frame_index, long frame_count) {
+                                 input_frames = frame_count;
+                               },
+                               true);
+  return input_frames;
+}
+
+void DecoderNormalisationImplementation::resetPipeline(long frame_index) {
+  _pcm_buffer.clear();
+  _mixed_offset = 0;
+  _mixed_frames = 0;
+  _input_eof = false;
+  _drained = false;
+  if (!_resampler) {
+    _wrapped_decoder->seek(frame_index);
+    _discard_frames = 0;
+    return;
+  }
+  // Output frame k after a reset lines up with input frame k / factor, so start the resampler
+  // ahead of the target and throw away the output that falls before it
+  _resampler->reset();
+  const long input_frame_index = std::max(
+      0L, static_cast<long>(std::floor(frame_index / _factor)) - NORMALISATION_PREROLL_FRAMES);
+  _wrapped_decoder->seek(input_frame_index);
+  _discard_frames = std::max(0L, frame_index - std::lround(input_frame_index * _factor));
 }
 
 }  // namespace decoder
@@ -23,27 +23,38 @@
 #include <NFDecoder/Decoder.h>
 
 #include <atomic>
-#include <future>
+#include <memory>
 #include <mutex>
 #include <vector>
 
-#include <NFDecoder/DataProvider.h>
+#include <NFDecoder/Executor.h>
 #include <NFDecoder/Factory.h>
+#include <NFDecoder/Resampler.h>
 
-#include <libresample.h>
+#include "ChannelMixer.h"
+#include "PCMBuffer.h"
 
 namespace nativeformat {
 namespace decoder {
 
+/*
+ * Mixes and resamples a decoder to a fixed sample rate and channel count. Every decode returns
+ * exactly the frames asked for until the wrapped decoder runs out, only as much input as the
+ * output needs is decoded and the buffers are reused between calls. Seeks restart the resampler
+ * a little before the target so its filter has real history by the time output is kept.
+ */
 class DecoderNormalisationImplementation
     : public Decoder,
       public std::enable_shared_from_this<DecoderNormalisationImplementation> {
  public:
-  typedef enum : int { ErrorCodeCouldNotDecodeHeader } ErrorCode;
+  typedef enum : int { ErrorCodeCouldNotDecodeHeader, ErrorCodeCouldNotCreateResampler } ErrorCode;
 
   DecoderNormalisationImplementation(const std::shared_ptr<Decoder> &wrapped_decoder,
+                                     const std::shared_ptr<Executor> &executor,
                                      const double samplerate,
-                                     const int channels);
+                                     const int channels,
+                                     const ResamplerType resampler_type,
+                                     const ResamplerQuality resampler_quality);
   virtual ~DecoderNormalisationImplementation();
 
   // Decoder
@@ -53,21 +64,45 @@ class DecoderNormalisationImplementation
   virtual void seek(long frame_index);
   virtual long frames();
   virtual void decode(long frames, const DECODE_CALLBACK &decode_callback, bool synchronous);
+  virtual void decodeInto(float *samples,
+                          long frames,
+                          const DECODE_INTO_CALLBACK &decode_into_callback,
+                          bool synchronous);
   virtual bool eof();
   virtual const std::string &path();
   virtual const std::string &name();
   virtual void flush();
   virtual void load(const ERROR_DECODER_CALLBACK &decoder_error_callback,
                     const LOAD_DECODER_CALLBACK &decoder_load_callback);
+  virtual std::shared_ptr<Decoder> clone();
 
  private:
+  // All of these expect _normalisation_mutex to be held
+  long readFrames(float *samples, long frames);
+  bool resampleInput(long missing_frames);
+  long decodeInput(long frames);
+  void resetPipeline(long frame_index);
+
   const std::shared_ptr<Decoder> _wrapped_decoder;
+  const std::shared_ptr<Executor> _executor;
+
+  const ResamplerType _resampler_type;
+  const ResamplerQuality _resampler_quality;
 
   double _factor;
-  void *_resampler_handlers[2];
+  std::shared_ptr<ChannelMixer> _channel_mixer;
+  std::shared_ptr<Resampler> _resampler;
   std::atomic<long> _frame_index;
-  std::mutex _resampler_mutex;
-  std::vector<float> _pcm_buffer;
+  std::mutex _normalisation_mutex;
+  std::vector<float> _input_buffer;
+  std::vector<float> _mixed_buffer;
+  long _mixed_offset;
+  long _mixed_frames;
+  long _resampled_capacity;
+  long _discard_frames;
+  bool _input_eof;
+  bool _drained;
+  PCMBuffer _pcm_buffer;
   std::atomic<double> _samplerate;
   std::atomic_int _channels;
 };
@@ -23,13 +23,13 @@
 #include "DecoderVorbisImplementation.h"
 
 #include <cstdlib>
-#include <future>
 
 namespace nativeformat {
 namespace decoder {
 
-DecoderOggImplementation::DecoderOggImplementation(std::shared_ptr<DataProvider> &data_provider)
-    : _data_provider(data_provider), _decoder(nullptr) {}
+DecoderOggImplementation::DecoderOggImplementation(std::shared_ptr<DataProvider> &data_provider,
+                                                   const std::shared_ptr<Executor> &executor)
+    : _data_provider(data_provider), _executor(executor), _decoder(nullptr) {}
 
 DecoderOggImplementation::~DecoderOggImplementation() {}
 
@@ -41,7 +41,7 @@ const std::string &DecoderOggImplementation::name() {
 void DecoderOggImplementation::load(const ERROR_DECODER_CALLBACK &decoder_error_callback,
                                     const LOAD_DECODER_CALLBACK &decoder_load_callback) {
   // Try both vorbis and opus decoders
-  auto vorbisDecoder = std::make_shared<DecoderVorbisImplementation>(_data_provider);
+  auto vorbisDecoder = std::make_shared<DecoderVorbisImplementation>(_data_provider, _executor);
   if (vorbisDecoder.get()->checkCodec()) {
     _decoder = vorbisDecoder;
     _decoder->load(decoder_error_callback, decoder_load_callback);
@@ -49,7 +49,7 @@ void DecoderOggImplementation::load(const ERROR_DECODER_CALLBACK &decoder_error_
   }
 
   _data_provider->seek(0, SEEK_SET);
-  auto opusDecoder = std::make_shared<DecoderOpusImplementation>(_data_provider);
+  auto opusDecoder = std::make_shared<DecoderOpusImplementation>(_data_provider, _executor);
   if (opusDecoder.get()->checkCodec()) {
     _decoder = opusDecoder;
     _decoder->load(decoder_error_callback, decoder_load_callback);
@@ -60,6 +60,18 @@ void DecoderOggImplementation::load(const ERROR_DECODER_CALLBACK &decoder_error_
   decoder_load_callback(false);
 }
 
+std::shared_ptr<Decoder> DecoderOggImplementation::clone() {
+  std::shared_ptr<Decoder> decoder = _decoder ? _decoder->clone() : nullptr;
+  if (!decoder) {
+    return nullptr;
+  }
+  // The codec is already known, so wrap a clone of it rather than probing again. The wrapper
+  // only reads its provider to probe
+  auto ogg_decoder = std::make_shared<DecoderOggImplementation>(_data_provider, _executor);
+  ogg_decoder->_decoder = decoder;
+  return ogg_decoder;
+}
+
 double DecoderOggImplementation::sampleRate() {
   return _decoder->sampleRate();
 }
@@ -86,6 +98,13 @@ void DecoderOggImplementation::decode(long frames,
   _decoder->decode(frames, decode_callback, synchronous);
 }
 
+void DecoderOggImplementation::decodeInto(float *samples,
+                                          long frames,
+                                          const DECODE_INTO_CALLBACK &decode_into_callback,
+                                          bool synchronous) {
+  _decoder->decodeInto(samples, frames, decode_into_callback, synchronous);
+}
+
 bool DecoderOggImplementation::eof() {
   return _decoder->eof();
 }
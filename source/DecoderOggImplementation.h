@@ -23,10 +23,10 @@
 #include <NFDecoder/Decoder.h>
 
 #include <atomic>
-#include <future>
 #include <mutex>
 
 #include <NFDecoder/DataProvider.h>
+#include <NFDecoder/Executor.h>
 #include <NFDecoder/Factory.h>
 
 namespace nativeformat {
@@ -39,7 +39,8 @@ class DecoderOggImplementation : public Decoder,
  public:
   typedef enum : int { ErrorCodeNotEnoughData, ErrorCodeCouldNotDecode } ErrorCode;
 
-  DecoderOggImplementation(std::shared_ptr<DataProvider> &data_provider);
+  DecoderOggImplementation(std::shared_ptr<DataProvider> &data_provider,
+                           const std::shared_ptr<Executor> &executor);
   virtual ~DecoderOggImplementation();
 
   // Decoder
@@ -49,15 +50,21 @@ class DecoderOggImplementation : public Decoder,
   virtual void seek(long frame_index);
   virtual long frames();
   virtual void decode(long frames, const DECODE_CALLBACK &decode_callback, bool synchronous);
+  virtual void decodeInto(float *samples,
+                          long frames,
+                          const DECODE_INTO_CALLBACK &decode_into_callback,
+                          bool synchronous);
   virtual bool eof();
   virtual const std::string &path();
   virtual const std::string &name();
   virtual void flush();
   virtual void load(const ERROR_DECODER_CALLBACK &decoder_error_callback,
                     const LOAD_DECODER_CALLBACK &decoder_load_callback);
+  virtual std::shared_ptr<Decoder> clone();
 
  private:
   std::shared_ptr<DataProvider> _data_provider;
+  const std::shared_ptr<Executor> _executor;
   std::shared_ptr<Decoder> _decoder;
 };
 
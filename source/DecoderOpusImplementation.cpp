@@ -21,7 +21,9 @@
 #include "DecoderOpusImplementation.h"
 
 #include <cstdlib>
-#include <future>
+
+#include "ProbeImplementation.h"
+#include "StreamInfoCache.h"
 
 namespace nativeformat {
 namespace decoder {
@@ -34,14 +36,25 @@ const OpusFileCallbacks DecoderOpusImplementation::callbacks{
     &DecoderOpusImplementation::opus_tell,
     &DecoderOpusImplementation::opus_close};
 
-DecoderOpusImplementation::DecoderOpusImplementation(std::shared_ptr<DataProvider> &data_provider)
+const OpusFileCallbacks DecoderOpusImplementation::unseekable_callbacks{
+    &DecoderOpusImplementation::opus_read,
+    nullptr,
+    &DecoderOpusImplementation::opus_tell,
+    &DecoderOpusImplementation::opus_close};
+
+DecoderOpusImplementation::DecoderOpusImplementation(
+    std::shared_ptr<DataProvider> &data_provider, const std::shared_ptr<Executor> &executor)
     : _data_provider(data_provider),
+      _executor(executor),
       _opus_file(nullptr),
       _channels(0),
       _samplerate(0.0),
       _frames(0),
       _frame_index(0),
-      _current_section(0) {}
+      _current_section(0),
+      _seekable(true),
+      _cached_frames(0),
+      _fast_start(true) {}
 
 DecoderOpusImplementation::~DecoderOpusImplementation() {
   if (_opus_file) {
@@ -57,7 +70,7 @@ const std::string &DecoderOpusImplementation::name() {
 bool DecoderOpusImplementation::checkCodec() {
   std::lock_guard<std::mutex> opus_lock(_opus_mutex);
   int error_code;
-  _opus_file = op_test_callbacks(this, &callbacks, nullptr, 0, &error_code);
+  _opus_file = op_test_callbacks(this, openCallbacks(), nullptr, 0, &error_code);
   if (error_code) {
     return false;
   }
@@ -73,39 +86,137 @@ bool DecoderOpusImplementation::checkCodec() {
 void DecoderOpusImplementation::load(const ERROR_DECODER_CALLBACK &decoder_error_callback,
                                      const LOAD_DECODER_CALLBACK &decoder_load_callback) {
   std::shared_ptr<DecoderOpusImplementation> strong_this = shared_from_this();
-  _load_future = std::async(
-      std::launch::async, [strong_this, decoder_error_callback, decoder_load_callback]() {
-        {
-          std::lock_guard<std::mutex> opus_lock(strong_this->_opus_mutex);
-
-          // Open file if checkCodec was not previously called
-          if (!strong_this->_opus_file) {
-            int error_code = 0;
-            strong_this->_opus_file = op_open_callbacks(
-                strong_this.get(), &strong_this->callbacks, nullptr, 0, &error_code);
-            if (error_code) {
-              printf("Could not open opus file: %s\n", opus_error(error_code).c_str());
-              decoder_error_callback(strong_this->name(), ErrorCodeCouldNotDecode);
-              decoder_load_callback(false);
-              return;
-            }
-            op_set_read_size(strong_this->_opus_file, OPUS_READ_SIZE);
-          }
+  _executor->execute([strong_this, decoder_error_callback, decoder_load_callback]() {
+    bool success = false;
+    {
+      std::lock_guard<std::mutex> opus_lock(strong_this->_opus_mutex);
+      success = strong_this->openStream(decoder_error_callback);
+    }
+    decoder_load_callback(success);
+  });
+}
 
-          int channels = op_channel_count(strong_this->_opus_file, -1);
-          long long frames = op_pcm_total(strong_this->_opus_file, -1);
+bool DecoderOpusImplementation::openStream(const ERROR_DECODER_CALLBACK &decoder_error_callback) {
+  // Open file if checkCodec was not previously called
+  if (!_opus_file) {
+    int error_code = 0;
+    _opus_file = op_open_callbacks(this, openCallbacks(), nullptr, 0, &error_code);
+    if (error_code) {
+      printf("Could not open opus file: %s\n", opus_error(error_code).c_str());
+      decoder_error_callback(name(), ErrorCodeCouldNotDecode);
+      return false;
+    }
+    op_set_read_size(_opus_file, OPUS_READ_SIZE);
+  }
 
-          if (channels < 0 || frames < 0) {
-            decoder_error_callback(strong_this->name(), std::min((long long)channels, frames));
-            decoder_load_callback(false);
-          }
+  int channels = op_channel_count(_opus_file, -1);
+  long long frames = _seekable ? op_pcm_total(_opus_file, -1) : _cached_frames;
 
-          strong_this->_channels = channels;
-          strong_this->_samplerate = 48000.0;  // all opus audio is 48 KHz
-          strong_this->_frames = frames;
-        }
-        decoder_load_callback(true);
-      });
+  if (channels < 0 || (_seekable && frames < 0)) {
+    decoder_error_callback(name(), std::min((long long)channels, frames));
+    return false;
+  }
+
+  _channels = channels;
+  _samplerate = 48000.0;  // all opus audio is 48 KHz
+  _frames = frames;
+  if (_seekable) {
+    StreamInfo stream_info;
+    stream_info.samplerate = _samplerate;
+    stream_info.channels = channels;
+    stream_info.frames = frames;
+    stream_info.data_offset = 0;
+    stream_info.data_bytes = _data_provider->size();
+    stream_info.seek_interval_frames = 0;
+    storeStreamInfo(streamInfoKey("opus", *_data_provider), stream_info);
+  } else if (frames == UNKNOWN_FRAMES) {
+    probeFrames();
+  }
+  return true;
+}
+
+const OpusFileCallbacks *DecoderOpusImplementation::openCallbacks() {
+  StreamInfo stream_info;
+  if (!_fast_start) {
+    _seekable = true;
+    _cached_frames = UNKNOWN_FRAMES;
+  } else if (findStreamInfo(streamInfoKey("opus", *_data_provider), stream_info)) {
+    _seekable = false;
+    _cached_frames = stream_info.frames;
+  } else {
+    _seekable = !lazyDuration();
+    _cached_frames = UNKNOWN_FRAMES;
+  }
+  return _seekable ? &callbacks : &unseekable_callbacks;
+}
+
+void DecoderOpusImplementation::probeFrames() {
+  // The probe reads the end of the stream through its own provider, so decoding can start now
+  std::shared_ptr<DataProvider> data_provider = _data_provider->clone();
+  if (!data_provider) {
+    return;
+  }
+  std::weak_ptr<DecoderOpusImplementation> weak_this = shared_from_this();
+  _executor->execute([weak_this, data_provider]() {
+    ProbeResult result =
+        ProbeImplementation::probeDataProvider(data_provider, PROBE_DEFAULT_BYTE_BUDGET);
+    if (result.codec != "opus" || result.frames == UNKNOWN_FRAMES) {
+      return;
+    }
+    if (std::shared_ptr<DecoderOpusImplementation> strong_this = weak_this.lock()) {
+      // A seekable reopen may have found the length first
+      long unknown_frames = UNKNOWN_FRAMES;
+      strong_this->_frames.compare_exchange_strong(unknown_frames, result.frames);
+    }
+    StreamInfo stream_info;
+    stream_info.samplerate = result.samplerate;
+    stream_info.channels = result.channels;
+    stream_info.frames = result.frames;
+    stream_info.data_offset = 0;
+    stream_info.data_bytes = data_provider->size();
+    stream_info.seek_interval_frames = 0;
+    storeStreamInfo(streamInfoKey("opus", *data_provider), stream_info);
+  });
+}
+
+bool DecoderOpusImplementation::reopenSeekable() {
+  op_free(_opus_file);
+  _data_provider->seek(0, SEEK_SET);
+  int error_code = 0;
+  _opus_file = op_open_callbacks(this, &callbacks, nullptr, 0, &error_code);
+  if (error_code) {
+    printf("Could not open opus file: %s\n", opus_error(error_code).c_str());
+    _opus_file = nullptr;
+    return false;
+  }
+  op_set_read_size(_opus_file, OPUS_READ_SIZE);
+  _seekable = true;
+  _current_section = 0;
+  if (_frames == UNKNOWN_FRAMES) {
+    long long frames = op_pcm_total(_opus_file, -1);
+    if (frames >= 0) {
+      _frames = frames;
+    }
+  }
+  return true;
+}
+
+std::shared_ptr<Decoder> DecoderOpusImplementation::clone() {
+  std::shared_ptr<DataProvider> data_provider = _data_provider->clone();
+  if (!data_provider) {
+    return nullptr;
+  }
+  // opusfile cannot share a parsed OggOpusFile, so the clone opens its own, reading the headers
+  // from the data the provider already holds
+  auto decoder = std::make_shared<DecoderOpusImplementation>(data_provider, _executor);
+  {
+    std::lock_guard<std::mutex> opus_lock(decoder->_opus_mutex);
+    decoder->_fast_start = false;
+    if (!decoder->openStream([](const std::string &domain, int error_code) {})) {
+      return nullptr;
+    }
+  }
+  return decoder;
 }
 
 double DecoderOpusImplementation::sampleRate() {
@@ -122,6 +233,17 @@ long DecoderOpusImplementation::currentFrameIndex() {
 
 void DecoderOpusImplementation::seek(long frame_index) {
   std::lock_guard<std::mutex> opus_lock(_opus_mutex);
+  if (!_opus_file) {
+    return;
+  }
+  // Decoding on from where the last decode stopped needs no seek
+  if (op_pcm_tell(_opus_file) == frame_index) {
+    _frame_index = frame_index;
+    return;
+  }
+  if (!_seekable && !reopenSeekable()) {
+    return;
+  }
   int error_code = op_pcm_seek(_opus_file, frame_index);
   if (error_code != 0) {
     printf("Seek failed: %s\n", opus_error(error_code).c_str());
@@ -137,21 +259,36 @@ long DecoderOpusImplementation::frames() {
 void DecoderOpusImplementation::decode(long frames,
                                        const DECODE_CALLBACK &decode_callback,
                                        bool synchronous) {
+  float *samples = (float *)malloc(frames * sizeof(float) * channels());
+  decodeInto(samples,
+             frames,
+             [decode_callback, samples](long frame_index, long frame_count) {
+               decode_callback(frame_index, frame_count, samples);
+               free(samples);
+             },
+             synchronous);
+}
+
+void DecoderOpusImplementation::decodeInto(float *samples,
+                                           long frames,
+                                           const DECODE_INTO_CALLBACK &decode_into_callback,
+                                           bool synchronous) {
   std::shared_ptr<DecoderOpusImplementation> strong_this = shared_from_this();
-  auto run_thread = [strong_this, decode_callback, frames] {
+  auto run_thread = [strong_this, samples, decode_into_callback, frames] {
     long frame_index = strong_this->currentFrameIndex();
 
     // Make sure opus file is on the same page
     strong_this->seek(frame_index);
 
-    float *samples = (float *)malloc(frames * sizeof(float) * strong_this->_channels);
+    // The buffer is sized for the channel count at the time of the call, never write past it
+    long total_samples = frames * strong_this->_channels;
     long read_frames = 0, read_samples = 0;
     {
       std::lock_guard<std::mutex> opus_lock(strong_this->_opus_mutex);
-      while (read_frames < frames) {
+      while (strong_this->_opus_file && read_frames < frames && read_samples < total_samples) {
         long current_read_frames = op_read_float(strong_this->_opus_file,
                                                  samples + read_samples,
-                                                 frames - read_frames,
+                                                 total_samples - read_samples,
                                                  &strong_this->_current_section);
         if (current_read_frames <= 0) {
           if (current_read_frames == OP_HOLE) {
@@ -164,22 +301,18 @@ void DecoderOpusImplementation::decode(long frames,
         }
         // update channel count in case we moved to a new section
         int channels = op_channel_count(strong_this->_opus_file, strong_this->_current_section);
-        if (channels > strong_this->_channels) {
-          samples = (float *)realloc(samples, frames * sizeof(float) * channels);
-        }
         strong_this->_channels = channels;
         read_frames += current_read_frames;
         read_samples += current_read_frames * channels;
       }
       strong_this->_frame_index = frame_index + read_frames;
     }
-    decode_callback(frame_index, read_frames, samples);
-    free(samples);
+    decode_into_callback(frame_index, read_frames);
   };
   if (synchronous) {
     run_thread();
   } else {
-    std::thread(run_thread).detach();
+    _executor->execute(run_thread);
   }
 }
 
@@ -23,10 +23,10 @@
 #include <NFDecoder/Decoder.h>
 
 #include <atomic>
-#include <future>
 #include <mutex>
 
 #include <NFDecoder/DataProvider.h>
+#include <NFDecoder/Executor.h>
 #include <NFDecoder/Factory.h>
 
 extern "C" {
@@ -43,7 +43,8 @@ class DecoderOpusImplementation : public Decoder,
  public:
   typedef enum : int { ErrorCodeNotEnoughData, ErrorCodeCouldNotDecode } ErrorCode;
 
-  DecoderOpusImplementation(std::shared_ptr<DataProvider> &data_provider);
+  DecoderOpusImplementation(std::shared_ptr<DataProvider> &data_provider,
+                            const std::shared_ptr<Executor> &executor);
   virtual ~DecoderOpusImplementation();
 
   bool checkCodec();
@@ -55,14 +56,25 @@ class DecoderOpusImplementation : public Decoder,
   virtual void seek(long frame_index);
   virtual long frames();
   virtual void decode(long frames, const DECODE_CALLBACK &decode_callback, bool synchronous);
+  virtual void decodeInto(float *samples,
+                          long frames,
+                          const DECODE_INTO_CALLBACK &decode_into_callback,
+                          bool synchronous);
   virtual bool eof();
   virtual const std::string &path();
   virtual const std::string &name();
   virtual void flush();
   virtual void load(const ERROR_DECODER_CALLBACK &decoder_error_callback,
                     const LOAD_DECODER_CALLBACK &decoder_load_callback);
+  virtual std::shared_ptr<Decoder> clone();
 
  private:
+  // Requires _opus_mutex to be held
+  bool openStream(const ERROR_DECODER_CALLBACK &decoder_error_callback);
+  const OpusFileCallbacks *openCallbacks();
+  bool reopenSeekable();
+  void probeFrames();
+
   static int opus_read(void *datasource, unsigned char *ptr, int nbytes);
   static int opus_seek(void *datasource, ogg_int64_t offset, int whence);
   static int opus_close(void *datasource);
@@ -70,6 +82,7 @@ class DecoderOpusImplementation : public Decoder,
   static std::string opus_error(int code);
 
   std::shared_ptr<DataProvider> _data_provider;
+  const std::shared_ptr<Executor> _executor;
 
   std::mutex _opus_mutex;
   OggOpusFile *_opus_file;
@@ -78,9 +91,16 @@ class DecoderOpusImplementation : public Decoder,
   std::atomic<long> _frames;
   std::atomic<long> _frame_index;
   int _current_section;
-  std::future<void> _load_future;
+  // Cached and lazily loaded streams open without a seek callback so opusfile skips the scan
+  // to their end, the first real seek reopens them seekable
+  bool _seekable;
+  // UNKNOWN_FRAMES when loaded lazily, until the background probe finds the length
+  long _cached_frames;
+  // Only a fresh load takes the unseekable route, clones are made to seek and open seekable
+  bool _fast_start;
 
   static const OpusFileCallbacks callbacks;
+  static const OpusFileCallbacks unseekable_callbacks;
 };
 
 }  // namespace decoder
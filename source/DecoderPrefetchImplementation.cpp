@@ -0,0 +1,274 @@
+/*
+ * Copyright (c) 2017 Spotify AB.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include "DecoderPrefetchImplementation.h"
+
+#include <algorithm>
+
+namespace nativeformat {
+namespace decoder {
+
+static const long PREFETCH_MAX_CHUNK_FRAMES = 4096;
+
+DecoderPrefetchImplementation::DecoderPrefetchImplementation(
+    const std::shared_ptr<Decoder> &wrapped_decoder,
+    const std::shared_ptr<Executor> &executor,
+    long prefetch_frames)
+    : _wrapped_decoder(wrapped_decoder),
+      _executor(executor),
+      _channels(wrapped_decoder->channels()),
+      _chunk_frames(std::max(1L, std::min(PREFETCH_MAX_CHUNK_FRAMES, prefetch_frames / 4))),
+      _ring(std::max(1L, prefetch_frames) * _channels),
+      _frame_index(wrapped_decoder->currentFrameIndex()),
+      _eof(false),
+      _running(false),
+      _scheduled(false),
+      _decode_buffer(_chunk_frames * _channels),
+      _generation(0),
+      _pending_seek(-1),
+      _pending_flush(false) {}
+
+DecoderPrefetchImplementation::~DecoderPrefetchImplementation() {}
+
+const std::string &DecoderPrefetchImplementation::name() {
+  static const std::string domain("com.nativeformat.decoder.prefetch");
+  return domain;
+}
+
+void DecoderPrefetchImplementation::load(const ERROR_DECODER_CALLBACK &decoder_error_callback,
+                                         const LOAD_DECODER_CALLBACK &decoder_load_callback) {
+  if (!_running) {
+    // Queued tasks never keep the decoder alive, a running one holds it for a single chunk
+    std::weak_ptr<DecoderPrefetchImplementation> weak_this = shared_from_this();
+    _prefetch_task = [weak_this]() {
+      if (std::shared_ptr<DecoderPrefetchImplementation> strong_this = weak_this.lock()) {
+        strong_this->prefetch();
+      }
+    };
+    _running = true;
+    requestPrefetch();
+  }
+  decoder_load_callback(true);
+}
+
+double DecoderPrefetchImplementation::sampleRate() {
+  return _wrapped_decoder->sampleRate();
+}
+
+int DecoderPrefetchImplementation::channels() {
+  return _channels;
+}
+
+long DecoderPrefetchImplementation::currentFrameIndex() {
+  return _frame_index;
+}
+
+void DecoderPrefetchImplementation::seek(long frame_index) {
+  {
+    std::lock_guard<std::mutex> prefetch_lock(_prefetch_mutex);
+    _frame_index = frame_index;
+    resetPrefetch(false);
+  }
+  requestPrefetch();
+}
+
+long DecoderPrefetchImplementation::frames() {
+  return _wrapped_decoder->frames();
+}
+
+void DecoderPrefetchImplementation::decode(long frames,
+                                           const DECODE_CALLBACK &decode_callback,
+                                           bool synchronous) {
+  if (hasFrames(frames)) {
+    decodeFrames(frames, decode_callback, false);
+    return;
+  }
+  auto strong_this = shared_from_this();
+  auto run_thread = [strong_this, frames, decode_callback]() {
+    strong_this->decodeFrames(frames, decode_callback, true);
+  };
+  if (synchronous) {
+    run_thread();
+  } else {
+    _executor->execute(run_thread);
+  }
+}
+
+void DecoderPrefetchImplementation::decodeInto(float *samples,
+                                               long frames,
+                                               const DECODE_INTO_CALLBACK &decode_into_callback,
+                                               bool synchronous) {
+  if (hasFrames(frames)) {
+    const long frame_index = _frame_index;
+    decode_into_callback(frame_index, readFrames(samples, frames, false));
+    return;
+  }
+  auto strong_this = shared_from_this();
+  auto run_thread = [strong_this, samples, frames, decode_into_callback]() {
+    const long frame_index = strong_this->currentFrameIndex();
+    decode_into_callback(frame_index, strong_this->readFrames(samples, frames, true));
+  };
+  if (synchronous) {
+    run_thread();
+  } else {
+    _executor->execute(run_thread);
+  }
+}
+
+bool DecoderPrefetchImplementation::eof() {
+  return _eof && _ring.readable() == 0;
+}
+
+const std::string &DecoderPrefetchImplementation::path() {
+  return _wrapped_decoder->path();
+}
+
+void DecoderPrefetchImplementation::flush() {
+  {
+    std::lock_guard<std::mutex> prefetch_lock(_prefetch_mutex);
+    // The wrapped decoder has run ahead of the reader, bring it back before prefetching again
+    resetPrefetch(true);
+  }
+  requestPrefetch();
+}
+
+void DecoderPrefetchImplementation::prefetch() {
+  const size_t chunk_samples = _chunk_frames * _channels;
+  long generation = 0;
+  long seek_frame = -1;
+  bool flush = false;
+  float *region = nullptr;
+  long region_frames = 0;
+  {
+    std::lock_guard<std::mutex> prefetch_lock(_prefetch_mutex);
+    if (_eof || _ring.writable() < chunk_samples) {
+      _scheduled = false;
+      return;
+    }
+    generation = _generation;
+    seek_frame = _pending_seek;
+    flush = _pending_flush;
+    _pending_seek = -1;
+    _pending_flush = false;
+    // Decode straight into the ring, the region only shrinks below a chunk where the ring wraps.
+    // A seek resets the ring while the chunk decodes, but the chunk is then never committed
+    size_t region_samples = 0;
+    region = _ring.prepareWrite(region_samples);
+    region_frames = std::min(static_cast<long>(region_samples / _channels), _chunk_frames);
+  }
+  // Only this task touches the wrapped decoder, so its I/O runs outside the lock
+  if (flush) {
+    _wrapped_decoder->flush();
+  }
+  if (seek_frame >= 0) {
+    _wrapped_decoder->seek(seek_frame);
+  }
+  long decoded_frames = 0;
+  _wrapped_decoder->decodeInto(region,
+                               region_frames,
+                               [&decoded_frames](long frame_index, long frame_count) {
+                                 decoded_frames = frame_count;
+                               },
+                               true);
+  {
+    std::lock_guard<std::mutex> prefetch_lock(_prefetch_mutex);
+    if (generation == _generation) {
+      _ring.commitWrite(std::max(0L, decoded_frames) * _channels);
+      // Decoders such as the normaliser come back short when their input underruns, only the
+      // wrapped decoder knows whether the stream really ended
+      if (decoded_frames <= 0 && _wrapped_decoder->eof()) {
+        _eof = true;
+      }
+    }
+    _scheduled = false;
+  }
+  _consumer_condition.notify_all();
+  requestPrefetch();
+}
+
+bool DecoderPrefetchImplementation::hasFrames(long frames) {
+  return _eof || _ring.readable() >= static_cast<size_t>(frames * _channels);
+}
+
+void DecoderPrefetchImplementation::decodeFrames(long frames,
+                                                 const DECODE_CALLBACK &decode_callback,
+                                                 bool wait) {
+  const long frame_index = _frame_index;
+  const size_t samples = frames * _channels;
+  size_t region_samples = 0;
+  const float *region = _ring.prepareRead(region_samples);
+  if (region_samples >= samples) {
+    // The producer never writes over samples that have not been consumed yet
+    decode_callback(frame_index, frames, const_cast<float *>(region));
+    _ring.consume(samples);
+    _frame_index = frame_index + frames;
+    requestPrefetch();
+    return;
+  }
+  if (_decode_buffer.size() < samples) {
+    _decode_buffer.resize(samples);
+  }
+  const long read_frames = readFrames(_decode_buffer.data(), frames, wait);
+  decode_callback(frame_index, read_frames, _decode_buffer.data());
+}
+
+long DecoderPrefetchImplementation::readFrames(float *samples, long frames, bool wait) {
+  long read_frames = 0;
+  while (read_frames < frames) {
+    // Everything the producer wrote before flagging the end is visible once the flag is
+    const bool eof = _eof;
+    read_frames += _ring.read(samples + (read_frames * _channels),
+                              (frames - read_frames) * _channels) /
+                   _channels;
+    if (read_frames == frames || !wait || !_running || (eof && _ring.readable() == 0)) {
+      break;
+    }
+    requestPrefetch();
+    waitForFrames();
+  }
+  _frame_index += read_frames;
+  requestPrefetch();
+  return read_frames;
+}
+
+void DecoderPrefetchImplementation::waitForFrames() {
+  std::unique_lock<std::mutex> prefetch_lock(_prefetch_mutex);
+  _consumer_condition.wait(prefetch_lock, [this] { return _ring.readable() > 0 || _eof; });
+}
+
+void DecoderPrefetchImplementation::requestPrefetch() {
+  if (_running && !_eof &&
+      _ring.writable() >= static_cast<size_t>(_chunk_frames * _channels) &&
+      !_scheduled.exchange(true)) {
+    _executor->execute(_prefetch_task);
+  }
+}
+
+void DecoderPrefetchImplementation::resetPrefetch(bool flush) {
+  ++_generation;
+  _pending_seek = _frame_index;
+  _pending_flush = _pending_flush || flush;
+  _ring.reset();
+  _eof = false;
+  _consumer_condition.notify_all();
+}
+
+}  // namespace decoder
+}  // namespace nativeformat
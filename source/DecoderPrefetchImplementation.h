@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2017 Spotify AB.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#pragma once
+
+#include <NFDecoder/Decoder.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <NFDecoder/Executor.h>
+
+#include "PCMRingBuffer.h"
+
+namespace nativeformat {
+namespace decoder {
+
+/*
+ * Keeps PCM decoded ahead of the reader with one chunk at a time decoded on the executor. Decodes
+ * that the prefetched PCM can satisfy are served on the calling thread without locking, topping
+ * the ring back up only posts a task. Seeks and flushes are handed to the next prefetch task, so
+ * only underruns wait for the wrapped decoder. Decode, seek and flush must all be called from one
+ * thread at a time.
+ */
+class DecoderPrefetchImplementation
+    : public Decoder,
+      public std::enable_shared_from_this<DecoderPrefetchImplementation> {
+ public:
+  DecoderPrefetchImplementation(const std::shared_ptr<Decoder> &wrapped_decoder,
+                                const std::shared_ptr<Executor> &executor,
+                                long prefetch_frames);
+  virtual ~DecoderPrefetchImplementation();
+
+  // Decoder
+  virtual double sampleRate();
+  virtual int channels();
+  virtual long currentFrameIndex();
+  virtual void seek(long frame_index);
+  virtual long frames();
+  virtual void decode(long frames, const DECODE_CALLBACK &decode_callback, bool synchronous);
+  virtual void decodeInto(float *samples,
+                          long frames,
+                          const DECODE_INTO_CALLBACK &decode_into_callback,
+                          bool synchronous);
+  virtual bool eof();
+  virtual const std::string &path();
+  virtual const std::string &name();
+  virtual void flush();
+  virtual void load(const ERROR_DECODER_CALLBACK &decoder_error_callback,
+                    const LOAD_DECODER_CALLBACK &decoder_load_callback);
+
+ private:
+  void prefetch();
+  bool hasFrames(long frames);
+  void decodeFrames(long frames, const DECODE_CALLBACK &decode_callback, bool wait);
+  long readFrames(float *samples, long frames, bool wait);
+  void waitForFrames();
+  void requestPrefetch();
+  // Requires _prefetch_mutex to be held
+  void resetPrefetch(bool flush);
+
+  const std::shared_ptr<Decoder> _wrapped_decoder;
+  const std::shared_ptr<Executor> _executor;
+  const int _channels;
+  const long _chunk_frames;
+
+  PCMRingBuffer _ring;
+  std::atomic<long> _frame_index;
+  std::atomic<bool> _eof;
+  std::atomic<bool> _running;
+  // Set while a prefetch task is queued or decoding, so only one ever touches the wrapped decoder
+  std::atomic<bool> _scheduled;
+  EXECUTOR_TASK _prefetch_task;
+  std::vector<float> _decode_buffer;
+  std::mutex _prefetch_mutex;
+  std::condition_variable _consumer_condition;
+  // Bumped by every seek and flush, a chunk decoded for an older generation is dropped
+  long _generation;
+  // Where the next prefetch task seeks the wrapped decoder to, -1 when it decodes on
+  long _pending_seek;
+  bool _pending_flush;
+};
+
+}  // namespace decoder
+}  // namespace nativeformat
@@ -20,22 +20,57 @@
  */
 #include "DecoderSpeexImplementation.h"
 
+#include <algorithm>
 #include <cstdlib>
-#include <future>
+#include <cstring>
 
+#include <speex/speex_callbacks.h>
 #include <speex/speex_header.h>
 
+#include "PCMKernels.h"
+#include "StreamInfoCache.h"
+
 namespace nativeformat {
 namespace decoder {
 
-DecoderSpeexImplementation::DecoderSpeexImplementation(std::shared_ptr<DataProvider> &data_provider)
+static const long SPEEX_READ_BYTES = 4096;
+// Speex decodes floats on a 16 bit scale
+static const float SPEEX_SAMPLE_SCALE = 1.0f / 32768.0f;
+// Packets decoded and dropped ahead of a seek target so the decoder's prediction has settled
+static const long SPEEX_SEEK_PREROLL_PACKETS = 4;
+// Once the bisection has narrowed to this many bytes the remaining pages are read in order
+static const long SPEEX_SEEK_LINEAR_BYTES = 16384;
+// Bytes at the end of the stream searched for the last granule, doubled until one turns up
+static const long SPEEX_END_SCAN_BYTES = 16384;
+// A second of wideband audio
+static const long SPEEX_SEEK_INDEX_INTERVAL_FRAMES = 16000;
+// Targets further than this past the closest indexed page are bisected for instead
+static const long SPEEX_SEEK_INDEX_MAX_DECODE_FRAMES = SPEEX_SEEK_INDEX_INTERVAL_FRAMES * 4;
+
+DecoderSpeexImplementation::DecoderSpeexImplementation(
+    std::shared_ptr<DataProvider> &data_provider, const std::shared_ptr<Executor> &executor)
     : _data_provider(data_provider),
-      _state(nullptr),
+      _executor(executor),
       _channels(1),
       _samplerate(0.0),
-      _frames(0),
+      _frames(UNKNOWN_FRAMES),
       _frame_index(0),
-      _current_section(0) {}
+      _state(nullptr),
+      _stereo(nullptr),
+      _frame_size(0),
+      _frames_per_packet(1),
+      _ogg_initialised(false),
+      _serial(0),
+      _sync_offset(0),
+      _audio_offset(0),
+      _granule(0),
+      _end_granule(-1),
+      _discard_until_frame(0),
+      _end_of_stream(false),
+      _seek_index(SPEEX_SEEK_INDEX_INTERVAL_FRAMES),
+      _indexing(false) {
+  ogg_sync_init(&_sync);
+}
 
 DecoderSpeexImplementation::~DecoderSpeexImplementation() {
   if (_state != nullptr) {
@@ -43,6 +78,13 @@ DecoderSpeexImplementation::~DecoderSpeexImplementation() {
     speex_bits_destroy(&_bits);
     _state = nullptr;
   }
+  if (_stereo != nullptr) {
+    speex_stereo_state_destroy(_stereo);
+  }
+  if (_ogg_initialised) {
+    ogg_stream_clear(&_stream);
+  }
+  ogg_sync_clear(&_sync);
 }
 
 const std::string &DecoderSpeexImplementation::name() {
@@ -53,21 +95,64 @@ const std::string &DecoderSpeexImplementation::name() {
 void DecoderSpeexImplementation::load(const ERROR_DECODER_CALLBACK &decoder_error_callback,
                                       const LOAD_DECODER_CALLBACK &decoder_load_callback) {
   std::shared_ptr<DecoderSpeexImplementation> strong_this = shared_from_this();
-  _load_future = std::async(std::launch::async,
-                            [strong_this, decoder_error_callback, decoder_load_callback]() {
-                              {
-                                std::lock_guard<std::mutex> speex_lock(strong_this->_speex_mutex);
-                                strong_this->_state = speex_decoder_init(&speex_nb_mode);
-                                int tmp = 1;
-                                speex_decoder_ctl(strong_this->_state, SPEEX_SET_ENH, &tmp);
-                                speex_bits_init(&strong_this->_bits);
-                                SpeexHeader header;
-                                strong_this->_data_provider->read(&header, sizeof(SpeexHeader), 1);
-                                strong_this->_samplerate = header.rate;
-                                strong_this->_channels = header.nb_channels;
-                              }
-                              decoder_load_callback(true);
-                            });
+  _executor->execute([strong_this, decoder_error_callback, decoder_load_callback]() {
+    int error_code = ErrorCodeNotEnoughData;
+    bool success = false;
+    {
+      std::lock_guard<std::mutex> speex_lock(strong_this->_speex_mutex);
+      success = strong_this->readHeaders(error_code);
+      if (success) {
+        // A stream seen before skips the scan for its last granule
+        strong_this->_stream_info_key = streamInfoKey("speex", *strong_this->_data_provider);
+        StreamInfo stream_info;
+        const bool cached = findStreamInfo(strong_this->_stream_info_key, stream_info);
+        strong_this->_frames = cached ? stream_info.frames : strong_this->lastGranule();
+        if (cached && !stream_info.seek_points.empty()) {
+          strong_this->_seek_index.assign(stream_info.seek_points, stream_info.frames);
+          strong_this->_indexing = false;
+        } else {
+          strong_this->_indexing = !strong_this->_seek_index.loadSidecar(
+              strong_this->path(),
+              strong_this->_data_provider->size(),
+              strong_this->_data_provider->revision());
+        }
+        if (!cached) {
+          strong_this->cacheStreamInfo();
+        }
+        strong_this->restartAt(-1, 0);
+      }
+    }
+    if (!success) {
+      decoder_error_callback(strong_this->name(), error_code);
+      decoder_load_callback(false);
+      return;
+    }
+    decoder_load_callback(true);
+  });
+}
+
+std::shared_ptr<Decoder> DecoderSpeexImplementation::clone() {
+  std::shared_ptr<DataProvider> data_provider = _data_provider->clone();
+  if (!data_provider) {
+    return nullptr;
+  }
+  auto decoder = std::make_shared<DecoderSpeexImplementation>(data_provider, _executor);
+  std::lock_guard<std::mutex> clone_lock(decoder->_speex_mutex);
+  // The decoder state comes from the header packet, read from the data the provider already
+  // holds. The length and the page index are copied rather than found again
+  int error_code = 0;
+  if (!decoder->readHeaders(error_code)) {
+    return nullptr;
+  }
+  {
+    std::lock_guard<std::mutex> speex_lock(_speex_mutex);
+    decoder->_frames = static_cast<long>(_frames);
+    decoder->_stream_info_key = _stream_info_key;
+    decoder->_seek_index = _seek_index;
+    decoder->_indexing = !_seek_index.complete();
+  }
+  decoder->restartAt(-1, 0);
+  return decoder;
 }
 
 double DecoderSpeexImplementation::sampleRate() {
@@ -83,70 +168,73 @@ long DecoderSpeexImplementation::currentFrameIndex() {
 }
 
 void DecoderSpeexImplementation::seek(long frame_index) {
-  flush();
-  {
-    std::lock_guard<std::mutex> speex_lock(_speex_mutex);
-    _data_provider->seek(sizeof(SpeexHeader), SEEK_SET);
-    int frame_size = 0;
-    speex_decoder_ctl(_state, SPEEX_GET_FRAME_SIZE, &frame_size);
-    long current_frame_index = 0;
-    while (!_data_provider->eof() && current_frame_index < frame_index) {
-      _cached_samples.clear();
-      char read_bytes[256];
-      const auto bytes_read = _data_provider->read(read_bytes, sizeof(char), sizeof(read_bytes));
-      speex_bits_read_from(&_bits, read_bytes, bytes_read);
-      float samples[frame_size];
-      const auto samples_read = speex_decode(_state, &_bits, samples);
-      _cached_samples.insert(_cached_samples.begin(), samples, samples + samples_read);
-      current_frame_index += samples_read;
-    }
-    _frame_index = frame_index;
+  std::lock_guard<std::mutex> speex_lock(_speex_mutex);
+  _cached_samples.clear();
+  _frame_index = frame_index;
+  _discard_until_frame = frame_index;
+  const long restart_frame =
+      frame_index - SPEEX_SEEK_PREROLL_PACKETS * _frame_size * _frames_per_packet;
+  long page_offset = -1;
+  long page_granule = 0;
+  bool bisected = false;
+  SeekIndex::Point point;
+  if (_seek_index.find(restart_frame, point) &&
+      restart_frame - point.frame <= SPEEX_SEEK_INDEX_MAX_DECODE_FRAMES) {
+    page_offset = point.offset;
+    page_granule = point.frame;
+  } else if (restart_frame > 0 && _data_provider->size() > 0) {
+    bisected = bisectPage(restart_frame, page_offset, page_granule);
   }
+  // Decoding on from the start or from an indexed page keeps the index contiguous
+  _indexing = !bisected && !_seek_index.complete();
+  restartAt(page_offset, page_granule);
 }
 
 long DecoderSpeexImplementation::frames() {
-  return UNKNOWN_FRAMES;
+  return _frames;
 }
 
 void DecoderSpeexImplementation::decode(long frames,
                                         const DECODE_CALLBACK &decode_callback,
                                         bool synchronous) {
+  float *samples = (float *)malloc(frames * sizeof(float) * channels());
+  decodeInto(samples,
+             frames,
+             [decode_callback, samples](long frame_index, long frame_count) {
+               decode_callback(frame_index, frame_count, samples);
+               free(samples);
+             },
+             synchronous);
+}
+
+void DecoderSpeexImplementation::decodeInto(float *samples,
+                                            long frames,
+                                            const DECODE_INTO_CALLBACK &decode_into_callback,
+                                            bool synchronous) {
   std::shared_ptr<DecoderSpeexImplementation> strong_this = shared_from_this();
-  auto run_thread = [strong_this, decode_callback, frames] {
-    long frame_index = strong_this->currentFrameIndex();
-    float *samples = (float *)malloc(frames * sizeof(float) * strong_this->_channels);
+  auto run_thread = [strong_this, samples, decode_into_callback, frames] {
+    long frame_index = 0;
     long read_frames = 0;
     {
       std::lock_guard<std::mutex> speex_lock(strong_this->_speex_mutex);
-      int frame_size = 0;
-      speex_decoder_ctl(strong_this->_state, SPEEX_GET_FRAME_SIZE, &frame_size);
-      while (!strong_this->_data_provider->eof() && strong_this->_cached_samples.size() < frames) {
-        char read_bytes[256];
-        const auto bytes_read =
-            strong_this->_data_provider->read(read_bytes, sizeof(char), sizeof(read_bytes));
-        speex_bits_read_from(&strong_this->_bits, read_bytes, bytes_read);
-        float samples[frame_size];
-        const auto samples_read = speex_decode(strong_this->_state, &strong_this->_bits, samples);
-        strong_this->_cached_samples.insert(
-            strong_this->_cached_samples.end(), samples, samples + samples_read);
-      }
+      const int channels = strong_this->_channels;
+      frame_index = strong_this->_frame_index;
+      strong_this->bufferFrames(frames);
+      read_frames = strong_this->_cached_samples.read(samples, frames * channels) / channels;
+      strong_this->_frame_index = frame_index + read_frames;
     }
-    read_frames = std::min(static_cast<long>(strong_this->_cached_samples.size()), frames);
-    memcpy(samples, strong_this->_cached_samples.data(), read_frames * sizeof(float));
-    strong_this->_cached_samples.erase(strong_this->_cached_samples.begin(),
-                                       strong_this->_cached_samples.begin() + read_frames);
-    decode_callback(frame_index, read_frames, samples);
-    free(samples);
+    decode_into_callback(frame_index, read_frames);
   };
   if (synchronous) {
     run_thread();
   } else {
-    std::thread(run_thread).detach();
+    _executor->execute(run_thread);
   }
 }
 
 bool DecoderSpeexImplementation::eof() {
-  return _data_provider->eof();
+  std::lock_guard<std::mutex> speex_lock(_speex_mutex);
+  return _end_of_stream && _cached_samples.empty();
 }
 
 const std::string &DecoderSpeexImplementation::path() {
@@ -154,10 +242,323 @@ const std::string &DecoderSpeexImplementation::path() {
 }
 
 void DecoderSpeexImplementation::flush() {
-  std::lock_guard<std::mutex> speex_lock(_speex_mutex);
+  // Restart the pages and the decoder where playback is, anything buffered is dropped
+  seek(currentFrameIndex());
+}
+
+long DecoderSpeexImplementation::readPage(ogg_page &page) {
+  while (true) {
+    const long result = ogg_sync_pageseek(&_sync, &page);
+    if (result > 0) {
+      const long offset = _sync_offset;
+      _sync_offset += result;
+      return offset;
+    }
+    if (result < 0) {
+      // Skipped bytes that were not the start of a page
+      _sync_offset -= result;
+      continue;
+    }
+    char *buffer = ogg_sync_buffer(&_sync, SPEEX_READ_BYTES);
+    const size_t bytes_read = _data_provider->read(buffer, sizeof(char), SPEEX_READ_BYTES);
+    if (bytes_read == 0) {
+      return -1;
+    }
+    ogg_sync_wrote(&_sync, bytes_read);
+  }
+}
+
+void DecoderSpeexImplementation::positionAt(long offset) {
+  _data_provider->seek(offset, SEEK_SET);
+  ogg_sync_reset(&_sync);
+  _sync_offset = offset;
+}
+
+void DecoderSpeexImplementation::pageIn(ogg_page &page, long offset) {
+  ogg_stream_pagein(&_stream, &page);
+  const ogg_int64_t granule = ogg_page_granulepos(&page);
+  if (granule < 0) {
+    return;
+  }
+  if (ogg_page_eos(&page)) {
+    // The last page can end part way through a packet, so it trims rather than resyncs
+    _end_granule = granule;
+  } else {
+    // Packets completed on this page end at its granule. On the first page that puts the start
+    // before zero by the encoder's lookahead, which decoding then drops
+    _granule = granule - ogg_page_packets(&page) * _frame_size * _frames_per_packet;
+  }
+  if (_indexing) {
+    _seek_index.add(granule, offset);
+  }
+}
+
+bool DecoderSpeexImplementation::readHeaders(int &error_code) {
+  positionAt(0);
+  ogg_page page;
+  if (readPage(page) < 0) {
+    error_code = ErrorCodeNotEnoughData;
+    return false;
+  }
+  error_code = ErrorCodeNotOggSpeex;
+  if (!ogg_page_bos(&page)) {
+    return false;
+  }
+  _serial = ogg_page_serialno(&page);
+  ogg_stream_init(&_stream, _serial);
+  _ogg_initialised = true;
+  ogg_stream_pagein(&_stream, &page);
+  ogg_packet packet;
+  if (ogg_stream_packetout(&_stream, &packet) != 1) {
+    return false;
+  }
+  SpeexHeader *header =
+      speex_packet_to_header(reinterpret_cast<char *>(packet.packet), packet.bytes);
+  if (header == nullptr) {
+    return false;
+  }
+  const SpeexMode *mode = nullptr;
+  if (header->mode >= 0 && header->mode < SPEEX_NB_MODES) {
+    mode = speex_lib_get_mode(header->mode);
+  }
+  const bool supported = mode != nullptr &&
+                         mode->bitstream_version == header->mode_bitstream_version &&
+                         (header->nb_channels == 1 || header->nb_channels == 2);
+  const int rate = header->rate;
+  const int header_packets = 2 + std::max(0, static_cast<int>(header->extra_headers));
+  _channels = header->nb_channels;
+  _samplerate = rate;
+  _frames_per_packet = std::max(1, static_cast<int>(header->frames_per_packet));
+  speex_header_free(header);
+  if (!supported) {
+    error_code = ErrorCodeUnsupportedMode;
+    return false;
+  }
+
+  _state = speex_decoder_init(mode);
+  speex_bits_init(&_bits);
+  int enhance = 1;
+  speex_decoder_ctl(_state, SPEEX_SET_ENH, &enhance);
+  speex_decoder_ctl(_state, SPEEX_GET_FRAME_SIZE, &_frame_size);
+  int sampling_rate = rate;
+  speex_decoder_ctl(_state, SPEEX_SET_SAMPLING_RATE, &sampling_rate);
+  // Stereo is coded in band, the handler picks up the balance for speex_decode_stereo
+  _stereo = speex_stereo_state_init();
+  SpeexCallback callback;
+  callback.callback_id = SPEEX_INBAND_STEREO;
+  callback.func = speex_std_stereo_request_handler;
+  callback.data = _stereo;
+  speex_decoder_ctl(_state, SPEEX_SET_HANDLER, &callback);
+  _decoded_samples.resize(_frame_size * 2);
+
+  // The comments and any extra headers sit on their own pages ahead of the audio
+  for (int header_packet = 1; header_packet < header_packets;) {
+    const int result = ogg_stream_packetout(&_stream, &packet);
+    if (result > 0) {
+      ++header_packet;
+      continue;
+    }
+    if (result < 0) {
+      continue;
+    }
+    if (readPage(page) < 0) {
+      error_code = ErrorCodeNotEnoughData;
+      return false;
+    }
+    if (ogg_page_serialno(&page) == _serial) {
+      ogg_stream_pagein(&_stream, &page);
+    }
+  }
+  _audio_offset = _sync_offset;
+  return true;
+}
+
+long DecoderSpeexImplementation::lastGranule() {
+  const long size = _data_provider->size();
+  if (size <= 0) {
+    return UNKNOWN_FRAMES;
+  }
+  for (long window = SPEEX_END_SCAN_BYTES;; window *= 2) {
+    const long begin = std::max(_audio_offset, size - window);
+    positionAt(begin);
+    ogg_int64_t last_granule = -1;
+    ogg_page page;
+    while (readPage(page) >= 0) {
+      const ogg_int64_t granule = ogg_page_granulepos(&page);
+      if (ogg_page_serialno(&page) == _serial && granule >= 0) {
+        last_granule = granule;
+      }
+    }
+    if (last_granule >= 0) {
+      return last_granule;
+    }
+    if (begin == _audio_offset) {
+      return UNKNOWN_FRAMES;
+    }
+  }
+}
+
+void DecoderSpeexImplementation::bufferFrames(long frames) {
+  const size_t samples = frames * _channels;
+  while (_cached_samples.size() < samples && !_end_of_stream) {
+    ogg_packet packet;
+    const int result = ogg_stream_packetout(&_stream, &packet);
+    if (result > 0) {
+      decodePacket(packet, true);
+      continue;
+    }
+    if (result < 0) {
+      // A gap in the pages, the next granule puts the frame index right again
+      continue;
+    }
+    ogg_page page;
+    long offset = -1;
+    if (_end_granule < 0) {
+      offset = readPage(page);
+    }
+    if (offset < 0) {
+      _end_of_stream = true;
+      if (_indexing) {
+        // Indexed from the first page to the last, worth keeping for next time
+        _indexing = false;
+        _seek_index.finish(_end_granule >= 0 ? _end_granule : _granule);
+        _seek_index.saveSidecar(
+            path(), _data_provider->size(), _data_provider->revision());
+        cacheStreamInfo();
+      }
+      break;
+    }
+    if (ogg_page_serialno(&page) == _serial) {
+      pageIn(page, offset);
+    }
+  }
+}
+
+void DecoderSpeexImplementation::cacheStreamInfo() {
+  StreamInfo stream_info;
+  stream_info.samplerate = _samplerate;
+  stream_info.channels = _channels;
+  stream_info.frames = _frames;
+  stream_info.data_offset = _audio_offset;
+  stream_info.data_bytes = _data_provider->size() - _audio_offset;
+  stream_info.seek_interval_frames = 0;
+  if (_seek_index.complete()) {
+    stream_info.seek_interval_frames = SPEEX_SEEK_INDEX_INTERVAL_FRAMES;
+    stream_info.seek_points = _seek_index.points();
+  }
+  storeStreamInfo(_stream_info_key, stream_info);
+}
+
+void DecoderSpeexImplementation::decodePacket(ogg_packet &packet, bool output) {
+  speex_bits_read_from(&_bits, reinterpret_cast<char *>(packet.packet), packet.bytes);
+  const int channels = _channels;
+  float *decoded_samples = _decoded_samples.data();
+  for (int i = 0; i < _frames_per_packet; ++i) {
+    // -1 is a terminator ending the packet early, -2 a corrupt frame
+    if (speex_decode(_state, &_bits, decoded_samples) != 0 || speex_bits_remaining(&_bits) < 0) {
+      break;
+    }
+    if (channels == 2) {
+      speex_decode_stereo(decoded_samples, _frame_size, _stereo);
+    }
+    const long first_frame = _granule;
+    _granule += _frame_size;
+    if (!output) {
+      continue;
+    }
+    const long begin = std::max(first_frame, _discard_until_frame);
+    const long end = _end_granule >= 0 ? std::min(_granule, _end_granule) : _granule;
+    if (end <= begin) {
+      continue;
+    }
+    const size_t count = (end - begin) * channels;
+    float *samples = _cached_samples.prepareWrite(count);
+    std::memcpy(samples,
+                decoded_samples + (begin - first_frame) * channels,
+                count * sizeof(float));
+    pcmGain(samples, count, SPEEX_SAMPLE_SCALE);
+    _cached_samples.commitWrite(count);
+  }
+}
+
+bool DecoderSpeexImplementation::bisectPage(long frame, long &page_offset, long &page_granule) {
+  bool found = false;
+  long begin = _audio_offset;
+  long end = _data_provider->size();
+  ogg_page page;
+  while (end - begin > SPEEX_SEEK_LINEAR_BYTES) {
+    const long middle = begin + (end - begin) / 2;
+    positionAt(middle);
+    long offset = -1;
+    ogg_int64_t granule = -1;
+    while ((offset = readPage(page)) >= 0 && offset < end) {
+      granule = ogg_page_granulepos(&page);
+      if (ogg_page_serialno(&page) == _serial && granule >= 0) {
+        break;
+      }
+    }
+    if (offset < 0 || offset >= end || granule >= frame) {
+      end = middle;
+      continue;
+    }
+    begin = _sync_offset;
+    page_offset = offset;
+    page_granule = granule;
+    found = true;
+  }
+  // Walk the last stretch for the final page that ends before the target
+  positionAt(begin);
+  long offset = -1;
+  while ((offset = readPage(page)) >= 0) {
+    const ogg_int64_t granule = ogg_page_granulepos(&page);
+    if (ogg_page_serialno(&page) != _serial || granule < 0) {
+      continue;
+    }
+    if (granule >= frame) {
+      break;
+    }
+    page_offset = offset;
+    page_granule = granule;
+    found = true;
+  }
+  return found;
+}
+
+void DecoderSpeexImplementation::restartAt(long page_offset, long page_granule) {
   speex_decoder_ctl(_state, SPEEX_RESET_STATE, nullptr);
+  speex_stereo_state_reset(_stereo);
   speex_bits_reset(&_bits);
-  _cached_samples.clear();
+  ogg_stream_reset(&_stream);
+  _end_granule = -1;
+  _end_of_stream = false;
+  if (page_offset < 0) {
+    positionAt(_audio_offset);
+    _granule = 0;
+    return;
+  }
+  positionAt(page_offset);
+  ogg_page page;
+  long offset = -1;
+  while ((offset = readPage(page)) >= 0 && ogg_page_serialno(&page) != _serial) {
+  }
+  if (offset < 0) {
+    _end_of_stream = true;
+    return;
+  }
+  // Everything completed on the page we land on ends by its granule, so it only warms the
+  // decoder up
+  ogg_stream_pagein(&_stream, &page);
+  ogg_packet packet;
+  int result = 0;
+  while ((result = ogg_stream_packetout(&_stream, &packet)) != 0) {
+    if (result > 0) {
+      decodePacket(packet, false);
+    }
+  }
+  _granule = page_granule;
+  if (ogg_page_eos(&page)) {
+    _end_granule = page_granule;
+  }
 }
 
 }  // namespace decoder
@@ -23,14 +23,19 @@
 #include <NFDecoder/Decoder.h>
 
 #include <atomic>
-#include <future>
 #include <mutex>
 #include <vector>
 
 #include <NFDecoder/DataProvider.h>
+#include <NFDecoder/Executor.h>
 #include <NFDecoder/Factory.h>
 
+#include <ogg/ogg.h>
 #include <speex/speex.h>
+#include <speex/speex_stereo.h>
+
+#include "PCMBuffer.h"
+#include "SeekIndex.h"
 
 namespace nativeformat {
 namespace decoder {
@@ -40,13 +45,17 @@ typedef std::function<void(bool success)> LOAD_DECODER_CALLBACK;
 class DecoderSpeexImplementation : public Decoder,
                                    public std::enable_shared_from_this<DecoderSpeexImplementation> {
  public:
-  typedef enum : int { ErrorCodeNotEnoughData, ErrorCodeCouldNotDecode } ErrorCode;
+  typedef enum : int {
+    ErrorCodeNotEnoughData,
+    ErrorCodeCouldNotDecode,
+    ErrorCodeNotOggSpeex,
+    ErrorCodeUnsupportedMode
+  } ErrorCode;
 
-  DecoderSpeexImplementation(std::shared_ptr<DataProvider> &data_provider);
+  DecoderSpeexImplementation(std::shared_ptr<DataProvider> &data_provider,
+                             const std::shared_ptr<Executor> &executor);
   virtual ~DecoderSpeexImplementation();
 
-  bool checkCodec();
-
   // Decoder
   virtual double sampleRate();
   virtual int channels();
@@ -54,26 +63,62 @@ class DecoderSpeexImplementation : public Decoder,
   virtual void seek(long frame_index);
   virtual long frames();
   virtual void decode(long frames, const DECODE_CALLBACK &decode_callback, bool synchronous);
+  virtual void decodeInto(float *samples,
+                          long frames,
+                          const DECODE_INTO_CALLBACK &decode_into_callback,
+                          bool synchronous);
   virtual bool eof();
   virtual const std::string &path();
   virtual const std::string &name();
   virtual void flush();
   virtual void load(const ERROR_DECODER_CALLBACK &decoder_error_callback,
                     const LOAD_DECODER_CALLBACK &decoder_load_callback);
+  virtual std::shared_ptr<Decoder> clone();
 
  private:
+  // All of these require _speex_mutex to be held
+  long readPage(ogg_page &page);
+  void positionAt(long offset);
+  void pageIn(ogg_page &page, long offset);
+  bool readHeaders(int &error_code);
+  long lastGranule();
+  void bufferFrames(long frames);
+  void decodePacket(ogg_packet &packet, bool output);
+  bool bisectPage(long frame, long &page_offset, long &page_granule);
+  void restartAt(long page_offset, long page_granule);
+  void cacheStreamInfo();
+
   std::shared_ptr<DataProvider> _data_provider;
+  const std::shared_ptr<Executor> _executor;
 
   std::mutex _speex_mutex;
   std::atomic<int> _channels;
   std::atomic<double> _samplerate;
   std::atomic<long> _frames;
   std::atomic<long> _frame_index;
-  int _current_section;
-  std::future<void> _load_future;
   void *_state;
   SpeexBits _bits;
-  std::vector<float> _cached_samples;
+  SpeexStereoState *_stereo;
+  int _frame_size;
+  int _frames_per_packet;
+  std::vector<float> _decoded_samples;
+  PCMBuffer _cached_samples;
+  ogg_sync_state _sync;
+  ogg_stream_state _stream;
+  bool _ogg_initialised;
+  int _serial;
+  // Byte offset in the provider of the next byte the sync state has not consumed
+  long _sync_offset;
+  long _audio_offset;
+  // Granule position of the next decoded sample, which is also its frame index
+  long _granule;
+  long _end_granule;
+  long _discard_until_frame;
+  bool _end_of_stream;
+  // Page granules and offsets seen while decoding forward, so repeat seeks skip the bisection
+  SeekIndex _seek_index;
+  bool _indexing;
+  std::string _stream_info_key;
 };
 
 }  // namespace decoder
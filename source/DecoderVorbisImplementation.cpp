@@ -21,7 +21,10 @@
 #include "DecoderVorbisImplementation.h"
 
 #include <cstdlib>
-#include <future>
+
+#include "PCMKernels.h"
+#include "ProbeImplementation.h"
+#include "StreamInfoCache.h"
 
 namespace nativeformat {
 namespace decoder {
@@ -34,16 +37,26 @@ const ov_callbacks DecoderVorbisImplementation::callbacks{
     .close_func = &DecoderVorbisImplementation::vorbis_close,
     .tell_func = &DecoderVorbisImplementation::vorbis_tell};
 
+const ov_callbacks DecoderVorbisImplementation::unseekable_callbacks{
+    .read_func = &DecoderVorbisImplementation::vorbis_read,
+    .seek_func = nullptr,
+    .close_func = &DecoderVorbisImplementation::vorbis_close,
+    .tell_func = &DecoderVorbisImplementation::vorbis_tell};
+
 DecoderVorbisImplementation::DecoderVorbisImplementation(
-    std::shared_ptr<DataProvider> &data_provider)
+    std::shared_ptr<DataProvider> &data_provider, const std::shared_ptr<Executor> &executor)
     : _data_provider(data_provider),
+      _executor(executor),
       _open(false),
       _info(nullptr),
       _channels(0),
       _samplerate(0.0),
       _frames(0),
       _frame_index(0),
-      _current_section(0) {}
+      _current_section(0),
+      _seekable(true),
+      _cached_frames(0),
+      _fast_start(true) {}
 
 DecoderVorbisImplementation::~DecoderVorbisImplementation() {
   if (_open) {
@@ -58,7 +71,7 @@ const std::string &DecoderVorbisImplementation::name() {
 
 bool DecoderVorbisImplementation::checkCodec() {
   std::lock_guard<std::mutex> vorbis_lock(_vorbis_mutex);
-  int error_code = ov_test_callbacks(this, &_vorbis_file, nullptr, 0, callbacks);
+  int error_code = ov_test_callbacks(this, &_vorbis_file, nullptr, 0, openCallbacks());
   if (error_code) {
     return false;
   }
@@ -76,41 +89,140 @@ bool DecoderVorbisImplementation::checkCodec() {
 void DecoderVorbisImplementation::load(const ERROR_DECODER_CALLBACK &decoder_error_callback,
                                        const LOAD_DECODER_CALLBACK &decoder_load_callback) {
   std::shared_ptr<DecoderVorbisImplementation> strong_this = shared_from_this();
-  _load_future = std::async(
-      std::launch::async, [strong_this, decoder_error_callback, decoder_load_callback]() {
-        {
-          std::lock_guard<std::mutex> vorbis_lock(strong_this->_vorbis_mutex);
-
-          // Open file if checkCodec was not previously called
-          if (!strong_this->_open) {
-            int error_code = ov_open_callbacks(
-                strong_this.get(), &strong_this->_vorbis_file, nullptr, 0, callbacks);
-            if (error_code) {
-              printf("Could not open vorbis file: %s\n", vorbis_error(error_code).c_str());
-              decoder_error_callback(strong_this->name(), ErrorCodeCouldNotDecode);
-              decoder_load_callback(false);
-              return;
-            }
-            ov_set_read_size(&strong_this->_vorbis_file, VORBIS_READ_SIZE);
-            strong_this->_open = true;
-          }
+  _executor->execute([strong_this, decoder_error_callback, decoder_load_callback]() {
+    bool success = false;
+    {
+      std::lock_guard<std::mutex> vorbis_lock(strong_this->_vorbis_mutex);
+      success = strong_this->openStream(decoder_error_callback);
+    }
+    decoder_load_callback(success);
+  });
+}
 
-          // Retrieve the header information
-          strong_this->_info = ov_info(&strong_this->_vorbis_file, 0);
-          if (strong_this->_info == nullptr) {
-            decoder_error_callback(strong_this->name(), ErrorCodeCouldNotDecode);
-            decoder_load_callback(false);
-            return;
-          }
+bool DecoderVorbisImplementation::openStream(const ERROR_DECODER_CALLBACK &decoder_error_callback) {
+  // Open file if checkCodec was not previously called
+  if (!_open) {
+    int error_code = ov_open_callbacks(this, &_vorbis_file, nullptr, 0, openCallbacks());
+    if (error_code) {
+      printf("Could not open vorbis file: %s\n", vorbis_error(error_code).c_str());
+      decoder_error_callback(name(), ErrorCodeCouldNotDecode);
+      return false;
+    }
+    ov_set_read_size(&_vorbis_file, VORBIS_READ_SIZE);
+    _open = true;
+  }
 
-          // Parse the information
-          strong_this->_channels = strong_this->_info->channels;
-          strong_this->_samplerate = static_cast<double>(strong_this->_info->rate);
-          double time_total = ov_time_total(&strong_this->_vorbis_file, -1);
-          strong_this->_frames = time_total * strong_this->sampleRate();
-        }
-        decoder_load_callback(true);
-      });
+  // Retrieve the header information
+  _info = ov_info(&_vorbis_file, 0);
+  if (_info == nullptr) {
+    decoder_error_callback(name(), ErrorCodeCouldNotDecode);
+    return false;
+  }
+
+  // Parse the information
+  _channels = _info->channels;
+  _samplerate = static_cast<double>(_info->rate);
+  if (!_seekable) {
+    _frames = _cached_frames;
+    if (_cached_frames == UNKNOWN_FRAMES) {
+      probeFrames();
+    }
+    return true;
+  }
+  double time_total = ov_time_total(&_vorbis_file, -1);
+  _frames = time_total * sampleRate();
+  StreamInfo stream_info;
+  stream_info.samplerate = _samplerate;
+  stream_info.channels = _channels;
+  stream_info.frames = _frames;
+  stream_info.data_offset = 0;
+  stream_info.data_bytes = _data_provider->size();
+  stream_info.seek_interval_frames = 0;
+  storeStreamInfo(streamInfoKey("vorbis", *_data_provider), stream_info);
+  return true;
+}
+
+const ov_callbacks &DecoderVorbisImplementation::openCallbacks() {
+  StreamInfo stream_info;
+  if (!_fast_start) {
+    _seekable = true;
+    _cached_frames = UNKNOWN_FRAMES;
+  } else if (findStreamInfo(streamInfoKey("vorbis", *_data_provider), stream_info)) {
+    _seekable = false;
+    _cached_frames = stream_info.frames;
+  } else {
+    _seekable = !lazyDuration();
+    _cached_frames = UNKNOWN_FRAMES;
+  }
+  return _seekable ? callbacks : unseekable_callbacks;
+}
+
+void DecoderVorbisImplementation::probeFrames() {
+  // The probe reads the end of the stream through its own provider, so decoding can start now
+  std::shared_ptr<DataProvider> data_provider = _data_provider->clone();
+  if (!data_provider) {
+    return;
+  }
+  std::weak_ptr<DecoderVorbisImplementation> weak_this = shared_from_this();
+  _executor->execute([weak_this, data_provider]() {
+    ProbeResult result =
+        ProbeImplementation::probeDataProvider(data_provider, PROBE_DEFAULT_BYTE_BUDGET);
+    if (result.codec != "vorbis" || result.frames == UNKNOWN_FRAMES) {
+      return;
+    }
+    if (std::shared_ptr<DecoderVorbisImplementation> strong_this = weak_this.lock()) {
+      // A seekable reopen may have found the length first
+      long unknown_frames = UNKNOWN_FRAMES;
+      strong_this->_frames.compare_exchange_strong(unknown_frames, result.frames);
+    }
+    StreamInfo stream_info;
+    stream_info.samplerate = result.samplerate;
+    stream_info.channels = result.channels;
+    stream_info.frames = result.frames;
+    stream_info.data_offset = 0;
+    stream_info.data_bytes = data_provider->size();
+    stream_info.seek_interval_frames = 0;
+    storeStreamInfo(streamInfoKey("vorbis", *data_provider), stream_info);
+  });
+}
+
+bool DecoderVorbisImplementation::reopenSeekable() {
+  ov_clear(&_vorbis_file);
+  _open = false;
+  _info = nullptr;
+  _data_provider->seek(0, SEEK_SET);
+  int error_code = ov_open_callbacks(this, &_vorbis_file, nullptr, 0, callbacks);
+  if (error_code) {
+    printf("Could not open vorbis file: %s\n", vorbis_error(error_code).c_str());
+    return false;
+  }
+  ov_set_read_size(&_vorbis_file, VORBIS_READ_SIZE);
+  _open = true;
+  _seekable = true;
+  _info = ov_info(&_vorbis_file, 0);
+  _current_section = 0;
+  if (_frames == UNKNOWN_FRAMES && _info != nullptr) {
+    _frames = ov_time_total(&_vorbis_file, -1) * sampleRate();
+  }
+  return true;
+}
+
+std::shared_ptr<Decoder> DecoderVorbisImplementation::clone() {
+  std::shared_ptr<DataProvider> data_provider = _data_provider->clone();
+  if (!data_provider) {
+    return nullptr;
+  }
+  // libvorbisfile cannot share a parsed OggVorbis_File, so the clone opens its own, reading the
+  // headers from the data the provider already holds
+  auto decoder = std::make_shared<DecoderVorbisImplementation>(data_provider, _executor);
+  {
+    std::lock_guard<std::mutex> vorbis_lock(decoder->_vorbis_mutex);
+    decoder->_fast_start = false;
+    if (!decoder->openStream([](const std::string &domain, int error_code) {})) {
+      return nullptr;
+    }
+  }
+  return decoder;
 }
 
 double DecoderVorbisImplementation::sampleRate() {
@@ -127,6 +239,17 @@ long DecoderVorbisImplementation::currentFrameIndex() {
 
 void DecoderVorbisImplementation::seek(long frame_index) {
   std::lock_guard<std::mutex> vorbis_lock(_vorbis_mutex);
+  if (!_open) {
+    return;
+  }
+  // Decoding on from where the last decode stopped needs no seek
+  if (ov_pcm_tell(&_vorbis_file) == frame_index) {
+    _frame_index = frame_index;
+    return;
+  }
+  if (!_seekable && !reopenSeekable()) {
+    return;
+  }
   int error_code = ov_pcm_seek(&_vorbis_file, frame_index);
   if (error_code != 0) {
     return;
@@ -141,15 +264,28 @@ long DecoderVorbisImplementation::frames() {
 void DecoderVorbisImplementation::decode(long frames,
                                          const DECODE_CALLBACK &decode_callback,
                                          bool synchronous) {
+  float *samples = (float *)malloc(frames * channels() * sizeof(float));
+  decodeInto(samples,
+             frames,
+             [decode_callback, samples](long frame_index, long frame_count) {
+               decode_callback(frame_index, frame_count, samples);
+               free(samples);
+             },
+             synchronous);
+}
+
+void DecoderVorbisImplementation::decodeInto(float *interleaved_samples,
+                                             long frames,
+                                             const DECODE_INTO_CALLBACK &decode_into_callback,
+                                             bool synchronous) {
   std::shared_ptr<DecoderVorbisImplementation> strong_this = shared_from_this();
-  auto run_thread = [strong_this, decode_callback, frames] {
+  auto run_thread = [strong_this, interleaved_samples, decode_into_callback, frames] {
     long frame_index = strong_this->currentFrameIndex();
 
     // Make sure vorbis file is on the same page
     strong_this->seek(frame_index);
 
     int channels = strong_this->channels();
-    float *interleaved_samples = (float *)malloc(frames * channels * sizeof(float));
     long read_frames = 0;
     {
       std::lock_guard<std::mutex> vorbis_lock(strong_this->_vorbis_mutex);
@@ -168,23 +304,19 @@ void DecoderVorbisImplementation::decode(long frames,
           }
           break;
         }
-        for (long i = 0; i < current_read_frames; ++i) {
-          for (int j = 0; j < channels; ++j) {
-            interleaved_samples[(i * channels) + j + (read_frames * channels)] = samples[j][i];
-          }
-        }
+        pcmInterleave(
+            samples, interleaved_samples + (read_frames * channels), current_read_frames, channels);
         read_frames += current_read_frames;
       }
     }
 
     strong_this->_frame_index = frame_index + read_frames;
-    decode_callback(frame_index, read_frames, interleaved_samples);
-    free(interleaved_samples);
+    decode_into_callback(frame_index, read_frames);
   };
   if (synchronous) {
     run_thread();
   } else {
-    std::thread(run_thread).detach();
+    _executor->execute(run_thread);
   }
 }
 
@@ -23,10 +23,10 @@
 #include <NFDecoder/Decoder.h>
 
 #include <atomic>
-#include <future>
 #include <mutex>
 
 #include <NFDecoder/DataProvider.h>
+#include <NFDecoder/Executor.h>
 #include <NFDecoder/Factory.h>
 
 extern "C" {
@@ -44,7 +44,8 @@ class DecoderVorbisImplementation
  public:
   typedef enum : int { ErrorCodeNotEnoughData, ErrorCodeCouldNotDecode } ErrorCode;
 
-  DecoderVorbisImplementation(std::shared_ptr<DataProvider> &data_provider);
+  DecoderVorbisImplementation(std::shared_ptr<DataProvider> &data_provider,
+                              const std::shared_ptr<Executor> &executor);
   virtual ~DecoderVorbisImplementation();
 
   bool checkCodec();
@@ -56,14 +57,25 @@ class DecoderVorbisImplementation
   virtual void seek(long frame_index);
   virtual long frames();
   virtual void decode(long frames, const DECODE_CALLBACK &decode_callback, bool synchronous);
+  virtual void decodeInto(float *samples,
+                          long frames,
+                          const DECODE_INTO_CALLBACK &decode_into_callback,
+                          bool synchronous);
   virtual bool eof();
   virtual const std::string &path();
   virtual const std::string &name();
   virtual void flush();
   virtual void load(const ERROR_DECODER_CALLBACK &decoder_error_callback,
                     const LOAD_DECODER_CALLBACK &decoder_load_callback);
+  virtual std::shared_ptr<Decoder> clone();
 
  private:
+  // Requires _vorbis_mutex to be held
+  bool openStream(const ERROR_DECODER_CALLBACK &decoder_error_callback);
+  const ov_callbacks &openCallbacks();
+  bool reopenSeekable();
+  void probeFrames();
+
   static size_t vorbis_read(void *ptr, size_t size, size_t nmemb, void *datasource);
   static int vorbis_seek(void *datasource, ogg_int64_t offset, int whence);
   static int vorbis_close(void *datasource);
@@ -71,6 +83,7 @@ class DecoderVorbisImplementation
   static std::string vorbis_error(int code);
 
   std::shared_ptr<DataProvider> _data_provider;
+  const std::shared_ptr<Executor> _executor;
 
   std::mutex _vorbis_mutex;
   bool _open;
@@ -81,9 +94,16 @@ class DecoderVorbisImplementation
   std::atomic<long> _frames;
   std::atomic<long> _frame_index;
   int _current_section;
-  std::future<void> _load_future;
+  // Cached and lazily loaded streams open without a seek callback so libvorbisfile skips the scan
+  // to their end, the first real seek reopens them seekable
+  bool _seekable;
+  // UNKNOWN_FRAMES when loaded lazily, until the background probe finds the length
+  long _cached_frames;
+  // Only a fresh load takes the unseekable route, clones are made to seek and open seekable
+  bool _fast_start;
 
   static const ov_callbacks callbacks;
+  static const ov_callbacks unseekable_callbacks;
 };
 
 }  // namespace decoder
@@ -20,8 +20,13 @@
  */
 #include "DecoderWavImplementation.h"
 
+#include <algorithm>
 #include <cstdlib>
-#include <future>
+#include <cstring>
+#include <limits>
+
+#include "PCMKernels.h"
+#include "StreamInfoCache.h"
 
 namespace nativeformat {
 namespace decoder {
@@ -37,8 +42,10 @@ static inline bool CHUNK_TYPE(char *s, const char *fcc) {
   return str.compare(0, 4, fcc) == 0;
 }
 
-DecoderWavImplementation::DecoderWavImplementation(std::shared_ptr<DataProvider> &data_provider)
+DecoderWavImplementation::DecoderWavImplementation(
+    std::shared_ptr<DataProvider> &data_provider, const std::shared_ptr<Executor> &executor)
     : _data_provider(data_provider),
+      _executor(executor),
       _channels(0),
       _samplerate(0.0),
       _frames(0),
@@ -55,43 +62,77 @@ const std::string &DecoderWavImplementation::name() {
 void DecoderWavImplementation::load(const ERROR_DECODER_CALLBACK &decoder_error_callback,
                                     const LOAD_DECODER_CALLBACK &decoder_load_callback) {
   std::shared_ptr<DecoderWavImplementation> strong_this = shared_from_this();
-  _load_future = std::async(
-      std::launch::async, [strong_this, decoder_error_callback, decoder_load_callback]() {
-        // Download the master header
-        size_t read_bytes =
-            strong_this->_data_provider->read(&strong_this->_header, sizeof(WAVHeader), 1);
-        if (read_bytes < sizeof(WAVHeader)) {
-          decoder_error_callback(strong_this->name(), ErrorCodeNotEnoughDataForHeader);
-          decoder_load_callback(false);
-          return;
-        } else if (!CHUNK_TYPE(strong_this->_header.riff_header_name, RIFF)) {
-          decoder_error_callback(strong_this->name(), ErrorCodeNotRiff);
-          decoder_load_callback(false);
-        } else if (!CHUNK_TYPE(strong_this->_header.wave_header_name, WAVE)) {
-          decoder_error_callback(strong_this->name(), ErrorCodeNotWav);
-          decoder_load_callback(false);
-        }
-
-        // Find all the chunks we care about, but don't read any data yet
-        bool fmt_found = false, data_found = false, ok;
-        while (!fmt_found || !data_found) {
-          ok = strong_this->readChunk();
-          if (!ok) {
-            decoder_error_callback(strong_this->name(), ErrorCodeChunkError);
-            decoder_load_callback(false);
-            return;
-          }
-          if (CHUNK_TYPE(strong_this->_chunk_type, FMT)) {
-            fmt_found = true;
-          } else if (CHUNK_TYPE(strong_this->_chunk_type, DATA)) {
-            data_found = true;
-          }
-        }
-
-        // Seek to beginning of data chunk to prepare for decoding
-        strong_this->seek(0);
-        decoder_load_callback(true);
-      });
+  _executor->execute([strong_this, decoder_error_callback, decoder_load_callback]() {
+    // A stream seen before skips the chunk walk, its headers come back from the cache
+    const std::string stream_info_key = streamInfoKey("wav", *strong_this->_data_provider);
+    StreamInfo stream_info;
+    if (findStreamInfo(stream_info_key, stream_info) &&
+        stream_info.codec_private.size() == sizeof(WAVHeader) + sizeof(FMTHeader)) {
+      memcpy(&strong_this->_header, stream_info.codec_private.data(), sizeof(WAVHeader));
+      memcpy(&strong_this->_fmt,
+             stream_info.codec_private.data() + sizeof(WAVHeader),
+             sizeof(FMTHeader));
+      strong_this->_channels = stream_info.channels;
+      strong_this->_samplerate = stream_info.samplerate;
+      strong_this->_frames = stream_info.frames;
+      strong_this->_frame_size = (strong_this->_fmt.bit_depth / 8) * strong_this->_fmt.channels;
+      strong_this->_data_offset = stream_info.data_offset;
+      strong_this->_data_bytes = stream_info.data_bytes;
+      strong_this->seek(0);
+      decoder_load_callback(true);
+      return;
+    }
+
+    // Download the master header
+    size_t read_bytes =
+        strong_this->_data_provider->read(&strong_this->_header, sizeof(WAVHeader), 1);
+    if (read_bytes < sizeof(WAVHeader)) {
+      decoder_error_callback(strong_this->name(), ErrorCodeNotEnoughDataForHeader);
+      decoder_load_callback(false);
+      return;
+    } else if (!CHUNK_TYPE(strong_this->_header.riff_header_name, RIFF)) {
+      decoder_error_callback(strong_this->name(), ErrorCodeNotRiff);
+      decoder_load_callback(false);
+      return;
+    } else if (!CHUNK_TYPE(strong_this->_header.wave_header_name, WAVE)) {
+      decoder_error_callback(strong_this->name(), ErrorCodeNotWav);
+      decoder_load_callback(false);
+      return;
+    }
+
+    // Find all the chunks we care about, but don't read any data yet
+    bool fmt_found = false, data_found = false, ok;
+    while (!fmt_found || !data_found) {
+      ok = strong_this->readChunk();
+      if (!ok) {
+        decoder_error_callback(strong_this->name(), ErrorCodeChunkError);
+        decoder_load_callback(false);
+        return;
+      }
+      if (CHUNK_TYPE(strong_this->_chunk_type, FMT)) {
+        fmt_found = true;
+      } else if (CHUNK_TYPE(strong_this->_chunk_type, DATA)) {
+        data_found = true;
+      }
+    }
+
+    stream_info.samplerate = strong_this->_samplerate;
+    stream_info.channels = strong_this->_channels;
+    stream_info.frames = strong_this->_frames;
+    stream_info.data_offset = strong_this->_data_offset;
+    stream_info.data_bytes = strong_this->_data_bytes;
+    const unsigned char *header = (const unsigned char *)&strong_this->_header;
+    const unsigned char *fmt = (const unsigned char *)&strong_this->_fmt;
+    stream_info.codec_private.assign(header, header + sizeof(WAVHeader));
+    stream_info.codec_private.insert(stream_info.codec_private.end(), fmt, fmt + sizeof(FMTHeader));
+    stream_info.seek_interval_frames = 0;
+    stream_info.seek_points.clear();
+    storeStreamInfo(stream_info_key, stream_info);
+
+    // Seek to beginning of data chunk to prepare for decoding
+    strong_this->seek(0);
+    decoder_load_callback(true);
+  });
 }
 
 double DecoderWavImplementation::sampleRate() {
@@ -115,74 +156,96 @@ long DecoderWavImplementation::frames() {
   return _frames;
 }
 
+std::shared_ptr<Decoder> DecoderWavImplementation::clone() {
+  std::shared_ptr<DataProvider> data_provider = _data_provider->clone();
+  if (!data_provider) {
+    return nullptr;
+  }
+  // The chunks were all found at load, copy what they said
+  auto decoder = std::make_shared<DecoderWavImplementation>(data_provider, _executor);
+  decoder->_channels = static_cast<int>(_channels);
+  decoder->_samplerate = static_cast<double>(_samplerate);
+  decoder->_frames = static_cast<long>(_frames);
+  decoder->_frame_size = static_cast<long>(_frame_size);
+  decoder->_header = _header;
+  decoder->_fmt = _fmt;
+  decoder->_data_offset = _data_offset;
+  decoder->_data_bytes = _data_bytes;
+  decoder->seek(0);
+  return decoder;
+}
+
 void DecoderWavImplementation::decode(long frames,
                                       const DECODE_CALLBACK &decode_callback,
                                       bool synchronous) {
+  float *samples = (float *)malloc(frames * channels() * sizeof(float));
+  decodeInto(samples,
+             frames,
+             [decode_callback, samples](long frame_index, long frame_count) {
+               decode_callback(frame_index, frame_count, frame_count > 0 ? samples : nullptr);
+               free(samples);
+             },
+             synchronous);
+}
+
+void DecoderWavImplementation::decodeInto(float *samples,
+                                          long frames,
+                                          const DECODE_INTO_CALLBACK &decode_into_callback,
+                                          bool synchronous) {
   long frame_index = _frame_index;
   if (frame_index >= _frames) {
-    decode_callback(frame_index, 0, nullptr);
+    decode_into_callback(frame_index, 0);
     return;
   }
   std::shared_ptr<DecoderWavImplementation> strong_this = shared_from_this();
-  auto run_thread = [strong_this, decode_callback, frames, frame_index] {
+  auto run_thread = [strong_this, samples, decode_into_callback, frames, frame_index] {
     if (frames == 0) {
-      decode_callback(frame_index, 0, nullptr);
+      decode_into_callback(frame_index, 0);
       return;
     }
 
     int channels = strong_this->channels();
     if (channels == 0) {
-      decode_callback(frame_index, 0, nullptr);
+      decode_into_callback(frame_index, 0);
       return;
     }
 
     size_t sample_size = wavSampleSize(strong_this->_fmt);
     if (sample_size == 0 || strong_this->_fmt.audio_format == WAVHeaderAudioFormatNone) {
-      decode_callback(frame_index, 0, nullptr);
+      decode_into_callback(frame_index, 0);
       return;
     }
 
-    if (strong_this->_fmt.audio_format == WAVHeaderAudioFormatIEEEFloat) {
-      std::vector<float> output(frames * channels);
-      size_t bytes_read =
-          strong_this->_data_provider->read((void *)output.data(), sample_size * channels, frames);
-      size_t frames_read = bytes_read / (sample_size * channels);
-      decode_callback(frame_index, frames_read, output.data());
-      return;
-    }
-
-    // Assume by default that strong_this->_fmt.audio_format ==
-    // WAVHeaderAudioFormatPCM
+    // Never read past the data chunk into whatever chunks follow it
+    long frames_to_read = std::min(frames, strong_this->_frames - frame_index);
     size_t frames_read = 0;
-    switch (sample_size) {
-      case 1: {
-        WavReader<uint8_t> wv(strong_this->_data_provider.get(), frames, channels);
-        frames_read = wv.transferSamples(frames, channels);
-        decode_callback(frame_index, frames_read, wv.out_samples.data());
-        return;
-      }
-      case 2: {
-        WavReader<int16_t> wv(strong_this->_data_provider.get(), frames, channels);
-        frames_read = wv.transferSamples(frames, channels);
-        decode_callback(frame_index, frames_read, wv.out_samples.data());
-        return;
-      }
-      case 4: {
-        WavReader<int32_t> wv(strong_this->_data_provider.get(), frames, channels);
-        frames_read = wv.transferSamples(frames, channels);
-        decode_callback(frame_index, frames_read, wv.out_samples.data());
-        return;
-      }
-      default: {
-        decode_callback(frame_index, 0, nullptr);
-        return;
+    if (strong_this->_fmt.audio_format == WAVHeaderAudioFormatIEEEFloat) {
+      DataProvider *data_provider = strong_this->_data_provider.get();
+      size_t bytes_to_read = frames_to_read * sample_size * channels;
+      long offset = data_provider->tell();
+      const void *borrowed_samples = data_provider->borrow(offset, bytes_to_read);
+      if (borrowed_samples != nullptr) {
+        memcpy(samples, borrowed_samples, bytes_to_read);
+        data_provider->seek(offset + bytes_to_read, SEEK_SET);
+        frames_read = frames_to_read;
+      } else {
+        size_t bytes_read =
+            data_provider->read((void *)samples, sample_size * channels, frames_to_read);
+        frames_read = bytes_read / (sample_size * channels);
       }
+    } else {
+      // Assume by default that strong_this->_fmt.audio_format ==
+      // WAVHeaderAudioFormatPCM
+      frames_read = transferSamples(
+          strong_this->_data_provider.get(), samples, frames_to_read, channels, sample_size);
     }
+    strong_this->_frame_index = frame_index + frames_read;
+    decode_into_callback(frame_index, frames_read);
   };
   if (synchronous) {
     run_thread();
   } else {
-    std::thread(run_thread).detach();
+    _executor->execute(run_thread);
   }
 }
 
@@ -200,6 +263,57 @@ size_t DecoderWavImplementation::wavSampleSize(const FMTHeader &header) {
   return header.bit_depth / 8;
 }
 
+size_t DecoderWavImplementation::transferSamples(DataProvider *data_provider,
+                                                 float *samples,
+                                                 size_t frames,
+                                                 size_t channels,
+                                                 size_t sample_size) {
+  if (sample_size > sizeof(float)) {
+    return 0;
+  }
+  // Convert straight out of the provider's storage when it can lend it
+  size_t sample_count = frames * channels;
+  long offset = data_provider->tell();
+  const void *borrowed_samples = data_provider->borrow(offset, sample_count * sample_size);
+  if (borrowed_samples != nullptr) {
+    convertSamples(borrowed_samples, samples, sample_count, sample_size);
+    data_provider->seek(offset + (sample_count * sample_size), SEEK_SET);
+    return frames;
+  }
+  // Otherwise read the raw samples into the tail of the output buffer and widen them in place,
+  // every sample type is at most as wide as a float so the output never overtakes the input
+  unsigned char *in_samples =
+      (unsigned char *)(samples + sample_count) - (sample_count * sample_size);
+  size_t bytes_read = data_provider->read(in_samples, sample_size * channels, frames);
+  size_t frames_read = bytes_read / (sample_size * channels);
+  convertSamples(in_samples, samples, frames_read * channels, sample_size);
+  return frames_read;
+}
+
+void DecoderWavImplementation::convertSamples(const void *in_samples,
+                                              float *samples,
+                                              size_t sample_count,
+                                              size_t sample_size) {
+  switch (sample_size) {
+    case 1:
+      pcmConvertUInt8ToFloat(in_samples, samples, sample_count, 1.0f / 128.0f);
+      break;
+    case 2:
+      pcmConvertInt16ToFloat(
+          in_samples, samples, sample_count, 1.0f / std::numeric_limits<int16_t>::max());
+      break;
+    case 3:
+      pcmConvertInt24ToFloat(in_samples, samples, sample_count, 1.0f / 8388607.0f);
+      break;
+    case 4:
+      pcmConvertInt32ToFloat(
+          in_samples, samples, sample_count, 1.0f / std::numeric_limits<int32_t>::max());
+      break;
+    default:
+      break;
+  }
+}
+
 bool DecoderWavImplementation::readChunk() {
   if (_data_provider->eof()) return false;
 
@@ -23,10 +23,10 @@
 #include <NFDecoder/Decoder.h>
 
 #include <atomic>
-#include <future>
 #include <mutex>
 
 #include <NFDecoder/DataProvider.h>
+#include <NFDecoder/Executor.h>
 #include <NFDecoder/Factory.h>
 
 namespace nativeformat {
@@ -45,7 +45,8 @@ class DecoderWavImplementation : public Decoder,
     ErrorCodeChunkError
   } ErrorCode;
 
-  DecoderWavImplementation(std::shared_ptr<DataProvider> &data_provider);
+  DecoderWavImplementation(std::shared_ptr<DataProvider> &data_provider,
+                           const std::shared_ptr<Executor> &executor);
   virtual ~DecoderWavImplementation();
 
   // Decoder
@@ -55,12 +56,17 @@ class DecoderWavImplementation : public Decoder,
   virtual void seek(long frame_index);
   virtual long frames();
   virtual void decode(long frames, const DECODE_CALLBACK &decode_callback, bool synchronous);
+  virtual void decodeInto(float *samples,
+                          long frames,
+                          const DECODE_INTO_CALLBACK &decode_into_callback,
+                          bool synchronous);
   virtual bool eof();
   virtual const std::string &path();
   virtual const std::string &name();
   virtual void flush();
   virtual void load(const ERROR_DECODER_CALLBACK &decoder_error_callback,
                     const LOAD_DECODER_CALLBACK &decoder_load_callback);
+  virtual std::shared_ptr<Decoder> clone();
 
  private:
   typedef enum : short {
@@ -95,8 +101,18 @@ class DecoderWavImplementation : public Decoder,
   bool readChunk();
   bool knownType();
   static size_t wavSampleSize(const FMTHeader &header);
+  static size_t transferSamples(DataProvider *data_provider,
+                                float *samples,
+                                size_t frames,
+                                size_t channels,
+                                size_t sample_size);
+  static void convertSamples(const void *in_samples,
+                             float *samples,
+                             size_t sample_count,
+                             size_t sample_size);
 
   std::shared_ptr<DataProvider> _data_provider;
+  const std::shared_ptr<Executor> _executor;
   const ERROR_DECODER_CALLBACK _decoder_error_callback;
 
   std::mutex _wav_mutex;
@@ -105,7 +121,6 @@ class DecoderWavImplementation : public Decoder,
   std::atomic<long> _frames;
   std::atomic<long> _frame_size;
   std::atomic<long> _frame_index;
-  std::future<void> _load_future;
   char _chunk_type[4];
   WAVHeader _header;
   FMTHeader _fmt;
@@ -113,32 +128,5 @@ class DecoderWavImplementation : public Decoder,
   uint32_t _data_bytes;
 };
 
-template <typename sample_t>
-struct WavReader {
-  std::vector<sample_t> in_samples;
-  std::vector<float> out_samples;
-  DataProvider *dp;
-  static constexpr size_t sample_size = sizeof(sample_t);
-
-  WavReader(DataProvider *data_provider, size_t frames, size_t channels)
-      : in_samples(frames * channels), dp(data_provider) {}
-  ~WavReader() {}
-
-  size_t transferSamples(size_t frames, size_t channels) {
-    size_t bytes_read = dp->read((char *)in_samples.data(), sample_size * channels, frames);
-    size_t frames_read = bytes_read / (sample_size * channels);
-    out_samples.resize(frames_read * channels);
-    static constexpr float s_min = static_cast<float>(std::numeric_limits<sample_t>::min());
-    static constexpr float s_max = static_cast<float>(std::numeric_limits<sample_t>::max());
-    static constexpr sample_t dc_offset = s_min ? 0 : s_max / 2;
-    for (long i = 0; i < frames_read * channels; ++i) {
-      float sample = static_cast<float>(in_samples[i] - dc_offset) /
-                     static_cast<float>(std::numeric_limits<sample_t>::max());
-      out_samples[i] = sample;
-    }
-    return frames_read;
-  }
-};
-
 }  // namespace decoder
 }  // namespace nativeformat
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2017 Spotify AB.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include <NFDecoder/Executor.h>
+
+#include <algorithm>
+#include <thread>
+
+#include "ExecutorThreadImplementation.h"
+#include "ExecutorThreadPoolImplementation.h"
+
+namespace nativeformat {
+namespace decoder {
+
+const size_t EXECUTOR_DEFAULT_QUEUE_SIZE = 1024;
+
+std::shared_ptr<Executor> createExecutor(size_t thread_count, size_t queue_size) {
+  if (thread_count == 0) {
+    thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+  return std::make_shared<ExecutorThreadPoolImplementation>(thread_count, queue_size);
+}
+
+std::shared_ptr<Executor> createThreadExecutor() {
+  return std::make_shared<ExecutorThreadImplementation>();
+}
+
+}  // namespace decoder
+}  // namespace nativeformat
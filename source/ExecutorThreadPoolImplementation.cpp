@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2017 Spotify AB.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include "ExecutorThreadPoolImplementation.h"
+
+namespace nativeformat {
+namespace decoder {
+
+ExecutorThreadPoolImplementation::ExecutorThreadPoolImplementation(size_t thread_count,
+                                                                   size_t queue_size)
+    : _queue_size(queue_size), _queue(std::make_shared<Queue>()) {
+  _queue->running = true;
+  for (size_t i = 0; i < thread_count; ++i) {
+    _threads.push_back(std::thread(&ExecutorThreadPoolImplementation::runWorker, _queue));
+  }
+}
+
+ExecutorThreadPoolImplementation::~ExecutorThreadPoolImplementation() {
+  {
+    std::lock_guard<std::mutex> lock(_queue->mutex);
+    _queue->running = false;
+  }
+  _queue->condition_variable.notify_all();
+  for (auto &thread : _threads) {
+    // The last reference to the pool can be dropped by one of its own tasks
+    if (thread.get_id() == std::this_thread::get_id()) {
+      thread.detach();
+    } else {
+      thread.join();
+    }
+  }
+}
+
+void ExecutorThreadPoolImplementation::execute(const EXECUTOR_TASK &task) {
+  {
+    std::lock_guard<std::mutex> lock(_queue->mutex);
+    if (_queue->tasks.size() < _queue_size) {
+      _queue->tasks.push_back(task);
+      _queue->condition_variable.notify_one();
+      return;
+    }
+  }
+  // Never block the caller, fall back to a dedicated thread when saturated
+  std::thread(task).detach();
+}
+
+void ExecutorThreadPoolImplementation::runWorker(std::shared_ptr<Queue> queue) {
+  std::unique_lock<std::mutex> lock(queue->mutex);
+  while (true) {
+    while (queue->running && queue->tasks.empty()) {
+      queue->condition_variable.wait(lock);
+    }
+    if (queue->tasks.empty()) {
+      break;
+    }
+    EXECUTOR_TASK task = std::move(queue->tasks.front());
+    queue->tasks.pop_front();
+    lock.unlock();
+    task();
+    task = nullptr;
+    lock.lock();
+  }
+}
+
+}  // namespace decoder
+}  // namespace nativeformat
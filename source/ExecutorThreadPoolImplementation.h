@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2017 Spotify AB.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#pragma once
+
+#include <NFDecoder/Executor.h>
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace nativeformat {
+namespace decoder {
+
+class ExecutorThreadPoolImplementation : public Executor {
+ public:
+  ExecutorThreadPoolImplementation(size_t thread_count, size_t queue_size);
+  virtual ~ExecutorThreadPoolImplementation();
+
+  // Executor
+  virtual void execute(const EXECUTOR_TASK &task);
+
+ private:
+  struct Queue {
+    std::mutex mutex;
+    std::condition_variable condition_variable;
+    std::deque<EXECUTOR_TASK> tasks;
+    bool running;
+  };
+
+  static void runWorker(std::shared_ptr<Queue> queue);
+
+  const size_t _queue_size;
+  std::shared_ptr<Queue> _queue;
+  std::vector<std::thread> _threads;
+};
+
+}  // namespace decoder
+}  // namespace nativeformat
@@ -20,6 +20,10 @@
  */
 #include <NFDecoder/Factory.h>
 
+#include <algorithm>
+#include <atomic>
+
+#include "DecoderPrefetchImplementation.h"
 #include "FactoryAndroidImplementation.h"
 #include "FactoryAppleImplementation.h"
 #include "FactoryCommonImplementation.h"
@@ -27,28 +31,75 @@
 #include "FactoryNormalisationImplementation.h"
 #include "FactoryServiceImplementation.h"
 #include "FactoryTransmuxerImplementation.h"
+#include "ParallelDecodeImplementation.h"
+#include "ProbeImplementation.h"
 
 namespace nativeformat {
 namespace decoder {
 
 const double STANDARD_SAMPLERATE = 44100.0;
 const int STANDARD_CHANNELS = 2;
+const long PREFETCH_DECODER_DEFAULT_FRAMES = 32768;
+const int PARALLEL_DECODE_DEFAULT_SEGMENTS = 4;
+const size_t STREAM_INFO_CACHE_DEFAULT_ENTRIES = 256;
+const int PROBE_DEFAULT_CONCURRENCY = 8;
+const size_t PROBE_DEFAULT_BYTE_BUDGET = 262144;
+
+namespace {
+
+// Probes read a few small windows at the head and tail of a stream, default sized blocks with
+// read ahead would download several times the budget to serve them
+const size_t PROBE_HTTP_BLOCK_SIZE = 16384;
+
+std::atomic<bool> &lazyDurationEnabled() {
+  static std::atomic<bool> lazy_duration(false);
+  return lazy_duration;
+}
+
+// Prefetch decoders post a task per chunk, so they share one pool rather than a thread apiece
+const std::shared_ptr<Executor> &prefetchExecutor() {
+  static const std::shared_ptr<Executor> prefetch_executor = createExecutor();
+  return prefetch_executor;
+}
+
+}  // namespace
+
+void Factory::createDecoder(const std::shared_ptr<DataProvider> &data_provider,
+                            const std::string &mime_type,
+                            const CREATE_DECODER_CALLBACK create_decoder_callback,
+                            const ERROR_DECODER_CALLBACK error_decoder_callback,
+                            double samplerate,
+                            int channels) {
+  if (!data_provider) {
+    create_decoder_callback(nullptr);
+    return;
+  }
+  createDecoder(data_provider->path(),
+                mime_type,
+                create_decoder_callback,
+                error_decoder_callback,
+                samplerate,
+                channels);
+}
 
 std::shared_ptr<Factory> createCommonFactory(
     std::shared_ptr<DataProviderFactory> data_provider_factory,
     std::shared_ptr<DecrypterFactory> decrypter_factory,
-    std::shared_ptr<ManifestFactory> manifest_factory) {
-  return std::make_shared<FactoryCommonImplementation>(data_provider_factory);
+    std::shared_ptr<ManifestFactory> manifest_factory,
+    std::shared_ptr<Executor> executor) {
+  return std::make_shared<FactoryCommonImplementation>(data_provider_factory, executor);
 }
 
 std::shared_ptr<Factory> createPlatformFactory(
     std::shared_ptr<DataProviderFactory> data_provider_factory,
     std::shared_ptr<DecrypterFactory> decrypter_factory,
-    std::shared_ptr<ManifestFactory> manifest_factory) {
-  std::shared_ptr<Factory> common_factory =
-      createCommonFactory(data_provider_factory, decrypter_factory, manifest_factory);
+    std::shared_ptr<ManifestFactory> manifest_factory,
+    std::shared_ptr<Executor> executor) {
+  std::shared_ptr<Factory> common_factory = createCommonFactory(
+      data_provider_factory, decrypter_factory, manifest_factory, executor);
 #if __APPLE__ && !USE_FFMPEG
-  return std::make_shared<FactoryAppleImplementation>(common_factory, data_provider_factory);
+  return std::make_shared<FactoryAppleImplementation>(
+      common_factory, data_provider_factory, executor);
 #endif
 #if ANDROID
   return std::make_shared<FactoryAndroidImplementation>(common_factory, data_provider_factory);
@@ -59,12 +110,13 @@ std::shared_ptr<Factory> createPlatformFactory(
 std::shared_ptr<Factory> createLGPLFactory(
     std::shared_ptr<DataProviderFactory> data_provider_factory,
     std::shared_ptr<DecrypterFactory> decrypter_factory,
-    std::shared_ptr<ManifestFactory> manifest_factory) {
-  std::shared_ptr<Factory> platform_factory =
-      createPlatformFactory(data_provider_factory, decrypter_factory, manifest_factory);
+    std::shared_ptr<ManifestFactory> manifest_factory,
+    std::shared_ptr<Executor> executor) {
+  std::shared_ptr<Factory> platform_factory = createPlatformFactory(
+      data_provider_factory, decrypter_factory, manifest_factory, executor);
 #if INCLUDE_LGPL
   return std::make_shared<FactoryLGPLImplementation>(
-      platform_factory, data_provider_factory, decrypter_factory);
+      platform_factory, data_provider_factory, decrypter_factory, executor);
 #endif
   return platform_factory;
 }
@@ -72,8 +124,10 @@ std::shared_ptr<Factory> createLGPLFactory(
 std::shared_ptr<Factory> createTransmuxerFactory(
     std::shared_ptr<DataProviderFactory> data_provider_factory,
     std::shared_ptr<DecrypterFactory> decrypter_factory,
-    std::shared_ptr<ManifestFactory> manifest_factory) {
-  auto lgpl_factory = createLGPLFactory(data_provider_factory, decrypter_factory, manifest_factory);
+    std::shared_ptr<ManifestFactory> manifest_factory,
+    std::shared_ptr<Executor> executor) {
+  auto lgpl_factory =
+      createLGPLFactory(data_provider_factory, decrypter_factory, manifest_factory, executor);
   return std::make_shared<FactoryTransmuxerImplementation>(
       lgpl_factory, data_provider_factory, manifest_factory, decrypter_factory);
 }
@@ -81,17 +135,32 @@ std::shared_ptr<Factory> createTransmuxerFactory(
 std::shared_ptr<Factory> createNormalisationFactory(
     std::shared_ptr<DataProviderFactory> data_provider_factory,
     std::shared_ptr<DecrypterFactory> decrypter_factory,
-    std::shared_ptr<ManifestFactory> manifest_factory) {
+    std::shared_ptr<ManifestFactory> manifest_factory,
+    std::shared_ptr<Executor> executor,
+    ResamplerType resampler_type,
+    ResamplerQuality resampler_quality) {
   return std::make_shared<FactoryNormalisationImplementation>(
-      createTransmuxerFactory(data_provider_factory, decrypter_factory, manifest_factory));
+      createTransmuxerFactory(
+          data_provider_factory, decrypter_factory, manifest_factory, executor),
+      executor,
+      resampler_type,
+      resampler_quality);
 }
 
 std::shared_ptr<Factory> createServiceFactory(
     std::shared_ptr<DataProviderFactory> data_provider_factory,
     std::shared_ptr<DecrypterFactory> decrypter_factory,
-    std::shared_ptr<ManifestFactory> manifest_factory) {
+    std::shared_ptr<ManifestFactory> manifest_factory,
+    std::shared_ptr<Executor> executor,
+    ResamplerType resampler_type,
+    ResamplerQuality resampler_quality) {
   return std::make_shared<FactoryServiceImplementation>(
-      createNormalisationFactory(data_provider_factory, decrypter_factory, manifest_factory),
+      createNormalisationFactory(data_provider_factory,
+                                 decrypter_factory,
+                                 manifest_factory,
+                                 executor,
+                                 resampler_type,
+                                 resampler_quality),
       data_provider_factory,
       manifest_factory,
       decrypter_factory);
@@ -99,7 +168,10 @@ std::shared_ptr<Factory> createServiceFactory(
 
 std::shared_ptr<Factory> createFactory(std::shared_ptr<DataProviderFactory> data_provider_factory,
                                        std::shared_ptr<DecrypterFactory> decrypter_factory,
-                                       std::shared_ptr<ManifestFactory> manifest_factory) {
+                                       std::shared_ptr<ManifestFactory> manifest_factory,
+                                       std::shared_ptr<Executor> executor,
+                                       ResamplerType resampler_type,
+                                       ResamplerQuality resampler_quality) {
   if (!data_provider_factory) {
     data_provider_factory = createDataProviderFactory();
   }
@@ -109,7 +181,91 @@ std::shared_ptr<Factory> createFactory(std::shared_ptr<DataProviderFactory> data
   if (!manifest_factory) {
     manifest_factory = createManifestFactory();
   }
-  return createServiceFactory(data_provider_factory, decrypter_factory, manifest_factory);
+  if (!executor) {
+    executor = createThreadExecutor();
+  }
+  return createServiceFactory(data_provider_factory,
+                              decrypter_factory,
+                              manifest_factory,
+                              executor,
+                              resampler_type,
+                              resampler_quality);
+}
+
+std::shared_ptr<Decoder> createPrefetchDecoder(std::shared_ptr<Decoder> decoder,
+                                               long prefetch_frames,
+                                               std::shared_ptr<Executor> executor) {
+  if (!decoder) {
+    return decoder;
+  }
+  if (!executor) {
+    executor = prefetchExecutor();
+  }
+  auto prefetch_decoder =
+      std::make_shared<DecoderPrefetchImplementation>(decoder, executor, prefetch_frames);
+  prefetch_decoder->load([](const std::string &domain, int error_code) {}, [](bool success) {});
+  return prefetch_decoder;
+}
+
+void decodeInParallel(std::shared_ptr<Factory> factory,
+                      const std::string &path,
+                      const std::string &mime_type,
+                      float *samples,
+                      long frame_index,
+                      long frames,
+                      const DECODE_INTO_CALLBACK decode_into_callback,
+                      const ERROR_DECODER_CALLBACK error_decoder_callback,
+                      int segments,
+                      double samplerate,
+                      int channels,
+                      std::shared_ptr<Executor> executor) {
+  if (!factory) {
+    decode_into_callback(frame_index, 0);
+    return;
+  }
+  if (!executor) {
+    // Every segment runs a long decode, give each its own thread
+    executor = createThreadExecutor();
+  }
+  auto parallel_decode = std::make_shared<ParallelDecodeImplementation>(
+      factory, path, mime_type, samplerate, channels, executor);
+  parallel_decode->decodeInto(
+      samples, frame_index, frames, segments, decode_into_callback, error_decoder_callback);
+}
+
+void probe(const std::vector<std::string> &paths,
+           const PROBE_CALLBACK probe_callback,
+           std::shared_ptr<DataProviderFactory> data_provider_factory,
+           int concurrency,
+           size_t byte_budget,
+           std::shared_ptr<Executor> executor) {
+  if (paths.empty()) {
+    return;
+  }
+  concurrency = std::max(1, std::min(concurrency, static_cast<int>(paths.size())));
+  if (!data_provider_factory) {
+    data_provider_factory = createDataProviderFactory(
+        nullptr,
+        nullptr,
+        std::max(static_cast<size_t>(1), std::min(byte_budget, PROBE_HTTP_BLOCK_SIZE)),
+        DATA_PROVIDER_HTTP_DEFAULT_BLOCK_COUNT,
+        0);
+  }
+  if (!executor) {
+    // Never more than concurrency probes are in flight, so the pool's queue never overflows
+    executor = createExecutor(concurrency);
+  }
+  auto probe_implementation =
+      std::make_shared<ProbeImplementation>(data_provider_factory, byte_budget, executor);
+  probe_implementation->probe(paths, concurrency, probe_callback);
+}
+
+void setLazyDuration(bool lazy_duration) {
+  lazyDurationEnabled() = lazy_duration;
+}
+
+bool lazyDuration() {
+  return lazyDurationEnabled();
 }
 
 }  // namespace decoder
@@ -44,6 +44,12 @@ class FactoryAndroidImplementation
                              const ERROR_DECODER_CALLBACK error_decoder_callback,
                              double samplerate,
                              int channels);
+  virtual void createDecoder(const std::shared_ptr<DataProvider> &data_provider,
+                             const std::string &mime_type,
+                             const CREATE_DECODER_CALLBACK create_decoder_callback,
+                             const ERROR_DECODER_CALLBACK error_decoder_callback,
+                             double samplerate,
+                             int channels);
 
  private:
   std::shared_ptr<Factory> _wrapped_factory;
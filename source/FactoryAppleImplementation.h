@@ -20,6 +20,7 @@
  */
 #pragma once
 
+#include <NFDecoder/Executor.h>
 #include <NFDecoder/Factory.h>
 
 #if __APPLE__
@@ -33,7 +34,8 @@ class FactoryAppleImplementation : public Factory,
                                    public std::enable_shared_from_this<FactoryAppleImplementation> {
  public:
   FactoryAppleImplementation(std::shared_ptr<Factory> wrapped_factory,
-                             std::shared_ptr<DataProviderFactory> &data_provider_factory);
+                             std::shared_ptr<DataProviderFactory> &data_provider_factory,
+                             std::shared_ptr<Executor> &executor);
   virtual ~FactoryAppleImplementation();
 
   // Factory
@@ -43,10 +45,17 @@ class FactoryAppleImplementation : public Factory,
                              const ERROR_DECODER_CALLBACK error_decoder_callback,
                              double samplerate,
                              int channels);
+  virtual void createDecoder(const std::shared_ptr<DataProvider> &data_provider,
+                             const std::string &mime_type,
+                             const CREATE_DECODER_CALLBACK create_decoder_callback,
+                             const ERROR_DECODER_CALLBACK error_decoder_callback,
+                             double samplerate,
+                             int channels);
 
  private:
   std::shared_ptr<Factory> _wrapped_factory;
   std::shared_ptr<DataProviderFactory> _data_provider_factory;
+  std::shared_ptr<Executor> _executor;
 };
 
 }  // namespace decoder
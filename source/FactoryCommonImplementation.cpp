@@ -23,20 +23,19 @@
 #include "DecoderFLACImplementation.h"
 #include "DecoderMidiImplementation.h"
 #include "DecoderOggImplementation.h"
+#include "DecoderOpusImplementation.h"
 #include "DecoderSpeexImplementation.h"
+#include "DecoderVorbisImplementation.h"
 #include "DecoderWavImplementation.h"
+#include "Path.h"
 
 namespace nativeformat {
 namespace decoder {
 
 FactoryCommonImplementation::FactoryCommonImplementation(
-    std::shared_ptr<DataProviderFactory> &data_provider_factory)
-    : _data_provider_factory(data_provider_factory),
-      _extensions_to_types({{NF_DECODER_MIME_TYPE_AUDIO_OGG, std::regex(".*\\.ogg|.*\\.opus")},
-                            {NF_DECODER_MIME_TYPE_WAV, std::regex(".*\\.wav")},
-                            {NF_DECODER_MIME_TYPE_FLAC, std::regex(".*\\.flac")},
-                            {NF_DECODER_MIME_TYPE_MIDI, std::regex("midi\\:.*")},
-                            {NF_DECODER_MIME_TYPE_SPEEX, std::regex(".*\\.spx")}}) {}
+    std::shared_ptr<DataProviderFactory> &data_provider_factory,
+    std::shared_ptr<Executor> &executor)
+    : _data_provider_factory(data_provider_factory), _executor(executor) {}
 
 FactoryCommonImplementation::~FactoryCommonImplementation() {}
 
@@ -47,77 +46,126 @@ void FactoryCommonImplementation::createDecoder(
     const ERROR_DECODER_CALLBACK error_decoder_callback,
     double samplerate,
     int channels) {
-  std::string mime_type_check = mime_type;
-  if (mime_type_check.empty()) {
-    for (auto it = _extensions_to_types.begin(); it != _extensions_to_types.end(); ++it) {
-      auto &ext = it->second;
-      if (std::regex_match(path, ext)) {
-        mime_type_check = it->first;
-        break;
-      }
-    }
-  }
-  if (NF_DECODER_OGG_MIME_TYPES.find(mime_type_check) != NF_DECODER_OGG_MIME_TYPES.end()) {
-    _data_provider_factory->createDataProvider(
-        path,
-        [create_decoder_callback,
-         error_decoder_callback](std::shared_ptr<DataProvider> data_provider) {
-          createDecoder<DecoderOggImplementation>(
-              data_provider, create_decoder_callback, error_decoder_callback);
-        },
-        error_decoder_callback);
-    return;
-  } else if (NF_DECODER_WAV_MIME_TYPES.find(mime_type_check) != NF_DECODER_WAV_MIME_TYPES.end()) {
-    _data_provider_factory->createDataProvider(
-        path,
-        [create_decoder_callback,
-         error_decoder_callback](std::shared_ptr<DataProvider> data_provider) {
-          createDecoder<DecoderWavImplementation>(
-              data_provider, create_decoder_callback, error_decoder_callback);
-        },
-        error_decoder_callback);
-    return;
-  } else if (NF_DECODER_FLAC_MIME_TYPES.find(mime_type_check) != NF_DECODER_FLAC_MIME_TYPES.end()) {
-    _data_provider_factory->createDataProvider(
-        path,
-        [create_decoder_callback,
-         error_decoder_callback](std::shared_ptr<DataProvider> data_provider) {
-          createDecoder<DecoderFLACImplementation>(
-              data_provider, create_decoder_callback, error_decoder_callback);
-        },
-        error_decoder_callback);
-    return;
-  } else if (NF_DECODER_MIDI_MIME_TYPES.find(mime_type_check) != NF_DECODER_MIDI_MIME_TYPES.end()) {
-    auto decoder = std::make_shared<DecoderMidiImplementation>(path);
+  // MIDI paths name a SoundFont alongside the file, so they never go through a data provider
+  if (isPathMidi(path) ||
+      NF_DECODER_MIDI_MIME_TYPES.find(mime_type) != NF_DECODER_MIDI_MIME_TYPES.end()) {
+    auto decoder = std::make_shared<DecoderMidiImplementation>(path, _executor);
     decoder->load(error_decoder_callback, [decoder, create_decoder_callback](bool success) {
       create_decoder_callback(success ? decoder : nullptr);
     });
     return;
-  } else if (NF_DECODER_SPEEX_MIME_TYPES.find(mime_type_check) !=
-             NF_DECODER_SPEEX_MIME_TYPES.end()) {
-    _data_provider_factory->createDataProvider(
-        path,
-        [create_decoder_callback,
-         error_decoder_callback](std::shared_ptr<DataProvider> data_provider) {
-          createDecoder<DecoderSpeexImplementation>(
-              data_provider, create_decoder_callback, error_decoder_callback);
-        },
-        error_decoder_callback);
+  }
+  // Unsupported MIME types are turned away without opening anything
+  if (!mime_type.empty() && formatForMimeType(mime_type) == SniffedFormatUnknown) {
+    create_decoder_callback(nullptr);
     return;
   }
-  create_decoder_callback(nullptr);
+  std::shared_ptr<Executor> executor = _executor;
+  _data_provider_factory->createDataProvider(
+      path,
+      [executor, mime_type, create_decoder_callback, error_decoder_callback](
+          std::shared_ptr<DataProvider> data_provider) {
+        if (!data_provider) {
+          create_decoder_callback(nullptr);
+          return;
+        }
+        createDecoder(
+            data_provider, mime_type, executor, create_decoder_callback, error_decoder_callback);
+      },
+      error_decoder_callback);
+}
+
+void FactoryCommonImplementation::createDecoder(
+    const std::shared_ptr<DataProvider> &data_provider,
+    const std::string &mime_type,
+    const CREATE_DECODER_CALLBACK create_decoder_callback,
+    const ERROR_DECODER_CALLBACK error_decoder_callback,
+    double samplerate,
+    int channels) {
+  createDecoder(
+      data_provider, mime_type, _executor, create_decoder_callback, error_decoder_callback);
+}
+
+void FactoryCommonImplementation::createDecoder(
+    std::shared_ptr<DataProvider> data_provider,
+    const std::string &mime_type,
+    std::shared_ptr<Executor> executor,
+    const CREATE_DECODER_CALLBACK create_decoder_callback,
+    const ERROR_DECODER_CALLBACK error_decoder_callback) {
+  // A MIME type is trusted as is, anything else is identified from the data itself
+  SniffedFormat format = SniffedFormatUnknown;
+  if (mime_type.empty()) {
+    format = sniffFormat(data_provider);
+  } else {
+    format = formatForMimeType(mime_type);
+    data_provider->seek(0, SEEK_SET);
+  }
+  createDecoderForFormat(
+      data_provider, format, executor, create_decoder_callback, error_decoder_callback);
+}
+
+SniffedFormat FactoryCommonImplementation::formatForMimeType(const std::string &mime_type) {
+  if (NF_DECODER_OGG_MIME_TYPES.find(mime_type) != NF_DECODER_OGG_MIME_TYPES.end()) {
+    return SniffedFormatOgg;
+  } else if (NF_DECODER_WAV_MIME_TYPES.find(mime_type) != NF_DECODER_WAV_MIME_TYPES.end()) {
+    return SniffedFormatWav;
+  } else if (NF_DECODER_FLAC_MIME_TYPES.find(mime_type) != NF_DECODER_FLAC_MIME_TYPES.end()) {
+    return SniffedFormatFLAC;
+  } else if (NF_DECODER_SPEEX_MIME_TYPES.find(mime_type) != NF_DECODER_SPEEX_MIME_TYPES.end()) {
+    return SniffedFormatOggSpeex;
+  }
+  return SniffedFormatUnknown;
+}
+
+void FactoryCommonImplementation::createDecoderForFormat(
+    std::shared_ptr<DataProvider> data_provider,
+    SniffedFormat format,
+    std::shared_ptr<Executor> executor,
+    const CREATE_DECODER_CALLBACK create_decoder_callback,
+    const ERROR_DECODER_CALLBACK error_decoder_callback) {
+  switch (format) {
+    case SniffedFormatWav:
+      createDecoder<DecoderWavImplementation>(
+          data_provider, executor, create_decoder_callback, error_decoder_callback);
+      return;
+    case SniffedFormatFLAC:
+      createDecoder<DecoderFLACImplementation>(
+          data_provider, executor, create_decoder_callback, error_decoder_callback);
+      return;
+    case SniffedFormatOgg:
+      // The codec is not known yet, the Ogg decoder probes for it
+      createDecoder<DecoderOggImplementation>(
+          data_provider, executor, create_decoder_callback, error_decoder_callback);
+      return;
+    case SniffedFormatOggVorbis:
+      createDecoder<DecoderVorbisImplementation>(
+          data_provider, executor, create_decoder_callback, error_decoder_callback);
+      return;
+    case SniffedFormatOggOpus:
+      createDecoder<DecoderOpusImplementation>(
+          data_provider, executor, create_decoder_callback, error_decoder_callback);
+      return;
+    case SniffedFormatOggSpeex:
+      createDecoder<DecoderSpeexImplementation>(
+          data_provider, executor, create_decoder_callback, error_decoder_callback);
+      return;
+    default:
+      create_decoder_callback(nullptr);
+      return;
+  }
 }
 
 template <typename DecoderType>
 void FactoryCommonImplementation::createDecoder(
     std::shared_ptr<DataProvider> data_provider,
+    std::shared_ptr<Executor> executor,
     const CREATE_DECODER_CALLBACK create_decoder_callback,
     const ERROR_DECODER_CALLBACK error_decoder_callback) {
   if (!data_provider) {
     create_decoder_callback(nullptr);
     return;
   }
-  std::shared_ptr<DecoderType> decoder = std::make_shared<DecoderType>(data_provider);
+  std::shared_ptr<DecoderType> decoder = std::make_shared<DecoderType>(data_provider, executor);
   decoder->load(error_decoder_callback, [decoder, create_decoder_callback](bool success) {
     create_decoder_callback(success ? decoder : nullptr);
   });
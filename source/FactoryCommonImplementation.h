@@ -21,17 +21,18 @@
 #pragma once
 
 #include <NFDecoder/DataProviderFactory.h>
+#include <NFDecoder/Executor.h>
 #include <NFDecoder/Factory.h>
 
-#include <regex>
-#include <unordered_map>
+#include "FormatSniffer.h"
 
 namespace nativeformat {
 namespace decoder {
 
 class FactoryCommonImplementation : public Factory {
  public:
-  FactoryCommonImplementation(std::shared_ptr<DataProviderFactory> &data_provider_factory);
+  FactoryCommonImplementation(std::shared_ptr<DataProviderFactory> &data_provider_factory,
+                              std::shared_ptr<Executor> &executor);
   virtual ~FactoryCommonImplementation();
 
   // Factory
@@ -41,16 +42,33 @@ class FactoryCommonImplementation : public Factory {
                              const ERROR_DECODER_CALLBACK error_decoder_callback,
                              double samplerate,
                              int channels);
+  virtual void createDecoder(const std::shared_ptr<DataProvider> &data_provider,
+                             const std::string &mime_type,
+                             const CREATE_DECODER_CALLBACK create_decoder_callback,
+                             const ERROR_DECODER_CALLBACK error_decoder_callback,
+                             double samplerate,
+                             int channels);
 
  private:
+  static SniffedFormat formatForMimeType(const std::string &mime_type);
+  static void createDecoder(std::shared_ptr<DataProvider> data_provider,
+                            const std::string &mime_type,
+                            std::shared_ptr<Executor> executor,
+                            const CREATE_DECODER_CALLBACK create_decoder_callback,
+                            const ERROR_DECODER_CALLBACK error_decoder_callback);
+  static void createDecoderForFormat(std::shared_ptr<DataProvider> data_provider,
+                                     SniffedFormat format,
+                                     std::shared_ptr<Executor> executor,
+                                     const CREATE_DECODER_CALLBACK create_decoder_callback,
+                                     const ERROR_DECODER_CALLBACK error_decoder_callback);
   template <typename DecoderType>
   static void createDecoder(std::shared_ptr<DataProvider> data_provider,
+                            std::shared_ptr<Executor> executor,
                             const CREATE_DECODER_CALLBACK create_decoder_callback,
                             const ERROR_DECODER_CALLBACK error_decoder_callback);
 
   const std::shared_ptr<DataProviderFactory> _data_provider_factory;
-
-  const std::unordered_map<std::string, std::regex> _extensions_to_types;
+  const std::shared_ptr<Executor> _executor;
 };
 
 }  // namespace decoder
@@ -31,10 +31,12 @@ namespace decoder {
 FactoryLGPLImplementation::FactoryLGPLImplementation(
     std::shared_ptr<Factory> wrapped_factory,
     std::shared_ptr<DataProviderFactory> &data_provider_factory,
-    const std::shared_ptr<DecrypterFactory> &decrypter_factory)
+    const std::shared_ptr<DecrypterFactory> &decrypter_factory,
+    const std::shared_ptr<Executor> &executor)
     : _wrapped_factory(wrapped_factory),
       _data_provider_factory(data_provider_factory),
-      _decrypter_factory(decrypter_factory) {}
+      _decrypter_factory(decrypter_factory),
+      _executor(executor) {}
 
 FactoryLGPLImplementation::~FactoryLGPLImplementation() {}
 
@@ -44,29 +46,60 @@ void FactoryLGPLImplementation::createDecoder(const std::string &path,
                                               const ERROR_DECODER_CALLBACK error_decoder_callback,
                                               double samplerate,
                                               int channels) {
+  if (isPathMidi(path)) {
+    _wrapped_factory->createDecoder(
+        path, mime_type, create_decoder_callback, error_decoder_callback, samplerate, channels);
+    return;
+  }
   auto strong_this = shared_from_this();
-  _wrapped_factory->createDecoder(
+  _data_provider_factory->createDataProvider(
       path,
+      [strong_this,
+       mime_type,
+       create_decoder_callback,
+       error_decoder_callback,
+       samplerate,
+       channels](const std::shared_ptr<DataProvider> &data_provider) {
+        if (!data_provider) {
+          create_decoder_callback(nullptr);
+          return;
+        }
+        strong_this->createDecoder(data_provider,
+                                   mime_type,
+                                   create_decoder_callback,
+                                   error_decoder_callback,
+                                   samplerate,
+                                   channels);
+      },
+      error_decoder_callback);
+}
+
+void FactoryLGPLImplementation::createDecoder(
+    const std::shared_ptr<DataProvider> &data_provider,
+    const std::string &mime_type,
+    const CREATE_DECODER_CALLBACK create_decoder_callback,
+    const ERROR_DECODER_CALLBACK error_decoder_callback,
+    double samplerate,
+    int channels) {
+  auto strong_this = shared_from_this();
+  _wrapped_factory->createDecoder(
+      data_provider,
       mime_type,
-      [create_decoder_callback, strong_this, path, error_decoder_callback](
+      [create_decoder_callback, strong_this, data_provider, error_decoder_callback](
           std::shared_ptr<Decoder> decoder) {
         if (!decoder) {
           strong_this->_decrypter_factory->createDecrypter(
-              path,
-              [strong_this, create_decoder_callback, error_decoder_callback, path](
+              data_provider->path(),
+              [strong_this, create_decoder_callback, error_decoder_callback, data_provider](
                   const std::shared_ptr<Decrypter> &decrypter) {
-                strong_this->_data_provider_factory->createDataProvider(
-                    path,
-                    [create_decoder_callback, error_decoder_callback, decrypter](
-                        const std::shared_ptr<DataProvider> &data_provider) {
-                      auto decoder =
-                          std::make_shared<DecoderAVCodecImplementation>(data_provider, decrypter);
-                      decoder->load(error_decoder_callback,
-                                    [decoder, create_decoder_callback](bool success) {
-                                      create_decoder_callback(success ? decoder : nullptr);
-                                    });
-                    },
-                    error_decoder_callback);
+                // The wrapped factory may have read from the provider while trying its decoders
+                data_provider->seek(0, SEEK_SET);
+                auto decoder = std::make_shared<DecoderAVCodecImplementation>(
+                    data_provider, decrypter, strong_this->_executor);
+                decoder->load(error_decoder_callback,
+                              [decoder, create_decoder_callback](bool success) {
+                                create_decoder_callback(success ? decoder : nullptr);
+                              });
               },
               error_decoder_callback);
         } else {
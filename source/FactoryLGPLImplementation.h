@@ -23,6 +23,7 @@
 #include <NFDecoder/Factory.h>
 
 #include <NFDecoder/DecrypterFactory.h>
+#include <NFDecoder/Executor.h>
 
 #if INCLUDE_LGPL
 
@@ -34,7 +35,8 @@ class FactoryLGPLImplementation : public Factory,
  public:
   FactoryLGPLImplementation(std::shared_ptr<Factory> wrapped_factory,
                             std::shared_ptr<DataProviderFactory> &data_provider_factory,
-                            const std::shared_ptr<DecrypterFactory> &decrypter_factory);
+                            const std::shared_ptr<DecrypterFactory> &decrypter_factory,
+                            const std::shared_ptr<Executor> &executor);
   virtual ~FactoryLGPLImplementation();
 
   // Factory
@@ -44,11 +46,18 @@ class FactoryLGPLImplementation : public Factory,
                              const ERROR_DECODER_CALLBACK error_decoder_callback,
                              double samplerate,
                              int channels);
+  virtual void createDecoder(const std::shared_ptr<DataProvider> &data_provider,
+                             const std::string &mime_type,
+                             const CREATE_DECODER_CALLBACK create_decoder_callback,
+                             const ERROR_DECODER_CALLBACK error_decoder_callback,
+                             double samplerate,
+                             int channels);
 
  private:
   std::shared_ptr<Factory> _wrapped_factory;
   std::shared_ptr<DataProviderFactory> _data_provider_factory;
   const std::shared_ptr<DecrypterFactory> _decrypter_factory;
+  const std::shared_ptr<Executor> _executor;
 };
 
 }  // namespace decoder
@@ -26,8 +26,14 @@ namespace nativeformat {
 namespace decoder {
 
 FactoryNormalisationImplementation::FactoryNormalisationImplementation(
-    std::shared_ptr<Factory> wrapped_factory)
-    : _wrapped_factory(wrapped_factory) {}
+    std::shared_ptr<Factory> wrapped_factory,
+    std::shared_ptr<Executor> executor,
+    ResamplerType resampler_type,
+    ResamplerQuality resampler_quality)
+    : _wrapped_factory(wrapped_factory),
+      _executor(executor),
+      _resampler_type(resampler_type),
+      _resampler_quality(resampler_quality) {}
 
 FactoryNormalisationImplementation::~FactoryNormalisationImplementation() {}
 
@@ -41,26 +47,56 @@ void FactoryNormalisationImplementation::createDecoder(
   _wrapped_factory->createDecoder(
       path,
       mime_type,
-      [create_decoder_callback, error_decoder_callback, samplerate, channels](
-          std::shared_ptr<Decoder> decoder) {
-        if (!decoder) {
-          create_decoder_callback(decoder);
-          return;
-        }
-        // No point in normalising an already normalised decoder
-        if (decoder->sampleRate() == samplerate && decoder->channels() == channels) {
-          create_decoder_callback(decoder);
-          return;
-        }
-        auto normalised_decoder =
-            std::make_shared<DecoderNormalisationImplementation>(decoder, samplerate, channels);
-        normalised_decoder->load(error_decoder_callback,
-                                 [create_decoder_callback, normalised_decoder](bool success) {
-                                   create_decoder_callback(normalised_decoder);
-                                 });
-      },
+      normaliseCallback(create_decoder_callback, error_decoder_callback, samplerate, channels),
       error_decoder_callback);
 }
 
+void FactoryNormalisationImplementation::createDecoder(
+    const std::shared_ptr<DataProvider> &data_provider,
+    const std::string &mime_type,
+    const CREATE_DECODER_CALLBACK create_decoder_callback,
+    const ERROR_DECODER_CALLBACK error_decoder_callback,
+    double samplerate,
+    int channels) {
+  _wrapped_factory->createDecoder(
+      data_provider,
+      mime_type,
+      normaliseCallback(create_decoder_callback, error_decoder_callback, samplerate, channels),
+      error_decoder_callback);
+}
+
+CREATE_DECODER_CALLBACK FactoryNormalisationImplementation::normaliseCallback(
+    const CREATE_DECODER_CALLBACK create_decoder_callback,
+    const ERROR_DECODER_CALLBACK error_decoder_callback,
+    double samplerate,
+    int channels) {
+  const std::shared_ptr<Executor> executor = _executor;
+  const ResamplerType resampler_type = _resampler_type;
+  const ResamplerQuality resampler_quality = _resampler_quality;
+  return [create_decoder_callback,
+          error_decoder_callback,
+          executor,
+          samplerate,
+          channels,
+          resampler_type,
+          resampler_quality](std::shared_ptr<Decoder> decoder) {
+    if (!decoder) {
+      create_decoder_callback(decoder);
+      return;
+    }
+    // No point in normalising an already normalised decoder
+    if (decoder->sampleRate() == samplerate && decoder->channels() == channels) {
+      create_decoder_callback(decoder);
+      return;
+    }
+    auto normalised_decoder = std::make_shared<DecoderNormalisationImplementation>(
+        decoder, executor, samplerate, channels, resampler_type, resampler_quality);
+    normalised_decoder->load(error_decoder_callback,
+                             [create_decoder_callback, normalised_decoder](bool success) {
+                               create_decoder_callback(success ? normalised_decoder : nullptr);
+                             });
+  };
+}
+
 }  // namespace decoder
 }  // namespace nativeformat
@@ -20,14 +20,19 @@
  */
 #pragma once
 
+#include <NFDecoder/Executor.h>
 #include <NFDecoder/Factory.h>
+#include <NFDecoder/Resampler.h>
 
 namespace nativeformat {
 namespace decoder {
 
 class FactoryNormalisationImplementation : public Factory {
  public:
-  FactoryNormalisationImplementation(std::shared_ptr<Factory> wrapped_factory);
+  FactoryNormalisationImplementation(std::shared_ptr<Factory> wrapped_factory,
+                                     std::shared_ptr<Executor> executor,
+                                     ResamplerType resampler_type,
+                                     ResamplerQuality resampler_quality);
   virtual ~FactoryNormalisationImplementation();
 
   // Factory
@@ -37,9 +42,24 @@ class FactoryNormalisationImplementation : public Factory {
                              const ERROR_DECODER_CALLBACK error_decoder_callback,
                              double samplerate,
                              int channels);
+  virtual void createDecoder(const std::shared_ptr<DataProvider> &data_provider,
+                             const std::string &mime_type,
+                             const CREATE_DECODER_CALLBACK create_decoder_callback,
+                             const ERROR_DECODER_CALLBACK error_decoder_callback,
+                             double samplerate,
+                             int channels);
 
  private:
+  // Wraps decoders from the wrapped factory in one that resamples and mixes to the output format
+  CREATE_DECODER_CALLBACK normaliseCallback(const CREATE_DECODER_CALLBACK create_decoder_callback,
+                                            const ERROR_DECODER_CALLBACK error_decoder_callback,
+                                            double samplerate,
+                                            int channels);
+
   std::shared_ptr<Factory> _wrapped_factory;
+  std::shared_ptr<Executor> _executor;
+  const ResamplerType _resampler_type;
+  const ResamplerQuality _resampler_quality;
 };
 
 }  // namespace decoder
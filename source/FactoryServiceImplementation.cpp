@@ -44,19 +44,57 @@ void FactoryServiceImplementation::createDecoder(
     const ERROR_DECODER_CALLBACK error_decoder_callback,
     double samplerate,
     int channels) {
-  std::string altered_mime_type = mime_type;
-  if (isPathSoundcloud(path)) {
-    altered_mime_type = NF_DECODER_MIME_TYPE_MP3;
+  // MIDI paths name a SoundFont alongside the file, so they never go through a data provider
+  if (isPathMidi(path)) {
+    _wrapped_factory->createDecoder(
+        path, mime_type, create_decoder_callback, error_decoder_callback, samplerate, channels);
+    return;
   }
-  _wrapped_factory->createDecoder(
+  // Open the source once here, every factory down the chain reads from the same provider
+  auto strong_this = shared_from_this();
+  _data_provider_factory->createDataProvider(
       path,
-      altered_mime_type,
-      [create_decoder_callback, error_decoder_callback](std::shared_ptr<Decoder> decoder) {
-        create_decoder_callback(decoder);
+      [strong_this,
+       mime_type,
+       create_decoder_callback,
+       error_decoder_callback,
+       samplerate,
+       channels](std::shared_ptr<DataProvider> data_provider) {
+        if (!data_provider) {
+          create_decoder_callback(nullptr);
+          return;
+        }
+        strong_this->createDecoder(data_provider,
+                                   mime_type,
+                                   create_decoder_callback,
+                                   error_decoder_callback,
+                                   samplerate,
+                                   channels);
       },
-      error_decoder_callback,
-      samplerate,
-      channels);
+      error_decoder_callback);
+}
+
+void FactoryServiceImplementation::createDecoder(
+    const std::shared_ptr<DataProvider> &data_provider,
+    const std::string &mime_type,
+    const CREATE_DECODER_CALLBACK create_decoder_callback,
+    const ERROR_DECODER_CALLBACK error_decoder_callback,
+    double samplerate,
+    int channels) {
+  if (!data_provider) {
+    create_decoder_callback(nullptr);
+    return;
+  }
+  std::string altered_mime_type = mime_type;
+  if (isPathSoundcloud(data_provider->path())) {
+    altered_mime_type = NF_DECODER_MIME_TYPE_MP3;
+  }
+  _wrapped_factory->createDecoder(data_provider,
+                                  altered_mime_type,
+                                  create_decoder_callback,
+                                  error_decoder_callback,
+                                  samplerate,
+                                  channels);
 }
 
 }  // namespace decoder
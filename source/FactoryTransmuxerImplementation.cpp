@@ -23,16 +23,12 @@
 #include <NFDecoder/NFDecoderMimeTypes.h>
 
 #include "DecoderDashToHLSTransmuxerImplementation.h"
+#include "FormatSniffer.h"
 #include "Path.h"
 
 namespace nativeformat {
 namespace decoder {
 
-namespace {
-static const char DASH_FILE_INDICATOR[] = "ftypdash\0";
-static const long DASH_FILE_INDICATOR_OFFSET = 4;
-}  // namespace
-
 FactoryTransmuxerImplementation::FactoryTransmuxerImplementation(
     std::shared_ptr<Factory> wrapped_factory,
     std::shared_ptr<DataProviderFactory> &data_provider_factory,
@@ -41,8 +37,7 @@ FactoryTransmuxerImplementation::FactoryTransmuxerImplementation(
     : _wrapped_factory(wrapped_factory),
       _data_provider_factory(data_provider_factory),
       _manifest_factory(manifest_factory),
-      _decrypter_factory(decrypter_factory),
-      _extensions_to_types({{NF_DECODER_MIME_TYPE_DASH_MP4, std::regex(".*\\.mp4")}}) {}
+      _decrypter_factory(decrypter_factory) {}
 
 FactoryTransmuxerImplementation::~FactoryTransmuxerImplementation() {}
 
@@ -53,49 +48,25 @@ void FactoryTransmuxerImplementation::createDecoder(
     const ERROR_DECODER_CALLBACK error_decoder_callback,
     double samplerate,
     int channels) {
-  std::string mime_type_check = mime_type;
-  if (mime_type_check.empty()) {
-    for (auto it = _extensions_to_types.begin(); it != _extensions_to_types.end(); ++it) {
-      auto &ext = it->second;
-      if (std::regex_match(path, ext)) {
-        mime_type_check = it->first;
-        break;
-      }
-    }
-  }
-  bool should_process =
-#if USE_FFMPEG
-      false;
-#else
-      (NF_DECODER_DASH_MP4_MIME_TYPES.find(mime_type_check) !=
-       NF_DECODER_DASH_MP4_MIME_TYPES.end());
-#endif
-
-  if (should_process) {
+  if (shouldProcess(path, mime_type)) {
     auto strong_this = shared_from_this();
     _data_provider_factory->createDataProvider(
         path,
-        [strong_this, path, error_decoder_callback, create_decoder_callback, mime_type](
-            const std::shared_ptr<DataProvider> &data_provider) {
+        [strong_this,
+         error_decoder_callback,
+         create_decoder_callback,
+         mime_type,
+         samplerate,
+         channels](const std::shared_ptr<DataProvider> &data_provider) {
           if (!data_provider) {
             return;
           }
-          data_provider->seek(DASH_FILE_INDICATOR_OFFSET, SEEK_SET);
-          char FILE_INDICATOR[sizeof(DASH_FILE_INDICATOR)];
-          data_provider->read(&FILE_INDICATOR, sizeof(char), sizeof(FILE_INDICATOR));
-          std::string str = DASH_FILE_INDICATOR;
-          bool is_dash_file = str.compare(FILE_INDICATOR) == 0;
-          data_provider->seek(0, SEEK_SET);
-
-          if (!is_dash_file) {
-            strong_this->_wrapped_factory->createDecoder(
-                path,
-                mime_type,
-                [create_decoder_callback, error_decoder_callback](
-                    std::shared_ptr<Decoder> decoder) { create_decoder_callback(decoder); },
-                error_decoder_callback);
-            return;
-          }
+          strong_this->createDecoder(data_provider,
+                                     mime_type,
+                                     create_decoder_callback,
+                                     error_decoder_callback,
+                                     samplerate,
+                                     channels);
         },
         error_decoder_callback);
     return;
@@ -109,5 +80,41 @@ void FactoryTransmuxerImplementation::createDecoder(
       error_decoder_callback);
 }
 
+void FactoryTransmuxerImplementation::createDecoder(
+    const std::shared_ptr<DataProvider> &data_provider,
+    const std::string &mime_type,
+    const CREATE_DECODER_CALLBACK create_decoder_callback,
+    const ERROR_DECODER_CALLBACK error_decoder_callback,
+    double samplerate,
+    int channels) {
+  if (shouldProcess(data_provider->path(), mime_type)) {
+    bool is_dash_file = sniffFormat(data_provider) == SniffedFormatDashMP4;
+    if (is_dash_file) {
+      return;
+    }
+  }
+  _wrapped_factory->createDecoder(
+      data_provider,
+      mime_type,
+      [create_decoder_callback, error_decoder_callback](std::shared_ptr<Decoder> decoder) {
+        create_decoder_callback(decoder);
+      },
+      error_decoder_callback);
+}
+
+bool FactoryTransmuxerImplementation::shouldProcess(const std::string &path,
+                                                    const std::string &mime_type) {
+#if USE_FFMPEG
+  return false;
+#else
+  std::string mime_type_check = mime_type;
+  if (mime_type_check.empty() && isPathMP4(path)) {
+    mime_type_check = NF_DECODER_MIME_TYPE_DASH_MP4;
+  }
+  return NF_DECODER_DASH_MP4_MIME_TYPES.find(mime_type_check) !=
+         NF_DECODER_DASH_MP4_MIME_TYPES.end();
+#endif
+}
+
 }  // namespace decoder
 }  // namespace nativeformat
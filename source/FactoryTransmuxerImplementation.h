@@ -23,7 +23,6 @@
 #include <NFDecoder/Factory.h>
 
 #include <memory>
-#include <regex>
 
 namespace nativeformat {
 namespace decoder {
@@ -45,14 +44,20 @@ class FactoryTransmuxerImplementation
                              const ERROR_DECODER_CALLBACK error_decoder_callback,
                              double samplerate,
                              int channels);
+  virtual void createDecoder(const std::shared_ptr<DataProvider> &data_provider,
+                             const std::string &mime_type,
+                             const CREATE_DECODER_CALLBACK create_decoder_callback,
+                             const ERROR_DECODER_CALLBACK error_decoder_callback,
+                             double samplerate,
+                             int channels);
 
  private:
+  static bool shouldProcess(const std::string &path, const std::string &mime_type);
+
   std::shared_ptr<Factory> _wrapped_factory;
   std::shared_ptr<DataProviderFactory> _data_provider_factory;
   std::shared_ptr<ManifestFactory> _manifest_factory;
   std::shared_ptr<DecrypterFactory> _decrypter_factory;
-
-  const std::unordered_map<std::string, std::regex> _extensions_to_types;
 };
 
 }  // namespace decoder
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2017 Spotify AB.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include "FormatSniffer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace nativeformat {
+namespace decoder {
+
+const size_t FORMAT_SNIFF_BYTES = 512;
+
+namespace {
+
+static const size_t OGG_PAGE_HEADER_SIZE = 27;
+static const size_t ID3_HEADER_SIZE = 10;
+static const char VORBIS_ID[] = "\x01vorbis";
+static const char OPUS_ID[] = "OpusHead";
+static const char SPEEX_ID[] = "Speex   ";
+// Split so the hex escape does not swallow the F
+static const char OGG_FLAC_ID[] = "\x7F"
+                                  "FLAC";
+
+bool matches(const unsigned char *data, size_t length, size_t offset, const char *magic) {
+  size_t magic_length = strlen(magic);
+  return offset + magic_length <= length && memcmp(data + offset, magic, magic_length) == 0;
+}
+
+SniffedFormat sniffOgg(const unsigned char *data, size_t length) {
+  // The first page of a stream holds the identification header as its only packet
+  if (length < OGG_PAGE_HEADER_SIZE) {
+    return SniffedFormatUnknown;
+  }
+  size_t packet_offset = OGG_PAGE_HEADER_SIZE + data[26];
+  if (matches(data, length, packet_offset, VORBIS_ID)) {
+    return SniffedFormatOggVorbis;
+  }
+  if (matches(data, length, packet_offset, OPUS_ID)) {
+    return SniffedFormatOggOpus;
+  }
+  if (matches(data, length, packet_offset, SPEEX_ID)) {
+    return SniffedFormatOggSpeex;
+  }
+  if (matches(data, length, packet_offset, OGG_FLAC_ID)) {
+    return SniffedFormatOggFLAC;
+  }
+  return SniffedFormatOgg;
+}
+
+SniffedFormat sniffMPEGSync(const unsigned char *data, size_t length) {
+  if (length < 4 || data[0] != 0xFF || (data[1] & 0xE0) != 0xE0) {
+    return SniffedFormatUnknown;
+  }
+  int layer = (data[1] >> 1) & 0x03;
+  if (layer == 0) {
+    // ADTS uses the MPEG-2/4 sync with the layer bits cleared
+    return (data[1] & 0xF6) == 0xF0 ? SniffedFormatAAC : SniffedFormatUnknown;
+  }
+  int version = (data[1] >> 3) & 0x03;
+  int bitrate_index = data[2] >> 4;
+  int samplerate_index = (data[2] >> 2) & 0x03;
+  if (version == 1 || bitrate_index == 0x0F || samplerate_index == 0x03) {
+    return SniffedFormatUnknown;
+  }
+  return SniffedFormatMP3;
+}
+
+SniffedFormat sniffID3(const unsigned char *data, size_t length) {
+  if (length < ID3_HEADER_SIZE) {
+    return SniffedFormatUnknown;
+  }
+  // Sync safe integers keep the top bit of each byte clear
+  if ((data[6] | data[7] | data[8] | data[9]) & 0x80) {
+    return SniffedFormatUnknown;
+  }
+  size_t tag_size = ID3_HEADER_SIZE + ((data[6] << 21) | (data[7] << 14) | (data[8] << 7) | data[9]);
+  if (data[5] & 0x10) {
+    tag_size += ID3_HEADER_SIZE;
+  }
+  if (tag_size >= length) {
+    // The audio starts past what was read, tagged streams are overwhelmingly MP3
+    return SniffedFormatMP3;
+  }
+  SniffedFormat format = sniffMPEGSync(data + tag_size, length - tag_size);
+  return format == SniffedFormatUnknown ? SniffedFormatMP3 : format;
+}
+
+}  // namespace
+
+SniffedFormat sniffFormat(const unsigned char *data, size_t length) {
+  if (matches(data, length, 0, "RIFF") && matches(data, length, 8, "WAVE")) {
+    return SniffedFormatWav;
+  }
+  if (matches(data, length, 0, "fLaC")) {
+    return SniffedFormatFLAC;
+  }
+  if (matches(data, length, 0, "OggS")) {
+    return sniffOgg(data, length);
+  }
+  if (matches(data, length, 0, "MThd")) {
+    return SniffedFormatMIDI;
+  }
+  if (matches(data, length, 4, "ftyp")) {
+    return matches(data, length, 8, "dash") ? SniffedFormatDashMP4 : SniffedFormatMP4;
+  }
+  if (matches(data, length, 0, "ID3")) {
+    return sniffID3(data, length);
+  }
+  return sniffMPEGSync(data, length);
+}
+
+SniffedFormat sniffFormat(const std::shared_ptr<DataProvider> &data_provider) {
+  if (!data_provider) {
+    return SniffedFormatUnknown;
+  }
+  // Mapped providers lend their storage, which saves the copy
+  long size = data_provider->size();
+  if (size > 0) {
+    size_t length = std::min(static_cast<size_t>(size), FORMAT_SNIFF_BYTES);
+    if (const void *data = data_provider->borrow(0, length)) {
+      data_provider->seek(0, SEEK_SET);
+      return sniffFormat(static_cast<const unsigned char *>(data), length);
+    }
+  }
+  std::vector<unsigned char> data(FORMAT_SNIFF_BYTES);
+  data_provider->seek(0, SEEK_SET);
+  size_t length = data_provider->read(data.data(), sizeof(unsigned char), data.size());
+  data_provider->seek(0, SEEK_SET);
+  return sniffFormat(data.data(), length);
+}
+
+}  // namespace decoder
+}  // namespace nativeformat
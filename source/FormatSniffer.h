@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2017 Spotify AB.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+#include <NFDecoder/DataProvider.h>
+
+namespace nativeformat {
+namespace decoder {
+
+typedef enum : int {
+  SniffedFormatUnknown,
+  SniffedFormatWav,
+  SniffedFormatFLAC,
+  // An Ogg stream whose first packet belongs to none of the codecs below
+  SniffedFormatOgg,
+  SniffedFormatOggVorbis,
+  SniffedFormatOggOpus,
+  SniffedFormatOggSpeex,
+  SniffedFormatOggFLAC,
+  SniffedFormatMP3,
+  SniffedFormatAAC,
+  SniffedFormatMP4,
+  SniffedFormatDashMP4,
+  SniffedFormatMIDI
+} SniffedFormat;
+
+// Enough for an Ogg page header with a full segment table plus the codec id of its first packet
+extern const size_t FORMAT_SNIFF_BYTES;
+
+/*
+ * Identifies a stream from the magic bytes at its start: RIFF/WAVE, fLaC, OggS followed by the
+ * codec id of the first packet, ID3 tags and MPEG audio sync words, ftyp brands and MThd. Nothing
+ * is parsed past the first FORMAT_SNIFF_BYTES, so a short or truncated header is Unknown rather
+ * than a guess.
+ */
+SniffedFormat sniffFormat(const unsigned char *data, size_t length);
+// Reads the start of the stream and leaves the provider rewound to 0
+SniffedFormat sniffFormat(const std::shared_ptr<DataProvider> &data_provider);
+
+}  // namespace decoder
+}  // namespace nativeformat
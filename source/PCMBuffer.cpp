@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2017 Spotify AB.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include "PCMBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "AllocationCounters.h"
+
+namespace nativeformat {
+namespace decoder {
+
+PCMBuffer::PCMBuffer(size_t capacity) : _buffer(capacity), _head(0), _tail(0) {}
+
+PCMBuffer::~PCMBuffer() {}
+
+float *PCMBuffer::data() {
+  return _buffer.data() + _head;
+}
+
+const float *PCMBuffer::data() const {
+  return _buffer.data() + _head;
+}
+
+size_t PCMBuffer::size() const {
+  return _tail - _head;
+}
+
+bool PCMBuffer::empty() const {
+  return _tail == _head;
+}
+
+size_t PCMBuffer::capacity() const {
+  return _buffer.size();
+}
+
+float *PCMBuffer::prepareWrite(size_t samples) {
+  if (_tail + samples <= _buffer.size()) {
+    return _buffer.data() + _tail;
+  }
+  // Keep at least half the storage free after compacting, so the live samples are moved at most
+  // once for every equal number of samples written
+  const size_t live_samples = size();
+  const size_t required_samples = live_samples + samples;
+  if (required_samples * 2 > _buffer.size()) {
+    countAllocation(AllocationCounterPCMBuffer);
+    std::vector<float> buffer(required_samples * 2);
+    memcpy(buffer.data(), data(), live_samples * sizeof(float));
+    _buffer.swap(buffer);
+  } else {
+    memmove(_buffer.data(), data(), live_samples * sizeof(float));
+  }
+  _head = 0;
+  _tail = live_samples;
+  return _buffer.data() + _tail;
+}
+
+void PCMBuffer::commitWrite(size_t samples) {
+  _tail = std::min(_tail + samples, _buffer.size());
+}
+
+void PCMBuffer::write(const float *samples, size_t count) {
+  if (count == 0) {
+    return;
+  }
+  memcpy(prepareWrite(count), samples, count * sizeof(float));
+  commitWrite(count);
+}
+
+void PCMBuffer::writeSilence(size_t count) {
+  if (count == 0) {
+    return;
+  }
+  std::fill_n(prepareWrite(count), count, 0.0f);
+  commitWrite(count);
+}
+
+size_t PCMBuffer::read(float *samples, size_t count) {
+  count = std::min(count, size());
+  memcpy(samples, data(), count * sizeof(float));
+  consume(count);
+  return count;
+}
+
+void PCMBuffer::consume(size_t count) {
+  _head = std::min(_head + count, _tail);
+  if (_head == _tail) {
+    _head = _tail = 0;
+  }
+}
+
+void PCMBuffer::clear() {
+  _head = _tail = 0;
+}
+
+void PCMBuffer::reserve(size_t capacity) {
+  if (capacity <= _buffer.size()) {
+    return;
+  }
+  countAllocation(AllocationCounterPCMBuffer);
+  const size_t live_samples = size();
+  std::vector<float> buffer(capacity);
+  if (live_samples > 0) {
+    memcpy(buffer.data(), data(), live_samples * sizeof(float));
+  }
+  _buffer.swap(buffer);
+  _head = 0;
+  _tail = live_samples;
+}
+
+}  // namespace decoder
+}  // namespace nativeformat
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2017 Spotify AB.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace nativeformat {
+namespace decoder {
+
+/*
+ * A FIFO of interleaved PCM samples. The readable samples are always contiguous, so they can be
+ * handed straight to a decode callback, and consuming from the front never moves memory. Storage
+ * only grows when a write would not fit; compaction is amortised across writes. Not thread safe.
+ */
+class PCMBuffer {
+ public:
+  PCMBuffer(size_t capacity = 0);
+  virtual ~PCMBuffer();
+
+  float *data();
+  const float *data() const;
+  size_t size() const;
+  bool empty() const;
+  size_t capacity() const;
+
+  float *prepareWrite(size_t samples);
+  void commitWrite(size_t samples);
+  void write(const float *samples, size_t count);
+  void writeSilence(size_t count);
+  size_t read(float *samples, size_t count);
+  void consume(size_t count);
+  void clear();
+  void reserve(size_t capacity);
+
+ private:
+  std::vector<float> _buffer;
+  size_t _head;
+  size_t _tail;
+};
+
+}  // namespace decoder
+}  // namespace nativeformat
@@ -0,0 +1,548 @@
+/*
+ * Copyright (c) 2017 Spotify AB.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include "PCMKernels.h"
+
+#include <atomic>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define PCM_KERNELS_X86 1
+#include <immintrin.h>
+#define PCM_KERNELS_SSE2 __attribute__((target("sse2")))
+#define PCM_KERNELS_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace nativeformat {
+namespace decoder {
+
+typedef struct PCMKernels {
+  void (*convert_uint8_to_float)(const void *in, float *out, size_t count, float scale);
+  void (*convert_int16_to_float)(const void *in, float *out, size_t count, float scale);
+  void (*convert_int24_to_float)(const void *in, float *out, size_t count, float scale);
+  void (*convert_int32_to_float)(const void *in, float *out, size_t count, float scale);
+  void (*interleave_int32_to_float)(
+      const int32_t *const *in, float *out, size_t frames, int channels, float scale);
+  void (*interleave)(const float *const *in, float *out, size_t frames, int channels);
+  void (*deinterleave)(const float *in, float *const *out, size_t frames, int channels);
+  void (*gain)(float *samples, size_t count, float gain);
+  void (*multiply_add)(const float *in, float *out, size_t count, float gain);
+} PCMKernels;
+
+// Scalar
+
+static void convertUInt8ToFloatScalar(const void *in, float *out, size_t count, float scale) {
+  const uint8_t *in_samples = (const uint8_t *)in;
+  for (size_t i = 0; i < count; ++i) {
+    out[i] = static_cast<float>(static_cast<int>(in_samples[i]) - 128) * scale;
+  }
+}
+
+static void convertInt16ToFloatScalar(const void *in, float *out, size_t count, float scale) {
+  const unsigned char *in_bytes = (const unsigned char *)in;
+  for (size_t i = 0; i < count; ++i) {
+    int16_t sample;
+    memcpy(&sample, in_bytes + (i * sizeof(int16_t)), sizeof(int16_t));
+    out[i] = static_cast<float>(sample) * scale;
+  }
+}
+
+static void convertInt24ToFloatScalar(const void *in, float *out, size_t count, float scale) {
+  const unsigned char *in_bytes = (const unsigned char *)in;
+  for (size_t i = 0; i < count; ++i) {
+    const unsigned char *sample_bytes = in_bytes + (i * 3);
+    uint32_t sample = (static_cast<uint32_t>(sample_bytes[0]) << 8) |
+                      (static_cast<uint32_t>(sample_bytes[1]) << 16) |
+                      (static_cast<uint32_t>(sample_bytes[2]) << 24);
+    out[i] = static_cast<float>(static_cast<int32_t>(sample) >> 8) * scale;
+  }
+}
+
+static void convertInt32ToFloatScalar(const void *in, float *out, size_t count, float scale) {
+  const unsigned char *in_bytes = (const unsigned char *)in;
+  for (size_t i = 0; i < count; ++i) {
+    int32_t sample;
+    memcpy(&sample, in_bytes + (i * sizeof(int32_t)), sizeof(int32_t));
+    out[i] = static_cast<float>(sample) * scale;
+  }
+}
+
+static void interleaveInt32ToFloatScalar(const int32_t *const *in,
+                                         float *out,
+                                         size_t start_frame,
+                                         size_t frames,
+                                         int channels,
+                                         float scale) {
+  for (size_t i = start_frame; i < frames; ++i) {
+    for (int j = 0; j < channels; ++j) {
+      out[(i * channels) + j] = static_cast<float>(in[j][i]) * scale;
+    }
+  }
+}
+
+static void interleaveScalar(
+    const float *const *in, float *out, size_t start_frame, size_t frames, int channels) {
+  for (size_t i = start_frame; i < frames; ++i) {
+    for (int j = 0; j < channels; ++j) {
+      out[(i * channels) + j] = in[j][i];
+    }
+  }
+}
+
+static void deinterleaveScalar(
+    const float *in, float *const *out, size_t start_frame, size_t frames, int channels) {
+  for (size_t i = start_frame; i < frames; ++i) {
+    for (int j = 0; j < channels; ++j) {
+      out[j][i] = in[(i * channels) + j];
+    }
+  }
+}
+
+static void gainScalar(float *samples, size_t start, size_t count, float gain) {
+  for (size_t i = start; i < count; ++i) {
+    samples[i] *= gain;
+  }
+}
+
+static void multiplyAddScalar(
+    const float *in, float *out, size_t start, size_t count, float gain) {
+  for (size_t i = start; i < count; ++i) {
+    out[i] += in[i] * gain;
+  }
+}
+
+static void interleaveInt32ToFloatScalarKernel(
+    const int32_t *const *in, float *out, size_t frames, int channels, float scale) {
+  interleaveInt32ToFloatScalar(in, out, 0, frames, channels, scale);
+}
+
+static void interleaveScalarKernel(const float *const *in,
+                                   float *out,
+                                   size_t frames,
+                                   int channels) {
+  interleaveScalar(in, out, 0, frames, channels);
+}
+
+static void deinterleaveScalarKernel(const float *in,
+                                     float *const *out,
+                                     size_t frames,
+                                     int channels) {
+  deinterleaveScalar(in, out, 0, frames, channels);
+}
+
+static void gainScalarKernel(float *samples, size_t count, float gain) {
+  gainScalar(samples, 0, count, gain);
+}
+
+static void multiplyAddScalarKernel(const float *in, float *out, size_t count, float gain) {
+  multiplyAddScalar(in, out, 0, count, gain);
+}
+
+static const PCMKernels SCALAR_KERNELS = {convertUInt8ToFloatScalar,
+                                          convertInt16ToFloatScalar,
+                                          convertInt24ToFloatScalar,
+                                          convertInt32ToFloatScalar,
+                                          interleaveInt32ToFloatScalarKernel,
+                                          interleaveScalarKernel,
+                                          deinterleaveScalarKernel,
+                                          gainScalarKernel,
+                                          multiplyAddScalarKernel};
+
+#if PCM_KERNELS_X86
+
+// SSE2
+
+PCM_KERNELS_SSE2 static void convertUInt8ToFloatSSE2(const void *in,
+                                                     float *out,
+                                                     size_t count,
+                                                     float scale) {
+  const unsigned char *in_bytes = (const unsigned char *)in;
+  const __m128 scale_vector = _mm_set1_ps(scale);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i centre = _mm_set1_epi32(128);
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m128i samples = _mm_loadu_si128((const __m128i *)(in_bytes + i));
+    __m128i low_samples = _mm_unpacklo_epi8(samples, zero);
+    __m128i high_samples = _mm_unpackhi_epi8(samples, zero);
+    __m128i widened_samples[4] = {_mm_unpacklo_epi16(low_samples, zero),
+                                  _mm_unpackhi_epi16(low_samples, zero),
+                                  _mm_unpacklo_epi16(high_samples, zero),
+                                  _mm_unpackhi_epi16(high_samples, zero)};
+    for (int j = 0; j < 4; ++j) {
+      __m128 converted = _mm_cvtepi32_ps(_mm_sub_epi32(widened_samples[j], centre));
+      _mm_storeu_ps(out + i + (j * 4), _mm_mul_ps(converted, scale_vector));
+    }
+  }
+  convertUInt8ToFloatScalar(in_bytes + i, out + i, count - i, scale);
+}
+
+PCM_KERNELS_SSE2 static void convertInt16ToFloatSSE2(const void *in,
+                                                     float *out,
+                                                     size_t count,
+                                                     float scale) {
+  const unsigned char *in_bytes = (const unsigned char *)in;
+  const __m128 scale_vector = _mm_set1_ps(scale);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m128i samples = _mm_loadu_si128((const __m128i *)(in_bytes + (i * sizeof(int16_t))));
+    __m128i low_samples = _mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16);
+    __m128i high_samples = _mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16);
+    _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(low_samples), scale_vector));
+    _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(high_samples), scale_vector));
+  }
+  convertInt16ToFloatScalar(in_bytes + (i * sizeof(int16_t)), out + i, count - i, scale);
+}
+
+PCM_KERNELS_SSE2 static void convertInt32ToFloatSSE2(const void *in,
+                                                     float *out,
+                                                     size_t count,
+                                                     float scale) {
+  const unsigned char *in_bytes = (const unsigned char *)in;
+  const __m128 scale_vector = _mm_set1_ps(scale);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128i samples = _mm_loadu_si128((const __m128i *)(in_bytes + (i * sizeof(int32_t))));
+    _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(samples), scale_vector));
+  }
+  convertInt32ToFloatScalar(in_bytes + (i * sizeof(int32_t)), out + i, count - i, scale);
+}
+
+PCM_KERNELS_SSE2 static void interleaveInt32ToFloatSSE2(
+    const int32_t *const *in, float *out, size_t frames, int channels, float scale) {
+  size_t i = 0;
+  if (channels == 1) {
+    convertInt32ToFloatSSE2(in[0], out, frames, scale);
+    return;
+  } else if (channels == 2) {
+    const __m128 scale_vector = _mm_set1_ps(scale);
+    for (; i + 4 <= frames; i += 4) {
+      __m128 left = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(in[0] + i)));
+      __m128 right = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(in[1] + i)));
+      left = _mm_mul_ps(left, scale_vector);
+      right = _mm_mul_ps(right, scale_vector);
+      _mm_storeu_ps(out + (i * 2), _mm_unpacklo_ps(left, right));
+      _mm_storeu_ps(out + (i * 2) + 4, _mm_unpackhi_ps(left, right));
+    }
+  }
+  interleaveInt32ToFloatScalar(in, out, i, frames, channels, scale);
+}
+
+PCM_KERNELS_SSE2 static void interleaveSSE2(const float *const *in,
+                                            float *out,
+                                            size_t frames,
+                                            int channels) {
+  size_t i = 0;
+  if (channels == 2) {
+    for (; i + 4 <= frames; i += 4) {
+      __m128 left = _mm_loadu_ps(in[0] + i);
+      __m128 right = _mm_loadu_ps(in[1] + i);
+      _mm_storeu_ps(out + (i * 2), _mm_unpacklo_ps(left, right));
+      _mm_storeu_ps(out + (i * 2) + 4, _mm_unpackhi_ps(left, right));
+    }
+  }
+  interleaveScalar(in, out, i, frames, channels);
+}
+
+PCM_KERNELS_SSE2 static void deinterleaveSSE2(const float *in,
+                                              float *const *out,
+                                              size_t frames,
+                                              int channels) {
+  size_t i = 0;
+  if (channels == 2) {
+    for (; i + 4 <= frames; i += 4) {
+      __m128 first_frames = _mm_loadu_ps(in + (i * 2));
+      __m128 second_frames = _mm_loadu_ps(in + (i * 2) + 4);
+      __m128 left = _mm_shuffle_ps(first_frames, second_frames, _MM_SHUFFLE(2, 0, 2, 0));
+      __m128 right = _mm_shuffle_ps(first_frames, second_frames, _MM_SHUFFLE(3, 1, 3, 1));
+      _mm_storeu_ps(out[0] + i, left);
+      _mm_storeu_ps(out[1] + i, right);
+    }
+  }
+  deinterleaveScalar(in, out, i, frames, channels);
+}
+
+PCM_KERNELS_SSE2 static void gainSSE2(float *samples, size_t count, float gain) {
+  const __m128 gain_vector = _mm_set1_ps(gain);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    _mm_storeu_ps(samples + i, _mm_mul_ps(_mm_loadu_ps(samples + i), gain_vector));
+  }
+  gainScalar(samples, i, count, gain);
+}
+
+PCM_KERNELS_SSE2 static void multiplyAddSSE2(const float *in,
+                                             float *out,
+                                             size_t count,
+                                             float gain) {
+  const __m128 gain_vector = _mm_set1_ps(gain);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const __m128 product = _mm_mul_ps(_mm_loadu_ps(in + i), gain_vector);
+    _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), product));
+  }
+  multiplyAddScalar(in, out, i, count, gain);
+}
+
+static const PCMKernels SSE2_KERNELS = {convertUInt8ToFloatSSE2,
+                                        convertInt16ToFloatSSE2,
+                                        convertInt24ToFloatScalar,
+                                        convertInt32ToFloatSSE2,
+                                        interleaveInt32ToFloatSSE2,
+                                        interleaveSSE2,
+                                        deinterleaveSSE2,
+                                        gainSSE2,
+                                        multiplyAddSSE2};
+
+// AVX2
+
+PCM_KERNELS_AVX2 static void convertUInt8ToFloatAVX2(const void *in,
+                                                     float *out,
+                                                     size_t count,
+                                                     float scale) {
+  const unsigned char *in_bytes = (const unsigned char *)in;
+  const __m256 scale_vector = _mm256_set1_ps(scale);
+  const __m256i centre = _mm256_set1_epi32(128);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i samples = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(in_bytes + i)));
+    __m256 converted = _mm256_cvtepi32_ps(_mm256_sub_epi32(samples, centre));
+    _mm256_storeu_ps(out + i, _mm256_mul_ps(converted, scale_vector));
+  }
+  convertUInt8ToFloatScalar(in_bytes + i, out + i, count - i, scale);
+}
+
+PCM_KERNELS_AVX2 static void convertInt16ToFloatAVX2(const void *in,
+                                                     float *out,
+                                                     size_t count,
+                                                     float scale) {
+  const unsigned char *in_bytes = (const unsigned char *)in;
+  const __m256 scale_vector = _mm256_set1_ps(scale);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i samples = _mm256_cvtepi16_epi32(
+        _mm_loadu_si128((const __m128i *)(in_bytes + (i * sizeof(int16_t)))));
+    _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(samples), scale_vector));
+  }
+  convertInt16ToFloatScalar(in_bytes + (i * sizeof(int16_t)), out + i, count - i, scale);
+}
+
+PCM_KERNELS_AVX2 static void convertInt24ToFloatAVX2(const void *in,
+                                                     float *out,
+                                                     size_t count,
+                                                     float scale) {
+  const unsigned char *in_bytes = (const unsigned char *)in;
+  const __m256 scale_vector = _mm256_set1_ps(scale);
+  // Moves each packed sample into the top three bytes of a lane, the shift then sign extends it
+  const __m256i shuffle = _mm256_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+                                           -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+  size_t i = 0;
+  // Each half loads 16 bytes but only uses 12, so stop early enough to stay inside the input
+  for (; i + 10 <= count; i += 8) {
+    __m128i low_samples = _mm_loadu_si128((const __m128i *)(in_bytes + (i * 3)));
+    __m128i high_samples = _mm_loadu_si128((const __m128i *)(in_bytes + (i * 3) + 12));
+    __m256i samples =
+        _mm256_inserti128_si256(_mm256_castsi128_si256(low_samples), high_samples, 1);
+    samples = _mm256_srai_epi32(_mm256_shuffle_epi8(samples, shuffle), 8);
+    _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(samples), scale_vector));
+  }
+  convertInt24ToFloatScalar(in_bytes + (i * 3), out + i, count - i, scale);
+}
+
+PCM_KERNELS_AVX2 static void convertInt32ToFloatAVX2(const void *in,
+                                                     float *out,
+                                                     size_t count,
+                                                     float scale) {
+  const unsigned char *in_bytes = (const unsigned char *)in;
+  const __m256 scale_vector = _mm256_set1_ps(scale);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i samples = _mm256_loadu_si256((const __m256i *)(in_bytes + (i * sizeof(int32_t))));
+    _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(samples), scale_vector));
+  }
+  convertInt32ToFloatScalar(in_bytes + (i * sizeof(int32_t)), out + i, count - i, scale);
+}
+
+PCM_KERNELS_AVX2 static void interleaveInt32ToFloatAVX2(
+    const int32_t *const *in, float *out, size_t frames, int channels, float scale) {
+  size_t i = 0;
+  if (channels == 1) {
+    convertInt32ToFloatAVX2(in[0], out, frames, scale);
+    return;
+  } else if (channels == 2) {
+    const __m256 scale_vector = _mm256_set1_ps(scale);
+    for (; i + 8 <= frames; i += 8) {
+      __m256 left = _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *)(in[0] + i)));
+      __m256 right = _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *)(in[1] + i)));
+      left = _mm256_mul_ps(left, scale_vector);
+      right = _mm256_mul_ps(right, scale_vector);
+      // Unpacking works within 128 bit lanes, so swap the middle halves back into order
+      __m256 low_frames = _mm256_unpacklo_ps(left, right);
+      __m256 high_frames = _mm256_unpackhi_ps(left, right);
+      _mm256_storeu_ps(out + (i * 2), _mm256_permute2f128_ps(low_frames, high_frames, 0x20));
+      _mm256_storeu_ps(out + (i * 2) + 8, _mm256_permute2f128_ps(low_frames, high_frames, 0x31));
+    }
+  }
+  interleaveInt32ToFloatScalar(in, out, i, frames, channels, scale);
+}
+
+PCM_KERNELS_AVX2 static void interleaveAVX2(const float *const *in,
+                                            float *out,
+                                            size_t frames,
+                                            int channels) {
+  size_t i = 0;
+  if (channels == 2) {
+    for (; i + 8 <= frames; i += 8) {
+      __m256 left = _mm256_loadu_ps(in[0] + i);
+      __m256 right = _mm256_loadu_ps(in[1] + i);
+      __m256 low_frames = _mm256_unpacklo_ps(left, right);
+      __m256 high_frames = _mm256_unpackhi_ps(left, right);
+      _mm256_storeu_ps(out + (i * 2), _mm256_permute2f128_ps(low_frames, high_frames, 0x20));
+      _mm256_storeu_ps(out + (i * 2) + 8, _mm256_permute2f128_ps(low_frames, high_frames, 0x31));
+    }
+  }
+  interleaveScalar(in, out, i, frames, channels);
+}
+
+PCM_KERNELS_AVX2 static void gainAVX2(float *samples, size_t count, float gain) {
+  const __m256 gain_vector = _mm256_set1_ps(gain);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    _mm256_storeu_ps(samples + i, _mm256_mul_ps(_mm256_loadu_ps(samples + i), gain_vector));
+  }
+  gainScalar(samples, i, count, gain);
+}
+
+PCM_KERNELS_AVX2 static void multiplyAddAVX2(const float *in,
+                                             float *out,
+                                             size_t count,
+                                             float gain) {
+  const __m256 gain_vector = _mm256_set1_ps(gain);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m256 product = _mm256_mul_ps(_mm256_loadu_ps(in + i), gain_vector);
+    _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(out + i), product));
+  }
+  multiplyAddScalar(in, out, i, count, gain);
+}
+
+static const PCMKernels AVX2_KERNELS = {convertUInt8ToFloatAVX2,
+                                        convertInt16ToFloatAVX2,
+                                        convertInt24ToFloatAVX2,
+                                        convertInt32ToFloatAVX2,
+                                        interleaveInt32ToFloatAVX2,
+                                        interleaveAVX2,
+                                        deinterleaveSSE2,
+                                        gainAVX2,
+                                        multiplyAddAVX2};
+
+#endif
+
+static const PCMKernels *kernelsForInstructionSet(PCMKernelsInstructionSet instruction_set) {
+#if PCM_KERNELS_X86
+  switch (instruction_set) {
+    case PCMKernelsInstructionSetAVX2:
+      return &AVX2_KERNELS;
+    case PCMKernelsInstructionSetSSE2:
+      return &SSE2_KERNELS;
+    case PCMKernelsInstructionSetScalar:
+      break;
+  }
+#endif
+  return &SCALAR_KERNELS;
+}
+
+static std::atomic<int> &currentInstructionSet() {
+  static std::atomic<int> instruction_set(pcmKernelsSupportedInstructionSet());
+  return instruction_set;
+}
+
+static const PCMKernels *kernels() {
+  return kernelsForInstructionSet(
+      static_cast<PCMKernelsInstructionSet>(currentInstructionSet().load()));
+}
+
+PCMKernelsInstructionSet pcmKernelsSupportedInstructionSet() {
+#if PCM_KERNELS_X86
+  static const PCMKernelsInstructionSet supported_instruction_set = []() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+      return PCMKernelsInstructionSetAVX2;
+    } else if (__builtin_cpu_supports("sse2")) {
+      return PCMKernelsInstructionSetSSE2;
+    }
+    return PCMKernelsInstructionSetScalar;
+  }();
+  return supported_instruction_set;
+#else
+  return PCMKernelsInstructionSetScalar;
+#endif
+}
+
+PCMKernelsInstructionSet pcmKernelsInstructionSet() {
+  return static_cast<PCMKernelsInstructionSet>(currentInstructionSet().load());
+}
+
+void setPCMKernelsInstructionSet(PCMKernelsInstructionSet instruction_set) {
+  if (instruction_set > pcmKernelsSupportedInstructionSet()) {
+    instruction_set = pcmKernelsSupportedInstructionSet();
+  }
+  currentInstructionSet() = instruction_set;
+}
+
+void pcmConvertUInt8ToFloat(const void *in, float *out, size_t count, float scale) {
+  kernels()->convert_uint8_to_float(in, out, count, scale);
+}
+
+void pcmConvertInt16ToFloat(const void *in, float *out, size_t count, float scale) {
+  kernels()->convert_int16_to_float(in, out, count, scale);
+}
+
+void pcmConvertInt24ToFloat(const void *in, float *out, size_t count, float scale) {
+  kernels()->convert_int24_to_float(in, out, count, scale);
+}
+
+void pcmConvertInt32ToFloat(const void *in, float *out, size_t count, float scale) {
+  kernels()->convert_int32_to_float(in, out, count, scale);
+}
+
+void pcmInterleaveInt32ToFloat(
+    const int32_t *const *in, float *out, size_t frames, int channels, float scale) {
+  kernels()->interleave_int32_to_float(in, out, frames, channels, scale);
+}
+
+void pcmInterleave(const float *const *in, float *out, size_t frames, int channels) {
+  kernels()->interleave(in, out, frames, channels);
+}
+
+void pcmDeinterleave(const float *in, float *const *out, size_t frames, int channels) {
+  kernels()->deinterleave(in, out, frames, channels);
+}
+
+void pcmGain(float *samples, size_t count, float gain) {
+  kernels()->gain(samples, count, gain);
+}
+
+void pcmMultiplyAdd(const float *in, float *out, size_t count, float gain) {
+  kernels()->multiply_add(in, out, count, gain);
+}
+
+}  // namespace decoder
+}  // namespace nativeformat
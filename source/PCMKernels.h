@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2017 Spotify AB.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace nativeformat {
+namespace decoder {
+
+typedef enum : int {
+  PCMKernelsInstructionSetScalar,
+  PCMKernelsInstructionSetSSE2,
+  PCMKernelsInstructionSetAVX2
+} PCMKernelsInstructionSet;
+
+// The widest instruction set this CPU supports, the kernels use it unless told otherwise
+PCMKernelsInstructionSet pcmKernelsSupportedInstructionSet();
+PCMKernelsInstructionSet pcmKernelsInstructionSet();
+// Clamped to what the CPU supports, mainly useful for comparing kernels in benchmarks
+void setPCMKernelsInstructionSet(PCMKernelsInstructionSet instruction_set);
+
+/*
+ * Integer to float conversions multiply each sample by scale, unsigned 8 bit samples are centred
+ * on 128 first and 24 bit samples are packed little endian. The input needs no alignment and may
+ * overlap the output as long as it ends where the output ends: the output never overtakes it.
+ */
+void pcmConvertUInt8ToFloat(const void *in, float *out, size_t count, float scale);
+void pcmConvertInt16ToFloat(const void *in, float *out, size_t count, float scale);
+void pcmConvertInt24ToFloat(const void *in, float *out, size_t count, float scale);
+void pcmConvertInt32ToFloat(const void *in, float *out, size_t count, float scale);
+
+// Planar channel buffers to interleaved frames and back
+void pcmInterleaveInt32ToFloat(
+    const int32_t *const *in, float *out, size_t frames, int channels, float scale);
+void pcmInterleave(const float *const *in, float *out, size_t frames, int channels);
+void pcmDeinterleave(const float *in, float *const *out, size_t frames, int channels);
+
+void pcmGain(float *samples, size_t count, float gain);
+// out += in * gain
+void pcmMultiplyAdd(const float *in, float *out, size_t count, float gain);
+
+}  // namespace decoder
+}  // namespace nativeformat
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2017 Spotify AB.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include "PCMRingBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace nativeformat {
+namespace decoder {
+
+// The indexes only ever grow, the difference between them is the number of readable samples
+PCMRingBuffer::PCMRingBuffer(size_t capacity)
+    : _buffer(std::max(capacity, static_cast<size_t>(1))), _write_index(0), _read_index(0) {}
+
+PCMRingBuffer::~PCMRingBuffer() {}
+
+size_t PCMRingBuffer::capacity() const {
+  return _buffer.size();
+}
+
+size_t PCMRingBuffer::writable() const {
+  return capacity() - (_write_index.load(std::memory_order_relaxed) -
+                       _read_index.load(std::memory_order_acquire));
+}
+
+float *PCMRingBuffer::prepareWrite(size_t &samples) {
+  const size_t write_index = _write_index.load(std::memory_order_relaxed);
+  const size_t offset = write_index % capacity();
+  samples = std::min(writable(), capacity() - offset);
+  return _buffer.data() + offset;
+}
+
+void PCMRingBuffer::commitWrite(size_t samples) {
+  _write_index.store(_write_index.load(std::memory_order_relaxed) + samples,
+                     std::memory_order_release);
+}
+
+size_t PCMRingBuffer::write(const float *samples, size_t count) {
+  size_t written = 0;
+  while (written < count) {
+    size_t region_samples = 0;
+    float *region = prepareWrite(region_samples);
+    region_samples = std::min(region_samples, count - written);
+    if (region_samples == 0) {
+      break;
+    }
+    memcpy(region, samples + written, region_samples * sizeof(float));
+    commitWrite(region_samples);
+    written += region_samples;
+  }
+  return written;
+}
+
+size_t PCMRingBuffer::readable() const {
+  return _write_index.load(std::memory_order_acquire) -
+         _read_index.load(std::memory_order_relaxed);
+}
+
+const float *PCMRingBuffer::prepareRead(size_t &samples) const {
+  const size_t read_index = _read_index.load(std::memory_order_relaxed);
+  const size_t offset = read_index % capacity();
+  samples = std::min(readable(), capacity() - offset);
+  return _buffer.data() + offset;
+}
+
+void PCMRingBuffer::consume(size_t count) {
+  const size_t read_index = _read_index.load(std::memory_order_relaxed);
+  _read_index.store(read_index + std::min(count, readable()), std::memory_order_release);
+}
+
+size_t PCMRingBuffer::read(float *samples, size_t count) {
+  size_t read = 0;
+  while (read < count) {
+    size_t region_samples = 0;
+    const float *region = prepareRead(region_samples);
+    region_samples = std::min(region_samples, count - read);
+    if (region_samples == 0) {
+      break;
+    }
+    memcpy(samples + read, region, region_samples * sizeof(float));
+    consume(region_samples);
+    read += region_samples;
+  }
+  return read;
+}
+
+void PCMRingBuffer::reset() {
+  _write_index.store(0, std::memory_order_release);
+  _read_index.store(0, std::memory_order_release);
+}
+
+}  // namespace decoder
+}  // namespace nativeformat
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2017 Spotify AB.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace nativeformat {
+namespace decoder {
+
+/*
+ * A lock free ring of interleaved PCM samples for exactly one producer thread and one consumer
+ * thread. Neither side ever blocks or allocates. Writes and reads are split into contiguous
+ * regions so a decoder can decode straight into the ring and a callback can read straight out of
+ * it; keep the capacity a multiple of the channel count and every region holds whole frames.
+ */
+class PCMRingBuffer {
+ public:
+  PCMRingBuffer(size_t capacity);
+  virtual ~PCMRingBuffer();
+
+  size_t capacity() const;
+
+  // Producer
+  size_t writable() const;
+  float *prepareWrite(size_t &samples);
+  void commitWrite(size_t samples);
+  size_t write(const float *samples, size_t count);
+
+  // Consumer
+  size_t readable() const;
+  const float *prepareRead(size_t &samples) const;
+  void consume(size_t count);
+  size_t read(float *samples, size_t count);
+
+  // Only safe while neither side is using the ring
+  void reset();
+
+ private:
+  std::vector<float> _buffer;
+  std::atomic<size_t> _write_index;
+  char _write_index_padding[64];
+  std::atomic<size_t> _read_index;
+  char _read_index_padding[64];
+};
+
+}  // namespace decoder
+}  // namespace nativeformat
@@ -0,0 +1,276 @@
+/*
+ * Copyright (c) 2017 Spotify AB.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include "ParallelDecodeImplementation.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace nativeformat {
+namespace decoder {
+
+// Shorter segments cost more in seeks and decoder setup than they save
+static const long PARALLEL_DECODE_MIN_SEGMENT_FRAMES = 65536;
+// Decoded ahead of each segment so codecs with overlapping frames or inexact seeks have settled
+// by the segment's first frame
+static const long PARALLEL_DECODE_PREROLL_FRAMES = 4096;
+static const long PARALLEL_DECODE_CHUNK_FRAMES = 4096;
+static const std::string PARALLEL_DECODE_DOMAIN("com.nativeformat.decoder.parallel");
+
+ParallelDecodeImplementation::ParallelDecodeImplementation(
+    const std::shared_ptr<Factory> &factory,
+    const std::string &path,
+    const std::string &mime_type,
+    double samplerate,
+    int channels,
+    const std::shared_ptr<Executor> &executor)
+    : _factory(factory),
+      _path(path),
+      _mime_type(mime_type),
+      _samplerate(samplerate),
+      _channels(channels),
+      _executor(executor),
+      _samples(nullptr),
+      _frame_index(0),
+      _frames(0),
+      _requested_segments(1),
+      _pending(0) {}
+
+ParallelDecodeImplementation::~ParallelDecodeImplementation() {}
+
+void ParallelDecodeImplementation::decodeInto(
+    float *samples,
+    long frame_index,
+    long frames,
+    int segments,
+    const DECODE_INTO_CALLBACK &decode_into_callback,
+    const ERROR_DECODER_CALLBACK &error_decoder_callback) {
+  {
+    std::lock_guard<std::mutex> parallel_lock(_parallel_mutex);
+    _samples = samples;
+    _frame_index = std::max(frame_index, 0L);
+    _frames = std::max(frames, 0L);
+    _requested_segments = std::max(segments, 1);
+    _decode_into_callback = decode_into_callback;
+    _error_decoder_callback = error_decoder_callback;
+    // The first decoder tells us how long the stream is before the range is split
+    _segment_frames = {_frame_index, _frame_index + _frames};
+    _decoders.assign(1, nullptr);
+    _resolved.assign(1, false);
+    _decoded_frames.assign(1, 0);
+    _pending = 1;
+  }
+  createDecoder(0);
+}
+
+void ParallelDecodeImplementation::createDecoder(size_t segment) {
+  std::shared_ptr<ParallelDecodeImplementation> strong_this = shared_from_this();
+  _factory->createDecoder(
+      _path,
+      _mime_type,
+      [strong_this, segment](std::shared_ptr<Decoder> decoder) {
+        strong_this->decoderCreated(segment, decoder);
+      },
+      [strong_this, segment](const std::string &domain, int error_code) {
+        strong_this->reportError(domain, error_code);
+        // Not every failure is followed by a null decoder, so settle the segment here
+        strong_this->decoderCreated(segment, nullptr);
+      },
+      _samplerate,
+      _channels);
+}
+
+void ParallelDecodeImplementation::decoderCreated(size_t segment,
+                                                  std::shared_ptr<Decoder> decoder) {
+  // Segments are copied into samples at the requested layout, so a factory that does not
+  // normalise its decoders must not hand back anything else
+  if (decoder && (decoder->channels() != _channels || decoder->sampleRate() != _samplerate)) {
+    reportError(PARALLEL_DECODE_DOMAIN, ErrorCodeFormatMismatch);
+    decoder = nullptr;
+  }
+  bool all_created = false;
+  {
+    std::lock_guard<std::mutex> parallel_lock(_parallel_mutex);
+    if (segment >= _resolved.size() || _resolved[segment]) {
+      return;
+    }
+    _resolved[segment] = true;
+    _decoders[segment] = decoder;
+    all_created = --_pending == 0;
+    if (all_created) {
+      _pending = _decoders.size();
+    }
+  }
+  if (segment == 0) {
+    planSegments(decoder);
+    return;
+  }
+  if (all_created) {
+    for (size_t i = 0; i < _decoders.size(); ++i) {
+      decodeSegment(i);
+    }
+  }
+}
+
+void ParallelDecodeImplementation::planSegments(const std::shared_ptr<Decoder> &decoder) {
+  if (!decoder) {
+    finish();
+    return;
+  }
+  size_t segments = 1;
+  {
+    std::lock_guard<std::mutex> parallel_lock(_parallel_mutex);
+    const long stream_frames = decoder->frames();
+    if (stream_frames >= 0) {
+      _frames = std::max(0L, std::min(_frames, stream_frames - _frame_index));
+    }
+    // A stream of unknown length might not seek either, so decode it in one go
+    if (stream_frames != UNKNOWN_FRAMES) {
+      segments = std::max(
+          1L,
+          std::min(static_cast<long>(_requested_segments),
+                   _frames / PARALLEL_DECODE_MIN_SEGMENT_FRAMES));
+    }
+    _segment_frames.resize(segments + 1);
+    for (size_t i = 0; i <= segments; ++i) {
+      _segment_frames[i] = _frame_index + _frames * i / segments;
+    }
+    _decoders.resize(segments);
+    _resolved.assign(segments, false);
+    _resolved[0] = true;
+    _decoded_frames.assign(segments, 0);
+    _pending = segments;
+  }
+  // The first segment is decoded on the first decoder, every other one on a clone of it, or on
+  // a decoder of its own when it cannot be cloned
+  if (segments == 1) {
+    decodeSegment(0);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> parallel_lock(_parallel_mutex);
+    --_pending;
+  }
+  for (size_t i = 1; i < segments; ++i) {
+    if (std::shared_ptr<Decoder> clone = decoder->clone()) {
+      decoderCreated(i, clone);
+    } else {
+      createDecoder(i);
+    }
+  }
+}
+
+void ParallelDecodeImplementation::decodeSegment(size_t segment) {
+  std::shared_ptr<ParallelDecodeImplementation> strong_this = shared_from_this();
+  _executor->execute([strong_this, segment]() {
+    std::shared_ptr<Decoder> decoder;
+    long begin = 0;
+    long end = 0;
+    {
+      std::lock_guard<std::mutex> parallel_lock(strong_this->_parallel_mutex);
+      decoder = strong_this->_decoders[segment];
+      begin = strong_this->_segment_frames[segment];
+      end = strong_this->_segment_frames[segment + 1];
+    }
+    if (!decoder || begin == end) {
+      strong_this->finishSegment(segment, 0);
+      return;
+    }
+    const int channels = strong_this->_channels;
+    const long start = std::max(0L, begin - PARALLEL_DECODE_PREROLL_FRAMES);
+    if (decoder->currentFrameIndex() != start) {
+      decoder->seek(start);
+    }
+    std::vector<float> chunk(PARALLEL_DECODE_CHUNK_FRAMES * channels);
+    long decoded_until = begin;
+    while (decoded_until < end) {
+      long chunk_index = 0;
+      long chunk_frames = 0;
+      decoder->decodeInto(chunk.data(),
+                          PARALLEL_DECODE_CHUNK_FRAMES,
+                          [&chunk_index, &chunk_frames](long frame_index, long frame_count) {
+                            chunk_index = frame_index;
+                            chunk_frames = frame_count;
+                          },
+                          true);
+      // Out of stream, or a seek that overshot the segment and would leave a gap
+      if (chunk_frames <= 0 || chunk_index > decoded_until) {
+        break;
+      }
+      const long copy_end = std::min(chunk_index + chunk_frames, end);
+      if (copy_end > decoded_until) {
+        std::memcpy(
+            strong_this->_samples + (decoded_until - strong_this->_frame_index) * channels,
+            chunk.data() + (decoded_until - chunk_index) * channels,
+            (copy_end - decoded_until) * channels * sizeof(float));
+        decoded_until = copy_end;
+      }
+    }
+    strong_this->finishSegment(segment, decoded_until - begin);
+  });
+}
+
+void ParallelDecodeImplementation::finishSegment(size_t segment, long frames) {
+  {
+    std::lock_guard<std::mutex> parallel_lock(_parallel_mutex);
+    _decoded_frames[segment] = frames;
+    // Release the decoder as soon as its segment is done
+    _decoders[segment] = nullptr;
+    if (--_pending > 0) {
+      return;
+    }
+  }
+  finish();
+}
+
+void ParallelDecodeImplementation::reportError(const std::string &domain, int error_code) {
+  ERROR_DECODER_CALLBACK error_decoder_callback;
+  {
+    std::lock_guard<std::mutex> parallel_lock(_parallel_mutex);
+    error_decoder_callback = _error_decoder_callback;
+  }
+  if (error_decoder_callback) {
+    error_decoder_callback(domain, error_code);
+  }
+}
+
+void ParallelDecodeImplementation::finish() {
+  long frame_index = 0;
+  long frames = 0;
+  DECODE_INTO_CALLBACK decode_into_callback;
+  {
+    std::lock_guard<std::mutex> parallel_lock(_parallel_mutex);
+    frame_index = _frame_index;
+    // Only report the frames that run unbroken from the start of the range
+    for (size_t i = 0; i < _decoded_frames.size(); ++i) {
+      frames += _decoded_frames[i];
+      if (_decoded_frames[i] < _segment_frames[i + 1] - _segment_frames[i]) {
+        break;
+      }
+    }
+    decode_into_callback = _decode_into_callback;
+    _decode_into_callback = nullptr;
+    _error_decoder_callback = nullptr;
+  }
+  decode_into_callback(frame_index, frames);
+}
+
+}  // namespace decoder
+}  // namespace nativeformat
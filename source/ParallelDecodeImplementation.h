@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2017 Spotify AB.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#pragma once
+
+#include <NFDecoder/Decoder.h>
+#include <NFDecoder/Executor.h>
+#include <NFDecoder/Factory.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace nativeformat {
+namespace decoder {
+
+/*
+ * Decodes a range of one stream on several decoders at once for offline jobs. The range is cut
+ * into segments at even frame boundaries, each segment seeks its own clone of the first decoder
+ * a little ahead of its first frame and keeps only the frames the decoder reports inside the
+ * segment, so the stitched output matches a straight decode.
+ */
+class ParallelDecodeImplementation
+    : public std::enable_shared_from_this<ParallelDecodeImplementation> {
+ public:
+  typedef enum : int { ErrorCodeFormatMismatch } ErrorCode;
+
+  ParallelDecodeImplementation(const std::shared_ptr<Factory> &factory,
+                               const std::string &path,
+                               const std::string &mime_type,
+                               double samplerate,
+                               int channels,
+                               const std::shared_ptr<Executor> &executor);
+  virtual ~ParallelDecodeImplementation();
+
+  void decodeInto(float *samples,
+                  long frame_index,
+                  long frames,
+                  int segments,
+                  const DECODE_INTO_CALLBACK &decode_into_callback,
+                  const ERROR_DECODER_CALLBACK &error_decoder_callback);
+
+ private:
+  void createDecoder(size_t segment);
+  void decoderCreated(size_t segment, std::shared_ptr<Decoder> decoder);
+  void planSegments(const std::shared_ptr<Decoder> &decoder);
+  void decodeSegment(size_t segment);
+  void finishSegment(size_t segment, long frames);
+  void finish();
+  void reportError(const std::string &domain, int error_code);
+
+  const std::shared_ptr<Factory> _factory;
+  const std::string _path;
+  const std::string _mime_type;
+  const double _samplerate;
+  const int _channels;
+  const std::shared_ptr<Executor> _executor;
+
+  std::mutex _parallel_mutex;
+  float *_samples;
+  long _frame_index;
+  long _frames;
+  int _requested_segments;
+  DECODE_INTO_CALLBACK _decode_into_callback;
+  ERROR_DECODER_CALLBACK _error_decoder_callback;
+  // A segment's first frame, then one past the last segment's last frame
+  std::vector<long> _segment_frames;
+  std::vector<std::shared_ptr<Decoder>> _decoders;
+  // Creation and decode results arrive once per segment, failures count as resolved
+  std::vector<bool> _resolved;
+  std::vector<long> _decoded_frames;
+  size_t _pending;
+};
+
+}  // namespace decoder
+}  // namespace nativeformat
@@ -20,15 +20,30 @@
  */
 #include "Path.h"
 
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <functional>
+#include <sstream>
+#include <thread>
+
 namespace nativeformat {
 namespace decoder {
 
-bool isMidi(const std::string &path) {
+bool isPathMidi(const std::string &path) {
   static const std::string midi_protocol = "midi:";
   return path.size() > midi_protocol.size() &&
          path.substr(0, midi_protocol.size()) == midi_protocol;
 }
 
+bool isPathMP4(const std::string &path) {
+  static const std::string mp4_extension = ".mp4";
+  return path.size() > mp4_extension.size() &&
+         path.compare(path.size() - mp4_extension.size(), mp4_extension.size(), mp4_extension) ==
+             0;
+}
+
 bool isPathSoundcloud(const std::string &path) {
   static const std::string http_protocol = "http";
   static const std::string https_protocol = "https";
@@ -52,5 +67,22 @@ bool isPathSoundcloud(const std::string &path) {
   return false;
 }
 
+int64_t pathModificationTime(const std::string &path) {
+  struct stat file_stat;
+  if (stat(path.c_str(), &file_stat) != 0) {
+    return 0;
+  }
+  return file_stat.st_mtime;
+}
+
+std::string temporaryPath(const std::string &path) {
+  static std::atomic<unsigned long> temporary_count(0);
+  std::stringstream temporary_path;
+  temporary_path << path << "." << getpid() << "." << std::hex
+                 << std::hash<std::thread::id>()(std::this_thread::get_id()) << "." << std::dec
+                 << temporary_count++ << ".tmp";
+  return temporary_path.str();
+}
+
 }  // namespace decoder
 }  // namespace nativeformat
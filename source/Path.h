@@ -20,13 +20,19 @@
  */
 #pragma once
 
+#include <cstdint>
 #include <string>
 
 namespace nativeformat {
 namespace decoder {
 
 extern bool isPathMidi(const std::string &path);
+extern bool isPathMP4(const std::string &path);
 extern bool isPathSoundcloud(const std::string &path);
+// Seconds since the epoch, 0 when the path is not a local file
+extern int64_t pathModificationTime(const std::string &path);
+// A name next to path that no other thread or process is writing to
+extern std::string temporaryPath(const std::string &path);
 
 }  // namespace decoder
 }  // namespace nativeformat
@@ -0,0 +1,578 @@
+/*
+ * Copyright (c) 2017 Spotify AB.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include "ProbeImplementation.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <ogg/ogg.h>
+
+#include "FormatSniffer.h"
+#include "Path.h"
+#include "StreamInfoCache.h"
+
+namespace nativeformat {
+namespace decoder {
+
+namespace {
+
+// Covers the identification headers of every format, and the first MP3 frame after its tags
+static const size_t PROBE_HEADER_BYTES = 4096;
+// Grown until it holds a page with a granule, or the budget runs out
+static const long OGG_END_SCAN_BYTES = 8192;
+static const size_t ID3_HEADER_SIZE = 10;
+static const size_t FLAC_STREAMINFO_OFFSET = 8;
+static const size_t FLAC_STREAMINFO_LENGTH = 34;
+static const size_t OGG_FLAC_STREAMINFO_OFFSET = 17;
+static const double OPUS_SAMPLERATE = 48000.0;
+static const int ADTS_SAMPLERATES[] = {
+    96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350};
+
+/*
+ * Reads a data provider until its byte budget is spent, after which reads come back short.
+ * Seeking is free, only the bytes read count; what the provider fetches to serve them depends on
+ * its own block size and read ahead.
+ */
+class ProbeReader {
+ public:
+  ProbeReader(DataProvider &data_provider, size_t byte_budget)
+      : _data_provider(data_provider), _remaining(byte_budget) {}
+
+  std::vector<unsigned char> read(long offset, size_t bytes) {
+    std::vector<unsigned char> data(std::min(bytes, _remaining));
+    if (data.empty()) {
+      return data;
+    }
+    _data_provider.seek(offset, SEEK_SET);
+    size_t read_bytes = _data_provider.read(data.data(), sizeof(unsigned char), data.size());
+    _remaining -= read_bytes;
+    data.resize(read_bytes);
+    return data;
+  }
+
+  long size() {
+    return _data_provider.size();
+  }
+
+ private:
+  DataProvider &_data_provider;
+  size_t _remaining;
+};
+
+typedef struct MPEGFrameHeader {
+  double samplerate;
+  int channels;
+  int bitrate;
+  int samples_per_frame;
+  size_t length;
+  // Where a Xing or Info header would start, counted from the frame
+  size_t xing_offset;
+} MPEGFrameHeader;
+
+bool matches(const std::vector<unsigned char> &data, size_t offset, const char *magic) {
+  size_t magic_length = strlen(magic);
+  return offset + magic_length <= data.size() &&
+         memcmp(data.data() + offset, magic, magic_length) == 0;
+}
+
+uint32_t readLE32(const unsigned char *data) {
+  return data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+uint16_t readLE16(const unsigned char *data) {
+  return data[0] | (data[1] << 8);
+}
+
+uint32_t readBE32(const unsigned char *data) {
+  return (static_cast<uint32_t>(data[0]) << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+}
+
+void describeFormat(SniffedFormat format, ProbeResult &result) {
+  switch (format) {
+    case SniffedFormatWav:
+      result.mime_type = NF_DECODER_MIME_TYPE_WAV;
+      result.codec = "pcm";
+      break;
+    case SniffedFormatFLAC:
+      result.mime_type = NF_DECODER_MIME_TYPE_FLAC;
+      result.codec = "flac";
+      break;
+    case SniffedFormatOgg:
+      result.mime_type = NF_DECODER_MIME_TYPE_AUDIO_OGG;
+      break;
+    case SniffedFormatOggVorbis:
+      result.mime_type = NF_DECODER_MIME_TYPE_AUDIO_OGG;
+      result.codec = "vorbis";
+      break;
+    case SniffedFormatOggOpus:
+      result.mime_type = NF_DECODER_MIME_TYPE_AUDIO_OGG;
+      result.codec = "opus";
+      break;
+    case SniffedFormatOggSpeex:
+      result.mime_type = NF_DECODER_MIME_TYPE_SPEEX_OGG;
+      result.codec = "speex";
+      break;
+    case SniffedFormatOggFLAC:
+      result.mime_type = NF_DECODER_MIME_TYPE_AUDIO_OGG;
+      result.codec = "flac";
+      break;
+    case SniffedFormatMP3:
+      result.mime_type = NF_DECODER_MIME_TYPE_MP3;
+      result.codec = "mp3";
+      break;
+    case SniffedFormatAAC:
+      result.codec = "aac";
+      break;
+    case SniffedFormatDashMP4:
+      result.mime_type = NF_DECODER_MIME_TYPE_DASH_MP4;
+      break;
+    case SniffedFormatMIDI:
+      result.mime_type = NF_DECODER_MIME_TYPE_MIDI;
+      result.codec = "midi";
+      break;
+    case SniffedFormatMP4:
+    case SniffedFormatUnknown:
+      break;
+  }
+}
+
+// The codec the decoders cache this format's stream info under, empty when they don't
+std::string streamInfoCodec(SniffedFormat format) {
+  switch (format) {
+    case SniffedFormatWav:
+      return "wav";
+    case SniffedFormatFLAC:
+      return "flac";
+    case SniffedFormatOggVorbis:
+      return "vorbis";
+    case SniffedFormatOggOpus:
+      return "opus";
+    case SniffedFormatOggSpeex:
+      return "speex";
+    default:
+      return "";
+  }
+}
+
+void parseFLACStreamInfo(const unsigned char *stream_info, ProbeResult &result) {
+  result.samplerate = (stream_info[10] << 12) | (stream_info[11] << 4) | (stream_info[12] >> 4);
+  result.channels = ((stream_info[12] >> 1) & 0x07) + 1;
+  uint64_t total_samples =
+      (static_cast<uint64_t>(stream_info[13] & 0x0F) << 32) | readBE32(stream_info + 14);
+  // 0 means the encoder did not know the length
+  result.frames = total_samples > 0 ? static_cast<long>(total_samples) : UNKNOWN_FRAMES;
+}
+
+void probeWav(ProbeReader &reader, ProbeResult &result) {
+  long offset = 12;
+  int block_align = 0;
+  // Every chunk header spends budget, so a corrupt chain of chunks ends when it runs out
+  while (true) {
+    std::vector<unsigned char> chunk = reader.read(offset, 8);
+    if (chunk.size() < 8) {
+      return;
+    }
+    const uint32_t chunk_bytes = readLE32(chunk.data() + 4);
+    offset += 8;
+    if (matches(chunk, 0, "fmt ")) {
+      std::vector<unsigned char> fmt = reader.read(offset, 16);
+      if (fmt.size() < 16) {
+        return;
+      }
+      result.channels = readLE16(fmt.data() + 2);
+      result.samplerate = readLE32(fmt.data() + 4);
+      block_align = readLE16(fmt.data() + 12);
+    } else if (matches(chunk, 0, "data")) {
+      // Streamed WAVs can claim more data than was written
+      long data_bytes = chunk_bytes;
+      long size = reader.size();
+      if (size > 0) {
+        data_bytes = std::min(data_bytes, size - offset);
+      }
+      if (block_align > 0) {
+        result.frames = data_bytes / block_align;
+      }
+      return;
+    }
+    offset += chunk_bytes + (chunk_bytes & 1);
+  }
+}
+
+void probeFLAC(ProbeReader &reader, ProbeResult &result) {
+  const size_t header_bytes = FLAC_STREAMINFO_OFFSET + FLAC_STREAMINFO_LENGTH;
+  std::vector<unsigned char> header = reader.read(0, header_bytes);
+  // STREAMINFO is always the first metadata block
+  if (header.size() < header_bytes || (header[4] & 0x7F) != 0) {
+    return;
+  }
+  parseFLACStreamInfo(header.data() + FLAC_STREAMINFO_OFFSET, result);
+}
+
+long oggLastGranule(ProbeReader &reader, int serial) {
+  const long size = reader.size();
+  if (size <= 0) {
+    return -1;
+  }
+  for (long window = OGG_END_SCAN_BYTES;; window *= 2) {
+    const long begin = std::max(0L, size - window);
+    std::vector<unsigned char> data = reader.read(begin, size - begin);
+    ogg_sync_state sync;
+    ogg_sync_init(&sync);
+    char *buffer = ogg_sync_buffer(&sync, data.size());
+    memcpy(buffer, data.data(), data.size());
+    ogg_sync_wrote(&sync, data.size());
+    ogg_int64_t last_granule = -1;
+    ogg_page page;
+    long page_bytes = 0;
+    while ((page_bytes = ogg_sync_pageseek(&sync, &page)) != 0) {
+      if (page_bytes > 0 && ogg_page_serialno(&page) == serial &&
+          ogg_page_granulepos(&page) >= 0) {
+        last_granule = ogg_page_granulepos(&page);
+      }
+    }
+    ogg_sync_clear(&sync);
+    if (last_granule >= 0) {
+      return last_granule;
+    }
+    // Either the whole stream was scanned, or the budget ran out partway through the window
+    if (begin == 0 || static_cast<long>(data.size()) < size - begin) {
+      return -1;
+    }
+  }
+}
+
+void probeOgg(ProbeReader &reader,
+              const std::vector<unsigned char> &header,
+              SniffedFormat format,
+              ProbeResult &result) {
+  ogg_sync_state sync;
+  ogg_sync_init(&sync);
+  char *buffer = ogg_sync_buffer(&sync, header.size());
+  memcpy(buffer, header.data(), header.size());
+  ogg_sync_wrote(&sync, header.size());
+  ogg_page page;
+  if (ogg_sync_pageout(&sync, &page) != 1) {
+    ogg_sync_clear(&sync);
+    return;
+  }
+  // The first page holds the identification header and nothing else
+  const std::vector<unsigned char> packet(page.body, page.body + page.body_len);
+  const int serial = ogg_page_serialno(&page);
+  ogg_sync_clear(&sync);
+  long pre_skip = 0;
+  switch (format) {
+    case SniffedFormatOggVorbis:
+      if (packet.size() < 16) {
+        return;
+      }
+      result.channels = packet[11];
+      result.samplerate = readLE32(packet.data() + 12);
+      break;
+    case SniffedFormatOggOpus:
+      if (packet.size() < 12) {
+        return;
+      }
+      // Opus always decodes at 48kHz, the header's rate is only what the input was
+      result.channels = packet[9];
+      result.samplerate = OPUS_SAMPLERATE;
+      pre_skip = readLE16(packet.data() + 10);
+      break;
+    case SniffedFormatOggSpeex:
+      if (packet.size() < 52) {
+        return;
+      }
+      result.samplerate = readLE32(packet.data() + 36);
+      result.channels = readLE32(packet.data() + 48);
+      break;
+    case SniffedFormatOggFLAC:
+      if (packet.size() < OGG_FLAC_STREAMINFO_OFFSET + FLAC_STREAMINFO_LENGTH) {
+        return;
+      }
+      parseFLACStreamInfo(packet.data() + OGG_FLAC_STREAMINFO_OFFSET, result);
+      if (result.frames != UNKNOWN_FRAMES) {
+        return;
+      }
+      break;
+    default:
+      return;
+  }
+  long last_granule = oggLastGranule(reader, serial);
+  if (last_granule >= 0) {
+    result.frames = std::max(0L, last_granule - pre_skip);
+  }
+}
+
+bool parseMPEGFrameHeader(const unsigned char *data, MPEGFrameHeader &header) {
+  static const int BITRATES[2][3][15] = {
+      // MPEG-1 layers I, II and III
+      {{0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448},
+       {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384},
+       {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320}},
+      // MPEG-2 and 2.5 layers I, II and III
+      {{0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256},
+       {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160},
+       {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160}}};
+  static const int SAMPLERATES[3] = {44100, 48000, 32000};
+  if (data[0] != 0xFF || (data[1] & 0xE0) != 0xE0) {
+    return false;
+  }
+  const int version = (data[1] >> 3) & 0x03;
+  const int layer_bits = (data[1] >> 1) & 0x03;
+  const int bitrate_index = data[2] >> 4;
+  const int samplerate_index = (data[2] >> 2) & 0x03;
+  // Free format streams have no bitrate to size their frames by, so they are not probed
+  if (version == 1 || layer_bits == 0 || bitrate_index == 0 || bitrate_index == 0x0F ||
+      samplerate_index == 0x03) {
+    return false;
+  }
+  const bool mpeg1 = version == 3;
+  const int layer = 4 - layer_bits;
+  const bool mono = (data[3] >> 6) == 0x03;
+  const int padding = (data[2] >> 1) & 0x01;
+  header.bitrate = BITRATES[mpeg1 ? 0 : 1][layer - 1][bitrate_index] * 1000;
+  header.samplerate = SAMPLERATES[samplerate_index] >> (mpeg1 ? 0 : (version == 2 ? 1 : 2));
+  header.channels = mono ? 1 : 2;
+  if (layer == 1) {
+    header.samples_per_frame = 384;
+    header.length = (12 * header.bitrate / static_cast<int>(header.samplerate) + padding) * 4;
+  } else {
+    header.samples_per_frame = (layer == 3 && !mpeg1) ? 576 : 1152;
+    header.length = (header.samples_per_frame / 8) * header.bitrate /
+                        static_cast<int>(header.samplerate) +
+                    padding;
+  }
+  // The Xing header follows the side information
+  header.xing_offset = 4 + (mpeg1 ? (mono ? 17 : 32) : (mono ? 9 : 17));
+  return header.length > 4;
+}
+
+void probeMP3(ProbeReader &reader, const std::vector<unsigned char> &header, ProbeResult &result) {
+  long offset = 0;
+  std::vector<unsigned char> data = header;
+  if (matches(header, 0, "ID3") && header.size() >= ID3_HEADER_SIZE) {
+    offset = ID3_HEADER_SIZE +
+             ((header[6] << 21) | (header[7] << 14) | (header[8] << 7) | header[9]);
+    if (header[5] & 0x10) {
+      offset += ID3_HEADER_SIZE;
+    }
+    data = reader.read(offset, PROBE_HEADER_BYTES);
+  }
+  // Take the first frame whose successor also parses, album art can look like a sync word
+  MPEGFrameHeader frame;
+  size_t frame_offset = 0;
+  while (true) {
+    if (frame_offset + 4 > data.size()) {
+      return;
+    }
+    if (parseMPEGFrameHeader(data.data() + frame_offset, frame)) {
+      MPEGFrameHeader next_frame;
+      const size_t next_offset = frame_offset + frame.length;
+      if (next_offset + 4 > data.size() ||
+          parseMPEGFrameHeader(data.data() + next_offset, next_frame)) {
+        break;
+      }
+    }
+    ++frame_offset;
+  }
+  result.samplerate = frame.samplerate;
+  result.channels = frame.channels;
+  const size_t xing_offset = frame_offset + frame.xing_offset;
+  if ((matches(data, xing_offset, "Xing") || matches(data, xing_offset, "Info")) &&
+      xing_offset + 12 <= data.size()) {
+    // The frame count is only there when the first flag is set
+    if (readBE32(data.data() + xing_offset + 4) & 0x01) {
+      result.frames =
+          static_cast<long>(readBE32(data.data() + xing_offset + 8)) * frame.samples_per_frame;
+      return;
+    }
+  }
+  const size_t vbri_offset = frame_offset + 36;
+  if (matches(data, vbri_offset, "VBRI") && vbri_offset + 18 <= data.size()) {
+    result.frames =
+        static_cast<long>(readBE32(data.data() + vbri_offset + 14)) * frame.samples_per_frame;
+    return;
+  }
+  // Without either header assume a constant bitrate
+  const long size = reader.size();
+  const long audio_offset = offset + frame_offset;
+  if (size > audio_offset) {
+    result.frames =
+        static_cast<long>((size - audio_offset) * 8.0 * frame.samplerate / frame.bitrate);
+  }
+}
+
+void probeAAC(const std::vector<unsigned char> &header, ProbeResult &result) {
+  // An ADTS frame header carries the rate and channel configuration, the length needs every frame
+  if (header.size() < 4) {
+    return;
+  }
+  const int samplerate_index = (header[2] >> 2) & 0x0F;
+  if (samplerate_index < static_cast<int>(sizeof(ADTS_SAMPLERATES) / sizeof(int))) {
+    result.samplerate = ADTS_SAMPLERATES[samplerate_index];
+  }
+  result.channels = ((header[2] & 0x01) << 2) | (header[3] >> 6);
+}
+
+}  // namespace
+
+ProbeImplementation::ProbeImplementation(
+    const std::shared_ptr<DataProviderFactory> &data_provider_factory,
+    size_t byte_budget,
+    const std::shared_ptr<Executor> &executor)
+    : _data_provider_factory(data_provider_factory),
+      _byte_budget(byte_budget),
+      _executor(executor),
+      _next_index(0) {}
+
+ProbeImplementation::~ProbeImplementation() {}
+
+void ProbeImplementation::probe(const std::vector<std::string> &paths,
+                                int concurrency,
+                                const PROBE_CALLBACK &probe_callback) {
+  {
+    std::lock_guard<std::mutex> probe_lock(_probe_mutex);
+    _paths = paths;
+    _probe_callback = probe_callback;
+    _next_index = 0;
+    _resolved.assign(paths.size(), false);
+  }
+  for (int i = 0; i < concurrency; ++i) {
+    probeNext();
+  }
+}
+
+ProbeResult ProbeImplementation::probeDataProvider(
+    const std::shared_ptr<DataProvider> &data_provider, size_t byte_budget) {
+  ProbeResult result;
+  result.samplerate = 0.0;
+  result.channels = 0;
+  result.frames = UNKNOWN_FRAMES;
+  if (!data_provider) {
+    return result;
+  }
+  result.path = data_provider->path();
+  ProbeReader reader(*data_provider, byte_budget);
+  const std::vector<unsigned char> header = reader.read(0, PROBE_HEADER_BYTES);
+  const SniffedFormat format = sniffFormat(header.data(), header.size());
+  describeFormat(format, result);
+
+  // Decoders that loaded the stream before already found all of it
+  const std::string codec = streamInfoCodec(format);
+  StreamInfo stream_info;
+  if (!codec.empty() && findStreamInfo(streamInfoKey(codec, *data_provider), stream_info)) {
+    result.samplerate = stream_info.samplerate;
+    result.channels = stream_info.channels;
+    result.frames = stream_info.frames;
+    return result;
+  }
+
+  switch (format) {
+    case SniffedFormatWav:
+      probeWav(reader, result);
+      break;
+    case SniffedFormatFLAC:
+      probeFLAC(reader, result);
+      break;
+    case SniffedFormatOggVorbis:
+    case SniffedFormatOggOpus:
+    case SniffedFormatOggSpeex:
+    case SniffedFormatOggFLAC:
+      probeOgg(reader, header, format, result);
+      break;
+    case SniffedFormatMP3:
+      probeMP3(reader, header, result);
+      break;
+    case SniffedFormatAAC:
+      probeAAC(header, result);
+      break;
+    default:
+      break;
+  }
+  return result;
+}
+
+void ProbeImplementation::probeNext() {
+  size_t index = 0;
+  std::string path;
+  {
+    std::lock_guard<std::mutex> probe_lock(_probe_mutex);
+    if (_next_index >= _paths.size()) {
+      return;
+    }
+    index = _next_index++;
+    path = _paths[index];
+  }
+  std::shared_ptr<ProbeImplementation> strong_this = shared_from_this();
+  // MIDI paths name a SoundFont alongside the file, there is no single stream to open
+  if (isPathMidi(path)) {
+    _executor->execute([strong_this, index, path]() {
+      ProbeResult result = probeDataProvider(nullptr, 0);
+      result.path = path;
+      describeFormat(SniffedFormatMIDI, result);
+      strong_this->finish(index, result);
+    });
+    return;
+  }
+  _data_provider_factory->createDataProvider(
+      path,
+      [strong_this, index](std::shared_ptr<DataProvider> data_provider) {
+        strong_this->dataProviderCreated(index, data_provider);
+      },
+      [strong_this, index](const std::string &domain, int error_code) {
+        strong_this->dataProviderCreated(index, nullptr);
+      });
+}
+
+void ProbeImplementation::dataProviderCreated(size_t index,
+                                              std::shared_ptr<DataProvider> data_provider) {
+  std::string path;
+  {
+    std::lock_guard<std::mutex> probe_lock(_probe_mutex);
+    if (index >= _resolved.size() || _resolved[index]) {
+      return;
+    }
+    _resolved[index] = true;
+    path = _paths[index];
+  }
+  std::shared_ptr<ProbeImplementation> strong_this = shared_from_this();
+  _executor->execute([strong_this, index, path, data_provider]() {
+    ProbeResult result = probeDataProvider(data_provider, strong_this->_byte_budget);
+    result.path = path;
+    strong_this->finish(index, result);
+  });
+}
+
+void ProbeImplementation::finish(size_t index, const ProbeResult &result) {
+  PROBE_CALLBACK probe_callback;
+  {
+    std::lock_guard<std::mutex> probe_lock(_probe_mutex);
+    probe_callback = _probe_callback;
+  }
+  if (probe_callback) {
+    probe_callback(index, result);
+  }
+  probeNext();
+}
+
+}  // namespace decoder
+}  // namespace nativeformat
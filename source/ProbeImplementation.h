@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2017 Spotify AB.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#pragma once
+
+#include <NFDecoder/DataProvider.h>
+#include <NFDecoder/DataProviderFactory.h>
+#include <NFDecoder/Executor.h>
+#include <NFDecoder/Factory.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace nativeformat {
+namespace decoder {
+
+/*
+ * Probes a batch of paths from their headers, keeping at most concurrency of them in flight. Each
+ * finished probe starts the next path, and every step runs as an executor task so a long run of
+ * paths that fail to open never nests on one stack.
+ */
+class ProbeImplementation : public std::enable_shared_from_this<ProbeImplementation> {
+ public:
+  ProbeImplementation(const std::shared_ptr<DataProviderFactory> &data_provider_factory,
+                      size_t byte_budget,
+                      const std::shared_ptr<Executor> &executor);
+  virtual ~ProbeImplementation();
+
+  void probe(const std::vector<std::string> &paths,
+             int concurrency,
+             const PROBE_CALLBACK &probe_callback);
+
+  // Reads at most byte_budget bytes of data_provider
+  static ProbeResult probeDataProvider(const std::shared_ptr<DataProvider> &data_provider,
+                                       size_t byte_budget);
+
+ private:
+  void probeNext();
+  void dataProviderCreated(size_t index, std::shared_ptr<DataProvider> data_provider);
+  void finish(size_t index, const ProbeResult &result);
+
+  const std::shared_ptr<DataProviderFactory> _data_provider_factory;
+  const size_t _byte_budget;
+  const std::shared_ptr<Executor> _executor;
+
+  std::mutex _probe_mutex;
+  std::vector<std::string> _paths;
+  PROBE_CALLBACK _probe_callback;
+  size_t _next_index;
+  // Not every failure to open is followed by a null provider, so each path settles once
+  std::vector<bool> _resolved;
+};
+
+}  // namespace decoder
+}  // namespace nativeformat
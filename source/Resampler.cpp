@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2017 Spotify AB.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include <NFDecoder/Resampler.h>
+
+#include "ResamplerLibresampleImplementation.h"
+#include "ResamplerSpeexImplementation.h"
+
+namespace nativeformat {
+namespace decoder {
+
+const ResamplerType RESAMPLER_DEFAULT_TYPE = ResamplerTypeLibresample;
+const ResamplerQuality RESAMPLER_DEFAULT_QUALITY = ResamplerQualityHigh;
+
+std::shared_ptr<Resampler> createResampler(int channels,
+                                           double input_samplerate,
+                                           double output_samplerate,
+                                           ResamplerType type,
+                                           ResamplerQuality quality) {
+  if (channels <= 0 || input_samplerate <= 0.0 || output_samplerate <= 0.0) {
+    return nullptr;
+  }
+  // The libraries fail quietly on rates they cannot handle, which would resample to nothing
+  switch (type) {
+    case ResamplerTypeLibresample: {
+      auto resampler = std::make_shared<ResamplerLibresampleImplementation>(
+          channels, input_samplerate, output_samplerate, quality);
+      return resampler->valid() ? resampler : nullptr;
+    }
+    case ResamplerTypeSpeex: {
+      auto resampler = std::make_shared<ResamplerSpeexImplementation>(
+          channels, input_samplerate, output_samplerate, quality);
+      return resampler->valid() ? resampler : nullptr;
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace decoder
+}  // namespace nativeformat
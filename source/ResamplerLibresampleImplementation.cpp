@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2017 Spotify AB.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include "ResamplerLibresampleImplementation.h"
+
+#include <algorithm>
+
+#include <libresample.h>
+
+#include "PCMKernels.h"
+
+namespace nativeformat {
+namespace decoder {
+
+ResamplerLibresampleImplementation::ResamplerLibresampleImplementation(
+    int channels, double input_samplerate, double output_samplerate, ResamplerQuality quality)
+    : _channels(channels),
+      _input_samplerate(input_samplerate),
+      _output_samplerate(output_samplerate),
+      _factor(output_samplerate / input_samplerate),
+      _high_quality(quality >= ResamplerQualityHigh),
+      _handles(channels, nullptr),
+      _input_channels(channels, nullptr),
+      _output_channels(channels, nullptr) {
+  open();
+}
+
+ResamplerLibresampleImplementation::~ResamplerLibresampleImplementation() {
+  close();
+}
+
+int ResamplerLibresampleImplementation::channels() {
+  return _channels;
+}
+
+double ResamplerLibresampleImplementation::inputSampleRate() {
+  return _input_samplerate;
+}
+
+double ResamplerLibresampleImplementation::outputSampleRate() {
+  return _output_samplerate;
+}
+
+long ResamplerLibresampleImplementation::process(
+    const float *input, long &input_frames, float *output, long output_frames, bool last) {
+  // A reset can fail to reopen the handles
+  if (!valid()) {
+    input_frames = 0;
+    return 0;
+  }
+  const size_t input_samples = input_frames * _channels;
+  const size_t output_samples = output_frames * _channels;
+  if (_planar_input.size() < input_samples) {
+    _planar_input.resize(input_samples);
+  }
+  if (_planar_output.size() < output_samples) {
+    _planar_output.resize(output_samples);
+  }
+  for (int i = 0; i < _channels; ++i) {
+    _input_channels[i] = _planar_input.data() + (i * input_frames);
+    _output_channels[i] = _planar_output.data() + (i * output_frames);
+  }
+  pcmDeinterleave(input, _input_channels.data(), input_frames, _channels);
+
+  // Every channel is fed the same number of frames, so they all consume and produce alike
+  int consumed_frames = 0;
+  long produced_frames = output_frames;
+  for (int i = 0; i < _channels; ++i) {
+    int channel_consumed_frames = 0;
+    const int channel_produced_frames = resample_process(_handles[i],
+                                                         _factor,
+                                                         _input_channels[i],
+                                                         input_frames,
+                                                         last,
+                                                         &channel_consumed_frames,
+                                                         _output_channels[i],
+                                                         output_frames);
+    consumed_frames = channel_consumed_frames;
+    produced_frames = std::min(produced_frames, std::max(0L, long(channel_produced_frames)));
+  }
+  pcmInterleave(_output_channels.data(), output, produced_frames, _channels);
+  input_frames = consumed_frames;
+  return produced_frames;
+}
+
+void ResamplerLibresampleImplementation::reset() {
+  // libresample cannot clear its history in place
+  close();
+  open();
+}
+
+bool ResamplerLibresampleImplementation::valid() const {
+  return std::find(_handles.begin(), _handles.end(), nullptr) == _handles.end();
+}
+
+bool ResamplerLibresampleImplementation::open() {
+  for (int i = 0; i < _channels; ++i) {
+    _handles[i] = resample_open(_high_quality, _factor, _factor);
+  }
+  return valid();
+}
+
+void ResamplerLibresampleImplementation::close() {
+  for (int i = 0; i < _channels; ++i) {
+    if (_handles[i] != nullptr) {
+      resample_close(_handles[i]);
+      _handles[i] = nullptr;
+    }
+  }
+}
+
+}  // namespace decoder
+}  // namespace nativeformat
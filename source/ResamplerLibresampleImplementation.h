@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2017 Spotify AB.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#pragma once
+
+#include <NFDecoder/Resampler.h>
+
+#include <vector>
+
+namespace nativeformat {
+namespace decoder {
+
+// libresample only handles one channel per handle, so this keeps a handle per channel
+class ResamplerLibresampleImplementation : public Resampler {
+ public:
+  ResamplerLibresampleImplementation(int channels,
+                                     double input_samplerate,
+                                     double output_samplerate,
+                                     ResamplerQuality quality);
+  virtual ~ResamplerLibresampleImplementation();
+
+  // Resampler
+  virtual int channels();
+  virtual double inputSampleRate();
+  virtual double outputSampleRate();
+  virtual long process(
+      const float *input, long &input_frames, float *output, long output_frames, bool last);
+  virtual void reset();
+
+  // False when the library could not set up a resampler for these rates and channels
+  bool valid() const;
+
+ private:
+  bool open();
+  void close();
+
+  const int _channels;
+  const double _input_samplerate;
+  const double _output_samplerate;
+  const double _factor;
+  const bool _high_quality;
+  std::vector<void *> _handles;
+  std::vector<float> _planar_input;
+  std::vector<float> _planar_output;
+  std::vector<float *> _input_channels;
+  std::vector<float *> _output_channels;
+};
+
+}  // namespace decoder
+}  // namespace nativeformat
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2017 Spotify AB.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include "ResamplerSpeexImplementation.h"
+
+#include <cmath>
+
+namespace nativeformat {
+namespace decoder {
+
+static const long SPEEX_RESAMPLER_NOT_DRAINING = -1;
+
+static int speexQuality(ResamplerQuality quality) {
+  switch (quality) {
+    case ResamplerQualityFastest:
+      return SPEEX_RESAMPLER_QUALITY_MIN;
+    case ResamplerQualityLow:
+      return SPEEX_RESAMPLER_QUALITY_VOIP;
+    case ResamplerQualityMedium:
+      return SPEEX_RESAMPLER_QUALITY_DESKTOP;
+    case ResamplerQualityHigh:
+      return 8;
+    case ResamplerQualityBest:
+      return SPEEX_RESAMPLER_QUALITY_MAX;
+  }
+  return SPEEX_RESAMPLER_QUALITY_DEFAULT;
+}
+
+ResamplerSpeexImplementation::ResamplerSpeexImplementation(int channels,
+                                                           double input_samplerate,
+                                                           double output_samplerate,
+                                                           ResamplerQuality quality)
+    : _channels(channels),
+      _input_samplerate(input_samplerate),
+      _output_samplerate(output_samplerate),
+      _resampler(nullptr),
+      _drain_frames(SPEEX_RESAMPLER_NOT_DRAINING) {
+  int error = RESAMPLER_ERR_SUCCESS;
+  _resampler = speex_resampler_init(channels,
+                                    std::lround(input_samplerate),
+                                    std::lround(output_samplerate),
+                                    speexQuality(quality),
+                                    &error);
+  if (_resampler != nullptr) {
+    speex_resampler_skip_zeros(_resampler);
+  }
+}
+
+ResamplerSpeexImplementation::~ResamplerSpeexImplementation() {
+  if (_resampler != nullptr) {
+    speex_resampler_destroy(_resampler);
+  }
+}
+
+int ResamplerSpeexImplementation::channels() {
+  return _channels;
+}
+
+double ResamplerSpeexImplementation::inputSampleRate() {
+  return _input_samplerate;
+}
+
+double ResamplerSpeexImplementation::outputSampleRate() {
+  return _output_samplerate;
+}
+
+long ResamplerSpeexImplementation::process(
+    const float *input, long &input_frames, float *output, long output_frames, bool last) {
+  if (_resampler == nullptr) {
+    input_frames = 0;
+    return 0;
+  }
+  const long requested_frames = input_frames;
+  spx_uint32_t input_length = input_frames;
+  spx_uint32_t output_length = output_frames;
+  speex_resampler_process_interleaved_float(
+      _resampler, input, &input_length, output, &output_length);
+  input_frames = input_length;
+  long produced_frames = output_length;
+  if (!last || input_frames < requested_frames) {
+    return produced_frames;
+  }
+
+  // Speex has no flush, the tail of the filter is pushed out with silence (a null input)
+  if (_drain_frames == SPEEX_RESAMPLER_NOT_DRAINING) {
+    _drain_frames = speex_resampler_get_input_latency(_resampler);
+  }
+  if (_drain_frames > 0 && produced_frames < output_frames) {
+    spx_uint32_t drain_length = _drain_frames;
+    spx_uint32_t drain_output_length = output_frames - produced_frames;
+    speex_resampler_process_interleaved_float(_resampler,
+                                              nullptr,
+                                              &drain_length,
+                                              output + (produced_frames * _channels),
+                                              &drain_output_length);
+    _drain_frames -= drain_length;
+    produced_frames += drain_output_length;
+  }
+  return produced_frames;
+}
+
+bool ResamplerSpeexImplementation::valid() const {
+  return _resampler != nullptr;
+}
+
+void ResamplerSpeexImplementation::reset() {
+  if (_resampler != nullptr) {
+    speex_resampler_reset_mem(_resampler);
+    speex_resampler_skip_zeros(_resampler);
+  }
+  _drain_frames = SPEEX_RESAMPLER_NOT_DRAINING;
+}
+
+}  // namespace decoder
+}  // namespace nativeformat
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2017 Spotify AB.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#pragma once
+
+#include <NFDecoder/Resampler.h>
+
+#include <speex/speex_resampler.h>
+
+namespace nativeformat {
+namespace decoder {
+
+class ResamplerSpeexImplementation : public Resampler {
+ public:
+  ResamplerSpeexImplementation(int channels,
+                               double input_samplerate,
+                               double output_samplerate,
+                               ResamplerQuality quality);
+  virtual ~ResamplerSpeexImplementation();
+
+  // Resampler
+  virtual int channels();
+  virtual double inputSampleRate();
+  virtual double outputSampleRate();
+  virtual long process(
+      const float *input, long &input_frames, float *output, long output_frames, bool last);
+  virtual void reset();
+
+  // False when the library could not set up a resampler for these rates and channels
+  bool valid() const;
+
+ private:
+  const int _channels;
+  const double _input_samplerate;
+  const double _output_samplerate;
+  SpeexResamplerState *_resampler;
+  long _drain_frames;
+};
+
+}  // namespace decoder
+}  // namespace nativeformat
@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2017 Spotify AB.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include "SeekIndex.h"
+
+#include <NFDecoder/Factory.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <sstream>
+
+#include "Path.h"
+
+namespace nativeformat {
+namespace decoder {
+
+namespace {
+
+const char SEEK_INDEX_MAGIC[4] = {'N', 'F', 'S', 'I'};
+const uint32_t SEEK_INDEX_VERSION = 2;
+// A frame and a byte offset
+const uint64_t SEEK_INDEX_POINT_BYTES = 2 * sizeof(int64_t);
+
+std::mutex &seekIndexCacheMutex() {
+  static std::mutex cache_mutex;
+  return cache_mutex;
+}
+
+std::string &seekIndexCacheDirectoryStorage() {
+  static std::string cache_directory;
+  return cache_directory;
+}
+
+template <typename T>
+bool readValue(FILE *file, T &value) {
+  return fread(&value, sizeof(T), 1, file) == 1;
+}
+
+template <typename T>
+bool writeValue(FILE *file, const T &value) {
+  return fwrite(&value, sizeof(T), 1, file) == 1;
+}
+
+}  // namespace
+
+void setSeekIndexCacheDirectory(const std::string &directory) {
+  std::lock_guard<std::mutex> cache_lock(seekIndexCacheMutex());
+  seekIndexCacheDirectoryStorage() = directory;
+}
+
+std::string seekIndexCacheDirectory() {
+  std::lock_guard<std::mutex> cache_lock(seekIndexCacheMutex());
+  return seekIndexCacheDirectoryStorage();
+}
+
+std::string seekIndexSidecarPath(const std::string &path) {
+  const std::string directory = seekIndexCacheDirectory();
+  if (directory.empty() || path.empty()) {
+    return "";
+  }
+  std::stringstream sidecar_path;
+  sidecar_path << directory << "/" << std::hex << std::hash<std::string>()(path) << ".nfsi";
+  return sidecar_path.str();
+}
+
+SeekIndex::SeekIndex(long interval_frames)
+    : _interval_frames(std::max(1L, interval_frames)), _frames(0), _complete(false) {}
+
+SeekIndex::~SeekIndex() {}
+
+long SeekIndex::intervalFrames() const {
+  return _interval_frames;
+}
+
+size_t SeekIndex::size() const {
+  return _points.size();
+}
+
+bool SeekIndex::empty() const {
+  return _points.empty();
+}
+
+bool SeekIndex::complete() const {
+  return _complete;
+}
+
+long SeekIndex::frames() const {
+  return _frames;
+}
+
+const SeekIndex::Point &SeekIndex::lastPoint() const {
+  return _points.back();
+}
+
+const std::vector<SeekIndex::Point> &SeekIndex::points() const {
+  return _points;
+}
+
+void SeekIndex::add(long frame, long offset) {
+  if (!_points.empty() && frame < _points.back().frame + _interval_frames) {
+    return;
+  }
+  _points.push_back({frame, offset});
+}
+
+void SeekIndex::finish(long frames) {
+  _frames = frames;
+  _complete = !_points.empty();
+}
+
+bool SeekIndex::find(long frame, Point &point) const {
+  auto next_point = std::upper_bound(
+      _points.begin(), _points.end(), frame, [](long frame, const Point &point) {
+        return frame < point.frame;
+      });
+  if (next_point == _points.begin()) {
+    return false;
+  }
+  point = *(next_point - 1);
+  return true;
+}
+
+void SeekIndex::clear() {
+  _points.clear();
+  _frames = 0;
+  _complete = false;
+}
+
+void SeekIndex::assign(const std::vector<Point> &points, long frames) {
+  _points = points;
+  _frames = frames;
+  _complete = !_points.empty();
+}
+
+bool SeekIndex::loadSidecar(const std::string &path, long size, const std::string &revision) {
+  const std::string sidecar_path = seekIndexSidecarPath(path);
+  if (sidecar_path.empty() || size <= 0 || revision.empty()) {
+    return false;
+  }
+  FILE *file = fopen(sidecar_path.c_str(), "rb");
+  if (file == nullptr) {
+    return false;
+  }
+  char magic[sizeof(SEEK_INDEX_MAGIC)];
+  uint32_t version = 0;
+  uint32_t path_length = 0;
+  int64_t media_size = 0;
+  uint32_t revision_length = 0;
+  int64_t interval_frames = 0;
+  int64_t frames = 0;
+  uint64_t point_count = 0;
+  bool valid = fread(magic, sizeof(magic), 1, file) == 1 &&
+               memcmp(magic, SEEK_INDEX_MAGIC, sizeof(magic)) == 0 &&
+               readValue(file, version) && version == SEEK_INDEX_VERSION &&
+               readValue(file, path_length) && path_length == path.size();
+  std::string media_path(path_length, '\0');
+  valid = valid && fread(&media_path[0], 1, path_length, file) == path_length &&
+          media_path == path && readValue(file, media_size) && media_size == size &&
+          readValue(file, revision_length) && revision_length == revision.size();
+  std::string media_revision(revision_length, '\0');
+  valid = valid && fread(&media_revision[0], 1, revision_length, file) == revision_length &&
+          media_revision == revision && readValue(file, interval_frames) &&
+          interval_frames == _interval_frames && readValue(file, frames) &&
+          readValue(file, point_count);
+  // A corrupt count must not size the allocation, the points that follow bound it
+  const long points_start = valid ? ftell(file) : -1;
+  valid = valid && points_start >= 0 && fseek(file, 0, SEEK_END) == 0;
+  const long file_size = valid ? ftell(file) : -1;
+  valid = valid && file_size >= points_start &&
+          point_count == static_cast<uint64_t>(file_size - points_start) / SEEK_INDEX_POINT_BYTES &&
+          fseek(file, points_start, SEEK_SET) == 0;
+  std::vector<Point> points;
+  if (valid) {
+    points.reserve(point_count);
+    for (uint64_t i = 0; i < point_count && valid; ++i) {
+      int64_t frame = 0;
+      int64_t offset = 0;
+      valid = readValue(file, frame) && readValue(file, offset) && offset >= 0 &&
+              offset < size && (points.empty() || frame > points.back().frame);
+      points.push_back({static_cast<long>(frame), static_cast<long>(offset)});
+    }
+  }
+  fclose(file);
+  if (!valid || points.empty()) {
+    return false;
+  }
+  _points.swap(points);
+  _frames = frames;
+  _complete = true;
+  return true;
+}
+
+bool SeekIndex::saveSidecar(const std::string &path,
+                            long size,
+                            const std::string &revision) const {
+  const std::string sidecar_path = seekIndexSidecarPath(path);
+  if (sidecar_path.empty() || size <= 0 || revision.empty() || !_complete) {
+    return false;
+  }
+  // Write next to the sidecar and move it into place, so readers never see half an index
+  const std::string temporary_path = temporaryPath(sidecar_path);
+  FILE *file = fopen(temporary_path.c_str(), "wb");
+  if (file == nullptr) {
+    return false;
+  }
+  const uint32_t path_length = path.size();
+  const uint32_t revision_length = revision.size();
+  bool written = fwrite(SEEK_INDEX_MAGIC, sizeof(SEEK_INDEX_MAGIC), 1, file) == 1 &&
+                 writeValue(file, SEEK_INDEX_VERSION) && writeValue(file, path_length) &&
+                 fwrite(path.data(), 1, path_length, file) == path_length &&
+                 writeValue(file, static_cast<int64_t>(size)) &&
+                 writeValue(file, revision_length) &&
+                 fwrite(revision.data(), 1, revision_length, file) == revision_length &&
+                 writeValue(file, static_cast<int64_t>(_interval_frames)) &&
+                 writeValue(file, static_cast<int64_t>(_frames)) &&
+                 writeValue(file, static_cast<uint64_t>(_points.size()));
+  for (const auto &point : _points) {
+    if (!written) {
+      break;
+    }
+    written = writeValue(file, static_cast<int64_t>(point.frame)) &&
+              writeValue(file, static_cast<int64_t>(point.offset));
+  }
+  written = fclose(file) == 0 && written;
+  if (!written || rename(temporary_path.c_str(), sidecar_path.c_str()) != 0) {
+    remove(temporary_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+}  // namespace decoder
+}  // namespace nativeformat
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2017 Spotify AB.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace nativeformat {
+namespace decoder {
+
+/*
+ * A sorted table of points where a decoder can restart: the first frame of a block of audio and
+ * the byte offset that block starts at. Points are added while decoding forward and are kept at
+ * least an interval apart, so an hour of audio indexed every half second is under 120KB. Lookups
+ * are a binary search, after which a decoder needs one provider seek and a short decode forward.
+ * Not thread safe.
+ */
+class SeekIndex {
+ public:
+  typedef struct Point {
+    long frame;
+    long offset;
+  } Point;
+
+  SeekIndex(long interval_frames);
+  virtual ~SeekIndex();
+
+  long intervalFrames() const;
+  size_t size() const;
+  bool empty() const;
+  // The index covers the stream from its first point up to frames
+  bool complete() const;
+  long frames() const;
+  const Point &lastPoint() const;
+  const std::vector<Point> &points() const;
+
+  // Points at or before the last point, or closer to it than the interval, are ignored
+  void add(long frame, long offset);
+  void finish(long frames);
+  // The last point at or before frame
+  bool find(long frame, Point &point) const;
+  void clear();
+  // Replaces the index with points known to cover the stream up to frames
+  void assign(const std::vector<Point> &points, long frames);
+
+  /**
+   * Sidecar files in the cache directory keep an index across runs. They are keyed by path and
+   * only trusted when the size and provider revision recorded with them still match the media and
+   * they were indexed at this index's interval. Media without a revision
+   * (DataProvider::revision() is empty) is never cached.
+   */
+  bool loadSidecar(const std::string &path, long size, const std::string &revision);
+  bool saveSidecar(const std::string &path, long size, const std::string &revision) const;
+
+ private:
+  long _interval_frames;
+  std::vector<Point> _points;
+  long _frames;
+  bool _complete;
+};
+
+extern std::string seekIndexSidecarPath(const std::string &path);
+
+}  // namespace decoder
+}  // namespace nativeformat
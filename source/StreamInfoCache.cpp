@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2017 Spotify AB.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include "StreamInfoCache.h"
+
+#include <NFDecoder/Factory.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <utility>
+
+#include "Path.h"
+
+namespace nativeformat {
+namespace decoder {
+
+namespace {
+
+const char STREAM_INFO_MAGIC[4] = {'N', 'F', 'S', 'C'};
+const uint32_t STREAM_INFO_VERSION = 1;
+// Header bytes are read straight into memory, so a corrupt length must not size the buffer
+const uint32_t STREAM_INFO_MAX_CODEC_PRIVATE_BYTES = 1 << 20;
+
+typedef std::list<std::pair<std::string, StreamInfo>> StreamInfoList;
+
+// Most recently used first
+typedef struct StreamInfoCache {
+  size_t entries = STREAM_INFO_CACHE_DEFAULT_ENTRIES;
+  std::string directory;
+  StreamInfoList stream_infos;
+  std::unordered_map<std::string, StreamInfoList::iterator> keys;
+} StreamInfoCache;
+
+std::mutex &streamInfoCacheMutex() {
+  static std::mutex cache_mutex;
+  return cache_mutex;
+}
+
+StreamInfoCache &streamInfoCache() {
+  static StreamInfoCache cache;
+  return cache;
+}
+
+// Requires the cache mutex to be held
+void insertStreamInfo(StreamInfoCache &cache, const std::string &key, const StreamInfo &info) {
+  auto existing = cache.keys.find(key);
+  if (existing != cache.keys.end()) {
+    cache.stream_infos.erase(existing->second);
+    cache.keys.erase(existing);
+  }
+  if (cache.entries == 0) {
+    return;
+  }
+  cache.stream_infos.emplace_front(key, info);
+  cache.keys[key] = cache.stream_infos.begin();
+  while (cache.stream_infos.size() > cache.entries) {
+    cache.keys.erase(cache.stream_infos.back().first);
+    cache.stream_infos.pop_back();
+  }
+}
+
+std::string sidecarPath(const std::string &directory, const std::string &key) {
+  std::stringstream sidecar_path;
+  sidecar_path << directory << "/" << std::hex << std::hash<std::string>()(key) << ".nfsc";
+  return sidecar_path.str();
+}
+
+template <typename T>
+bool readValue(FILE *file, T &value) {
+  return fread(&value, sizeof(T), 1, file) == 1;
+}
+
+template <typename T>
+bool writeValue(FILE *file, const T &value) {
+  return fwrite(&value, sizeof(T), 1, file) == 1;
+}
+
+bool loadSidecar(const std::string &directory, const std::string &key, StreamInfo &info) {
+  FILE *file = fopen(sidecarPath(directory, key).c_str(), "rb");
+  if (file == nullptr) {
+    return false;
+  }
+  // Read into a local so a corrupt file never leaves part of an entry behind
+  StreamInfo loaded;
+  char magic[sizeof(STREAM_INFO_MAGIC)];
+  uint32_t version = 0;
+  uint32_t key_length = 0;
+  int32_t channels = 0;
+  int64_t frames = 0;
+  int64_t data_offset = 0;
+  int64_t data_bytes = 0;
+  uint32_t codec_private_length = 0;
+  int64_t seek_interval_frames = 0;
+  uint64_t point_count = 0;
+  bool valid = fread(magic, sizeof(magic), 1, file) == 1 &&
+               memcmp(magic, STREAM_INFO_MAGIC, sizeof(magic)) == 0 &&
+               readValue(file, version) && version == STREAM_INFO_VERSION &&
+               readValue(file, key_length) && key_length == key.size();
+  // Different keys can hash to the same file, so the key is stored too
+  std::string stored_key(key_length, '\0');
+  valid = valid && fread(&stored_key[0], 1, key_length, file) == key_length && stored_key == key &&
+          readValue(file, loaded.samplerate) && readValue(file, channels) &&
+          readValue(file, frames) && readValue(file, data_offset) &&
+          readValue(file, data_bytes) && readValue(file, codec_private_length) &&
+          codec_private_length <= data_offset &&
+          codec_private_length <= STREAM_INFO_MAX_CODEC_PRIVATE_BYTES;
+  if (valid) {
+    loaded.codec_private.resize(codec_private_length);
+    valid = fread(loaded.codec_private.data(), 1, codec_private_length, file) ==
+                codec_private_length &&
+            readValue(file, seek_interval_frames) && readValue(file, point_count);
+  }
+  for (uint64_t i = 0; i < point_count && valid; ++i) {
+    int64_t frame = 0;
+    int64_t offset = 0;
+    valid = readValue(file, frame) && readValue(file, offset) &&
+            (loaded.seek_points.empty() || frame > loaded.seek_points.back().frame);
+    if (valid) {
+      loaded.seek_points.push_back({static_cast<long>(frame), static_cast<long>(offset)});
+    }
+  }
+  fclose(file);
+  if (!valid) {
+    return false;
+  }
+  loaded.channels = channels;
+  loaded.frames = frames;
+  loaded.data_offset = data_offset;
+  loaded.data_bytes = data_bytes;
+  loaded.seek_interval_frames = seek_interval_frames;
+  info = std::move(loaded);
+  return true;
+}
+
+bool saveSidecar(const std::string &directory, const std::string &key, const StreamInfo &info) {
+  // Write next to the sidecar and move it into place, so readers never see half an entry
+  const std::string sidecar_path = sidecarPath(directory, key);
+  const std::string temporary_path = temporaryPath(sidecar_path);
+  FILE *file = fopen(temporary_path.c_str(), "wb");
+  if (file == nullptr) {
+    return false;
+  }
+  const uint32_t key_length = key.size();
+  const uint32_t codec_private_length = info.codec_private.size();
+  bool written =
+      fwrite(STREAM_INFO_MAGIC, sizeof(STREAM_INFO_MAGIC), 1, file) == 1 &&
+      writeValue(file, STREAM_INFO_VERSION) && writeValue(file, key_length) &&
+      fwrite(key.data(), 1, key_length, file) == key_length &&
+      writeValue(file, info.samplerate) && writeValue(file, static_cast<int32_t>(info.channels)) &&
+      writeValue(file, static_cast<int64_t>(info.frames)) &&
+      writeValue(file, static_cast<int64_t>(info.data_offset)) &&
+      writeValue(file, static_cast<int64_t>(info.data_bytes)) &&
+      writeValue(file, codec_private_length) &&
+      fwrite(info.codec_private.data(), 1, codec_private_length, file) == codec_private_length &&
+      writeValue(file, static_cast<int64_t>(info.seek_interval_frames)) &&
+      writeValue(file, static_cast<uint64_t>(info.seek_points.size()));
+  for (const auto &point : info.seek_points) {
+    if (!written) {
+      break;
+    }
+    written = writeValue(file, static_cast<int64_t>(point.frame)) &&
+              writeValue(file, static_cast<int64_t>(point.offset));
+  }
+  written = fclose(file) == 0 && written;
+  if (!written || rename(temporary_path.c_str(), sidecar_path.c_str()) != 0) {
+    remove(temporary_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+void setStreamInfoCacheEntries(size_t entries) {
+  std::lock_guard<std::mutex> cache_lock(streamInfoCacheMutex());
+  StreamInfoCache &cache = streamInfoCache();
+  cache.entries = entries;
+  while (cache.stream_infos.size() > cache.entries) {
+    cache.keys.erase(cache.stream_infos.back().first);
+    cache.stream_infos.pop_back();
+  }
+}
+
+size_t streamInfoCacheEntries() {
+  std::lock_guard<std::mutex> cache_lock(streamInfoCacheMutex());
+  return streamInfoCache().entries;
+}
+
+void setStreamInfoCacheDirectory(const std::string &directory) {
+  std::lock_guard<std::mutex> cache_lock(streamInfoCacheMutex());
+  streamInfoCache().directory = directory;
+}
+
+std::string streamInfoCacheDirectory() {
+  std::lock_guard<std::mutex> cache_lock(streamInfoCacheMutex());
+  return streamInfoCache().directory;
+}
+
+std::string streamInfoKey(const std::string &codec, DataProvider &data_provider) {
+  const long size = data_provider.size();
+  if (size <= 0) {
+    return "";
+  }
+  std::stringstream key;
+  key << codec << "\n" << data_provider.path() << "\n" << size << "\n" << data_provider.revision();
+  return key.str();
+}
+
+bool findStreamInfo(const std::string &key, StreamInfo &stream_info) {
+  if (key.empty()) {
+    return false;
+  }
+  std::string directory;
+  {
+    std::lock_guard<std::mutex> cache_lock(streamInfoCacheMutex());
+    StreamInfoCache &cache = streamInfoCache();
+    if (cache.entries == 0) {
+      return false;
+    }
+    auto entry = cache.keys.find(key);
+    if (entry != cache.keys.end()) {
+      cache.stream_infos.splice(cache.stream_infos.begin(), cache.stream_infos, entry->second);
+      stream_info = entry->second->second;
+      return true;
+    }
+    directory = cache.directory;
+  }
+  // Read outside the lock, a slow disk should not hold up hits for other streams
+  if (directory.empty() || !loadSidecar(directory, key, stream_info)) {
+    return false;
+  }
+  std::lock_guard<std::mutex> cache_lock(streamInfoCacheMutex());
+  insertStreamInfo(streamInfoCache(), key, stream_info);
+  return true;
+}
+
+void storeStreamInfo(const std::string &key, const StreamInfo &stream_info) {
+  if (key.empty()) {
+    return;
+  }
+  std::string directory;
+  {
+    std::lock_guard<std::mutex> cache_lock(streamInfoCacheMutex());
+    StreamInfoCache &cache = streamInfoCache();
+    if (cache.entries == 0) {
+      return;
+    }
+    insertStreamInfo(cache, key, stream_info);
+    directory = cache.directory;
+  }
+  if (!directory.empty()) {
+    saveSidecar(directory, key, stream_info);
+  }
+}
+
+}  // namespace decoder
+}  // namespace nativeformat
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2017 Spotify AB.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <NFDecoder/DataProvider.h>
+
+#include "SeekIndex.h"
+
+namespace nativeformat {
+namespace decoder {
+
+/*
+ * What a decoder learned from parsing a stream's headers and scanning to its end, enough for it
+ * to load the same stream again without doing either.
+ */
+typedef struct StreamInfo {
+  double samplerate = 0.0;
+  int channels = 0;
+  long frames = 0;
+  long data_offset = 0;
+  long data_bytes = 0;
+  // Format specific header bytes, such as a WAV fmt chunk or FLAC metadata blocks
+  std::vector<unsigned char> codec_private;
+  // A complete SeekIndex, empty when the stream was never indexed to its end
+  long seek_interval_frames = 0;
+  std::vector<SeekIndex::Point> seek_points;
+} StreamInfo;
+
+/**
+ * Entries are keyed by codec, path, size and the provider's revision, so a changed file or
+ * entity misses rather than loading stale headers. Streams of unknown size get an empty key,
+ * which is never cached.
+ */
+extern std::string streamInfoKey(const std::string &codec, DataProvider &data_provider);
+extern bool findStreamInfo(const std::string &key, StreamInfo &stream_info);
+extern void storeStreamInfo(const std::string &key, const StreamInfo &stream_info);
+
+}  // namespace decoder
+}  // namespace nativeformat
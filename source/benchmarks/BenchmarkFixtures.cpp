@@ -0,0 +1,449 @@
+/*
+ * Copyright (c) 2017 Spotify AB.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include "BenchmarkFixtures.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <FLAC/all.h>
+#include <ogg/ogg.h>
+#include <opus.h>
+#include <speex/speex.h>
+#include <speex/speex_header.h>
+#include <vorbis/codec.h>
+#include <vorbis/vorbisenc.h>
+
+namespace nativeformat {
+namespace decoder {
+
+const double BENCHMARK_FIXTURE_SECONDS = 10.0;
+
+static const std::string BENCHMARK_FIXTURE_VENDOR = "NFDecoderBenchmarks";
+static const int BENCHMARK_FIXTURE_OGG_SERIAL = 0x4e464442;
+static const double BENCHMARK_FIXTURE_OPUS_SAMPLERATE = 48000.0;
+static const int BENCHMARK_FIXTURE_OPUS_FRAME_SIZE = 960;
+static const int BENCHMARK_FIXTURE_MAX_PACKET_SIZE = 4000;
+
+static bool fileExists(const std::string &path) {
+  struct stat file_stat;
+  return stat(path.c_str(), &file_stat) == 0 && file_stat.st_size > 0;
+}
+
+static void appendLittleEndian(std::vector<unsigned char> &bytes, uint32_t value, int byte_count) {
+  for (int i = 0; i < byte_count; ++i) {
+    bytes.push_back(static_cast<unsigned char>((value >> (i * 8)) & 0xFF));
+  }
+}
+
+static void appendString(std::vector<unsigned char> &bytes, const std::string &string) {
+  bytes.insert(bytes.end(), string.begin(), string.end());
+}
+
+// A few tones, a slow sweep and some noise, so the codecs have real work to do
+static std::vector<float> createSignal(double samplerate, int channels, long frames) {
+  std::vector<float> signal(frames * channels);
+  uint32_t noise_state = 0x12345678;
+  double sweep_phase = 0.0;
+  for (long frame = 0; frame < frames; ++frame) {
+    const double time = frame / samplerate;
+    const double sweep_frequency = 1000.0 + 800.0 * std::sin(2.0 * M_PI * 0.25 * time);
+    sweep_phase += 2.0 * M_PI * sweep_frequency / samplerate;
+    for (int channel = 0; channel < channels; ++channel) {
+      noise_state = noise_state * 1664525u + 1013904223u;
+      const double noise = (static_cast<double>(noise_state >> 8) / 16777216.0) - 0.5;
+      const double sample = 0.3 * std::sin(2.0 * M_PI * 220.0 * time + channel * 0.5) +
+                            0.2 * std::sin(sweep_phase) + 0.05 * noise;
+      signal[frame * channels + channel] = static_cast<float>(sample);
+    }
+  }
+  return signal;
+}
+
+static int32_t quantise(float sample, int bits) {
+  const double scale = static_cast<double>((1u << (bits - 1)) - 1);
+  return static_cast<int32_t>(std::lrint(std::max(-1.0f, std::min(1.0f, sample)) * scale));
+}
+
+static bool writeBytes(const std::string &path, const std::vector<unsigned char> &bytes) {
+  FILE *file = fopen(path.c_str(), "wb");
+  if (!file) {
+    return false;
+  }
+  const bool written = fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+  return fclose(file) == 0 && written;
+}
+
+static void writeOggPacket(ogg_stream_state *stream,
+                           const unsigned char *data,
+                           long bytes,
+                           ogg_int64_t granulepos,
+                           ogg_int64_t packetno,
+                           bool eos) {
+  ogg_packet packet;
+  packet.packet = const_cast<unsigned char *>(data);
+  packet.bytes = bytes;
+  packet.b_o_s = packetno == 0;
+  packet.e_o_s = eos;
+  packet.granulepos = granulepos;
+  packet.packetno = packetno;
+  ogg_stream_packetin(stream, &packet);
+}
+
+static bool writeOggPages(ogg_stream_state *stream, FILE *file, bool flush) {
+  ogg_page page;
+  bool written = true;
+  while (flush ? ogg_stream_flush(stream, &page) : ogg_stream_pageout(stream, &page)) {
+    written &= fwrite(page.header, 1, page.header_len, file) == size_t(page.header_len);
+    written &= fwrite(page.body, 1, page.body_len, file) == size_t(page.body_len);
+  }
+  return written;
+}
+
+static bool writeWav(const std::string &path,
+                     const std::vector<float> &signal,
+                     double samplerate,
+                     int channels,
+                     int bits) {
+  const uint32_t sample_size = bits / 8;
+  const uint32_t data_size = signal.size() * sample_size;
+  std::vector<unsigned char> bytes;
+  bytes.reserve(44 + data_size);
+  appendString(bytes, "RIFF");
+  appendLittleEndian(bytes, 36 + data_size, 4);
+  appendString(bytes, "WAVE");
+  appendString(bytes, "fmt ");
+  appendLittleEndian(bytes, 16, 4);
+  appendLittleEndian(bytes, 1, 2);
+  appendLittleEndian(bytes, channels, 2);
+  appendLittleEndian(bytes, static_cast<uint32_t>(samplerate), 4);
+  appendLittleEndian(bytes, static_cast<uint32_t>(samplerate) * channels * sample_size, 4);
+  appendLittleEndian(bytes, channels * sample_size, 2);
+  appendLittleEndian(bytes, bits, 2);
+  appendString(bytes, "data");
+  appendLittleEndian(bytes, data_size, 4);
+  for (float sample : signal) {
+    appendLittleEndian(bytes, static_cast<uint32_t>(quantise(sample, bits)), sample_size);
+  }
+  return writeBytes(path, bytes);
+}
+
+static bool writeFlac(const std::string &path,
+                      const std::vector<float> &signal,
+                      double samplerate,
+                      int channels,
+                      int bits) {
+  FLAC__StreamEncoder *encoder = FLAC__stream_encoder_new();
+  if (!encoder) {
+    return false;
+  }
+  const long frames = signal.size() / channels;
+  bool success = FLAC__stream_encoder_set_channels(encoder, channels) &&
+                 FLAC__stream_encoder_set_bits_per_sample(encoder, bits) &&
+                 FLAC__stream_encoder_set_sample_rate(encoder, samplerate) &&
+                 FLAC__stream_encoder_set_compression_level(encoder, 5) &&
+                 FLAC__stream_encoder_set_total_samples_estimate(encoder, frames);
+  success = success && FLAC__stream_encoder_init_file(encoder, path.c_str(), nullptr, nullptr) ==
+                           FLAC__STREAM_ENCODER_INIT_STATUS_OK;
+  if (success) {
+    static const long block_frames = 4096;
+    std::vector<FLAC__int32> block(block_frames * channels);
+    for (long frame = 0; frame < frames && success; frame += block_frames) {
+      const long block_frame_count = std::min(block_frames, frames - frame);
+      for (long i = 0; i < block_frame_count * channels; ++i) {
+        block[i] = quantise(signal[frame * channels + i], bits);
+      }
+      success = FLAC__stream_encoder_process_interleaved(encoder, block.data(), block_frame_count);
+    }
+    success = FLAC__stream_encoder_finish(encoder) && success;
+  }
+  FLAC__stream_encoder_delete(encoder);
+  return success;
+}
+
+static bool writeVorbis(const std::string &path,
+                        const std::vector<float> &signal,
+                        double samplerate,
+                        int channels) {
+  vorbis_info info;
+  vorbis_info_init(&info);
+  if (vorbis_encode_init_vbr(&info, channels, samplerate, 0.4f) != 0) {
+    vorbis_info_clear(&info);
+    return false;
+  }
+  FILE *file = fopen(path.c_str(), "wb");
+  if (!file) {
+    vorbis_info_clear(&info);
+    return false;
+  }
+  vorbis_comment comment;
+  vorbis_comment_init(&comment);
+  vorbis_dsp_state dsp_state;
+  vorbis_analysis_init(&dsp_state, &info);
+  vorbis_block block;
+  vorbis_block_init(&dsp_state, &block);
+  ogg_stream_state stream;
+  ogg_stream_init(&stream, BENCHMARK_FIXTURE_OGG_SERIAL);
+
+  ogg_packet header;
+  ogg_packet header_comment;
+  ogg_packet header_code;
+  vorbis_analysis_headerout(&dsp_state, &comment, &header, &header_comment, &header_code);
+  ogg_stream_packetin(&stream, &header);
+  ogg_stream_packetin(&stream, &header_comment);
+  ogg_stream_packetin(&stream, &header_code);
+  bool success = writeOggPages(&stream, file, true);
+
+  static const long analysis_frames = 1024;
+  const long frames = signal.size() / channels;
+  for (long frame = 0; success; frame += analysis_frames) {
+    const long analysis_frame_count = std::max(0L, std::min(analysis_frames, frames - frame));
+    if (analysis_frame_count > 0) {
+      float **buffer = vorbis_analysis_buffer(&dsp_state, analysis_frame_count);
+      for (long i = 0; i < analysis_frame_count; ++i) {
+        for (int channel = 0; channel < channels; ++channel) {
+          buffer[channel][i] = signal[(frame + i) * channels + channel];
+        }
+      }
+    }
+    // A zero frame count marks the end of the stream
+    vorbis_analysis_wrote(&dsp_state, analysis_frame_count);
+    while (vorbis_analysis_blockout(&dsp_state, &block) == 1) {
+      vorbis_analysis(&block, nullptr);
+      vorbis_bitrate_addblock(&block);
+      ogg_packet packet;
+      while (vorbis_bitrate_flushpacket(&dsp_state, &packet)) {
+        ogg_stream_packetin(&stream, &packet);
+        success &= writeOggPages(&stream, file, false);
+      }
+    }
+    if (analysis_frame_count == 0) {
+      break;
+    }
+  }
+  success &= writeOggPages(&stream, file, true);
+
+  ogg_stream_clear(&stream);
+  vorbis_block_clear(&block);
+  vorbis_dsp_clear(&dsp_state);
+  vorbis_comment_clear(&comment);
+  vorbis_info_clear(&info);
+  return fclose(file) == 0 && success;
+}
+
+static bool writeOpus(const std::string &path, const std::vector<float> &signal, int channels) {
+  int error = OPUS_OK;
+  OpusEncoder *encoder = opus_encoder_create(
+      BENCHMARK_FIXTURE_OPUS_SAMPLERATE, channels, OPUS_APPLICATION_AUDIO, &error);
+  if (error != OPUS_OK || !encoder) {
+    return false;
+  }
+  FILE *file = fopen(path.c_str(), "wb");
+  if (!file) {
+    opus_encoder_destroy(encoder);
+    return false;
+  }
+  opus_encoder_ctl(encoder, OPUS_SET_BITRATE(128000));
+  opus_int32 pre_skip = 0;
+  opus_encoder_ctl(encoder, OPUS_GET_LOOKAHEAD(&pre_skip));
+  ogg_stream_state stream;
+  ogg_stream_init(&stream, BENCHMARK_FIXTURE_OGG_SERIAL);
+
+  std::vector<unsigned char> head;
+  appendString(head, "OpusHead");
+  head.push_back(1);
+  head.push_back(static_cast<unsigned char>(channels));
+  appendLittleEndian(head, pre_skip, 2);
+  appendLittleEndian(head, static_cast<uint32_t>(BENCHMARK_FIXTURE_OPUS_SAMPLERATE), 4);
+  appendLittleEndian(head, 0, 2);
+  head.push_back(0);
+  writeOggPacket(&stream, head.data(), head.size(), 0, 0, false);
+  bool success = writeOggPages(&stream, file, true);
+
+  std::vector<unsigned char> tags;
+  appendString(tags, "OpusTags");
+  appendLittleEndian(tags, BENCHMARK_FIXTURE_VENDOR.size(), 4);
+  appendString(tags, BENCHMARK_FIXTURE_VENDOR);
+  appendLittleEndian(tags, 0, 4);
+  writeOggPacket(&stream, tags.data(), tags.size(), 0, 1, false);
+  success &= writeOggPages(&stream, file, true);
+
+  // Granule positions include the pre-skip, the final one trims the padding of the last packet
+  const long frames = signal.size() / channels;
+  const long total_frames = frames + pre_skip;
+  std::vector<float> pcm(BENCHMARK_FIXTURE_OPUS_FRAME_SIZE * channels);
+  unsigned char packet[BENCHMARK_FIXTURE_MAX_PACKET_SIZE];
+  long encoded_frames = 0;
+  for (ogg_int64_t packetno = 2; encoded_frames < total_frames && success; ++packetno) {
+    for (int i = 0; i < BENCHMARK_FIXTURE_OPUS_FRAME_SIZE; ++i) {
+      const long frame = encoded_frames + i;
+      for (int channel = 0; channel < channels; ++channel) {
+        pcm[i * channels + channel] = frame < frames ? signal[frame * channels + channel] : 0.0f;
+      }
+    }
+    const opus_int32 bytes = opus_encode_float(
+        encoder, pcm.data(), BENCHMARK_FIXTURE_OPUS_FRAME_SIZE, packet, sizeof(packet));
+    if (bytes < 0) {
+      success = false;
+      break;
+    }
+    encoded_frames += BENCHMARK_FIXTURE_OPUS_FRAME_SIZE;
+    const bool eos = encoded_frames >= total_frames;
+    writeOggPacket(
+        &stream, packet, bytes, eos ? total_frames : encoded_frames, packetno, eos);
+    success &= writeOggPages(&stream, file, false);
+  }
+  success &= writeOggPages(&stream, file, true);
+
+  ogg_stream_clear(&stream);
+  opus_encoder_destroy(encoder);
+  return fclose(file) == 0 && success;
+}
+
+static bool writeSpeex(const std::string &path,
+                       const std::vector<float> &signal,
+                       double samplerate,
+                       int channels) {
+  if (channels != 1) {
+    return false;
+  }
+  const SpeexMode *mode = &speex_wb_mode;
+  void *encoder = speex_encoder_init(mode);
+  if (!encoder) {
+    return false;
+  }
+  FILE *file = fopen(path.c_str(), "wb");
+  if (!file) {
+    speex_encoder_destroy(encoder);
+    return false;
+  }
+  int quality = 8;
+  speex_encoder_ctl(encoder, SPEEX_SET_QUALITY, &quality);
+  int frame_size = 0;
+  speex_encoder_ctl(encoder, SPEEX_GET_FRAME_SIZE, &frame_size);
+  ogg_stream_state stream;
+  ogg_stream_init(&stream, BENCHMARK_FIXTURE_OGG_SERIAL);
+
+  SpeexHeader header;
+  speex_init_header(&header, samplerate, channels, mode);
+  header.frames_per_packet = 1;
+  header.vbr = 0;
+  int header_size = 0;
+  char *header_packet = speex_header_to_packet(&header, &header_size);
+  writeOggPacket(
+      &stream, reinterpret_cast<unsigned char *>(header_packet), header_size, 0, 0, false);
+  speex_header_free(header_packet);
+  bool success = writeOggPages(&stream, file, true);
+
+  std::vector<unsigned char> comments;
+  appendLittleEndian(comments, BENCHMARK_FIXTURE_VENDOR.size(), 4);
+  appendString(comments, BENCHMARK_FIXTURE_VENDOR);
+  appendLittleEndian(comments, 0, 4);
+  writeOggPacket(&stream, comments.data(), comments.size(), 0, 1, false);
+  success &= writeOggPages(&stream, file, true);
+
+  SpeexBits bits;
+  speex_bits_init(&bits);
+  const long frames = signal.size();
+  std::vector<spx_int16_t> pcm(frame_size);
+  char packet[BENCHMARK_FIXTURE_MAX_PACKET_SIZE];
+  long encoded_frames = 0;
+  for (ogg_int64_t packetno = 2; encoded_frames < frames && success; ++packetno) {
+    for (int i = 0; i < frame_size; ++i) {
+      const long frame = encoded_frames + i;
+      pcm[i] = frame < frames ? quantise(signal[frame], 16) : 0;
+    }
+    speex_bits_reset(&bits);
+    speex_encode_int(encoder, pcm.data(), &bits);
+    const int bytes = speex_bits_write(&bits, packet, sizeof(packet));
+    encoded_frames += frame_size;
+    const bool eos = encoded_frames >= frames;
+    writeOggPacket(&stream,
+                   reinterpret_cast<unsigned char *>(packet),
+                   bytes,
+                   eos ? frames : encoded_frames,
+                   packetno,
+                   eos);
+    success &= writeOggPages(&stream, file, false);
+  }
+  success &= writeOggPages(&stream, file, true);
+
+  speex_bits_destroy(&bits);
+  ogg_stream_clear(&stream);
+  speex_encoder_destroy(encoder);
+  return fclose(file) == 0 && success;
+}
+
+std::vector<BenchmarkFixture> createBenchmarkFixtures(const std::string &directory) {
+  mkdir(directory.c_str(), 0755);
+  const std::vector<BenchmarkFixture> candidates = {
+      {"wav16", directory + "/benchmark_16.wav", 44100.0, 2, 0},
+      {"wav24", directory + "/benchmark_24.wav", 96000.0, 2, 0},
+      {"flac16", directory + "/benchmark_16.flac", 44100.0, 2, 0},
+      {"flac24", directory + "/benchmark_24.flac", 96000.0, 2, 0},
+      {"vorbis", directory + "/benchmark.ogg", 44100.0, 2, 0},
+      {"opus", directory + "/benchmark.opus", BENCHMARK_FIXTURE_OPUS_SAMPLERATE, 2, 0},
+      {"speex", directory + "/benchmark.spx", 16000.0, 1, 0},
+      {"mp3", directory + "/benchmark.mp3", 44100.0, 2, 0},
+      {"aac", directory + "/benchmark.m4a", 44100.0, 2, 0}};
+  std::vector<BenchmarkFixture> fixtures;
+  for (BenchmarkFixture fixture : candidates) {
+    fixture.frames = static_cast<long>(BENCHMARK_FIXTURE_SECONDS * fixture.samplerate);
+    if (!fileExists(fixture.path)) {
+      const std::vector<float> signal =
+          createSignal(fixture.samplerate, fixture.channels, fixture.frames);
+      bool written = false;
+      if (fixture.codec == "wav16") {
+        written = writeWav(fixture.path, signal, fixture.samplerate, fixture.channels, 16);
+      } else if (fixture.codec == "wav24") {
+        written = writeWav(fixture.path, signal, fixture.samplerate, fixture.channels, 24);
+      } else if (fixture.codec == "flac16") {
+        written = writeFlac(fixture.path, signal, fixture.samplerate, fixture.channels, 16);
+      } else if (fixture.codec == "flac24") {
+        written = writeFlac(fixture.path, signal, fixture.samplerate, fixture.channels, 24);
+      } else if (fixture.codec == "vorbis") {
+        written = writeVorbis(fixture.path, signal, fixture.samplerate, fixture.channels);
+      } else if (fixture.codec == "opus") {
+        written = writeOpus(fixture.path, signal, fixture.channels);
+      } else if (fixture.codec == "speex") {
+        written = writeSpeex(fixture.path, signal, fixture.samplerate, fixture.channels);
+      } else {
+        // No encoder is vendored for these, they are only benchmarked when provided
+        continue;
+      }
+      if (!written) {
+        std::cerr << "Failed to create benchmark fixture: " << fixture.path << std::endl;
+        remove(fixture.path.c_str());
+        continue;
+      }
+    }
+    fixtures.push_back(fixture);
+  }
+  return fixtures;
+}
+
+}  // namespace decoder
+}  // namespace nativeformat
@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2017 Spotify AB.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace nativeformat {
+namespace decoder {
+
+typedef struct BenchmarkFixture {
+  std::string codec;
+  std::string path;
+  double samplerate;
+  int channels;
+  long frames;
+} BenchmarkFixture;
+
+extern const double BENCHMARK_FIXTURE_SECONDS;
+
+/**
+ * Encodes the benchmark signal with each of the vendored encoders into directory. Fixtures that
+ * already exist are reused, so repeated runs only pay for encoding once. MP3 and AAC have no
+ * vendored encoder, 44.1kHz stereo benchmark.mp3 and benchmark.m4a are used if already there.
+ */
+extern std::vector<BenchmarkFixture> createBenchmarkFixtures(const std::string &directory);
+
+}  // namespace decoder
+}  // namespace nativeformat
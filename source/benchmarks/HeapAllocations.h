@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2017 Spotify AB.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#pragma once
+
+namespace nativeformat {
+namespace decoder {
+
+/**
+ * Every heap allocation the benchmark process has made so far, on any thread. On glibc malloc and
+ * its aligned variants are interposed, so allocations inside libavcodec and the other codec
+ * libraries are seen too; elsewhere only operator new is counted.
+ */
+extern long heapAllocationCount();
+
+}  // namespace decoder
+}  // namespace nativeformat
@@ -0,0 +1,545 @@
+/*
+ * Copyright (c) 2017 Spotify AB.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include <benchmark/benchmark.h>
+
+#include <NFDecoder/Factory.h>
+#include <NFDecoder/Resampler.h>
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "AllocationCounters.h"
+#include "BenchmarkFixtures.h"
+#include "ChannelMixer.h"
+#include "DataProviderFactoryImplementation.h"
+#include "HeapAllocations.h"
+#include "PCMBuffer.h"
+#include "PCMKernels.h"
+
+namespace nativeformat {
+namespace decoder {
+
+static const std::vector<long> BENCHMARK_BLOCK_SIZES = {256, 1024, 4096, 16384};
+static const long BENCHMARK_SEEK_DECODE_FRAMES = 1024;
+static const size_t BENCHMARK_KERNEL_SAMPLES = 8192;
+static const size_t BENCHMARK_PCM_BUFFER_BLOCK = 1024;
+static const long BENCHMARK_RESAMPLER_BLOCK_FRAMES = 1024;
+// Decoded before timing starts, so buffers, codec tables and caches have settled
+static const double BENCHMARK_WARM_UP_SECONDS = 1.0;
+
+typedef struct CreateDecoderState {
+  std::mutex mutex;
+  std::condition_variable condition;
+  bool finished = false;
+  std::shared_ptr<Decoder> decoder;
+  std::string error;
+} CreateDecoderState;
+
+static std::shared_ptr<Factory> benchmarkFactory() {
+  static std::shared_ptr<Factory> factory = createFactory();
+  return factory;
+}
+
+static std::shared_ptr<Decoder> createDecoder(const BenchmarkFixture &fixture,
+                                              double samplerate,
+                                              int channels,
+                                              std::string &error) {
+  std::shared_ptr<CreateDecoderState> state = std::make_shared<CreateDecoderState>();
+  benchmarkFactory()->createDecoder(
+      fixture.path,
+      "",
+      [state](std::shared_ptr<Decoder> decoder) {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (!state->finished) {
+          state->decoder = decoder;
+          state->finished = true;
+          state->condition.notify_all();
+        }
+      },
+      [state](const std::string &domain, int error_code) {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (!state->finished) {
+          state->error = domain + " " + std::to_string(error_code);
+          state->finished = true;
+          state->condition.notify_all();
+        }
+      },
+      samplerate,
+      channels);
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->condition.wait(lock, [state] { return state->finished; });
+  if (!state->decoder && state->error.empty()) {
+    state->error = "Could not create a decoder for " + fixture.path;
+  }
+  error = state->error;
+  return state->decoder;
+}
+
+static long decodeFrames(Decoder &decoder, std::vector<float> &samples, long frames) {
+  long frames_decoded = 0;
+  decoder.decodeInto(samples.data(),
+                     frames,
+                     [&frames_decoded](long frame_index, long frame_count) {
+                       frames_decoded = frame_count;
+                     },
+                     true);
+  return frames_decoded;
+}
+
+// Decodes block_size frames per iteration, wrapping around at the end of the stream
+static void benchmarkDecode(benchmark::State &state,
+                            const BenchmarkFixture &fixture,
+                            long block_size,
+                            double samplerate,
+                            int channels,
+                            bool prefetch) {
+  std::string error;
+  std::shared_ptr<Decoder> decoder = createDecoder(fixture, samplerate, channels, error);
+  if (!decoder) {
+    state.SkipWithError(error.c_str());
+    return;
+  }
+  if (prefetch) {
+    decoder = createPrefetchDecoder(decoder);
+  }
+  std::vector<float> samples(block_size * decoder->channels());
+  // PCM buffers should not grow at all after warming up, and a steady state decode should make
+  // no heap allocations anywhere in the process, codec libraries included
+  const long warm_up_frames = BENCHMARK_WARM_UP_SECONDS * decoder->sampleRate();
+  for (long warm_up_decoded = 0; warm_up_decoded < warm_up_frames;) {
+    const long frame_count = decodeFrames(*decoder, samples, block_size);
+    if (frame_count <= 0) {
+      break;
+    }
+    warm_up_decoded += frame_count;
+  }
+  decoder->seek(0);
+  decodeFrames(*decoder, samples, block_size);
+  const long allocations = totalAllocationCount();
+  const long heap_allocations = heapAllocationCount();
+  long rewind_heap_allocations = 0;
+  long frames_decoded = 0;
+  bool rewound = false;
+  for (auto _ : state) {
+    const long frame_count = decodeFrames(*decoder, samples, block_size);
+    if (frame_count > 0) {
+      frames_decoded += frame_count;
+      rewound = false;
+      continue;
+    }
+    if (rewound) {
+      state.SkipWithError("Decoder produced no frames after seeking to the start");
+      break;
+    }
+    state.PauseTiming();
+    const long rewind_start = heapAllocationCount();
+    decoder->seek(0);
+    rewind_heap_allocations += heapAllocationCount() - rewind_start;
+    rewound = true;
+    state.ResumeTiming();
+  }
+  const long steady_heap_allocations =
+      heapAllocationCount() - heap_allocations - rewind_heap_allocations;
+  state.SetItemsProcessed(frames_decoded);
+  state.counters["x_realtime"] =
+      benchmark::Counter(frames_decoded / decoder->sampleRate(), benchmark::Counter::kIsRate);
+  state.counters["pcm_buffer_allocations"] = totalAllocationCount() - allocations;
+  state.counters["heap_allocations_per_second"] =
+      frames_decoded > 0 ? steady_heap_allocations * decoder->sampleRate() / frames_decoded : 0.0;
+}
+
+static void benchmarkLoad(benchmark::State &state, const BenchmarkFixture &fixture) {
+  const long opens = DataProviderFactoryImplementation::openCount();
+  for (auto _ : state) {
+    std::string error;
+    std::shared_ptr<Decoder> decoder =
+        createDecoder(fixture, fixture.samplerate, fixture.channels, error);
+    state.PauseTiming();
+    if (!decoder) {
+      state.SkipWithError(error.c_str());
+      break;
+    }
+    decoder.reset();
+    state.ResumeTiming();
+  }
+  // A decoder should open its source once however many factories try it
+  state.counters["provider_opens"] = benchmark::Counter(
+      DataProviderFactoryImplementation::openCount() - opens, benchmark::Counter::kAvgIterations);
+}
+
+// Seeks to a pseudo random frame and decodes a short block, as a scrubbing user would
+static void benchmarkSeek(benchmark::State &state, const BenchmarkFixture &fixture) {
+  std::string error;
+  std::shared_ptr<Decoder> decoder =
+      createDecoder(fixture, fixture.samplerate, fixture.channels, error);
+  if (!decoder) {
+    state.SkipWithError(error.c_str());
+    return;
+  }
+  std::vector<float> samples(BENCHMARK_SEEK_DECODE_FRAMES * decoder->channels());
+  const long frames = decoder->frames() == UNKNOWN_FRAMES ? fixture.frames : decoder->frames();
+  const long seekable_frames = std::max(1L, frames - BENCHMARK_SEEK_DECODE_FRAMES);
+  uint32_t random_state = 0x9e3779b9;
+  for (auto _ : state) {
+    random_state = random_state * 1664525u + 1013904223u;
+    decoder->seek(random_state % seekable_frames);
+    benchmark::DoNotOptimize(decodeFrames(*decoder, samples, BENCHMARK_SEEK_DECODE_FRAMES));
+  }
+}
+
+static void benchmarkConvert(benchmark::State &state,
+                             PCMKernelsInstructionSet instruction_set,
+                             void (*convert)(const void *, float *, size_t, float),
+                             size_t sample_size) {
+  if (instruction_set > pcmKernelsSupportedInstructionSet()) {
+    state.SkipWithError("Instruction set not supported by this CPU");
+    return;
+  }
+  setPCMKernelsInstructionSet(instruction_set);
+  std::vector<unsigned char> in(BENCHMARK_KERNEL_SAMPLES * sample_size, 0x5a);
+  std::vector<float> out(BENCHMARK_KERNEL_SAMPLES);
+  for (auto _ : state) {
+    convert(in.data(), out.data(), BENCHMARK_KERNEL_SAMPLES, 1.0f / 32767.0f);
+    benchmark::ClobberMemory();
+  }
+  setPCMKernelsInstructionSet(pcmKernelsSupportedInstructionSet());
+  state.SetItemsProcessed(state.iterations() * BENCHMARK_KERNEL_SAMPLES);
+  state.SetBytesProcessed(state.iterations() * BENCHMARK_KERNEL_SAMPLES * sample_size);
+}
+
+static void benchmarkInterleave(benchmark::State &state,
+                                PCMKernelsInstructionSet instruction_set,
+                                bool deinterleave) {
+  if (instruction_set > pcmKernelsSupportedInstructionSet()) {
+    state.SkipWithError("Instruction set not supported by this CPU");
+    return;
+  }
+  setPCMKernelsInstructionSet(instruction_set);
+  static const int channels = 2;
+  const size_t frames = BENCHMARK_KERNEL_SAMPLES / channels;
+  std::vector<float> interleaved(BENCHMARK_KERNEL_SAMPLES, 0.5f);
+  std::vector<float> left(frames, 0.25f);
+  std::vector<float> right(frames, -0.25f);
+  float *planar[channels] = {left.data(), right.data()};
+  for (auto _ : state) {
+    if (deinterleave) {
+      pcmDeinterleave(interleaved.data(), planar, frames, channels);
+    } else {
+      pcmInterleave(planar, interleaved.data(), frames, channels);
+    }
+    benchmark::ClobberMemory();
+  }
+  setPCMKernelsInstructionSet(pcmKernelsSupportedInstructionSet());
+  state.SetItemsProcessed(state.iterations() * BENCHMARK_KERNEL_SAMPLES);
+}
+
+static void benchmarkGain(benchmark::State &state, PCMKernelsInstructionSet instruction_set) {
+  if (instruction_set > pcmKernelsSupportedInstructionSet()) {
+    state.SkipWithError("Instruction set not supported by this CPU");
+    return;
+  }
+  setPCMKernelsInstructionSet(instruction_set);
+  std::vector<float> samples(BENCHMARK_KERNEL_SAMPLES, 0.5f);
+  for (auto _ : state) {
+    pcmGain(samples.data(), samples.size(), 0.999f);
+    benchmark::ClobberMemory();
+  }
+  setPCMKernelsInstructionSet(pcmKernelsSupportedInstructionSet());
+  state.SetItemsProcessed(state.iterations() * BENCHMARK_KERNEL_SAMPLES);
+}
+
+static void benchmarkChannelMixer(benchmark::State &state,
+                                  PCMKernelsInstructionSet instruction_set,
+                                  int input_channels,
+                                  int output_channels) {
+  if (instruction_set > pcmKernelsSupportedInstructionSet()) {
+    state.SkipWithError("Instruction set not supported by this CPU");
+    return;
+  }
+  setPCMKernelsInstructionSet(instruction_set);
+  const size_t frames = BENCHMARK_KERNEL_SAMPLES / input_channels;
+  ChannelMixer mixer(input_channels, output_channels);
+  std::vector<float> input(frames * input_channels, 0.5f);
+  std::vector<float> output(frames * output_channels);
+  for (auto _ : state) {
+    mixer.process(input.data(), output.data(), frames);
+    benchmark::ClobberMemory();
+  }
+  setPCMKernelsInstructionSet(pcmKernelsSupportedInstructionSet());
+  state.SetItemsProcessed(state.iterations() * frames);
+}
+
+// Pushes and pops a block through a FIFO already holding state.range(0) samples
+static void benchmarkPCMBuffer(benchmark::State &state) {
+  PCMBuffer buffer;
+  buffer.writeSilence(state.range(0));
+  std::vector<float> block(BENCHMARK_PCM_BUFFER_BLOCK, 0.5f);
+  for (auto _ : state) {
+    buffer.write(block.data(), block.size());
+    buffer.read(block.data(), block.size());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * BENCHMARK_PCM_BUFFER_BLOCK);
+}
+
+// The staging pattern PCMBuffer replaced, kept as a baseline
+static void benchmarkVectorEraseFront(benchmark::State &state) {
+  std::vector<float> buffer(state.range(0), 0.0f);
+  std::vector<float> block(BENCHMARK_PCM_BUFFER_BLOCK, 0.5f);
+  for (auto _ : state) {
+    buffer.insert(buffer.end(), block.begin(), block.end());
+    std::copy(buffer.begin(), buffer.begin() + block.size(), block.begin());
+    buffer.erase(buffer.begin(), buffer.begin() + block.size());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * BENCHMARK_PCM_BUFFER_BLOCK);
+}
+
+// Resamples one second of stereo per iteration
+static void benchmarkResampler(benchmark::State &state,
+                               ResamplerType type,
+                               ResamplerQuality quality,
+                               double input_samplerate,
+                               double output_samplerate) {
+  static const int channels = 2;
+  std::shared_ptr<Resampler> resampler =
+      createResampler(channels, input_samplerate, output_samplerate, type, quality);
+  if (!resampler) {
+    state.SkipWithError("Could not create the resampler");
+    return;
+  }
+  const long input_frames = static_cast<long>(input_samplerate);
+  std::vector<float> input(input_frames * channels);
+  for (long i = 0; i < input_frames; ++i) {
+    const float sample = std::sin(2.0 * M_PI * 440.0 * i / input_samplerate) * 0.5f;
+    input[i * channels] = sample;
+    input[i * channels + 1] = -sample;
+  }
+  const long output_block_frames =
+      static_cast<long>(BENCHMARK_RESAMPLER_BLOCK_FRAMES * output_samplerate / input_samplerate) +
+      64;
+  std::vector<float> output(output_block_frames * channels);
+  for (auto _ : state) {
+    long offset = 0;
+    while (offset < input_frames) {
+      long block_frames = std::min(BENCHMARK_RESAMPLER_BLOCK_FRAMES, input_frames - offset);
+      resampler->process(input.data() + (offset * channels),
+                         block_frames,
+                         output.data(),
+                         output_block_frames,
+                         false);
+      offset += std::max(1L, block_frames);
+    }
+    benchmark::ClobberMemory();
+  }
+  state.counters["cpu_seconds_per_audio_second"] = benchmark::Counter(
+      state.iterations(), benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+}
+
+static std::string resamplerTypeName(ResamplerType type) {
+  switch (type) {
+    case ResamplerTypeLibresample:
+      return "libresample";
+    case ResamplerTypeSpeex:
+      return "speex";
+  }
+  return "unknown";
+}
+
+static std::string resamplerQualityName(ResamplerQuality quality) {
+  switch (quality) {
+    case ResamplerQualityFastest:
+      return "fastest";
+    case ResamplerQualityLow:
+      return "low";
+    case ResamplerQualityMedium:
+      return "medium";
+    case ResamplerQualityHigh:
+      return "high";
+    case ResamplerQualityBest:
+      return "best";
+  }
+  return "unknown";
+}
+
+static std::string instructionSetName(PCMKernelsInstructionSet instruction_set) {
+  switch (instruction_set) {
+    case PCMKernelsInstructionSetScalar:
+      return "scalar";
+    case PCMKernelsInstructionSetSSE2:
+      return "sse2";
+    case PCMKernelsInstructionSetAVX2:
+      return "avx2";
+  }
+  return "unknown";
+}
+
+static void registerCodecBenchmarks(const std::vector<BenchmarkFixture> &fixtures) {
+  for (const BenchmarkFixture &fixture : fixtures) {
+    // Normalisation only wraps a decoder when its output differs from what was asked for
+    const double normalised_samplerate = fixture.samplerate == 48000.0 ? 44100.0 : 48000.0;
+    for (long block_size : BENCHMARK_BLOCK_SIZES) {
+      const std::string suffix = fixture.codec + "/" + std::to_string(block_size);
+      benchmark::RegisterBenchmark(("decode/" + suffix).c_str(),
+                                   [fixture, block_size](benchmark::State &state) {
+                                     benchmarkDecode(state,
+                                                     fixture,
+                                                     block_size,
+                                                     fixture.samplerate,
+                                                     fixture.channels,
+                                                     false);
+                                   })
+          ->UseRealTime();
+      benchmark::RegisterBenchmark(("prefetch/" + suffix).c_str(),
+                                   [fixture, block_size](benchmark::State &state) {
+                                     benchmarkDecode(state,
+                                                     fixture,
+                                                     block_size,
+                                                     fixture.samplerate,
+                                                     fixture.channels,
+                                                     true);
+                                   })
+          ->UseRealTime();
+      benchmark::RegisterBenchmark(
+          ("normalise/" + suffix).c_str(),
+          [fixture, block_size, normalised_samplerate](benchmark::State &state) {
+            benchmarkDecode(
+                state, fixture, block_size, normalised_samplerate, STANDARD_CHANNELS, false);
+          })
+          ->UseRealTime();
+    }
+    benchmark::RegisterBenchmark(
+        ("load/" + fixture.codec).c_str(),
+        [fixture](benchmark::State &state) { benchmarkLoad(state, fixture); })
+        ->UseRealTime()
+        ->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark(
+        ("seek/" + fixture.codec).c_str(),
+        [fixture](benchmark::State &state) { benchmarkSeek(state, fixture); })
+        ->UseRealTime()
+        ->Unit(benchmark::kMicrosecond);
+  }
+}
+
+static void registerResamplerBenchmarks() {
+  const ResamplerType types[] = {ResamplerTypeLibresample, ResamplerTypeSpeex};
+  const ResamplerQuality qualities[] = {ResamplerQualityFastest,
+                                        ResamplerQualityLow,
+                                        ResamplerQualityMedium,
+                                        ResamplerQualityHigh,
+                                        ResamplerQualityBest};
+  const double conversions[][2] = {{44100.0, 48000.0}, {48000.0, 44100.0}};
+  for (ResamplerType type : types) {
+    for (ResamplerQuality quality : qualities) {
+      for (const auto &conversion : conversions) {
+        const std::string name = "resampler/" + resamplerTypeName(type) + "/" +
+                                 resamplerQualityName(quality) + "/" +
+                                 std::to_string(static_cast<int>(conversion[0])) + "_to_" +
+                                 std::to_string(static_cast<int>(conversion[1]));
+        benchmark::RegisterBenchmark(
+            name.c_str(), benchmarkResampler, type, quality, conversion[0], conversion[1])
+            ->Unit(benchmark::kMillisecond);
+      }
+    }
+  }
+}
+
+static void registerKernelBenchmarks() {
+  const PCMKernelsInstructionSet instruction_sets[] = {
+      PCMKernelsInstructionSetScalar, PCMKernelsInstructionSetSSE2, PCMKernelsInstructionSetAVX2};
+  for (PCMKernelsInstructionSet instruction_set : instruction_sets) {
+    const std::string suffix = "/" + instructionSetName(instruction_set);
+    benchmark::RegisterBenchmark(("pcm_kernels/uint8_to_float" + suffix).c_str(),
+                                 benchmarkConvert,
+                                 instruction_set,
+                                 pcmConvertUInt8ToFloat,
+                                 1);
+    benchmark::RegisterBenchmark(("pcm_kernels/int16_to_float" + suffix).c_str(),
+                                 benchmarkConvert,
+                                 instruction_set,
+                                 pcmConvertInt16ToFloat,
+                                 2);
+    benchmark::RegisterBenchmark(("pcm_kernels/int24_to_float" + suffix).c_str(),
+                                 benchmarkConvert,
+                                 instruction_set,
+                                 pcmConvertInt24ToFloat,
+                                 3);
+    benchmark::RegisterBenchmark(("pcm_kernels/int32_to_float" + suffix).c_str(),
+                                 benchmarkConvert,
+                                 instruction_set,
+                                 pcmConvertInt32ToFloat,
+                                 4);
+    benchmark::RegisterBenchmark(("pcm_kernels/interleave" + suffix).c_str(),
+                                 benchmarkInterleave,
+                                 instruction_set,
+                                 false);
+    benchmark::RegisterBenchmark(("pcm_kernels/deinterleave" + suffix).c_str(),
+                                 benchmarkInterleave,
+                                 instruction_set,
+                                 true);
+    benchmark::RegisterBenchmark(("pcm_kernels/gain" + suffix).c_str(),
+                                 benchmarkGain,
+                                 instruction_set);
+    benchmark::RegisterBenchmark(("channel_mixer/6_to_2" + suffix).c_str(),
+                                 benchmarkChannelMixer,
+                                 instruction_set,
+                                 6,
+                                 2);
+    benchmark::RegisterBenchmark(("channel_mixer/2_to_1" + suffix).c_str(),
+                                 benchmarkChannelMixer,
+                                 instruction_set,
+                                 2,
+                                 1);
+  }
+  benchmark::RegisterBenchmark("pcm_buffer/fifo", benchmarkPCMBuffer)->Range(1 << 10, 1 << 20);
+  benchmark::RegisterBenchmark("pcm_buffer/vector_erase_front", benchmarkVectorEraseFront)
+      ->Range(1 << 10, 1 << 20);
+}
+
+}  // namespace decoder
+}  // namespace nativeformat
+
+int main(int argc, char *argv[]) {
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  const char *fixture_directory = std::getenv("NFDECODER_BENCHMARK_FIXTURES");
+  const std::vector<nativeformat::decoder::BenchmarkFixture> fixtures =
+      nativeformat::decoder::createBenchmarkFixtures(fixture_directory ? fixture_directory
+                                                                       : "benchmark-fixtures");
+  benchmark::AddCustomContext("nfdecoder_version", nativeformat::decoder::version());
+  benchmark::AddCustomContext("pcm_kernels_instruction_set",
+                              nativeformat::decoder::instructionSetName(
+                                  nativeformat::decoder::pcmKernelsSupportedInstructionSet()));
+  nativeformat::decoder::registerCodecBenchmarks(fixtures);
+  nativeformat::decoder::registerResamplerBenchmarks();
+  nativeformat::decoder::registerKernelBenchmarks();
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}